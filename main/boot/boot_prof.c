@@ -0,0 +1,111 @@
+#include "boot_prof.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include <inttypes.h>
+#include <string.h>
+
+#define TAG "boot"
+
+static boot_prof_stage_t boot_stages[BOOT_PROF_STAGES];
+static int boot_stage_count;
+static int64_t boot_milestones[BOOT_MILESTONE_MAX];
+static portMUX_TYPE boot_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const boot_milestone_names[BOOT_MILESTONE_MAX] = {
+    [BOOT_MILESTONE_UART_RX] = "uart_rx",
+    [BOOT_MILESTONE_GOT_IP] = "got_ip",
+    [BOOT_MILESTONE_CLIENT] = "client",
+    [BOOT_MILESTONE_BRIDGED] = "bridged",
+};
+
+int boot_prof_begin(const char *name)
+{
+    /*
+     * 在临界区外取任务名与时间，临界区内只分配编号与复制。
+     * 编号按进入临界区的顺序，两个任务同时开始阶段时可能与开始时间的先后相反，输出以 start_us 为准。
+     */
+    int64_t now = esp_timer_get_time();
+    const char *task = pcTaskGetName(NULL);
+    int stage = -1;
+    taskENTER_CRITICAL(&boot_lock);
+    if (boot_stage_count < BOOT_PROF_STAGES)
+    {
+        stage = boot_stage_count++;
+        boot_prof_stage_t *s = &boot_stages[stage];
+        s->name = name;
+        strlcpy(s->task, task, sizeof(s->task));
+        s->start_us = now;
+        s->end_us = 0;
+    }
+    taskEXIT_CRITICAL(&boot_lock);
+    return stage;
+}
+
+void boot_prof_end(int stage)
+{
+    if (stage < 0 || stage >= BOOT_PROF_STAGES)
+        return;
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&boot_lock);
+    boot_stages[stage].end_us = now;
+    taskEXIT_CRITICAL(&boot_lock);
+}
+
+void boot_prof_milestone(boot_milestone_t m)
+{
+    /* 已记录时不进入临界区，转发路径上的开销只有一次读取 */
+    if (m >= BOOT_MILESTONE_MAX || boot_milestones[m] != 0)
+        return;
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&boot_lock);
+    if (boot_milestones[m] == 0)
+        boot_milestones[m] = now;
+    taskEXIT_CRITICAL(&boot_lock);
+}
+
+int64_t boot_prof_milestone_time(boot_milestone_t m)
+{
+    if (m >= BOOT_MILESTONE_MAX)
+        return 0;
+    taskENTER_CRITICAL(&boot_lock);
+    int64_t t = boot_milestones[m];
+    taskEXIT_CRITICAL(&boot_lock);
+    return t;
+}
+
+const char *boot_prof_milestone_name(boot_milestone_t m)
+{
+    return m < BOOT_MILESTONE_MAX ? boot_milestone_names[m] : NULL;
+}
+
+int boot_prof_get_stages(boot_prof_stage_t *stages, int max)
+{
+    taskENTER_CRITICAL(&boot_lock);
+    int n = boot_stage_count < max ? boot_stage_count : max;
+    memcpy(stages, boot_stages, n * sizeof(boot_prof_stage_t));
+    taskEXIT_CRITICAL(&boot_lock);
+    return n;
+}
+
+void boot_prof_log(void)
+{
+    /* 在栈较小的主任务中调用，不放在栈上 */
+    static boot_prof_stage_t stages[BOOT_PROF_STAGES];
+    int n = boot_prof_get_stages(stages, BOOT_PROF_STAGES);
+    for (int i = 0; i < n; i++)
+    {
+        const boot_prof_stage_t *s = &stages[i];
+        if (s->end_us)
+            ESP_LOGI(TAG, "%-10s %-12s %6" PRId32 " ms +%" PRId32 " ms", s->name, s->task,
+                     (int32_t)(s->start_us / 1000), (int32_t)((s->end_us - s->start_us) / 1000));
+        else
+            ESP_LOGI(TAG, "%-10s %-12s %6" PRId32 " ms running", s->name, s->task, (int32_t)(s->start_us / 1000));
+    }
+    for (int m = 0; m < BOOT_MILESTONE_MAX; m++)
+    {
+        int64_t t = boot_prof_milestone_time(m);
+        if (t)
+            ESP_LOGI(TAG, "%-10s %6" PRId32 " ms", boot_milestone_names[m], (int32_t)(t / 1000));
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOOT_PROF_STAGES 24
+
+/* 启动后只记录第一次发生的时间 */
+typedef enum
+{
+    BOOT_MILESTONE_UART_RX, // 第一个串口字节进入环形缓冲区
+    BOOT_MILESTONE_GOT_IP,  // 首次获得 IP
+    BOOT_MILESTONE_CLIENT,  // 第一个转发客户端连接
+    BOOT_MILESTONE_BRIDGED, // 第一个串口字节发给客户端
+    BOOT_MILESTONE_MAX,
+} boot_milestone_t;
+
+typedef struct
+{
+    const char *name;
+    char task[configMAX_TASK_NAME_LEN]; // 执行该阶段的任务，任务可能已删除，因此复制名称
+    int64_t start_us;
+    int64_t end_us; // 0 表示尚未结束
+} boot_prof_stage_t;
+
+/**
+ * @brief 记录一个初始化阶段的开始，时间从 esp_timer 启动算起，不含 ROM 与二级引导程序
+ *
+ * @param name 须为常量字符串
+ * @return int 阶段序号，交给 boot_prof_end，记录已满时返回 -1
+ */
+int boot_prof_begin(const char *name);
+
+void boot_prof_end(int stage);
+
+/**
+ * @brief 记录里程碑，只有第一次调用生效，可以在转发路径上直接调用
+ */
+void boot_prof_milestone(boot_milestone_t m);
+
+/**
+ * @brief 里程碑的时间，微秒，尚未到达时返回 0
+ */
+int64_t boot_prof_milestone_time(boot_milestone_t m);
+
+const char *boot_prof_milestone_name(boot_milestone_t m);
+
+/**
+ * @brief 复制已记录的阶段，按开始时间排列
+ */
+int boot_prof_get_stages(boot_prof_stage_t *stages, int max);
+
+/**
+ * @brief 以日志输出启动时间线
+ */
+void boot_prof_log(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,414 @@
+#include "bridge_deflate.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFLATE_HASH_BITS 9
+#define DEFLATE_HASH_SIZE (1 << DEFLATE_HASH_BITS)
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+
+struct bridge_deflate
+{
+    uint32_t window;   // 历史窗口大小，缓冲区为其两倍
+    uint32_t win_len;  // 缓冲区中的有效数据
+    uint32_t bitbuf;   // 尚未输出的位，低位先出
+    uint8_t bitcnt;
+    bool header_done;  // 已输出 zlib 头
+    bool block_open;   // 当前处于一个未结束的固定 Huffman 块中
+    uint32_t adler_a;
+    uint32_t adler_b;
+    uint32_t total_in;
+    uint32_t total_out;
+    uint16_t *hash;    // 3 字节哈希到缓冲区位置 + 1，0 表示空
+    uint8_t *buf;
+};
+
+static const uint16_t len_base[] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+                                    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t len_extra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[] = {1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+                                     33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+                                     1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+size_t bridge_deflate_size(size_t window)
+{
+    return sizeof(bridge_deflate_t) + DEFLATE_HASH_SIZE * sizeof(uint16_t) + 2 * window;
+}
+
+bridge_deflate_t *bridge_deflate_new(size_t window)
+{
+    if (window < 256 || window > 32768 || (window & (window - 1)))
+        return NULL;
+    bridge_deflate_t *z = malloc(bridge_deflate_size(window));
+    if (z == NULL)
+        return NULL;
+    memset(z, 0, sizeof(bridge_deflate_t));
+    z->window = window;
+    z->adler_a = 1;
+    z->hash = (uint16_t *)(z + 1);
+    z->buf = (uint8_t *)(z->hash + DEFLATE_HASH_SIZE);
+    memset(z->hash, 0, DEFLATE_HASH_SIZE * sizeof(uint16_t));
+    return z;
+}
+
+void bridge_deflate_free(bridge_deflate_t *z)
+{
+    free(z);
+}
+
+void bridge_deflate_reset(bridge_deflate_t *z)
+{
+    uint32_t in = z->total_in, out = z->total_out;
+    size_t window = z->window;
+    memset(z, 0, sizeof(bridge_deflate_t));
+    z->window = window;
+    z->adler_a = 1;
+    z->total_in = in;
+    z->total_out = out;
+    z->hash = (uint16_t *)(z + 1);
+    z->buf = (uint8_t *)(z->hash + DEFLATE_HASH_SIZE);
+    memset(z->hash, 0, DEFLATE_HASH_SIZE * sizeof(uint16_t));
+}
+
+static inline uint8_t *put_bits(bridge_deflate_t *z, uint8_t *out, uint32_t bits, uint8_t n)
+{
+    z->bitbuf |= bits << z->bitcnt;
+    z->bitcnt += n;
+    while (z->bitcnt >= 8)
+    {
+        *out++ = z->bitbuf;
+        z->bitbuf >>= 8;
+        z->bitcnt -= 8;
+    }
+    return out;
+}
+
+/* Huffman 码按高位在前写入，需要反转后放入低位先出的位流 */
+static inline uint32_t reverse_bits(uint32_t code, uint8_t n)
+{
+    uint32_t r = 0;
+    for (uint8_t i = 0; i < n; i++)
+    {
+        r = (r << 1) | (code & 1);
+        code >>= 1;
+    }
+    return r;
+}
+
+static inline uint8_t *put_symbol(bridge_deflate_t *z, uint8_t *out, uint16_t sym)
+{
+    if (sym < 144)
+        return put_bits(z, out, reverse_bits(0x30 + sym, 8), 8);
+    if (sym < 256)
+        return put_bits(z, out, reverse_bits(0x190 + sym - 144, 9), 9);
+    if (sym < 280)
+        return put_bits(z, out, reverse_bits(sym - 256, 7), 7);
+    return put_bits(z, out, reverse_bits(0xc0 + sym - 280, 8), 8);
+}
+
+static uint8_t *put_match(bridge_deflate_t *z, uint8_t *out, uint32_t len, uint32_t dist)
+{
+    int i = sizeof(len_base) / sizeof(len_base[0]) - 1;
+    while (len_base[i] > len)
+        i--;
+    out = put_symbol(z, out, 257 + i);
+    if (len_extra[i])
+        out = put_bits(z, out, len - len_base[i], len_extra[i]);
+
+    i = sizeof(dist_base) / sizeof(dist_base[0]) - 1;
+    while (dist_base[i] > dist)
+        i--;
+    out = put_bits(z, out, reverse_bits(i, 5), 5);
+    if (dist_extra[i])
+        out = put_bits(z, out, dist - dist_base[i], dist_extra[i]);
+    return out;
+}
+
+static inline uint32_t hash3(const uint8_t *p)
+{
+    uint32_t v = p[0] | p[1] << 8 | p[2] << 16;
+    return (v * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+static void adler32_update(bridge_deflate_t *z, const uint8_t *src, size_t len)
+{
+    uint32_t a = z->adler_a, b = z->adler_b;
+    while (len)
+    {
+        /* 5552 是保证 b 不溢出的最大分段长度 */
+        size_t n = len < 5552 ? len : 5552;
+        len -= n;
+        while (n--)
+        {
+            a += *src++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    z->adler_a = a;
+    z->adler_b = b;
+}
+
+/**
+ * @brief 丢弃较早的一半缓冲区，保留最近 window 字节作为历史
+ */
+static void slide(bridge_deflate_t *z)
+{
+    uint32_t shift = z->win_len - z->window;
+    memmove(z->buf, z->buf + shift, z->window);
+    z->win_len = z->window;
+    for (int i = 0; i < DEFLATE_HASH_SIZE; i++)
+        z->hash[i] = z->hash[i] > shift ? z->hash[i] - shift : 0;
+}
+
+size_t bridge_deflate_write(bridge_deflate_t *z, const uint8_t *src, size_t len, uint8_t *dst, bool flush)
+{
+    uint8_t *out = dst;
+    if (!z->header_done)
+    {
+        /* CMF: deflate，窗口 2^(CINFO+8)；FLG 使 CMF*256+FLG 为 31 的倍数 */
+        uint8_t cinfo = 0;
+        while ((256u << cinfo) < z->window)
+            cinfo++;
+        uint8_t cmf = cinfo << 4 | 8;
+        *out++ = cmf;
+        *out++ = 31 - (cmf * 256) % 31;
+        z->header_done = true;
+    }
+
+    if (len)
+    {
+        if (!z->block_open)
+        {
+            out = put_bits(z, out, 0x2, 3); // BFINAL=0, BTYPE=01 固定 Huffman
+            z->block_open = true;
+        }
+    }
+
+    while (len)
+    {
+        /* 每段不超过窗口大小，保证滑动后缓冲区放得下 */
+        size_t n = len < z->window ? len : z->window;
+        if (z->win_len + n > 2 * z->window)
+            slide(z);
+        uint32_t start = z->win_len;
+        memcpy(z->buf + start, src, n);
+        z->win_len += n;
+        adler32_update(z, src, n);
+        z->total_in += n;
+        src += n;
+        len -= n;
+
+        uint8_t *buf = z->buf;
+        uint32_t end = z->win_len;
+        uint32_t p = start;
+        while (p < end)
+        {
+            uint32_t best = 0, dist = 0;
+            if (p + DEFLATE_MIN_MATCH <= end)
+            {
+                uint32_t h = hash3(buf + p);
+                uint32_t cand = z->hash[h];
+                z->hash[h] = p + 1;
+                if (cand && p + 1 - cand <= z->window)
+                {
+                    cand--;
+                    uint32_t max = end - p < DEFLATE_MAX_MATCH ? end - p : DEFLATE_MAX_MATCH;
+                    while (best < max && buf[cand + best] == buf[p + best])
+                        best++;
+                    dist = p - cand;
+                }
+            }
+
+            if (best >= DEFLATE_MIN_MATCH)
+            {
+                out = put_match(z, out, best, dist);
+                /* 匹配内部的位置也加入哈希，提高后续匹配率 */
+                for (uint32_t i = 1; i < best && p + i + DEFLATE_MIN_MATCH <= end; i++)
+                    z->hash[hash3(buf + p + i)] = p + i + 1;
+                p += best;
+            }
+            else
+            {
+                out = put_symbol(z, out, buf[p]);
+                p++;
+            }
+        }
+    }
+
+    if (flush && z->block_open)
+    {
+        /* 结束当前块，再输出一个空的存储块使输出按字节对齐 */
+        out = put_symbol(z, out, 256);
+        out = put_bits(z, out, 0, 3);
+        if (z->bitcnt)
+            out = put_bits(z, out, 0, 8 - z->bitcnt);
+        *out++ = 0x00;
+        *out++ = 0x00;
+        *out++ = 0xff;
+        *out++ = 0xff;
+        z->block_open = false;
+    }
+
+    z->total_out += out - dst;
+    return out - dst;
+}
+
+size_t bridge_deflate_finish(bridge_deflate_t *z, uint8_t *dst)
+{
+    uint8_t *out = dst + bridge_deflate_write(z, NULL, 0, dst, false);
+    if (z->block_open)
+        out = put_symbol(z, out, 256);
+    /* 最后一个空的固定 Huffman 块 */
+    out = put_bits(z, out, 0x3, 3);
+    out = put_symbol(z, out, 256);
+    if (z->bitcnt)
+        out = put_bits(z, out, 0, 8 - z->bitcnt);
+    z->block_open = false;
+
+    uint32_t adler = z->adler_b << 16 | z->adler_a;
+    *out++ = adler >> 24;
+    *out++ = adler >> 16;
+    *out++ = adler >> 8;
+    *out++ = adler;
+    z->total_out += out - dst;
+    return out - dst;
+}
+
+void bridge_deflate_get_stats(const bridge_deflate_t *z, uint32_t *in, uint32_t *out)
+{
+    *in = z->total_in;
+    *out = z->total_out;
+}
+
+typedef struct
+{
+    const uint8_t *src;
+    size_t len;
+    size_t pos;
+    uint32_t bitbuf;
+    uint8_t bitcnt;
+} inflate_bits_t;
+
+/* 读取 n 位，低位先出；数据不足时返回 -1 */
+static int get_bits(inflate_bits_t *b, uint8_t n)
+{
+    while (b->bitcnt < n)
+    {
+        if (b->pos >= b->len)
+            return -1;
+        b->bitbuf |= (uint32_t)b->src[b->pos++] << b->bitcnt;
+        b->bitcnt += 8;
+    }
+    int v = b->bitbuf & ((1u << n) - 1);
+    b->bitbuf >>= n;
+    b->bitcnt -= n;
+    return v;
+}
+
+/* 按高位在前逐位读取固定 Huffman 码 */
+static int get_fixed_symbol(inflate_bits_t *b)
+{
+    int code = 0;
+    for (int n = 1; n <= 9; n++)
+    {
+        int bit = get_bits(b, 1);
+        if (bit < 0)
+            return -1;
+        code = code << 1 | bit;
+        if (n == 7 && code <= 0x17)
+            return 256 + code;
+        if (n == 8 && code >= 0x30 && code <= 0xbf)
+            return code - 0x30;
+        if (n == 8 && code >= 0xc0 && code <= 0xc7)
+            return 280 + code - 0xc0;
+        if (n == 9 && code >= 0x190)
+            return 144 + code - 0x190;
+    }
+    return -1;
+}
+
+int bridge_deflate_decode(const uint8_t *src, size_t len, uint8_t *dst, size_t cap)
+{
+    if (len < 6 || (src[0] & 0x0f) != 8 || (src[0] * 256 + src[1]) % 31 || (src[1] & 0x20))
+        return -1;
+
+    inflate_bits_t b = {.src = src, .len = len - 4, .pos = 2};
+    size_t out = 0;
+    int final = 0;
+    while (!final)
+    {
+        final = get_bits(&b, 1);
+        int type = get_bits(&b, 2);
+        if (final < 0 || type < 0)
+            return -1;
+
+        if (type == 0)
+        {
+            /* 存储块：丢弃不足一字节的位，之后是 LEN 与 NLEN */
+            b.bitbuf = 0;
+            b.bitcnt = 0;
+            if (b.pos + 4 > b.len)
+                return -1;
+            uint16_t n = b.src[b.pos] | b.src[b.pos + 1] << 8;
+            uint16_t nn = b.src[b.pos + 2] | b.src[b.pos + 3] << 8;
+            b.pos += 4;
+            if ((nn ^ 0xFFFF) != n || b.pos + n > b.len || out + n > cap)
+                return -1;
+            memcpy(dst + out, b.src + b.pos, n);
+            b.pos += n;
+            out += n;
+            continue;
+        }
+        if (type != 1)
+            return -1;
+
+        while (true)
+        {
+            int sym = get_fixed_symbol(&b);
+            if (sym < 0 || sym > 285)
+                return -1;
+            if (sym < 256)
+            {
+                if (out >= cap)
+                    return -1;
+                dst[out++] = sym;
+                continue;
+            }
+            if (sym == 256)
+                break;
+
+            int i = sym - 257;
+            int extra = get_bits(&b, len_extra[i]);
+            int dcode = get_bits(&b, 5);
+            if (extra < 0 || dcode < 0)
+                return -1;
+            dcode = reverse_bits(dcode, 5);
+            if (dcode >= 30)
+                return -1;
+            int dextra = get_bits(&b, dist_extra[dcode]);
+            if (dextra < 0)
+                return -1;
+            size_t mlen = len_base[i] + extra;
+            size_t dist = dist_base[dcode] + dextra;
+            if (dist > out || out + mlen > cap)
+                return -1;
+            for (size_t k = 0; k < mlen; k++, out++)
+                dst[out] = dst[out - dist];
+        }
+    }
+
+    /* 校验 Adler-32 */
+    uint32_t a = 1, s2 = 0;
+    for (size_t i = 0; i < out; i++)
+    {
+        a = (a + dst[i]) % 65521;
+        s2 = (s2 + a) % 65521;
+    }
+    const uint8_t *t = src + len - 4;
+    if (((uint32_t)t[0] << 24 | t[1] << 16 | t[2] << 8 | t[3]) != (s2 << 16 | a))
+        return -1;
+    return out;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 压缩 len 字节输出的最大长度：固定 Huffman 字面量最长 9 位，另加块尾与同步标记 */
+#define BRIDGE_DEFLATE_BOUND(len) ((len) + (len) / 8 + 16)
+
+/**
+ * @brief zlib 格式的流式压缩器，固定 Huffman 编码，贪心匹配，历史窗口大小可配置
+ *
+ * 内存占用为 bridge_deflate_size()，远小于完整的 zlib 实现，适合为每个客户端单独分配。
+ */
+typedef struct bridge_deflate bridge_deflate_t;
+
+/**
+ * @param window 历史窗口大小，2 的幂，256 到 32768 之间
+ */
+size_t bridge_deflate_size(size_t window);
+bridge_deflate_t *bridge_deflate_new(size_t window);
+void bridge_deflate_free(bridge_deflate_t *z);
+
+/**
+ * @brief 压缩一段数据追加到 dst
+ *
+ * @param dst 剩余空间至少为 BRIDGE_DEFLATE_BOUND(len)
+ * @param flush 为 true 时以同步标记结束（Z_SYNC_FLUSH），对端可以立即解出已输出的全部数据
+ * @return size_t 输出的字节数，未 flush 时不足一个字节的位保留到下次输出
+ */
+size_t bridge_deflate_write(bridge_deflate_t *z, const uint8_t *src, size_t len, uint8_t *dst, bool flush);
+
+/**
+ * @brief 结束压缩流，输出最后一个块与 Adler-32 校验，dst 至少 16 字节
+ */
+size_t bridge_deflate_finish(bridge_deflate_t *z, uint8_t *dst);
+
+/**
+ * @brief 丢弃历史与未完成的流，下次写入开始一个新的 zlib 流，用于各自独立解压的数据块
+ */
+void bridge_deflate_reset(bridge_deflate_t *z);
+
+/**
+ * @brief 解压本模块生成的完整 zlib 流，只支持固定 Huffman 与存储块
+ *
+ * @return int 解压后的长度，数据损坏、格式不支持或 dst 空间不足时返回 -1
+ */
+int bridge_deflate_decode(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+/**
+ * @brief 累计的输入与输出字节数
+ */
+void bridge_deflate_get_stats(const bridge_deflate_t *z, uint32_t *in, uint32_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,39 @@
+#include "bridge_flush.h"
+#include "sdkconfig.h"
+
+void bridge_flush_init(bridge_flush_t *flush)
+{
+    flush->pending_since = 0;
+    flush->last_flush = 0;
+}
+
+int64_t bridge_flush_check(bridge_flush_t *flush, uint32_t pending, int64_t now)
+{
+    if (pending == 0)
+    {
+        flush->pending_since = 0;
+        return -1;
+    }
+
+    if (flush->pending_since == 0)
+    {
+        flush->pending_since = now;
+        /* 链路空闲一段时间后到达的数据多为交互回显，不做等待 */
+        if (now - flush->last_flush >= CONFIG_BRIDGE_FLUSH_DEADLINE_US)
+            return 0;
+    }
+
+    if (pending >= CONFIG_BRIDGE_FLUSH_THRESHOLD)
+        return 0;
+
+    int64_t wait = flush->pending_since + CONFIG_BRIDGE_FLUSH_DEADLINE_US - now;
+    return wait > 0 ? wait : 0;
+}
+
+void bridge_flush_done(bridge_flush_t *flush, uint32_t remaining, int64_t now)
+{
+    flush->last_flush = now;
+    /* 未发完的数据已经超时，保留原到达时间使其在可写后立即发送 */
+    if (remaining == 0)
+        flush->pending_since = 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief 发送合并状态，每个输出通道一个
+ *
+ * 积压达到 CONFIG_BRIDGE_FLUSH_THRESHOLD 字节或最早的积压数据等待超过
+ * CONFIG_BRIDGE_FLUSH_DEADLINE_US 微秒时发送，空闲链路上的首批数据立即发送以保证交互响应。
+ */
+typedef struct
+{
+    int64_t pending_since; // 最早未发送数据的到达时间，0 表示没有积压
+    int64_t last_flush;    // 上次发送的时间
+} bridge_flush_t;
+
+void bridge_flush_init(bridge_flush_t *flush);
+
+/**
+ * @brief 判断是否需要立即发送
+ *
+ * @param pending 当前积压字节数
+ * @param now esp_timer_get_time() 时间戳
+ * @return int64_t 0 立即发送，大于 0 为距离截止时间的微秒数，小于 0 表示没有积压
+ */
+int64_t bridge_flush_check(bridge_flush_t *flush, uint32_t pending, int64_t now);
+
+/**
+ * @brief 发送后更新状态
+ *
+ * @param remaining 发送后仍然积压的字节数
+ */
+void bridge_flush_done(bridge_flush_t *flush, uint32_t remaining, int64_t now);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,156 @@
+#include "bridge_ring.h"
+#include "sdkconfig.h"
+#include <stdatomic.h>
+#include <string.h>
+
+#define RING_SIZE CONFIG_BRIDGE_RING_SIZE
+#define RING_MASK (RING_SIZE - 1)
+/* 读者可访问的最大历史长度，留出一个写入块的余量避免读到正在被覆盖的数据 */
+#define RING_HISTORY (RING_SIZE - BRIDGE_RING_CHUNK)
+/* 记录最近写入的接收时间，需为 2 的幂 */
+#define RING_MARKS 64
+
+_Static_assert((RING_SIZE & RING_MASK) == 0, "BRIDGE_RING_SIZE must be a power of two");
+_Static_assert(RING_SIZE >= 4 * BRIDGE_RING_CHUNK, "BRIDGE_RING_SIZE too small");
+
+static uint8_t ring_buf[RING_SIZE];
+/* head 之前的数据已提交可读，reserve 之前的区域可能正在被生产者写入 */
+static _Atomic uint32_t ring_head;
+static _Atomic uint32_t ring_reserve;
+static _Atomic bool ring_full;
+
+/* 每次提交的结束位置与接收时间，按提交顺序循环存放 */
+static struct
+{
+    uint32_t end;
+    int64_t time;
+} ring_marks[RING_MARKS];
+static uint32_t ring_mark_count;
+
+void bridge_ring_init()
+{
+    atomic_store(&ring_head, 0);
+    atomic_store(&ring_reserve, 0);
+    atomic_store(&ring_full, false);
+    ring_mark_count = 0;
+}
+
+size_t bridge_ring_write_begin(uint8_t **ptr)
+{
+    uint32_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    size_t off = head & RING_MASK;
+    size_t len = RING_SIZE - off;
+    if (len > BRIDGE_RING_CHUNK)
+        len = BRIDGE_RING_CHUNK;
+
+    /* 先公布将要覆盖的范围，读者据此判断读到的数据是否被破坏 */
+    atomic_store_explicit(&ring_reserve, head + len, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+    *ptr = &ring_buf[off];
+    return len;
+}
+
+void bridge_ring_write_commit(size_t len, int64_t time)
+{
+    uint32_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    ring_marks[ring_mark_count & (RING_MARKS - 1)].end = head + len;
+    ring_marks[ring_mark_count & (RING_MARKS - 1)].time = time;
+    ring_mark_count++;
+
+    if (head + len >= RING_HISTORY)
+        atomic_store_explicit(&ring_full, true, memory_order_relaxed);
+    atomic_store_explicit(&ring_reserve, head + len, memory_order_relaxed);
+    atomic_store_explicit(&ring_head, head + len, memory_order_release);
+}
+
+uint32_t bridge_ring_head()
+{
+    return atomic_load_explicit(&ring_head, memory_order_acquire);
+}
+
+size_t bridge_ring_capacity()
+{
+    return RING_HISTORY;
+}
+
+static uint32_t ring_available(uint32_t head)
+{
+    /* 写满一圈之前只能回放实际写入的部分 */
+    if (!atomic_load_explicit(&ring_full, memory_order_relaxed) && head < RING_HISTORY)
+        return head;
+    return RING_HISTORY;
+}
+
+void bridge_ring_cursor_init(bridge_ring_cursor_t *cur, size_t backlog)
+{
+    uint32_t head = bridge_ring_head();
+    uint32_t available = ring_available(head);
+    if (backlog > available)
+        backlog = available;
+    cur->pos = head - backlog;
+    cur->overruns = 0;
+    cur->dropped = 0;
+}
+
+size_t bridge_ring_peek(bridge_ring_cursor_t *cur, const uint8_t **ptr)
+{
+    uint32_t head = bridge_ring_head();
+    uint32_t lag = head - cur->pos;
+    if (lag == 0)
+        return 0;
+
+    uint32_t available = ring_available(head);
+    if (lag > available)
+    {
+        cur->overruns++;
+        cur->dropped += lag - available;
+        cur->pos = head - available;
+        lag = available;
+    }
+
+    size_t off = cur->pos & RING_MASK;
+    size_t len = RING_SIZE - off;
+    if (len > lag)
+        len = lag;
+    *ptr = &ring_buf[off];
+    return len;
+}
+
+bool bridge_ring_consume(bridge_ring_cursor_t *cur, size_t len)
+{
+    uint32_t start = cur->pos;
+    cur->pos += len;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    uint32_t reserve = atomic_load_explicit(&ring_reserve, memory_order_acquire);
+    if (reserve - start > RING_SIZE)
+    {
+        cur->overruns++;
+        return false;
+    }
+    return true;
+}
+
+uint32_t bridge_ring_lag(const bridge_ring_cursor_t *cur)
+{
+    return bridge_ring_head() - cur->pos;
+}
+
+int64_t bridge_ring_time(uint32_t pos)
+{
+    if (ring_mark_count == 0)
+        return 0;
+
+    /* 从最新的记录向前找到包含 pos 的那次写入，通常只需几步 */
+    uint32_t n = ring_mark_count < RING_MARKS ? ring_mark_count : RING_MARKS;
+    uint32_t idx = (ring_mark_count - 1) & (RING_MARKS - 1);
+    int64_t time = ring_marks[idx].time;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        idx = (ring_mark_count - 1 - i) & (RING_MARKS - 1);
+        if ((int32_t)(ring_marks[idx].end - pos) <= 0)
+            break;
+        time = ring_marks[idx].time;
+    }
+    return time;
+}
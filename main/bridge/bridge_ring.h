@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 单次写入的最大长度，读者需要与写入位置保持至少这么多字节的距离 */
+#define BRIDGE_RING_CHUNK 1024
+
+/**
+ * @brief 读游标，每个消费者持有一个
+ *
+ * pos 为绝对字节位置（自启动以来写入的字节数，按 32 位回绕），
+ * 生产者与游标的差值即为该消费者的积压字节数。
+ */
+typedef struct
+{
+    uint32_t pos;
+    uint32_t overruns; // 被生产者追上的次数
+    uint32_t dropped;  // 因追尾丢失的字节数
+} bridge_ring_cursor_t;
+
+void bridge_ring_init();
+
+/**
+ * @brief 获取一段连续可写空间，最长 BRIDGE_RING_CHUNK 字节，仅允许单个生产者调用
+ *
+ * @param ptr 可写区域起始地址
+ * @return size_t 可写长度
+ */
+size_t bridge_ring_write_begin(uint8_t **ptr);
+
+/**
+ * @brief 提交 bridge_ring_write_begin 取得的空间中实际写入的字节
+ *
+ * @param time 数据的接收时间，供 bridge_ring_time 查询
+ */
+void bridge_ring_write_commit(size_t len, int64_t time);
+
+uint32_t bridge_ring_head();
+
+/**
+ * @brief 读者可回放的最大历史长度，游标积压超过该值即会丢数据
+ */
+size_t bridge_ring_capacity();
+
+/**
+ * @brief 初始化游标，backlog 为需要回放的历史字节数，超出已有数据时截断
+ */
+void bridge_ring_cursor_init(bridge_ring_cursor_t *cur, size_t backlog);
+
+/**
+ * @brief 获取游标处一段连续的可读数据，游标落后过多时先跳过已被覆盖的部分并计入 overruns
+ *
+ * @return size_t 可读长度，0 表示没有新数据
+ */
+size_t bridge_ring_peek(bridge_ring_cursor_t *cur, const uint8_t **ptr);
+
+/**
+ * @brief 消费 bridge_ring_peek 返回的数据
+ *
+ * @return true 数据在使用期间未被生产者覆盖
+ * @return false 使用期间数据已被覆盖，已计入 overruns
+ */
+bool bridge_ring_consume(bridge_ring_cursor_t *cur, size_t len);
+
+uint32_t bridge_ring_lag(const bridge_ring_cursor_t *cur);
+
+/**
+ * @brief 查询绝对位置 pos 处数据的接收时间，只记录最近的若干次写入，更早的数据返回最早的记录
+ *
+ * 与生产者在同一任务中调用
+ */
+int64_t bridge_ring_time(uint32_t pos);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,150 @@
+#include "bridge_udp.h"
+#include "bridge_flush.h"
+#include "bridge_ring.h"
+#include "esp_log.h"
+#include "lwip/inet.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+#include "timesync/timesync.h"
+#include <string.h>
+#include <sys/errno.h>
+
+static const char *TAG = "bridge_udp";
+
+static int udp_fd = -1;
+static struct sockaddr_in udp_dest;
+static bridge_ring_cursor_t udp_cursor;
+static bridge_flush_t udp_flush;
+static uint32_t udp_seq;
+static uint8_t udp_flags;
+static bridge_udp_stats_t udp_stats;
+
+esp_err_t bridge_udp_open()
+{
+#if CONFIG_BRIDGE_UDP_PORT
+    if (udp_fd >= 0)
+        return ESP_OK;
+
+    udp_dest.sin_family = AF_INET;
+    udp_dest.sin_port = htons(CONFIG_BRIDGE_UDP_PORT);
+    if (inet_aton(CONFIG_BRIDGE_UDP_ADDR, &udp_dest.sin_addr) == 0)
+    {
+        ESP_LOGE(TAG, "invalid address %s", CONFIG_BRIDGE_UDP_ADDR);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    udp_fd = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp_fd < 0)
+    {
+        ESP_LOGE(TAG, "socket create failed %d %s", errno, strerror(errno));
+        return ESP_FAIL;
+    }
+
+    if (IP_MULTICAST(ntohl(udp_dest.sin_addr.s_addr)))
+    {
+        uint8_t ttl = CONFIG_BRIDGE_UDP_TTL;
+        if (lwip_setsockopt(udp_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) == -1)
+            ESP_LOGE(TAG, "setsockopt IP_MULTICAST_TTL failed %d %s", errno, strerror(errno));
+    }
+
+    /* 只发送连接建立之后的数据 */
+    bridge_ring_cursor_init(&udp_cursor, 0);
+    bridge_flush_init(&udp_flush);
+    udp_flags = 0;
+    ESP_LOGI(TAG, "streaming to %s:%d", CONFIG_BRIDGE_UDP_ADDR, CONFIG_BRIDGE_UDP_PORT);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void bridge_udp_close()
+{
+    if (udp_fd < 0)
+        return;
+    lwip_close(udp_fd);
+    udp_fd = -1;
+}
+
+/**
+ * @brief 发送一个数据报，头部与环形缓冲区中的数据通过 sendmsg 一起发送，不额外拷贝
+ */
+static void bridge_udp_send(const uint8_t *data, size_t len)
+{
+    int64_t timestamp = bridge_ring_time(udp_cursor.pos);
+    uint8_t flags = udp_flags;
+    int64_t unix_us;
+    if (timesync_to_unix(timestamp, &unix_us))
+    {
+        timestamp = unix_us;
+        flags |= BRIDGE_UDP_FLAG_UNIX_TIME;
+    }
+    bridge_udp_header_t header = {
+        .magic = htons(BRIDGE_UDP_MAGIC),
+        .version = BRIDGE_UDP_VERSION,
+        .flags = flags,
+        .seq = htonl(udp_seq),
+        .offset = htonl(udp_cursor.pos),
+        .timestamp_hi = htonl((uint64_t)timestamp >> 32),
+        .timestamp_lo = htonl((uint32_t)timestamp),
+    };
+    struct iovec iov[2] = {
+        {.iov_base = &header, .iov_len = sizeof(header)},
+        {.iov_base = (void *)data, .iov_len = len},
+    };
+    struct msghdr msg = {
+        .msg_name = &udp_dest,
+        .msg_namelen = sizeof(udp_dest),
+        .msg_iov = iov,
+        .msg_iovlen = 2,
+    };
+
+    /* 发送失败的数据报同样占用序号，接收端据此统计丢失 */
+    udp_seq++;
+    if (lwip_sendmsg(udp_fd, &msg, MSG_DONTWAIT) < 0)
+    {
+        udp_stats.errors++;
+        return;
+    }
+    udp_flags = 0;
+    udp_stats.datagrams++;
+    udp_stats.bytes += len;
+}
+
+int64_t bridge_udp_poll(int64_t now)
+{
+    if (udp_fd < 0)
+        return -1;
+
+    int64_t wait = bridge_flush_check(&udp_flush, bridge_ring_lag(&udp_cursor), now);
+    if (wait != 0)
+        return wait;
+
+    const uint8_t *data;
+    size_t len;
+    while (true)
+    {
+        uint32_t dropped = udp_cursor.dropped;
+        len = bridge_ring_peek(&udp_cursor, &data);
+        if (udp_cursor.dropped != dropped)
+        {
+            udp_stats.dropped += udp_cursor.dropped - dropped;
+            udp_flags |= BRIDGE_UDP_FLAG_OVERRUN;
+        }
+        if (len == 0)
+            break;
+        if (len > CONFIG_BRIDGE_UDP_PAYLOAD)
+            len = CONFIG_BRIDGE_UDP_PAYLOAD;
+
+        bridge_udp_send(data, len);
+        if (!bridge_ring_consume(&udp_cursor, len))
+            udp_flags |= BRIDGE_UDP_FLAG_OVERRUN;
+    }
+    bridge_flush_done(&udp_flush, 0, now);
+    return -1;
+}
+
+void bridge_udp_get_stats(bridge_udp_stats_t *stats)
+{
+    *stats = udp_stats;
+}
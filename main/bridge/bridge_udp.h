@@ -0,0 +1,63 @@
+#pragma once
+
+#include "esp_bit_defs.h"
+#include "esp_err.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BRIDGE_UDP_MAGIC 0x5755 // "WU"
+#define BRIDGE_UDP_VERSION 1
+
+#define BRIDGE_UDP_FLAG_OVERRUN BIT0   // 本数据报之前有数据因积压被覆盖，offset 不连续
+#define BRIDGE_UDP_FLAG_UNIX_TIME BIT1 // timestamp 为经 SNTP 校准的 Unix 时间，否则为启动以来的时间
+
+/**
+ * @brief 数据报头，所有字段为网络字节序，其后紧跟串口数据
+ *
+ * seq 每个数据报加一，用于统计丢包；offset 为首字节在串口数据流中的绝对位置（按 32 位回绕），
+ * 用于统计丢失的字节数；timestamp 为首字节的接收时间（微秒），按线路速率由读取时间倒推。
+ */
+typedef struct __attribute__((packed))
+{
+    uint16_t magic;
+    uint8_t version;
+    uint8_t flags;
+    uint32_t seq;
+    uint32_t offset;
+    uint32_t timestamp_hi;
+    uint32_t timestamp_lo;
+} bridge_udp_header_t;
+
+typedef struct
+{
+    uint32_t datagrams;
+    uint32_t bytes;
+    uint32_t errors;  // 发送失败而丢弃的数据报
+    uint32_t dropped; // 被覆盖而未发送的字节数
+} bridge_udp_stats_t;
+
+/**
+ * @brief 按 CONFIG_BRIDGE_UDP_ADDR/PORT 创建发送套接字，从当前位置开始发送
+ *
+ * 以下接口都只在 telnet_srv 任务中调用
+ *
+ * @return esp_err_t 未启用时返回 ESP_ERR_NOT_SUPPORTED
+ */
+esp_err_t bridge_udp_open();
+void bridge_udp_close();
+
+/**
+ * @brief 按合并策略发送积压数据
+ *
+ * @return int64_t 大于 0 为下次需要检查的微秒数，小于 0 表示没有积压或未启用
+ */
+int64_t bridge_udp_poll(int64_t now);
+
+void bridge_udp_get_stats(bridge_udp_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
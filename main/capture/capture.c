@@ -0,0 +1,466 @@
+#include "capture.h"
+#include "bridge/bridge_deflate.h"
+#include "bridge/bridge_ring.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "stats/stats.h"
+#include "timesync/timesync.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CAPTURE_SECTOR_SIZE 4096
+#define CAPTURE_BUFS 2
+#define CAPTURE_WINDOW 1024
+/* 写入任务忙时重新检查的间隔 */
+#define CAPTURE_BUSY_RETRY_US 20000
+#define CAPTURE_ALIGN(n) (((n) + 3) & ~3u)
+/* 压缩时为 deflate 结尾预留的空间 */
+#define CAPTURE_FINISH_MAX 16
+
+typedef struct
+{
+    capture_record_t hdr;
+    uint8_t data[CAPTURE_REC_DATA];
+} capture_buf_t;
+
+static const char *TAG = "capture";
+
+static const esp_partition_t *cap_part;
+static uint32_t cap_sectors;
+static QueueHandle_t cap_free_queue;  // 空闲的记录缓冲区
+static QueueHandle_t cap_write_queue; // 等待写入 flash 的记录
+static capture_stats_t cap_stats;
+
+/* 扇区索引，由写入任务修改，导出时在 cap_lock 保护下读取 */
+static SemaphoreHandle_t cap_lock;
+static uint32_t cap_head; // 正在写入的扇区
+static uint32_t cap_head_seq;
+static uint32_t cap_used; // 以 cap_head 结尾的连续有效扇区数
+static uint32_t cap_write_off;
+static uint16_t cap_boot;
+
+/* 以下只在 telnet_srv 任务中使用 */
+static bridge_ring_cursor_t cap_cursor;
+static bool cap_cursor_ready;
+static capture_buf_t *cap_rec; // 正在组装的记录
+static int64_t cap_rec_start;
+static bool cap_overrun;
+static bridge_deflate_t *cap_z;
+
+static uint32_t capture_sector_crc(const capture_sector_t *hdr)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)hdr, offsetof(capture_sector_t, crc));
+}
+
+static uint32_t capture_record_crc(const capture_record_t *hdr, const uint8_t *data)
+{
+    capture_record_t tmp = *hdr;
+    tmp.crc = 0;
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&tmp, sizeof(tmp));
+    return esp_rom_crc32_le(crc, data, hdr->len);
+}
+
+static bool capture_read_sector(uint32_t sector, capture_sector_t *hdr)
+{
+    if (esp_partition_read(cap_part, sector * CAPTURE_SECTOR_SIZE, hdr, sizeof(*hdr)) != ESP_OK)
+        return false;
+    return hdr->magic == CAPTURE_SECTOR_MAGIC && hdr->crc == capture_sector_crc(hdr);
+}
+
+/**
+ * @brief 擦除下一个扇区并写入扇区头，将被覆盖的最早扇区先从索引中去掉
+ */
+static void capture_open_sector(const capture_record_t *first)
+{
+    uint32_t next = (cap_head + 1) % cap_sectors;
+    xSemaphoreTake(cap_lock, portMAX_DELAY);
+    if (cap_used == cap_sectors)
+        cap_used--;
+    xSemaphoreGive(cap_lock);
+
+    capture_sector_t hdr = {
+        .magic = CAPTURE_SECTOR_MAGIC,
+        .seq = cap_head_seq + 1,
+        .boot = cap_boot,
+        .unix_us = first->unix_us,
+    };
+    hdr.crc = capture_sector_crc(&hdr);
+    esp_err_t err = esp_partition_erase_range(cap_part, next * CAPTURE_SECTOR_SIZE, CAPTURE_SECTOR_SIZE);
+    if (err == ESP_OK)
+        err = esp_partition_write(cap_part, next * CAPTURE_SECTOR_SIZE, &hdr, sizeof(hdr));
+    if (err != ESP_OK)
+    {
+        /* 损坏的扇区在读取时因校验失败被跳过 */
+        ESP_LOGE(TAG, "open sector %u failed %s", (unsigned)next, esp_err_to_name(err));
+        cap_stats.write_errors++;
+    }
+
+    xSemaphoreTake(cap_lock, portMAX_DELAY);
+    cap_head = next;
+    cap_head_seq = hdr.seq;
+    cap_used++;
+    cap_write_off = sizeof(hdr);
+    xSemaphoreGive(cap_lock);
+}
+
+/**
+ * @brief 擦写 flash 期间 CPU 会暂停执行 flash 中的代码，放在单独的任务中，不让 telnet_srv 等待
+ */
+static void capture_writer_task(void *arg)
+{
+    capture_buf_t *buf;
+    while (xQueueReceive(cap_write_queue, &buf, portMAX_DELAY) == pdTRUE)
+    {
+        size_t size = sizeof(buf->hdr) + buf->hdr.len;
+        if (cap_write_off + size > CAPTURE_SECTOR_SIZE)
+            capture_open_sector(&buf->hdr);
+        esp_err_t err = esp_partition_write(cap_part, cap_head * CAPTURE_SECTOR_SIZE + cap_write_off, buf, size);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "write failed %s", esp_err_to_name(err));
+            cap_stats.write_errors++;
+        }
+        cap_write_off += CAPTURE_ALIGN(size);
+        xQueueSend(cap_free_queue, &buf, 0);
+    }
+}
+
+/**
+ * @brief 找到序号最大的扇区与其中的写入位置，以及在它之前序号连续的有效扇区数
+ */
+static void capture_recover()
+{
+    capture_sector_t hdr;
+    bool found = false;
+    for (uint32_t i = 0; i < cap_sectors; i++)
+    {
+        if (!capture_read_sector(i, &hdr))
+            continue;
+        if (!found || (int32_t)(hdr.seq - cap_head_seq) > 0)
+        {
+            found = true;
+            cap_head = i;
+            cap_head_seq = hdr.seq;
+            cap_boot = hdr.boot + 1;
+        }
+    }
+    if (!found)
+    {
+        /* 空分区，第一条记录写入扇区 0，序号从 0 开始 */
+        cap_head = cap_sectors - 1;
+        cap_head_seq = UINT32_MAX;
+        cap_used = 0;
+        cap_write_off = CAPTURE_SECTOR_SIZE;
+        return;
+    }
+
+    cap_used = 1;
+    while (cap_used < cap_sectors)
+    {
+        uint32_t sector = (cap_head + cap_sectors - cap_used) % cap_sectors;
+        if (!capture_read_sector(sector, &hdr) || hdr.seq != cap_head_seq - cap_used)
+            break;
+        cap_used++;
+    }
+
+    /* 记录头是一次写入的，按长度跳到第一个未写入的位置 */
+    uint32_t off = sizeof(capture_sector_t);
+    while (off + sizeof(capture_record_t) <= CAPTURE_SECTOR_SIZE)
+    {
+        capture_record_t rec;
+        if (esp_partition_read(cap_part, cap_head * CAPTURE_SECTOR_SIZE + off, &rec, sizeof(rec)) != ESP_OK ||
+            rec.len == 0xFFFF)
+            break;
+        off += CAPTURE_ALIGN(sizeof(rec) + rec.len);
+    }
+    cap_write_off = off;
+}
+
+esp_err_t capture_init()
+{
+#if CONFIG_BRIDGE_CAPTURE
+    cap_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, CAPTURE_PARTITION_SUBTYPE, "capture");
+    if (cap_part == NULL)
+    {
+        ESP_LOGW(TAG, "no capture partition");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    cap_sectors = cap_part->size / CAPTURE_SECTOR_SIZE;
+    capture_recover();
+
+    capture_buf_t *bufs = malloc(CAPTURE_BUFS * sizeof(capture_buf_t));
+    cap_lock = xSemaphoreCreateMutex();
+    cap_free_queue = xQueueCreate(CAPTURE_BUFS, sizeof(capture_buf_t *));
+    cap_write_queue = xQueueCreate(CAPTURE_BUFS, sizeof(capture_buf_t *));
+#if CONFIG_BRIDGE_CAPTURE_COMPRESS
+    cap_z = bridge_deflate_new(CAPTURE_WINDOW);
+#endif
+    if (bufs == NULL || cap_lock == NULL || cap_free_queue == NULL || cap_write_queue == NULL)
+    {
+        ESP_LOGE(TAG, "no memory");
+        cap_part = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    stats_mem_alloc(STATS_MEM_CAPTURE, bufs);
+#if CONFIG_BRIDGE_CAPTURE_COMPRESS
+    stats_mem_alloc(STATS_MEM_CAPTURE, cap_z);
+#endif
+    for (int i = 0; i < CAPTURE_BUFS; i++)
+    {
+        capture_buf_t *buf = &bufs[i];
+        xQueueSend(cap_free_queue, &buf, 0);
+    }
+
+    if (xTaskCreate(capture_writer_task, "capture", 3072, NULL, 1, NULL) != pdPASS)
+    {
+        ESP_LOGE(TAG, "xTaskCreate capture failed");
+        cap_part = NULL;
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "%u/%u sectors used, boot %u", (unsigned)cap_used, (unsigned)cap_sectors, cap_boot);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+static bool capture_rec_begin(int64_t now)
+{
+    if (xQueueReceive(cap_free_queue, &cap_rec, 0) != pdTRUE)
+    {
+        cap_rec = NULL;
+        return false;
+    }
+
+    capture_record_t *hdr = &cap_rec->hdr;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->boot = cap_boot;
+    hdr->offset = cap_cursor.pos;
+    int64_t time_us = bridge_ring_time(cap_cursor.pos);
+    int64_t unix_us = 0;
+    timesync_to_unix(time_us, &unix_us);
+    hdr->time_us = time_us;
+    hdr->unix_us = unix_us;
+    if (cap_overrun)
+        hdr->flags |= CAPTURE_REC_OVERRUN;
+    cap_overrun = false;
+    if (cap_z)
+    {
+        hdr->flags |= CAPTURE_REC_DEFLATE;
+        bridge_deflate_reset(cap_z);
+    }
+    cap_rec_start = now;
+    return true;
+}
+
+/**
+ * @brief 追加数据，压缩时保证剩余空间放得下最坏情况的输出与流结尾
+ *
+ * @return size_t 实际追加的长度，0 表示记录已满
+ */
+static size_t capture_rec_append(const uint8_t *data, size_t len)
+{
+    capture_record_t *hdr = &cap_rec->hdr;
+    size_t n = CAPTURE_REC_RAW_MAX - hdr->raw_len;
+    if (len < n)
+        n = len;
+
+    if (cap_z)
+    {
+        size_t space = CAPTURE_REC_DATA - hdr->len;
+        /* BRIDGE_DEFLATE_BOUND(n) + CAPTURE_FINISH_MAX <= space */
+        size_t max = space > 16 + CAPTURE_FINISH_MAX ? (space - 16 - CAPTURE_FINISH_MAX) * 8 / 9 : 0;
+        if (n > max)
+            n = max;
+        if (n)
+            hdr->len += bridge_deflate_write(cap_z, data, n, cap_rec->data + hdr->len, false);
+    }
+    else
+    {
+        size_t space = CAPTURE_REC_DATA - hdr->len;
+        if (n > space)
+            n = space;
+        memcpy(cap_rec->data + hdr->len, data, n);
+        hdr->len += n;
+    }
+    hdr->raw_len += n;
+    return n;
+}
+
+static void capture_rec_finish()
+{
+    capture_record_t *hdr = &cap_rec->hdr;
+    if (cap_z)
+        hdr->len += bridge_deflate_finish(cap_z, cap_rec->data + hdr->len);
+    hdr->crc = capture_record_crc(hdr, cap_rec->data);
+    cap_stats.records++;
+    cap_stats.raw_bytes += hdr->raw_len;
+    cap_stats.stored_bytes += hdr->len;
+    /* 缓冲区总数与队列长度相同，不会失败 */
+    xQueueSend(cap_write_queue, &cap_rec, 0);
+    cap_rec = NULL;
+}
+
+int64_t capture_poll(int64_t now)
+{
+    if (cap_part == NULL)
+        return -1;
+    if (!cap_cursor_ready)
+    {
+        /* 从环形缓冲区中最早的数据开始，启动日志也能记录下来 */
+        bridge_ring_cursor_init(&cap_cursor, bridge_ring_capacity());
+        cap_cursor_ready = true;
+    }
+
+    while (true)
+    {
+        const uint8_t *data;
+        uint32_t dropped = cap_cursor.dropped;
+        size_t len = bridge_ring_peek(&cap_cursor, &data);
+        if (cap_cursor.dropped != dropped)
+        {
+            cap_stats.dropped += cap_cursor.dropped - dropped;
+            cap_overrun = true;
+            /* 一条记录中的数据必须连续 */
+            if (cap_rec && cap_rec->hdr.raw_len)
+                capture_rec_finish();
+        }
+        if (len == 0)
+            break;
+
+        if (cap_rec == NULL && !capture_rec_begin(now))
+            return CAPTURE_BUSY_RETRY_US;
+        size_t used = capture_rec_append(data, len);
+        bridge_ring_consume(&cap_cursor, used);
+        if (used < len)
+            capture_rec_finish();
+    }
+
+    if (cap_rec == NULL || cap_rec->hdr.raw_len == 0)
+        return -1;
+    int64_t wait = cap_rec_start + CONFIG_BRIDGE_CAPTURE_FLUSH_MS * 1000LL - now;
+    if (wait > 0)
+        return wait;
+    capture_rec_finish();
+    return -1;
+}
+
+void capture_get_stats(capture_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (cap_part == NULL)
+        return;
+    *stats = cap_stats;
+    stats->sectors = cap_sectors;
+    xSemaphoreTake(cap_lock, portMAX_DELAY);
+    stats->used_sectors = cap_used;
+    xSemaphoreGive(cap_lock);
+    stats->boot = cap_boot;
+}
+
+/**
+ * @brief 逻辑序号 i 处及之后第一个已校时扇区的时间，均未校时返回 INT64_MAX
+ */
+static int64_t capture_sector_time(uint32_t tail, uint32_t i, uint32_t end)
+{
+    capture_sector_t hdr;
+    for (; i < end; i++)
+    {
+        if (capture_read_sector((tail + i) % cap_sectors, &hdr) && hdr.unix_us)
+            return hdr.unix_us;
+    }
+    return INT64_MAX;
+}
+
+esp_err_t capture_iter_init(capture_iter_t *it, int64_t from_unix_us)
+{
+    if (cap_part == NULL)
+        return ESP_ERR_NOT_SUPPORTED;
+
+    xSemaphoreTake(cap_lock, portMAX_DELAY);
+    uint32_t head = cap_head;
+    uint32_t used = cap_used;
+    xSemaphoreGive(cap_lock);
+    if (used == 0)
+        return ESP_ERR_NOT_FOUND;
+
+    /* 二分查找最后一个起始时间不晚于 from 的扇区，只需读取 log2(扇区数) 个左右的扇区头 */
+    uint32_t tail = (head + cap_sectors + 1 - used) % cap_sectors;
+    uint32_t lo = 0, hi = used;
+    while (from_unix_us > 0 && hi - lo > 1)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (capture_sector_time(tail, mid, hi) <= from_unix_us)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    it->sector = (tail + lo) % cap_sectors;
+    it->left = used - lo;
+    it->off = 0;
+    it->seq = 0;
+    return ESP_OK;
+}
+
+static void capture_iter_skip(capture_iter_t *it)
+{
+    it->sector = (it->sector + 1) % cap_sectors;
+    it->left--;
+    it->off = 0;
+}
+
+int capture_iter_next(capture_iter_t *it, capture_record_t *rec, uint8_t *raw)
+{
+    capture_sector_t sector;
+    while (it->left)
+    {
+        if (it->off == 0)
+        {
+            if (!capture_read_sector(it->sector, &sector))
+            {
+                capture_iter_skip(it);
+                continue;
+            }
+            it->seq = sector.seq;
+            it->off = sizeof(sector);
+        }
+
+        uint32_t addr = it->sector * CAPTURE_SECTOR_SIZE + it->off;
+        if (it->off + sizeof(*rec) > CAPTURE_SECTOR_SIZE ||
+            esp_partition_read(cap_part, addr, rec, sizeof(*rec)) != ESP_OK || rec->len == 0xFFFF ||
+            rec->len > CAPTURE_REC_DATA || it->off + sizeof(*rec) + rec->len > CAPTURE_SECTOR_SIZE)
+        {
+            capture_iter_skip(it);
+            continue;
+        }
+        it->off += CAPTURE_ALIGN(sizeof(*rec) + rec->len);
+        if (esp_partition_read(cap_part, addr + sizeof(*rec), it->data, rec->len) != ESP_OK ||
+            rec->crc != capture_record_crc(rec, it->data))
+            continue;
+
+        /* 读取期间该扇区可能已被写入任务擦除并重新写入 */
+        if (!capture_read_sector(it->sector, &sector) || sector.seq != it->seq)
+        {
+            capture_iter_skip(it);
+            continue;
+        }
+
+        int n = rec->len;
+        if (rec->flags & CAPTURE_REC_DEFLATE)
+            n = bridge_deflate_decode(it->data, rec->len, raw, CAPTURE_REC_RAW_MAX);
+        else
+            memcpy(raw, it->data, rec->len);
+        if (n != rec->raw_len || n == 0)
+            continue;
+        return n;
+    }
+    return 0;
+}
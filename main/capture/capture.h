@@ -0,0 +1,115 @@
+#pragma once
+
+#include "esp_bit_defs.h"
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAPTURE_SECTOR_MAGIC 0x50414357 // "WCAP"
+#define CAPTURE_PARTITION_SUBTYPE 0x40
+
+#define CAPTURE_REC_DEFLATE BIT0 // 数据为独立的 zlib 流
+#define CAPTURE_REC_OVERRUN BIT1 // 本记录之前有数据因积压被覆盖而未记录
+
+/* 单条记录存储的最大长度与解压后的最大长度 */
+#define CAPTURE_REC_DATA 1024
+#define CAPTURE_REC_RAW_MAX 4096
+
+/**
+ * @brief 扇区头，位于每个 4KB 扇区开头，其后依次存放记录
+ *
+ * 扇区按 seq 递增循环写入整个分区，每个扇区每轮只擦除一次，磨损自然均衡。
+ * unix_us 为扇区内第一条记录的时间，按 seq 顺序单调递增，查找时间范围时对扇区头二分查找。
+ */
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint16_t boot; // 打开该扇区时的启动序号
+    uint16_t reserved;
+    int64_t unix_us; // 未校时为 0
+    uint32_t crc;    // 以上字段的 CRC32
+} capture_sector_t;
+
+/**
+ * @brief 记录头，其后紧跟 len 字节数据，按 4 字节对齐存放；len 为 0xFFFF 表示扇区剩余部分未写入
+ */
+typedef struct __attribute__((packed))
+{
+    uint16_t len;     // 存储的数据长度
+    uint16_t raw_len; // 解压后的长度
+    uint8_t flags;    // CAPTURE_REC_*
+    uint8_t reserved;
+    uint16_t boot;   // 记录时的启动序号，time_us 只在同一次启动内可比较
+    uint32_t offset; // 首字节在串口数据流中的位置，按 32 位回绕
+    int64_t time_us; // 首字节的接收时间，自启动以来
+    int64_t unix_us; // 同一时刻的 Unix 时间，未校时为 0
+    uint32_t crc;    // 以上字段（crc 置 0）与数据的 CRC32
+} capture_record_t;
+
+typedef struct
+{
+    uint32_t records;
+    uint32_t raw_bytes;    // 记录的串口数据
+    uint32_t stored_bytes; // 写入 flash 的数据，不含记录头
+    uint32_t dropped;      // 来不及记录而被覆盖的字节数
+    uint32_t write_errors;
+    uint32_t sectors;      // 分区扇区总数
+    uint32_t used_sectors; // 有效扇区数
+    uint16_t boot;
+} capture_stats_t;
+
+/**
+ * @brief 遍历记录的位置，含一条记录的读取缓冲区，较大，不宜放在栈上
+ */
+typedef struct
+{
+    uint32_t sector; // 物理扇区号
+    uint32_t seq;    // 该扇区的序号，用于发现遍历期间被覆盖的扇区
+    uint32_t off;    // 下一条记录在扇区内的偏移
+    uint32_t left;   // 包括当前扇区在内尚未遍历的扇区数
+    uint8_t data[CAPTURE_REC_DATA];
+} capture_iter_t;
+
+/**
+ * @brief 查找 capture 分区，恢复写入位置并启动写入任务，需要在 telnet_init 之前调用
+ *
+ * @return esp_err_t 未启用或没有 capture 分区时返回 ESP_ERR_NOT_SUPPORTED
+ */
+esp_err_t capture_init();
+
+/**
+ * @brief 从环形缓冲区取出新数据组成记录，交给写入任务，只在 telnet_srv 任务中调用
+ *
+ * 写 flash 在单独的任务中进行，写入任务忙时数据留在环形缓冲区中，不会阻塞转发
+ *
+ * @return int64_t 大于 0 为下次需要检查的微秒数，小于 0 表示没有积压或未启用
+ */
+int64_t capture_poll(int64_t now);
+
+void capture_get_stats(capture_stats_t *stats);
+
+/**
+ * @brief 定位到可能包含 from_unix_us 之后数据的第一个扇区
+ *
+ * @param from_unix_us 为 0 时从最早的记录开始
+ * @return esp_err_t 没有记录时返回 ESP_ERR_NOT_FOUND
+ */
+esp_err_t capture_iter_init(capture_iter_t *it, int64_t from_unix_us);
+
+/**
+ * @brief 读取下一条记录并解压
+ *
+ * @param raw 至少 CAPTURE_REC_RAW_MAX 字节
+ * @return int 数据长度，0 表示已遍历完，损坏的记录与遍历期间被覆盖的扇区会被跳过
+ */
+int capture_iter_next(capture_iter_t *it, capture_record_t *rec, uint8_t *raw);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,169 +1,409 @@
 #include "config.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_system.h"
 #include "events/events.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "nvs.h"
+#include "sdkconfig.h"
 #include <string.h>
 
-int conf_get_dev_name(char *name, size_t len)
+#define TAG "config"
+
+#define CONF_NAMESPACE "storage"
+#define CONF_DEV_NAME_MAX 20
+#define CONF_DEV_NAME_DEFAULT "DEVICE"
+#define CONF_COMMIT_STACK 3072
+
+/* NVS 中的键名，按 conf_key_t 排列 */
+static const char *const conf_nvs_keys[CONF_KEY_MAX] = {
+    [CONF_KEY_DEV_NAME] = "dev_name",
+    [CONF_KEY_UART] = "uart_conf",
+    [CONF_KEY_WIFI_SSID] = "wifi_ssid",
+    [CONF_KEY_WIFI_PASSWD] = "wifi_passwd",
+};
+
+/* 字符串以 0 填满整个数组，变更检测直接比较整个字段 */
+typedef struct
 {
-    if (len < 20)
+    char dev_name[CONF_DEV_NAME_MAX + 1];
+    uart_config_t uart;
+    char wifi_ssid[33];
+    char wifi_passwd[65];
+} conf_values_t;
+
+static conf_values_t conf;
+static uint32_t conf_present; // NVS 中存在或已被设置的配置项
+static uint32_t conf_dirty;   // 已变更但尚未提交的配置项
+static conf_stats_t conf_stats;
+
+static SemaphoreHandle_t conf_mutex;  // 保护以上状态，只在复制数据时持有
+static SemaphoreHandle_t commit_mutex; // 串行化提交，避免旧的快照覆盖新的
+/* 写 flash 与 NVS 页面回收可能持续数十毫秒，在独立的低优先级任务中提交，不占用 esp_timer 任务 */
+static TaskHandle_t commit_task;
+
+static void conf_lock()
+{
+    xSemaphoreTake(conf_mutex, portMAX_DELAY);
+}
+
+static void conf_unlock()
+{
+    xSemaphoreGive(conf_mutex);
+}
+
+static void *conf_field(conf_values_t *values, conf_key_t key, size_t *size)
+{
+    switch (key)
     {
-        return ESP_ERR_INVALID_ARG;
+    case CONF_KEY_DEV_NAME:
+        *size = sizeof(values->dev_name);
+        return values->dev_name;
+    case CONF_KEY_UART:
+        *size = sizeof(values->uart);
+        return &values->uart;
+    case CONF_KEY_WIFI_SSID:
+        *size = sizeof(values->wifi_ssid);
+        return values->wifi_ssid;
+    case CONF_KEY_WIFI_PASSWD:
+        *size = sizeof(values->wifi_passwd);
+        return values->wifi_passwd;
+    default:
+        *size = 0;
+        return NULL;
     }
-    nvs_handle_t nvs_handle = 0;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+}
+
+static void conf_set_defaults(conf_values_t *values)
+{
+    memset(values, 0, sizeof(*values));
+    strcpy(values->dev_name, CONF_DEV_NAME_DEFAULT);
+    values->uart.baud_rate = 115200;
+    values->uart.data_bits = UART_DATA_8_BITS;
+    values->uart.stop_bits = UART_STOP_BITS_1;
+    values->uart.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+    values->uart.parity = UART_PARITY_DISABLE;
+    values->uart.source_clk = UART_SCLK_DEFAULT;
+    values->uart.rx_flow_ctrl_thresh = 122;
+}
+
+static esp_err_t conf_load(nvs_handle_t nvs_handle, conf_key_t key)
+{
+    size_t size;
+    void *field = conf_field(&conf, key, &size);
+    uint8_t buf[sizeof(conf_values_t)] = {};
+    size_t len = size;
+    esp_err_t err = key == CONF_KEY_UART ? nvs_get_blob(nvs_handle, conf_nvs_keys[key], buf, &len)
+                                         : nvs_get_str(nvs_handle, conf_nvs_keys[key], (char *)buf, &len);
+    if (err == ESP_OK && key == CONF_KEY_UART && len != size)
+        err = ESP_ERR_NVS_INVALID_LENGTH;
     if (err != ESP_OK)
     {
-        ESP_LOGE("NVS", "NVS open field %s", esp_err_to_name(err));
+        if (err != ESP_ERR_NVS_NOT_FOUND)
+            ESP_LOGW(TAG, "load %s failed %s, use default", conf_nvs_keys[key], esp_err_to_name(err));
         return err;
     }
-
-    size_t _len = len;
-    err = nvs_get_str(nvs_handle, "dev_name", name, &_len);
-    if (err == ESP_ERR_NVS_NOT_FOUND)
-    {
-        strcpy(name, "DEVICE");
-        err = nvs_set_str(nvs_handle, "dev_name", name);
-        if (err != ESP_OK)
-        {
-            ESP_LOGE("NVS", "NVS set dev_name default config field %s", esp_err_to_name(err));
-        }
-    }
-    nvs_close(nvs_handle);
-    return err;
+    memcpy(field, buf, size);
+    conf_present |= 1 << key;
+    return ESP_OK;
 }
 
-int conf_set_dev_name(const char *name)
+/**
+ * @brief 把快照中的脏配置写入 NVS，全部成功后统一 nvs_commit
+ */
+static esp_err_t conf_write(const conf_values_t *values, uint32_t dirty)
 {
-    if (strlen(name) > 20)
-        return ESP_ERR_INVALID_SIZE;
-
     nvs_handle_t nvs_handle = 0;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+    esp_err_t err = nvs_open(CONF_NAMESPACE, NVS_READWRITE, &nvs_handle);
     if (err != ESP_OK)
     {
-        ESP_LOGE("NVS", "NVS open field %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "NVS open field %s", esp_err_to_name(err));
         return err;
     }
-
-    char old_name[32];
-    size_t len = sizeof(old_name);
-    err = nvs_get_str(nvs_handle, "dev_name", old_name, &len);
-    if (err == ESP_OK && len > 0)
+    uint32_t written = 0;
+    for (int key = 0; key < CONF_KEY_MAX && err == ESP_OK; key++)
     {
-        if (strcmp(old_name, name) != 0)
-        {
-            err = nvs_set_str(nvs_handle, "dev_name", name);
-            if (err == ESP_OK)
-                app_event_post(APP_EVENT_DEV_NAME_CHANGED, NULL, 0, portMAX_DELAY);
-        }
+        if (!(dirty & (1 << key)))
+            continue;
+        size_t size;
+        const void *field = conf_field((conf_values_t *)values, key, &size);
+        err = key == CONF_KEY_UART ? nvs_set_blob(nvs_handle, conf_nvs_keys[key], field, size)
+                                   : nvs_set_str(nvs_handle, conf_nvs_keys[key], field);
+        if (err != ESP_OK)
+            ESP_LOGE(TAG, "NVS set %s field %s", conf_nvs_keys[key], esp_err_to_name(err));
+        else
+            written++;
     }
-
+    if (err == ESP_OK)
+        err = nvs_commit(nvs_handle);
     nvs_close(nvs_handle);
+
+    conf_lock();
+    conf_stats.keys_written += written;
+    if (err == ESP_OK)
+        conf_stats.commits++;
+    else
+        conf_stats.errors++;
+    conf_unlock();
     return err;
 }
 
-int conf_get_uart_param(uart_config_t *uart_config)
+esp_err_t conf_flush(void)
 {
-    nvs_handle_t nvs_handle = 0;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK)
-    {
-        ESP_LOGE("NVS", "NVS open field %s", esp_err_to_name(err));
-        return err;
-    }
-    size_t length = sizeof(uart_config_t);
-    err = nvs_get_blob(nvs_handle, "uart_conf", uart_config, &length);
-    if (err != ESP_OK || length != sizeof(uart_config_t))
+    if (conf_mutex == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(commit_mutex, portMAX_DELAY);
+    conf_values_t snapshot;
+    conf_lock();
+    uint32_t dirty = conf_dirty;
+    snapshot = conf;
+    conf_dirty = 0;
+    conf_unlock();
+
+    esp_err_t err = ESP_OK;
+    if (dirty)
     {
-        uart_config->baud_rate = 115200;
-        uart_config->data_bits = UART_DATA_8_BITS;
-        uart_config->stop_bits = UART_STOP_BITS_1;
-        uart_config->flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
-        uart_config->parity = UART_PARITY_DISABLE;
-        uart_config->source_clk = UART_SCLK_DEFAULT;
-        uart_config->rx_flow_ctrl_thresh = 122;
-        err = nvs_set_blob(nvs_handle, "uart_conf", uart_config, sizeof(uart_config_t));
+        err = conf_write(&snapshot, dirty);
         if (err != ESP_OK)
         {
-            ESP_LOGE("NVS", "NVS set uart default config field %s", esp_err_to_name(err));
+            /* 全部重新标记，之后的变更或 conf_flush 会再次提交 */
+            conf_lock();
+            conf_dirty |= dirty;
+            conf_unlock();
         }
     }
-    nvs_close(nvs_handle);
+    xSemaphoreGive(commit_mutex);
     return err;
 }
 
-int conf_set_uart_param(uart_config_t *uart_config)
+static void conf_commit_task(void *arg)
 {
-    nvs_handle_t nvs_handle = 0;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK)
+    while (1)
     {
-        ESP_LOGE("NVS", "NVS open field %s", esp_err_to_name(err));
-        return err;
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        /* 连续的变更（如先后设置 SSID 与密码）合并为一次提交，每次变更重新计时 */
+        while (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_BRIDGE_CONF_COMMIT_DELAY_MS)))
+            ;
+        conf_flush();
     }
-    err = nvs_set_blob(nvs_handle, "uart_conf", &uart_config, sizeof(uart_config_t));
-    nvs_close(nvs_handle);
-    return err;
 }
 
-int conf_set_wifi_ssid(const char *ssid)
+static void conf_shutdown_handler(void)
+{
+    conf_flush();
+}
+
+esp_err_t conf_init(void)
 {
+    static StaticSemaphore_t conf_mutex_buf, commit_mutex_buf;
+    conf_mutex = xSemaphoreCreateMutexStatic(&conf_mutex_buf);
+    commit_mutex = xSemaphoreCreateMutexStatic(&commit_mutex_buf);
+
+    if (xTaskCreate(conf_commit_task, "conf_commit", CONF_COMMIT_STACK, NULL, tskIDLE_PRIORITY, &commit_task) !=
+        pdPASS)
+    {
+        /* 变更留在缓存中，关机前由 conf_shutdown_handler 写入 */
+        ESP_LOGE(TAG, "xTaskCreate conf_commit failed");
+    }
+    esp_register_shutdown_handler(conf_shutdown_handler);
+
+    conf_set_defaults(&conf);
     nvs_handle_t nvs_handle = 0;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+    esp_err_t err = nvs_open(CONF_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+        return ESP_OK; // 首次启动，命名空间在第一次提交时创建
     if (err != ESP_OK)
     {
-        ESP_LOGE("NVS", "NVS open field %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "NVS open field %s", esp_err_to_name(err));
         return err;
     }
-    err = nvs_set_str(nvs_handle, "wifi_ssid", ssid);
+    for (int key = 0; key < CONF_KEY_MAX; key++)
+        conf_load(nvs_handle, key);
     nvs_close(nvs_handle);
-    return err;
+    return ESP_OK;
 }
 
-int conf_get_wifi_ssid(char *ssid, size_t len)
+void conf_get_stats(conf_stats_t *stats)
 {
-    nvs_handle_t nvs_handle = 0;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK)
+    if (conf_mutex == NULL)
     {
-        ESP_LOGE("NVS", "NVS open field %s", esp_err_to_name(err));
-        return err;
+        memset(stats, 0, sizeof(*stats));
+        return;
     }
+    conf_lock();
+    *stats = conf_stats;
+    conf_unlock();
+}
 
-    size_t _len = len;
-    err = nvs_get_str(nvs_handle, "wifi_ssid", ssid, &_len);
-    nvs_close(nvs_handle);
+/**
+ * @brief 更新缓存，取值相同时不做任何事，否则标记为脏、推迟提交并发布变更事件
+ */
+static esp_err_t conf_update(conf_key_t key, const void *value)
+{
+    if (conf_mutex == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    size_t size;
+    conf_lock();
+    void *field = conf_field(&conf, key, &size);
+    if ((conf_present & (1 << key)) && memcmp(field, value, size) == 0)
+    {
+        conf_stats.unchanged++;
+        conf_unlock();
+        return ESP_OK;
+    }
+    memcpy(field, value, size);
+    conf_present |= 1 << key;
+    conf_dirty |= 1 << key;
+    conf_unlock();
+
+    if (commit_task)
+        xTaskNotifyGive(commit_task);
+
+    /* 可能在事件循环任务中调用，不能等待 */
+    if (app_event_post(APP_EVENT_CONF_CHANGED, &key, sizeof(key), 0) != ESP_OK)
+        ESP_LOGW(TAG, "post conf changed event failed");
+    return ESP_OK;
+}
+
+/**
+ * @brief 读取字符串配置，缓冲区不足时与 nvs_get_str 一样返回 ESP_ERR_NVS_INVALID_LENGTH
+ */
+static esp_err_t conf_get_str(conf_key_t key, char *out, size_t len)
+{
+    if (conf_mutex == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    size_t size;
+    esp_err_t err = ESP_OK;
+    conf_lock();
+    const char *field = conf_field(&conf, key, &size);
+    if (key != CONF_KEY_DEV_NAME && !(conf_present & (1 << key)))
+        err = ESP_ERR_NVS_NOT_FOUND;
+    else if (strlen(field) + 1 > len)
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    else
+        strcpy(out, field);
+    conf_unlock();
     return err;
 }
 
+static esp_err_t conf_set_str(conf_key_t key, const char *value, size_t size)
+{
+    char buf[sizeof(conf_values_t)] = {};
+    size_t len = strnlen(value, size);
+    if (len >= size)
+        return ESP_ERR_INVALID_SIZE;
+    memcpy(buf, value, len);
+    return conf_update(key, buf);
+}
+
+int conf_get_dev_name(char *name, size_t len)
+{
+    if (len < 20)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return conf_get_str(CONF_KEY_DEV_NAME, name, len);
+}
+
+int conf_set_dev_name(const char *name)
+{
+    return conf_set_str(CONF_KEY_DEV_NAME, name, sizeof(conf.dev_name));
+}
+
+int conf_get_uart_param(uart_config_t *uart_config)
+{
+    if (conf_mutex == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    conf_lock();
+    *uart_config = conf.uart;
+    conf_unlock();
+    return ESP_OK;
+}
+
+int conf_set_uart_param(uart_config_t *uart_config)
+{
+    /* 按字节比较，先清零以免结构体填充导致误判 */
+    uart_config_t value;
+    memset(&value, 0, sizeof(value));
+    value.baud_rate = uart_config->baud_rate;
+    value.data_bits = uart_config->data_bits;
+    value.parity = uart_config->parity;
+    value.stop_bits = uart_config->stop_bits;
+    value.flow_ctrl = uart_config->flow_ctrl;
+    value.rx_flow_ctrl_thresh = uart_config->rx_flow_ctrl_thresh;
+    value.source_clk = uart_config->source_clk;
+    return conf_update(CONF_KEY_UART, &value);
+}
+
+int conf_set_wifi_ssid(const char *ssid)
+{
+    return conf_set_str(CONF_KEY_WIFI_SSID, ssid, sizeof(conf.wifi_ssid));
+}
+
+int conf_get_wifi_ssid(char *ssid, size_t len)
+{
+    return conf_get_str(CONF_KEY_WIFI_SSID, ssid, len);
+}
+
 int conf_set_wifi_passwd(const char *passwd)
+{
+    return conf_set_str(CONF_KEY_WIFI_PASSWD, passwd, sizeof(conf.wifi_passwd));
+}
+
+int conf_get_wifi_passwd(char *passwd, size_t len)
+{
+    return conf_get_str(CONF_KEY_WIFI_PASSWD, passwd, len);
+}
+
+int conf_get_tls_cred(uint8_t *key, size_t *key_len, uint8_t *cert, size_t *cert_len)
 {
     nvs_handle_t nvs_handle = 0;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+    esp_err_t err = nvs_open(CONF_NAMESPACE, NVS_READONLY, &nvs_handle);
     if (err != ESP_OK)
-    {
-        ESP_LOGE("NVS", "NVS open field %s", esp_err_to_name(err));
         return err;
-    }
-    err = nvs_set_str(nvs_handle, "wifi_passwd", passwd);
+
+    err = nvs_get_blob(nvs_handle, "tls_key", key, key_len);
+    if (err == ESP_OK)
+        err = nvs_get_blob(nvs_handle, "tls_cert", cert, cert_len);
     nvs_close(nvs_handle);
     return err;
 }
 
-int conf_get_wifi_passwd(char *passwd, size_t len)
+int conf_set_tls_cred(const uint8_t *key, size_t key_len, const uint8_t *cert, size_t cert_len)
 {
     nvs_handle_t nvs_handle = 0;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
+    esp_err_t err = nvs_open(CONF_NAMESPACE, NVS_READWRITE, &nvs_handle);
     if (err != ESP_OK)
     {
-        ESP_LOGE("NVS", "NVS open field %s", esp_err_to_name(err));
+        ESP_LOGE(TAG, "NVS open field %s", esp_err_to_name(err));
         return err;
     }
-
-    size_t _len = len;
-    err = nvs_get_str(nvs_handle, "wifi_passwd", passwd, &_len);
+    err = nvs_set_blob(nvs_handle, "tls_key", key, key_len);
+    if (err == ESP_OK)
+        err = nvs_set_blob(nvs_handle, "tls_cert", cert, cert_len);
+    if (err == ESP_OK)
+        err = nvs_commit(nvs_handle);
     nvs_close(nvs_handle);
+
+    if (conf_mutex)
+    {
+        conf_lock();
+        if (err == ESP_OK)
+        {
+            conf_stats.commits++;
+            conf_stats.keys_written += 2;
+        }
+        else
+        {
+            conf_stats.errors++;
+        }
+        conf_unlock();
+    }
     return err;
 }
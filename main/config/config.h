@@ -1,12 +1,47 @@
 #pragma once
 
+#include "esp_err.h"
 #include "hal/uart_types.h"
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* 缓存在内存中的配置项，变更时作为 APP_EVENT_CONF_CHANGED 的事件数据 */
+typedef enum
+{
+    CONF_KEY_DEV_NAME,
+    CONF_KEY_UART,
+    CONF_KEY_WIFI_SSID,
+    CONF_KEY_WIFI_PASSWD,
+    CONF_KEY_MAX,
+} conf_key_t;
+
+typedef struct
+{
+    uint32_t commits;      // NVS 提交次数，每次批量写入全部脏配置
+    uint32_t keys_written; // 写入 NVS 的配置项数，包括 TLS 凭据
+    uint32_t unchanged;    // 因取值未变而省去的写入
+    uint32_t errors;       // 失败的提交，脏配置保留到下次提交
+} conf_stats_t;
+
+/**
+ * @brief 从 NVS 一次性读入全部配置，须在 nvs_flash_init 之后、其他模块之前调用
+ *
+ * 之后的 conf_get_* 均从内存读取，conf_set_* 只在取值变化时标记为脏，
+ * 并在 CONFIG_BRIDGE_CONF_COMMIT_DELAY_MS 内无新变更后合并为一次 NVS 事务写入
+ */
+esp_err_t conf_init(void);
+
+/**
+ * @brief 立即写入尚未提交的配置，重启与关机前调用
+ */
+esp_err_t conf_flush(void);
+
+void conf_get_stats(conf_stats_t *stats);
+
 int conf_get_dev_name(char *name, size_t len);
 int conf_set_dev_name(const char *name);
 
@@ -19,6 +54,10 @@ int conf_get_wifi_ssid(char *ssid, size_t len);
 int conf_set_wifi_passwd(const char *passwd);
 int conf_get_wifi_passwd(char *passwd, size_t len);
 
+/* TLS 服务器私钥与证书，均为 DER 格式，len 输入缓冲区大小，输出实际长度，不经过缓存 */
+int conf_get_tls_cred(uint8_t *key, size_t *key_len, uint8_t *cert, size_t *cert_len);
+int conf_set_tls_cred(const uint8_t *key, size_t key_len, const uint8_t *cert, size_t cert_len);
+
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
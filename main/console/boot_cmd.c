@@ -0,0 +1,83 @@
+#include "boot/boot_prof.h"
+#include "console.h"
+#include "esp_console.h"
+#include "esp_timer.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BOOT_BAR_WIDTH 40
+
+static void boot_print_bar(int64_t start, int64_t end, int64_t span)
+{
+    char bar[BOOT_BAR_WIDTH + 1];
+    int from = start * BOOT_BAR_WIDTH / span;
+    int to = end * BOOT_BAR_WIDTH / span;
+    if (to >= BOOT_BAR_WIDTH)
+        to = BOOT_BAR_WIDTH - 1;
+    for (int i = 0; i < BOOT_BAR_WIDTH; i++)
+        bar[i] = i >= from && i <= to ? '#' : ' ';
+    bar[BOOT_BAR_WIDTH] = '\0';
+    console_printf(" |%s|\n", bar);
+}
+
+static int boot_cmd_cb(int argc, char **argv)
+{
+    boot_prof_stage_t *stages = malloc(BOOT_PROF_STAGES * sizeof(boot_prof_stage_t));
+    if (stages == NULL)
+        return ESP_ERR_NO_MEM;
+    int n = boot_prof_get_stages(stages, BOOT_PROF_STAGES);
+
+    /* 时间轴覆盖全部阶段与里程碑，未结束的阶段画到当前时间 */
+    int64_t now = esp_timer_get_time();
+    int64_t span = 1;
+    for (int i = 0; i < n; i++)
+    {
+        int64_t end = stages[i].end_us ? stages[i].end_us : now;
+        if (end > span)
+            span = end;
+    }
+    for (int m = 0; m < BOOT_MILESTONE_MAX; m++)
+    {
+        if (boot_prof_milestone_time(m) > span)
+            span = boot_prof_milestone_time(m);
+    }
+
+    console_printf("boot timeline, ms since esp_timer start (ROM and bootloader not included):\n");
+    console_printf("  %-10s %-12s %6s %6s  0%*" PRId32 "\n", "stage", "task", "start", "time", BOOT_BAR_WIDTH,
+                   (int32_t)(span / 1000));
+    for (int i = 0; i < n; i++)
+    {
+        const boot_prof_stage_t *s = &stages[i];
+        int64_t end = s->end_us ? s->end_us : now;
+        console_printf("  %-10s %-12s %6" PRId32, s->name, s->task, (int32_t)(s->start_us / 1000));
+        if (s->end_us)
+            console_printf(" %6" PRId32, (int32_t)((s->end_us - s->start_us) / 1000));
+        else
+            console_printf(" %6s", "-");
+        boot_print_bar(s->start_us, end, span);
+    }
+    free(stages);
+
+    for (int m = 0; m < BOOT_MILESTONE_MAX; m++)
+    {
+        int64_t t = boot_prof_milestone_time(m);
+        if (t)
+            console_printf("  %-23s %6" PRId32 "\n", boot_prof_milestone_name(m), (int32_t)(t / 1000));
+        else
+            console_printf("  %-23s %6s\n", boot_prof_milestone_name(m), "-");
+    }
+    return ESP_OK;
+}
+
+void register_boot_cmd()
+{
+    const esp_console_cmd_t cmd = {
+        .command = "boot",
+        .help = "显示启动各阶段的时间线，以及首个串口字节、获得 IP、首个客户端与首次转发的时间",
+        .hint = NULL,
+        .func = boot_cmd_cb,
+    };
+
+    esp_console_cmd_register(&cmd);
+}
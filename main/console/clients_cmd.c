@@ -0,0 +1,98 @@
+#include "console.h"
+#include "capture/capture.h"
+#include "esp_console.h"
+#include "log/log_ring.h"
+#include "sdkconfig.h"
+#include "telnet/telnet_server.h"
+#include "timesync/timesync.h"
+#include <inttypes.h>
+#include <stdlib.h>
+
+static int clients_cmd_cb(int argc, char **argv)
+{
+    /* 连接数受 socket 数量限制 */
+    telnet_client_stats_t *stats = calloc(CONFIG_LWIP_MAX_SOCKETS, sizeof(telnet_client_stats_t));
+    if (stats == NULL)
+        return ESP_ERR_NO_MEM;
+
+    telnet_core_stats_t core;
+    int n = telnet_get_client_stats(stats, CONFIG_LWIP_MAX_SOCKETS, &core);
+    if (n == 0)
+    {
+        console_printf("没有已连接的客户端\n");
+    }
+    for (int i = 0; i < n; i++)
+    {
+        console_printf("%d %s lag: %" PRIu32 " overruns: %" PRIu32 " dropped: %" PRIu32 "%s\n", stats[i].fd,
+                       stats[i].ip_str, stats[i].lag, stats[i].overruns, stats[i].dropped,
+                       stats[i].timestamps ? " timestamps" : "");
+        if (stats[i].mccp_out)
+        {
+            console_printf("  mccp in: %" PRIu32 " out: %" PRIu32 " ratio: %.2f cpu: %" PRIu32 " cycles/KB (%" PRIu32
+                           "us/KB)\n",
+                           stats[i].mccp_in, stats[i].mccp_out, (double)stats[i].mccp_in / stats[i].mccp_out,
+                           stats[i].mccp_cycles_per_kb, stats[i].mccp_cycles_per_kb / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+        }
+    }
+    if (core.latency_count)
+    {
+        console_printf("wake to send: min %" PRIu32 "us avg %" PRIu32 "us max %" PRIu32 "us (%" PRIu32 ")\n",
+                       core.latency_min_us, core.latency_avg_us, core.latency_max_us, core.latency_count);
+    }
+    console_printf("uart fifo_ovf: %" PRIu32 " buffer_full: %" PRIu32 " parity: %" PRIu32 " frame: %" PRIu32
+                   " break: %" PRIu32 "\n",
+                   core.uart_events[UART_FIFO_OVF], core.uart_events[UART_BUFFER_FULL],
+                   core.uart_events[UART_PARITY_ERR], core.uart_events[UART_FRAME_ERR], core.uart_events[UART_BREAK]);
+    console_printf("time: %s\n", timesync_synced() ? "synced" : "since boot");
+    console_printf("flow rx_pauses: %" PRIu32 " tx_pauses: %" PRIu32 "\n", core.rx_pauses, core.tx_pauses);
+    if (core.udp.datagrams || core.udp.errors)
+    {
+        console_printf("udp datagrams: %" PRIu32 " bytes: %" PRIu32 " errors: %" PRIu32 " dropped: %" PRIu32 "\n",
+                       core.udp.datagrams, core.udp.bytes, core.udp.errors, core.udp.dropped);
+    }
+    if (core.tls.clients || core.tls.handshakes || core.tls.resumed || core.tls.failed)
+    {
+        console_printf("tls clients: %" PRIu32 " full: %" PRIu32 " (avg %" PRIu32 "ms) resumed: %" PRIu32
+                       " (avg %" PRIu32 "ms) failed: %" PRIu32 " sent: %" PRIu32 "\n",
+                       core.tls.clients, core.tls.handshakes, core.tls.handshake_avg_ms, core.tls.resumed,
+                       core.tls.resumed_avg_ms, core.tls.failed, core.tls.tx_bytes);
+    }
+#if CONFIG_BRIDGE_TLS_PORT
+    console_printf("tls sha256:");
+    for (int i = 0; i < sizeof(core.tls.fingerprint); i++)
+        console_printf("%c%02X", i ? ':' : ' ', core.tls.fingerprint[i]);
+    console_printf("\n");
+#endif
+    capture_stats_t cap;
+    capture_get_stats(&cap);
+    if (cap.sectors)
+    {
+        console_printf("capture sectors: %" PRIu32 "/%" PRIu32 " boot: %u records: %" PRIu32 " raw: %" PRIu32
+                       " stored: %" PRIu32 " dropped: %" PRIu32 " errors: %" PRIu32 "\n",
+                       cap.used_sectors, cap.sectors, cap.boot, cap.records, cap.raw_bytes, cap.stored_bytes,
+                       cap.dropped, cap.write_errors);
+    }
+    log_ring_stats_t lr;
+    log_ring_get_stats(&lr);
+    if (lr.capacity)
+    {
+        console_printf("log records: %" PRIu32 " lost: %" PRIu32 " direct: %" PRIu32 " pending: %" PRIu32
+                       "/%" PRIu32 "\n",
+                       lr.records, lr.lost, lr.direct, lr.pending, lr.capacity);
+    }
+    free(stats);
+    return ESP_OK;
+}
+
+void register_clients_cmd()
+{
+    const esp_console_cmd_t cmd = {
+        .command = "clients",
+        .help = "查看客户端积压与丢失统计",
+        .hint = NULL,
+        .func = clients_cmd_cb,
+        .argtable = NULL,
+    };
+
+    esp_console_cmd_register(&cmd);
+}
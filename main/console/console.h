@@ -8,10 +8,46 @@ extern "C" {
 #endif
 
 int console_repl_init();
+
+/**
+ * @brief 向当前任务注册的输出重定向打印
+ *
+ * 格式化在调用任务自己的缓冲区中完成，不持有全局锁。输出以行为单位成批写出，
+ * 不以换行结尾的内容留在缓冲区中，直到换行、缓冲区满或调用 console_flush()。
+ * 未注册重定向的任务的输出被丢弃。
+ */
 int console_printf(const char *fmt, ...);
+
+/**
+ * @brief 写出当前任务缓冲区中尚未写出的内容
+ */
+void console_flush(void);
+
+/**
+ * @brief 将任务中 console_printf 的输出重定向到 write，任务删除时自动注销
+ *
+ * @return 0 成功，-ESP_ERR_INVALID_STATE 任务已注册，-ESP_ERR_NO_MEM 内存不足
+ */
 int console_register_redirection(TaskHandle_t task_hdl, int (*write)(const char *, uint32_t));
+
+/**
+ * @brief 注销任务的输出重定向并写出剩余内容，须在该任务不再调用 console_printf 时调用
+ */
+int console_unregister_redirection(TaskHandle_t task_hdl);
+
+/**
+ * @brief 执行一条命令，返回前写出命令的全部输出
+ *
+ * 多个任务调用时依次执行，esp_console_run 与各命令的参数表都不可重入。
+ * USB REPL、网络与蓝牙控制台都只通过此函数执行命令，不直接调用 esp_console_run
+ */
 int console_run_command(const char *cmd);
 
+/**
+ * @brief 在 CONFIG_BRIDGE_CONSOLE_PORT 上接受 TCP 连接，逐行执行命令，每个连接一个任务
+ */
+int console_net_init();
+
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
@@ -5,16 +5,62 @@
 #include "driver/usb_serial_jtag.h"
 #include "esp_console.h"
 #include "esp_err.h"
+#include "esp_idf_version.h"
 #include "esp_log.h"
+#include "freertos/semphr.h"
 #include "hal/uart_types.h"
+#include "linenoise/linenoise.h"
+#include "log/log_ring.h"
 #include "nvs.h"
+#include "stats/stats.h"
 #include <assert.h>
+#include <fcntl.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-#define REDIRECTION_LIST_LEN 2
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+#include "driver/usb_serial_jtag_vfs.h"
+#define console_vfs_use_driver() usb_serial_jtag_vfs_use_driver()
+#define console_vfs_set_line_endings()                                                                                 \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        usb_serial_jtag_vfs_set_rx_line_endings(ESP_LINE_ENDINGS_CR);                                                  \
+        usb_serial_jtag_vfs_set_tx_line_endings(ESP_LINE_ENDINGS_CRLF);                                                \
+    } while (0)
+#else
+#include "esp_vfs_dev.h"
+#include "esp_vfs_usb_serial_jtag.h"
+#define console_vfs_use_driver() esp_vfs_usb_serial_jtag_use_driver()
+#define console_vfs_set_line_endings()                                                                                 \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        esp_vfs_dev_usb_serial_jtag_set_rx_line_endings(ESP_LINE_ENDINGS_CR);                                          \
+        esp_vfs_dev_usb_serial_jtag_set_tx_line_endings(ESP_LINE_ENDINGS_CRLF);                                        \
+    } while (0)
+#endif
+
+#if !CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+#error The console and its log output are written for the USB-Serial-JTAG console
+#endif
+
+/* 输出重定向记录在任务的线程本地存储中，索引 0 由 pthread 使用 */
+#define CONSOLE_TLS_INDEX 1
+#define CONSOLE_SINK_BUF  256 // 每个重定向任务的行缓冲
+#define CONSOLE_LINE_BUF  128 // 未重定向输出与日志在栈上格式化，超长时改用堆
+#define CONSOLE_CMDLINE_MAX 128
+#define CONSOLE_HISTORY_LEN 32
+#define CONSOLE_REPL_STACK 4096
+#define CONSOLE_REPL_PRIORITY 2
+#define CONSOLE_PROMPT "#"
+
+static const char *TAG = "console";
+
+_Static_assert(CONSOLE_TLS_INDEX < CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS,
+               "CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS too small for console redirection");
 
 void register_set_uart();
 void register_shutdown();
@@ -22,45 +68,180 @@ void register_set_name();
 void register_system();
 void register_battery_cmd();
 void register_ifconfig();
+void register_clients_cmd();
+void register_stats_cmd();
+void register_boot_cmd();
+
+typedef int (*console_write_t)(const char *, uint32_t);
 
 typedef struct
 {
-    esp_console_repl_t repl_core; // base class
-    char prompt[32];              // Prompt to be printed before each line
-    int state;
-    const char *history_save_path;
-    TaskHandle_t task_hdl;     // REPL task handle
-    size_t max_cmdline_length; // Maximum length of a command line. If 0, default value will be used.
-} esp_console_repl_com_t;
-
-static struct
-{
-    TaskHandle_t task_hdl;
-    int (*write)(const char *, uint32_t);
-} redirection_list[REDIRECTION_LIST_LEN];
+    console_write_t write;
+    size_t len;
+    char buf[CONSOLE_SINK_BUF];
+} console_sink_t;
 
 static int console_witre(const char *buf, uint32_t len)
 {
     return usb_serial_jtag_write_bytes(buf, len, 0);
 }
 
-static int console_log_output(const char *fmt, va_list ap)
+/* 格式化后直接写出，不经过任何缓冲或锁，可被多个任务同时调用 */
+static int console_direct_vprintf(console_write_t write, const char *fmt, va_list ap)
+{
+    char buf[CONSOLE_LINE_BUF];
+    va_list copy;
+    va_copy(copy, ap);
+    int num = vsnprintf(buf, sizeof(buf), fmt, copy);
+    va_end(copy);
+    if (num < 0)
+        return num;
+    if ((size_t)num < sizeof(buf))
+    {
+        write(buf, num);
+        return num;
+    }
+
+    char *big = malloc(num + 1);
+    if (big == NULL)
+    {
+        write(buf, sizeof(buf) - 1);
+        return num;
+    }
+    vsnprintf(big, num + 1, fmt, ap);
+    write(big, num);
+    free(big);
+    return num;
+}
+
+static void console_sink_flush(console_sink_t *sink)
+{
+    if (sink->len)
+    {
+        sink->write(sink->buf, sink->len);
+        sink->len = 0;
+    }
+}
+
+/* 缓冲区只属于注册的任务，无需加锁；以行为单位成批写出 */
+static int console_sink_vprintf(console_sink_t *sink, const char *fmt, va_list ap)
 {
-    static char buf[512];
-    int num = vsnprintf(buf, sizeof(buf), fmt, ap);
-    console_witre(buf, num);
+    size_t space = sizeof(sink->buf) - sink->len;
+    va_list copy;
+    va_copy(copy, ap);
+    int num = vsnprintf(sink->buf + sink->len, space, fmt, copy);
+    va_end(copy);
+    if (num <= 0)
+        return num;
+    if ((size_t)num >= space)
+    {
+        /* 放不下时先写出已缓冲的内容，整个缓冲区也放不下的输出直接写出 */
+        console_sink_flush(sink);
+        if ((size_t)num >= sizeof(sink->buf))
+            return console_direct_vprintf(sink->write, fmt, ap);
+        vsnprintf(sink->buf, sizeof(sink->buf), fmt, ap);
+    }
+    sink->len += num;
+    if (sink->buf[sink->len - 1] == '\n')
+        console_sink_flush(sink);
     return num;
 }
 
+static void console_sink_delete(int index, void *sink)
+{
+    stats_mem_free(STATS_MEM_CONSOLE, sink);
+    free(sink);
+}
+
+static int console_log_output(const char *fmt, va_list ap)
+{
+    /* 优先交给输出任务格式化，无法延后的直接输出 */
+    int num = log_ring_vprintf(fmt, ap);
+    if (num >= 0)
+        return num;
+    return console_direct_vprintf(console_witre, fmt, ap);
+}
+
+/* esp_console_run 与各命令的参数表都不可重入，REPL、网络与蓝牙控制台都经过 console_run_command 取得此锁 */
+static SemaphoreHandle_t command_lock;
+
+/**
+ * @brief USB REPL 任务，命令经 console_run_command 执行，与网络与蓝牙控制台互斥
+ *
+ * 不使用 esp_console_new_repl_*，其任务直接调用不可重入的 esp_console_run
+ */
+static void console_repl_task(void *arg)
+{
+    console_register_redirection(xTaskGetCurrentTaskHandle(), console_witre);
+
+    /* 终端不响应光标位置查询时（如串口日志工具）退回哑模式，不输出转义序列 */
+    const char *prompt = LOG_COLOR_I CONSOLE_PROMPT " " LOG_RESET_COLOR;
+    if (linenoiseProbe() != 0)
+    {
+        linenoiseSetDumbMode(1);
+        prompt = CONSOLE_PROMPT " ";
+        printf("\r\nYour terminal does not support escape sequences, line editing and history are disabled.\r\n");
+    }
+    printf("\r\nType 'help' to get the list of commands.\r\n");
+    while (1)
+    {
+        char *line = linenoise(prompt);
+        if (line == NULL)
+            continue;
+        if (line[0])
+        {
+            linenoiseHistoryAdd(line);
+            console_run_command(line);
+        }
+        linenoiseFree(line);
+    }
+}
+
+/**
+ * @brief 以公开接口初始化 USB-Serial-JTAG 驱动、VFS 与 linenoise，与 esp_console_new_repl_usb_serial_jtag 的步骤相同
+ */
+static esp_err_t console_usb_init()
+{
+    setvbuf(stdin, NULL, _IONBF, 0);
+    /* 终端回车只发送 CR，输出的 '\n' 需要转为 CRLF */
+    console_vfs_set_line_endings();
+    fcntl(fileno(stdout), F_SETFL, 0);
+    fcntl(fileno(stdin), F_SETFL, 0);
+
+    usb_serial_jtag_driver_config_t usb_config = USB_SERIAL_JTAG_DRIVER_CONFIG_DEFAULT();
+    esp_err_t err = usb_serial_jtag_driver_install(&usb_config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "usb_serial_jtag_driver_install failed %s", esp_err_to_name(err));
+        return err;
+    }
+    /* 驱动安装后 stdin/stdout 改为中断驱动的阻塞读写 */
+    console_vfs_use_driver();
+
+    esp_console_config_t console_config = ESP_CONSOLE_CONFIG_DEFAULT();
+    console_config.max_cmdline_length = CONSOLE_CMDLINE_MAX;
+#if CONFIG_LOG_COLORS
+    console_config.hint_color = atoi(LOG_COLOR_CYAN);
+#endif
+    err = esp_console_init(&console_config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_console_init failed %s", esp_err_to_name(err));
+        return err;
+    }
+    linenoiseSetMultiLine(1);
+    linenoiseSetCompletionCallback(&esp_console_get_completion);
+    linenoiseSetHintsCallback((linenoiseHintsCallback *)&esp_console_get_hint);
+    linenoiseHistorySetMaxLen(CONSOLE_HISTORY_LEN);
+    linenoiseSetMaxLineLen(CONSOLE_CMDLINE_MAX);
+    return ESP_OK;
+}
+
 int console_repl_init()
 {
-    esp_console_repl_t *repl = NULL;
-    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
-    /* Prompt to be printed before each line.
-     * This can be customized, made dynamic, etc.
-     */
-    repl_config.prompt = "#";
-    repl_config.max_cmdline_length = 128;
+    command_lock = xSemaphoreCreateMutex();
+    if (console_usb_init() != ESP_OK)
+        return ESP_FAIL;
 
     esp_console_register_help_command();
     register_set_uart();
@@ -69,74 +250,90 @@ int console_repl_init()
     register_system();
     register_battery_cmd();
     register_ifconfig();
+    register_clients_cmd();
+    register_stats_cmd();
+    register_boot_cmd();
 
-#if defined(CONFIG_ESP_CONSOLE_UART_DEFAULT) || defined(CONFIG_ESP_CONSOLE_UART_CUSTOM)
-    esp_console_dev_uart_config_t hw_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_console_new_repl_uart(&hw_config, &repl_config, &repl));
-#elif defined(CONFIG_ESP_CONSOLE_USB_CDC)
-    esp_console_dev_usb_cdc_config_t hw_config = ESP_CONSOLE_DEV_CDC_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_console_new_repl_usb_cdc(&hw_config, &repl_config, &repl));
-#elif defined(CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG)
-    esp_console_dev_usb_serial_jtag_config_t hw_config = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_console_new_repl_usb_serial_jtag(&hw_config, &repl_config, &repl));
     /* 重设日志输出接口为非阻塞型 */
+    log_ring_init(console_witre);
     esp_log_set_vprintf(console_log_output);
-#else
-#error Unsupported console type
-#endif
-    esp_console_repl_com_t *repl_com = __containerof(repl, esp_console_repl_com_t, repl_core);
-    console_register_redirection(repl_com->task_hdl, console_witre);
-    return esp_console_start_repl(repl);
+
+    if (xTaskCreate(console_repl_task, "console_repl", CONSOLE_REPL_STACK, NULL, CONSOLE_REPL_PRIORITY, NULL) !=
+        pdPASS)
+    {
+        ESP_LOGE(TAG, "xTaskCreate console_repl failed");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
 }
 
 int console_printf(const char *fmt, ...)
 {
-    static char buf[512];
-    static SemaphoreHandle_t mutex = NULL;
-    if (mutex == NULL)
-        mutex = xSemaphoreCreateMutex();
-
-    xSemaphoreTake(mutex, portMAX_DELAY);
+    console_sink_t *sink = pvTaskGetThreadLocalStoragePointer(NULL, CONSOLE_TLS_INDEX);
     va_list ap;
     va_start(ap, fmt);
-    int r = vsnprintf(buf, sizeof(buf), fmt, ap);
+    /* 未注册重定向的任务没有输出目标，与此前一样丢弃 */
+    int r = sink ? console_sink_vprintf(sink, fmt, ap) : vsnprintf(NULL, 0, fmt, ap);
     va_end(ap);
-
-    TaskHandle_t handle = xTaskGetCurrentTaskHandle();
-    for (int i = 0; i < REDIRECTION_LIST_LEN; i++)
-    {
-        if (redirection_list[i].task_hdl == handle && redirection_list[i].write)
-        {
-            r = redirection_list[i].write(buf, r);
-            break;
-        }
-    }
-    xSemaphoreGive(mutex);
     return r;
 }
 
+void console_flush(void)
+{
+    console_sink_t *sink = pvTaskGetThreadLocalStoragePointer(NULL, CONSOLE_TLS_INDEX);
+    if (sink)
+        console_sink_flush(sink);
+}
+
 int console_register_redirection(TaskHandle_t task_hdl, int (*write)(const char *, uint32_t))
 {
     if (task_hdl == NULL || write == NULL)
     {
         return -ESP_ERR_INVALID_ARG;
     }
-    for (int i = 0; i < REDIRECTION_LIST_LEN; i++)
+    if (pvTaskGetThreadLocalStoragePointer(task_hdl, CONSOLE_TLS_INDEX) != NULL)
     {
-        if (redirection_list[i].task_hdl == NULL)
-        {
-            redirection_list[i].task_hdl = task_hdl;
-            redirection_list[i].write = write;
-            return i;
-        }
+        return -ESP_ERR_INVALID_STATE;
+    }
+    console_sink_t *sink = malloc(sizeof(console_sink_t));
+    if (sink == NULL)
+    {
+        return -ESP_ERR_NO_MEM;
+    }
+    stats_mem_alloc(STATS_MEM_CONSOLE, sink);
+    sink->write = write;
+    sink->len = 0;
+    /* 任务删除时由 FreeRTOS 回调释放 */
+    vTaskSetThreadLocalStoragePointerAndDelCallback(task_hdl, CONSOLE_TLS_INDEX, sink, console_sink_delete);
+    return 0;
+}
+
+int console_unregister_redirection(TaskHandle_t task_hdl)
+{
+    if (task_hdl == NULL)
+    {
+        return -ESP_ERR_INVALID_ARG;
+    }
+    console_sink_t *sink = pvTaskGetThreadLocalStoragePointer(task_hdl, CONSOLE_TLS_INDEX);
+    if (sink == NULL)
+    {
+        return -ESP_ERR_NOT_FOUND;
     }
-    return -ESP_ERR_NO_MEM;
+    vTaskSetThreadLocalStoragePointerAndDelCallback(task_hdl, CONSOLE_TLS_INDEX, NULL, NULL);
+    console_sink_flush(sink);
+    stats_mem_free(STATS_MEM_CONSOLE, sink);
+    free(sink);
+    return 0;
 }
 
 int console_run_command(const char *cmd)
 {
-    int ret;
+    int ret = ESP_OK;
+    if (command_lock)
+        xSemaphoreTake(command_lock, portMAX_DELAY);
     esp_err_t err = esp_console_run(cmd, &ret);
+    if (command_lock)
+        xSemaphoreGive(command_lock);
     if (err == ESP_ERR_NOT_FOUND)
     {
         console_printf("Unrecognized command\n");
@@ -153,5 +350,6 @@ int console_run_command(const char *cmd)
     {
         console_printf("Internal error: %s\n", esp_err_to_name(err));
     }
+    console_flush();
     return ret;
 }
\ No newline at end of file
@@ -0,0 +1,283 @@
+#include "console/console.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "rpc/rpc.h"
+#include "sdkconfig.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#define CONSOLE_NET_LINE_MAX 128 // 与 REPL 的 max_cmdline_length 一致
+#define CONSOLE_NET_IDLE_S 600
+#define CONSOLE_NET_STACK 5120 // 命令与 RPC 在会话任务中执行，比 REPL 任务多留出 RPC 缓冲区
+#define CONSOLE_NET_PROMPT "#"
+/* 密码错误后延迟断开，两个会话合计每秒最多尝试两次 */
+#define CONSOLE_NET_AUTH_DELAY_MS 1000
+/* 密码错误的日志最多每分钟一条，被扫描时不会刷满日志 */
+#define CONSOLE_NET_AUTH_LOG_US (60 * 1000000LL)
+
+#if CONFIG_BRIDGE_CONSOLE_PORT
+static const char *TAG = "console_net";
+
+/* 会话任务的 socket，console_printf 的输出在调用任务中写出，据此找到对应的连接 */
+static __thread int console_net_fd = -1;
+static atomic_int console_net_sessions;
+static atomic_uint console_net_auth_failures;
+static _Atomic int64_t console_net_auth_logged;
+
+static int console_net_write(const char *buf, uint32_t len)
+{
+    uint32_t sent = 0;
+    while (sent < len)
+    {
+        int r = lwip_send(console_net_fd, buf + sent, len - sent, 0);
+        if (r <= 0)
+            return sent ? sent : -1;
+        sent += r;
+    }
+    return sent;
+}
+
+/**
+ * @brief 读取一行，去掉行尾的 \r，超长部分丢弃
+ *
+ * @return int 行长度，-1 表示连接已断开或空闲超时
+ */
+static int console_net_readline(char *line, size_t size, char *buf, size_t *buf_len)
+{
+    size_t n = 0;
+    while (1)
+    {
+        char *nl = memchr(buf, '\n', *buf_len);
+        size_t take = nl ? (size_t)(nl - buf) : *buf_len;
+        size_t copy = take < size - 1 - n ? take : size - 1 - n;
+        memcpy(line + n, buf, copy);
+        n += copy;
+        if (nl)
+        {
+            take++;
+            *buf_len -= take;
+            memmove(buf, buf + take, *buf_len);
+            if (n && line[n - 1] == '\r')
+                n--;
+            line[n] = '\0';
+            return n;
+        }
+        *buf_len = 0;
+
+        int r = lwip_recv(console_net_fd, buf, CONSOLE_NET_LINE_MAX, 0);
+        if (r <= 0)
+            return -1;
+        *buf_len = r;
+    }
+}
+
+/**
+ * @brief 先取 buf 中已收到的数据，不足时从 socket 读取，凑满 len 字节
+ */
+static int console_net_read(uint8_t *dst, size_t len, char *buf, size_t *buf_len)
+{
+    size_t n = *buf_len < len ? *buf_len : len;
+    memcpy(dst, buf, n);
+    *buf_len -= n;
+    memmove(buf, buf + n, *buf_len);
+    while (n < len)
+    {
+        int r = lwip_recv(console_net_fd, dst + n, len - n, 0);
+        if (r <= 0)
+            return -1;
+        n += r;
+    }
+    return len;
+}
+
+static void console_net_auth_failed()
+{
+    unsigned failures = atomic_fetch_add(&console_net_auth_failures, 1) + 1;
+    int64_t now = esp_timer_get_time();
+    int64_t last = atomic_load(&console_net_auth_logged);
+    if ((last == 0 || now - last >= CONSOLE_NET_AUTH_LOG_US) &&
+        atomic_compare_exchange_strong(&console_net_auth_logged, &last, now))
+        ESP_LOGW(TAG, "%d wrong password, %u failures since boot", console_net_fd, failures);
+    vTaskDelay(pdMS_TO_TICKS(CONSOLE_NET_AUTH_DELAY_MS));
+}
+
+/**
+ * @brief 处理一条 RPC 请求：RPC_MAGIC、2 字节小端长度、消息，应答格式相同，之后不发送提示符
+ */
+static int console_net_rpc(char *buf, size_t *buf_len)
+{
+    uint8_t hdr[3];
+    uint8_t req[RPC_MSG_MAX];
+    uint8_t resp[3 + RPC_MSG_MAX];
+    if (console_net_read(hdr, sizeof(hdr), buf, buf_len) < 0)
+        return -1;
+    size_t len = hdr[1] | hdr[2] << 8;
+    if (len > sizeof(req))
+    {
+        ESP_LOGW(TAG, "%d rpc request too long %u", console_net_fd, (unsigned)len);
+        return -1;
+    }
+    if (console_net_read(req, len, buf, buf_len) < 0)
+        return -1;
+
+    size_t n = rpc_handle(req, len, resp + 3, RPC_MSG_MAX);
+    resp[0] = RPC_MAGIC;
+    resp[1] = n;
+    resp[2] = n >> 8;
+    return console_net_write((const char *)resp, 3 + n) < 0 ? -1 : 0;
+}
+
+/**
+ * @brief 逐行执行命令，每条命令的输出结束后发送提示符，便于脚本判断命令完成
+ *
+ * 行首为 RPC_MAGIC 时按二进制 RPC 请求处理，文本命令与 RPC 可以在同一连接上交替使用
+ */
+static void console_net_session(void *arg)
+{
+    console_net_fd = (intptr_t)arg;
+    char line[CONSOLE_NET_LINE_MAX];
+    char buf[CONSOLE_NET_LINE_MAX];
+    size_t buf_len = 0;
+
+    if (console_register_redirection(xTaskGetCurrentTaskHandle(), console_net_write) != 0)
+        goto exit;
+    console_net_write("password: ", 10);
+    if (console_net_readline(line, sizeof(line), buf, &buf_len) < 0)
+        goto exit;
+    if (strcmp(line, CONFIG_BRIDGE_CONSOLE_PASSWORD) != 0)
+    {
+        console_net_auth_failed();
+        goto exit;
+    }
+
+    console_net_write(CONSOLE_NET_PROMPT, strlen(CONSOLE_NET_PROMPT));
+    while (1)
+    {
+        if (buf_len == 0)
+        {
+            int r = lwip_recv(console_net_fd, buf, sizeof(buf), 0);
+            if (r <= 0)
+                break;
+            buf_len = r;
+        }
+        if ((uint8_t)buf[0] == RPC_MAGIC)
+        {
+            if (console_net_rpc(buf, &buf_len) < 0)
+                break;
+            continue;
+        }
+
+        if (console_net_readline(line, sizeof(line), buf, &buf_len) < 0)
+            break;
+        if (line[0])
+            console_run_command(line);
+        console_net_write(CONSOLE_NET_PROMPT, strlen(CONSOLE_NET_PROMPT));
+    }
+
+exit:
+    ESP_LOGI(TAG, "%d session closed", console_net_fd);
+    lwip_close(console_net_fd);
+    atomic_fetch_sub(&console_net_sessions, 1);
+    /* 重定向随任务删除释放 */
+    vTaskDelete(NULL);
+}
+
+static int console_net_listen()
+{
+    struct sockaddr_in addr = {
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_BRIDGE_CONSOLE_PORT),
+    };
+    int fd = lwip_socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        ESP_LOGE(TAG, "socket create failed %d %s", errno, strerror(errno));
+        return -1;
+    }
+    int opval = 1;
+    lwip_setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opval, sizeof(int));
+    if (lwip_bind(fd, (const struct sockaddr *)&addr, sizeof(addr)) == -1 || lwip_listen(fd, 2) == -1)
+    {
+        ESP_LOGE(TAG, "socket bind/listen failed %d %s", errno, strerror(errno));
+        lwip_close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void console_net_task(void *arg)
+{
+    int listen_fd = -1;
+    while (1)
+    {
+        if (listen_fd < 0 && (listen_fd = console_net_listen()) < 0)
+        {
+            vTaskDelay(pdMS_TO_TICKS(5000));
+            continue;
+        }
+
+        struct sockaddr_in addr;
+        socklen_t addrlen = sizeof(addr);
+        int fd = lwip_accept(listen_fd, (struct sockaddr *)&addr, &addrlen);
+        if (fd < 0)
+        {
+            ESP_LOGE(TAG, "accept failed %d %s", errno, strerror(errno));
+            lwip_close(listen_fd);
+            listen_fd = -1;
+            continue;
+        }
+
+        char ip_str[16];
+        inet_ntoa_r(addr.sin_addr, ip_str, sizeof(ip_str));
+        if (atomic_fetch_add(&console_net_sessions, 1) >= CONFIG_BRIDGE_CONSOLE_MAX_CLIENTS)
+        {
+            ESP_LOGW(TAG, "%d:%s too many sessions", fd, ip_str);
+            lwip_send(fd, "busy\n", 5, 0);
+            lwip_close(fd);
+            atomic_fetch_sub(&console_net_sessions, 1);
+            continue;
+        }
+
+        /* 命令的应答很短，关闭 Nagle 让脚本批量下发命令时每条都立即返回 */
+        int opval = 1;
+        lwip_setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opval, sizeof(int));
+        struct timeval tv = {.tv_sec = CONSOLE_NET_IDLE_S};
+        lwip_setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        ESP_LOGI(TAG, "%d:%s session opened", fd, ip_str);
+        if (xTaskCreate(console_net_session, "console_net", CONSOLE_NET_STACK, (void *)(intptr_t)fd, 2, NULL) != pdPASS)
+        {
+            ESP_LOGE(TAG, "xTaskCreate console_net failed");
+            lwip_close(fd);
+            atomic_fetch_sub(&console_net_sessions, 1);
+        }
+    }
+}
+#endif
+
+int console_net_init()
+{
+#if CONFIG_BRIDGE_CONSOLE_PORT
+    /* 控制台可以修改 WiFi 与串口配置，没有密码时不开放 */
+    if (CONFIG_BRIDGE_CONSOLE_PASSWORD[0] == '\0')
+    {
+        ESP_LOGW(TAG, "BRIDGE_CONSOLE_PASSWORD is empty, network console disabled");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xTaskCreate(console_net_task, "console_listen", 2560, NULL, 2, NULL) != pdPASS)
+    {
+        ESP_LOGE(TAG, "xTaskCreate console_listen failed");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "listening on port %d", CONFIG_BRIDGE_CONSOLE_PORT);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
@@ -2,9 +2,8 @@
 #include "console.h"
 #include "driver/uart.h"
 #include "esp_console.h"
-#include "esp_log.h"
 #include "hal/uart_types.h"
-#include "nvs.h"
+#include "usr_uart/usr_uart.h"
 #include <string.h>
 
 static struct
@@ -19,109 +18,91 @@ static struct
 static int set_uart_cmd_cb(int argc, char **argv)
 {
     arg_parse(argc, argv, (void **)&uart_cmd_args);
-    nvs_handle_t nvs_handle = 0;
-    esp_err_t err = nvs_open("storage", NVS_READWRITE, &nvs_handle);
-    if (err != ESP_OK)
-    {
-        ESP_LOGE("NVS", "NVS open field %s", esp_err_to_name(err));
-        return ESP_OK;
-    }
-    uart_config_t uart_nvs_config = {};
-    size_t read_size = sizeof(uart_config_t);
-    nvs_get_blob(nvs_handle, "uart_conf", &uart_nvs_config, &read_size);
+    uart_config_t config = {};
+    uint32_t mask = 0;
 
     if (uart_cmd_args.baud->count)
     {
-        int baud = 0, baud_old = 0;
-        uart_get_baudrate(UART_NUM_1, (uint32_t *)&baud_old);
-        uart_set_baudrate(UART_NUM_1, uart_cmd_args.baud->ival[0]);
-        uart_get_baudrate(UART_NUM_1, (uint32_t *)&baud);
-        if (abs(baud - uart_cmd_args.baud->ival[0]) < uart_cmd_args.baud->ival[0] * 0.0005)
-        {
-            console_printf("设置 波特率：%d ", baud);
-            uart_nvs_config.baud_rate = baud;
-        }
-        else
-        {
-            console_printf("\n错误：无法设置波特率%d，实际波特率%d\n", uart_cmd_args.baud->ival[0], baud);
-            uart_set_baudrate(UART_NUM_1, baud_old);
-            goto exit;
-        }
+        config.baud_rate = uart_cmd_args.baud->ival[0];
+        mask |= USR_UART_BAUD_RATE;
     }
-
     if (uart_cmd_args.word_length->count)
     {
-        uart_word_length_t word_length = uart_cmd_args.word_length->ival[0] - 5;
-        if (word_length < 0 || word_length >= UART_DATA_BITS_MAX)
+        config.data_bits = uart_cmd_args.word_length->ival[0] - 5;
+        if (uart_cmd_args.word_length->ival[0] < 5 || config.data_bits >= UART_DATA_BITS_MAX)
         {
-            console_printf("\n错误：字长仅支持5到8比特\n");
-            goto exit;
+            console_printf("错误：字长仅支持5到8比特\n");
+            return ESP_OK;
         }
-        uart_set_word_length(UART_NUM_1, word_length);
-        console_printf("，字长：%d ", uart_cmd_args.word_length->ival[0]);
-        uart_nvs_config.data_bits = word_length;
+        mask |= USR_UART_DATA_BITS;
     }
     if (uart_cmd_args.stop_bits->count)
     {
-
-        uart_stop_bits_t stop_bits;
-
         if (uart_cmd_args.stop_bits->dval[0] == 1)
         {
-            stop_bits = UART_STOP_BITS_1;
+            config.stop_bits = UART_STOP_BITS_1;
         }
         else if (uart_cmd_args.stop_bits->dval[0] == 1.5)
         {
-            stop_bits = UART_STOP_BITS_1_5;
+            config.stop_bits = UART_STOP_BITS_1_5;
         }
         else if (uart_cmd_args.stop_bits->dval[0] == 2)
         {
-            stop_bits = UART_STOP_BITS_2;
+            config.stop_bits = UART_STOP_BITS_2;
         }
         else
         {
-            console_printf("\n错误：停止位仅支持1，1.5，2比特\n");
-            goto exit;
+            console_printf("错误：停止位仅支持1，1.5，2比特\n");
+            return ESP_OK;
         }
-        uart_set_stop_bits(UART_NUM_1, stop_bits);
-        console_printf("，停止位：%.1lf ", uart_cmd_args.stop_bits->dval[0]);
-        uart_nvs_config.stop_bits = stop_bits;
+        mask |= USR_UART_STOP_BITS;
     }
     if (uart_cmd_args.parity->count)
     {
-        uart_parity_t parity;
         if (strcmp("DIS", uart_cmd_args.parity->sval[0]) == 0)
         {
-            parity = UART_PARITY_DISABLE;
+            config.parity = UART_PARITY_DISABLE;
         }
         else if (strcmp("EVEN", uart_cmd_args.parity->sval[0]) == 0)
         {
-            parity = UART_PARITY_EVEN;
+            config.parity = UART_PARITY_EVEN;
         }
         else if (strcmp("ODD", uart_cmd_args.parity->sval[0]) == 0)
         {
-            parity = UART_PARITY_ODD;
+            config.parity = UART_PARITY_ODD;
         }
         else
         {
-            console_printf("\n错误：校验方式仅支持无校验DIS，奇校验ODD，偶校验EVEN\n");
-            goto exit;
+            console_printf("错误：校验方式仅支持无校验DIS，奇校验ODD，偶校验EVEN\n");
+            return ESP_OK;
         }
-        console_printf("，校验方式：%s ", uart_cmd_args.parity->sval[0]);
-        uart_set_parity(UART_NUM_1, parity);
-        uart_nvs_config.parity = parity;
+        mask |= USR_UART_PARITY;
     }
 
-    console_printf("\n");
-    err = nvs_set_blob(nvs_handle, "uart_conf", &uart_nvs_config, sizeof(uart_config_t));
-    if (err != ESP_OK)
+    esp_err_t err = usr_uart_configure(&config, mask);
+    if (err == ESP_ERR_NOT_SUPPORTED)
     {
-        console_printf("错误：无法保存配置 %s\n", esp_err_to_name(err));
-        goto exit;
+        console_printf("错误：无法设置波特率%d，实际波特率%d\n", uart_cmd_args.baud->ival[0], config.baud_rate);
+        return ESP_OK;
+    }
+    if (err == ESP_ERR_INVALID_ARG)
+    {
+        console_printf("错误：参数无效\n");
+        return ESP_OK;
     }
 
-exit:
-    nvs_close(nvs_handle);
+    console_printf("设置");
+    if (mask & USR_UART_BAUD_RATE)
+        console_printf(" 波特率：%d ", config.baud_rate);
+    if (mask & USR_UART_DATA_BITS)
+        console_printf("，字长：%d ", uart_cmd_args.word_length->ival[0]);
+    if (mask & USR_UART_STOP_BITS)
+        console_printf("，停止位：%.1lf ", uart_cmd_args.stop_bits->dval[0]);
+    if (mask & USR_UART_PARITY)
+        console_printf("，校验方式：%s ", uart_cmd_args.parity->sval[0]);
+    console_printf("\n");
+    if (err != ESP_OK)
+        console_printf("错误：无法保存配置 %s\n", esp_err_to_name(err));
     return ESP_OK;
 }
 
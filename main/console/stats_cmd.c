@@ -0,0 +1,367 @@
+#include "argtable3/argtable3.h"
+#include "config/config.h"
+#include "console.h"
+#include "esp_console.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "log/log_ring.h"
+#include "sdkconfig.h"
+#include "stats/stats.h"
+#include "telnet/telnet_server.h"
+#include "usr_uart/usr_uart.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define STATS_INTERVAL_MS 1000
+#define STATS_TASKS_SPARE 4 // 两次采样之间可能新建的任务
+
+static struct
+{
+    struct arg_lit *json;
+    struct arg_int *interval;
+    struct arg_end *end;
+} stats_args;
+
+static struct
+{
+    struct arg_int *interval;
+    struct arg_end *end;
+} top_args;
+
+typedef struct
+{
+    const char *name;
+    UBaseType_t prio;
+    uint32_t stack_free; // 栈的历史最小剩余字节数
+    uint32_t runtime;    // 累计运行时间，微秒，32 位计数约 71 分钟回绕
+    uint32_t delta;      // 采样区间内的运行时间
+} stats_task_t;
+
+typedef struct
+{
+    TaskStatus_t *status; // 第二次采样，name 指向其中的任务名
+    stats_task_t *tasks;
+    int count;
+    uint32_t elapsed; // 采样区间的总时间，多核时为各核之和
+} stats_tasks_t;
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+static int stats_task_cmp(const void *a, const void *b)
+{
+    const stats_task_t *x = a, *y = b;
+    return x->delta < y->delta ? 1 : x->delta > y->delta ? -1 : 0;
+}
+#endif
+
+/**
+ * @brief 间隔 interval_ms 采样两次任务运行时间，得到区间内的 CPU 占用，0 表示自启动以来
+ *
+ * 任务在采样区间内被删除时不计入，新建的任务按第二次采样的累计值计入
+ */
+static int stats_sample_tasks(stats_tasks_t *out, int interval_ms)
+{
+    out->status = NULL;
+    out->tasks = NULL;
+    out->count = 0;
+    out->elapsed = 0;
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    UBaseType_t max = uxTaskGetNumberOfTasks() + STATS_TASKS_SPARE;
+    TaskStatus_t *before = NULL;
+    UBaseType_t n_before = 0;
+    uint32_t total_before = 0;
+    if (interval_ms > 0)
+    {
+        before = malloc(max * sizeof(TaskStatus_t));
+        if (before == NULL)
+            return ESP_ERR_NO_MEM;
+        n_before = uxTaskGetSystemState(before, max, &total_before);
+        vTaskDelay(pdMS_TO_TICKS(interval_ms));
+        max = n_before + STATS_TASKS_SPARE;
+    }
+
+    out->status = malloc(max * sizeof(TaskStatus_t));
+    out->tasks = malloc(max * sizeof(stats_task_t));
+    if (out->status == NULL || out->tasks == NULL)
+    {
+        free(before);
+        free(out->status);
+        free(out->tasks);
+        out->status = NULL;
+        out->tasks = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    uint32_t total = 0;
+    UBaseType_t n = uxTaskGetSystemState(out->status, max, &total);
+    out->elapsed = (total - total_before) * portNUM_PROCESSORS;
+
+    for (UBaseType_t i = 0; i < n; i++)
+    {
+        const TaskStatus_t *s = &out->status[i];
+        stats_task_t *t = &out->tasks[i];
+        t->name = s->pcTaskName;
+        t->prio = s->uxCurrentPriority;
+        t->stack_free = s->usStackHighWaterMark;
+        t->runtime = s->ulRunTimeCounter;
+        t->delta = s->ulRunTimeCounter;
+        for (UBaseType_t j = 0; j < n_before; j++)
+        {
+            if (before[j].xHandle == s->xHandle && before[j].xTaskNumber == s->xTaskNumber)
+            {
+                t->delta = s->ulRunTimeCounter - before[j].ulRunTimeCounter;
+                break;
+            }
+        }
+    }
+    free(before);
+    out->count = n;
+    qsort(out->tasks, n, sizeof(stats_task_t), stats_task_cmp);
+#endif
+    return ESP_OK;
+}
+
+static void stats_free_tasks(stats_tasks_t *tasks)
+{
+    free(tasks->status);
+    free(tasks->tasks);
+}
+
+/**
+ * @brief CPU 占用的千分比，未启用运行时间统计时返回 -1
+ */
+static int stats_task_permille(const stats_tasks_t *tasks, const stats_task_t *t)
+{
+    if (tasks->elapsed == 0)
+        return -1;
+    return (uint64_t)t->delta * 1000 / tasks->elapsed;
+}
+
+static void stats_print_tasks(const stats_tasks_t *tasks, int interval_ms)
+{
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    if (interval_ms > 0)
+        console_printf("tasks (%dms):\n", interval_ms);
+    else
+        console_printf("tasks (since boot):\n");
+    console_printf("  %-16s %4s %6s %10s\n", "name", "prio", "cpu", "stack_free");
+    for (int i = 0; i < tasks->count; i++)
+    {
+        const stats_task_t *t = &tasks->tasks[i];
+        int permille = stats_task_permille(tasks, t);
+        if (permille < 0)
+            console_printf("  %-16s %4u %6s %10" PRIu32 "\n", t->name, (unsigned)t->prio, "-", t->stack_free);
+        else
+            console_printf("  %-16s %4u %3d.%d%% %10" PRIu32 "\n", t->name, (unsigned)t->prio, permille / 10,
+                           permille % 10, t->stack_free);
+    }
+#else
+    console_printf("tasks: 未启用 CONFIG_FREERTOS_USE_TRACE_FACILITY\n");
+#endif
+}
+
+static void stats_print_text(const telnet_client_stats_t *clients, int n, const telnet_core_stats_t *core,
+                             const usr_uart_stats_t *uart, const stats_tasks_t *tasks, int interval_ms)
+{
+    console_printf("uptime: %" PRIu32 "s\n", (uint32_t)(esp_timer_get_time() / 1000000));
+    console_printf("uart rx: %" PRIu32 " tx: %" PRIu32 " tx_dropped: %" PRIu32 "\n", core->uart_rx_bytes,
+                   uart->tx_bytes, uart->tx_dropped);
+    console_printf("uart events:");
+    for (int i = 0; i < UART_EVENT_MAX; i++)
+    {
+        if (stats_uart_event_name(i))
+            console_printf(" %s: %" PRIu32, stats_uart_event_name(i), core->uart_events[i]);
+        else if (core->uart_events[i])
+            console_printf(" event%d: %" PRIu32, i, core->uart_events[i]);
+    }
+    console_printf("\n");
+    console_printf("udp datagrams: %" PRIu32 " bytes: %" PRIu32 " errors: %" PRIu32 " dropped: %" PRIu32 "\n",
+                   core->udp.datagrams, core->udp.bytes, core->udp.errors, core->udp.dropped);
+    for (int i = 0; i < n; i++)
+    {
+        console_printf("client %d %s rx: %" PRIu32 " tx: %" PRIu32 " lag: %" PRIu32 " overruns: %" PRIu32
+                       " dropped: %" PRIu32 "\n",
+                       clients[i].fd, clients[i].ip_str, clients[i].rx_bytes, clients[i].tx_bytes, clients[i].lag,
+                       clients[i].overruns, clients[i].dropped);
+    }
+
+    stats_print_tasks(tasks, interval_ms);
+
+    size_t total = heap_caps_get_total_size(MALLOC_CAP_DEFAULT);
+    size_t free_size = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    console_printf("heap total: %u free: %u min_free: %u largest: %u\n", (unsigned)total, (unsigned)free_size,
+                   (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT),
+                   (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+    size_t other = total - free_size;
+    console_printf("heap used:");
+    for (int i = 0; i < STATS_MEM_MAX; i++)
+    {
+        size_t used = stats_mem_get(i);
+        console_printf(" %s: %u", stats_mem_name(i), (unsigned)used);
+        other -= used < other ? used : other;
+    }
+    console_printf(" other: %u\n", (unsigned)other);
+
+    log_ring_stats_t lr;
+    log_ring_get_stats(&lr);
+    console_printf("log records: %" PRIu32 " lost: %" PRIu32 "\n", lr.records, lr.lost);
+
+    conf_stats_t cs;
+    conf_get_stats(&cs);
+    console_printf("config commits: %" PRIu32 " keys_written: %" PRIu32 " unchanged: %" PRIu32 " errors: %" PRIu32
+                   "\n",
+                   cs.commits, cs.keys_written, cs.unchanged, cs.errors);
+}
+
+/* 与文本输出的内容相同，键名固定，供脚本解析，整个对象输出为一行 */
+static void stats_print_json(const telnet_client_stats_t *clients, int n, const telnet_core_stats_t *core,
+                             const usr_uart_stats_t *uart, const stats_tasks_t *tasks, int interval_ms)
+{
+    console_printf("{\"uptime_ms\":%" PRIu32 ",\"interval_ms\":%d", (uint32_t)(esp_timer_get_time() / 1000),
+                   interval_ms);
+    console_printf(",\"uart\":{\"rx_bytes\":%" PRIu32 ",\"tx_bytes\":%" PRIu32 ",\"tx_dropped\":%" PRIu32
+                   ",\"events\":{",
+                   core->uart_rx_bytes, uart->tx_bytes, uart->tx_dropped);
+    bool first = true;
+    for (int i = 0; i < UART_EVENT_MAX; i++)
+    {
+        if (stats_uart_event_name(i) == NULL)
+            continue;
+        console_printf("%s\"%s\":%" PRIu32, first ? "" : ",", stats_uart_event_name(i), core->uart_events[i]);
+        first = false;
+    }
+    console_printf("}},\"udp\":{\"datagrams\":%" PRIu32 ",\"bytes\":%" PRIu32 ",\"errors\":%" PRIu32
+                   ",\"dropped\":%" PRIu32 "}",
+                   core->udp.datagrams, core->udp.bytes, core->udp.errors, core->udp.dropped);
+
+    console_printf(",\"clients\":[");
+    for (int i = 0; i < n; i++)
+    {
+        console_printf("%s{\"fd\":%d,\"ip\":\"%s\",\"rx_bytes\":%" PRIu32 ",\"tx_bytes\":%" PRIu32
+                       ",\"lag\":%" PRIu32 ",\"overruns\":%" PRIu32 ",\"dropped\":%" PRIu32 "}",
+                       i ? "," : "", clients[i].fd, clients[i].ip_str, clients[i].rx_bytes, clients[i].tx_bytes,
+                       clients[i].lag, clients[i].overruns, clients[i].dropped);
+    }
+
+    console_printf("],\"tasks\":[");
+    for (int i = 0; i < tasks->count; i++)
+    {
+        const stats_task_t *t = &tasks->tasks[i];
+        int permille = stats_task_permille(tasks, t);
+        console_printf("%s{\"name\":\"%s\",\"prio\":%u,\"runtime_us\":%" PRIu32 ",\"stack_free\":%" PRIu32,
+                       i ? "," : "", t->name, (unsigned)t->prio, t->runtime, t->stack_free);
+        if (permille >= 0)
+            console_printf(",\"cpu\":%d.%d", permille / 10, permille % 10);
+        console_printf("}");
+    }
+
+    size_t total = heap_caps_get_total_size(MALLOC_CAP_DEFAULT);
+    size_t free_size = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    console_printf("],\"heap\":{\"total\":%u,\"free\":%u,\"min_free\":%u,\"largest\":%u,\"used\":{", (unsigned)total,
+                   (unsigned)free_size, (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT),
+                   (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+    size_t other = total - free_size;
+    for (int i = 0; i < STATS_MEM_MAX; i++)
+    {
+        size_t used = stats_mem_get(i);
+        console_printf("\"%s\":%u,", stats_mem_name(i), (unsigned)used);
+        other -= used < other ? used : other;
+    }
+
+    log_ring_stats_t lr;
+    log_ring_get_stats(&lr);
+    console_printf("\"other\":%u}},\"log\":{\"records\":%" PRIu32 ",\"lost\":%" PRIu32 "}", (unsigned)other,
+                   lr.records, lr.lost);
+
+    conf_stats_t cs;
+    conf_get_stats(&cs);
+    console_printf(",\"config\":{\"commits\":%" PRIu32 ",\"keys_written\":%" PRIu32 ",\"unchanged\":%" PRIu32
+                   ",\"errors\":%" PRIu32 "}}\n",
+                   cs.commits, cs.keys_written, cs.unchanged, cs.errors);
+}
+
+static int stats_cmd_cb(int argc, char **argv)
+{
+    if (arg_parse(argc, argv, (void **)&stats_args) != 0)
+    {
+        console_printf("用法：stats [-j] [-i <ms>]\n");
+        return ESP_OK;
+    }
+    int interval_ms = stats_args.interval->count ? stats_args.interval->ival[0] : STATS_INTERVAL_MS;
+    if (interval_ms < 0)
+        interval_ms = 0;
+
+    stats_tasks_t tasks;
+    if (stats_sample_tasks(&tasks, interval_ms) != ESP_OK)
+        return ESP_ERR_NO_MEM;
+
+    /* 连接数受 socket 数量限制 */
+    telnet_client_stats_t *clients = calloc(CONFIG_LWIP_MAX_SOCKETS, sizeof(telnet_client_stats_t));
+    if (clients == NULL)
+    {
+        stats_free_tasks(&tasks);
+        return ESP_ERR_NO_MEM;
+    }
+    telnet_core_stats_t core;
+    int n = telnet_get_client_stats(clients, CONFIG_LWIP_MAX_SOCKETS, &core);
+    usr_uart_stats_t uart;
+    usr_uart_get_stats(&uart);
+
+    if (stats_args.json->count)
+        stats_print_json(clients, n, &core, &uart, &tasks, interval_ms);
+    else
+        stats_print_text(clients, n, &core, &uart, &tasks, interval_ms);
+
+    free(clients);
+    stats_free_tasks(&tasks);
+    return ESP_OK;
+}
+
+static int top_cmd_cb(int argc, char **argv)
+{
+    if (arg_parse(argc, argv, (void **)&top_args) != 0)
+    {
+        console_printf("用法：top [-i <ms>]\n");
+        return ESP_OK;
+    }
+    int interval_ms = top_args.interval->count ? top_args.interval->ival[0] : STATS_INTERVAL_MS;
+    if (interval_ms < 0)
+        interval_ms = 0;
+
+    stats_tasks_t tasks;
+    if (stats_sample_tasks(&tasks, interval_ms) != ESP_OK)
+        return ESP_ERR_NO_MEM;
+    stats_print_tasks(&tasks, interval_ms);
+    stats_free_tasks(&tasks);
+    return ESP_OK;
+}
+
+void register_stats_cmd()
+{
+    stats_args.json = arg_lit0("j", "json", "以单行 JSON 输出");
+    stats_args.interval = arg_int0("i", "interval", "<ms>", "CPU 占用的采样间隔，默认 1000，0 为自启动以来");
+    stats_args.end = arg_end(2);
+
+    const esp_console_cmd_t stats_cmd = {
+        .command = "stats",
+        .help = "查看串口与客户端收发字节数、串口事件、任务 CPU 占用与栈余量、各子系统堆内存",
+        .hint = NULL,
+        .func = stats_cmd_cb,
+        .argtable = &stats_args,
+    };
+    esp_console_cmd_register(&stats_cmd);
+
+    top_args.interval = arg_int0("i", "interval", "<ms>", "采样间隔，默认 1000，0 为自启动以来");
+    top_args.end = arg_end(1);
+
+    const esp_console_cmd_t top_cmd = {
+        .command = "top",
+        .help = "按 CPU 占用列出任务及栈余量",
+        .hint = NULL,
+        .func = top_cmd_cb,
+        .argtable = &top_args,
+    };
+    esp_console_cmd_register(&top_cmd);
+}
@@ -199,50 +199,11 @@ static void register_log_level(void)
     ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
 }
 
-/** 'tasks' command prints the list of tasks and related information */
-#if WITH_TASKS_INFO
-
-static int tasks_info(int argc, char **argv)
-{
-    const size_t bytes_per_task = 40; /* see vTaskList description */
-    char *task_list_buffer = malloc(uxTaskGetNumberOfTasks() * bytes_per_task);
-    if (task_list_buffer == NULL)
-    {
-        ESP_LOGE(TAG, "failed to allocate buffer for vTaskList output");
-        return 1;
-    }
-    fputs("Task Name\tStatus\tPrio\tHWM\tTask#", stdout);
-#ifdef CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
-    fputs("\tAffinity", stdout);
-#endif
-    fputs("\n", stdout);
-    vTaskList(task_list_buffer);
-    fputs(task_list_buffer, stdout);
-    free(task_list_buffer);
-    return 0;
-}
-
-static void register_tasks(void)
-{
-    const esp_console_cmd_t cmd = {
-        .command = "tasks",
-        .help = "Get information about running tasks",
-        .hint = NULL,
-        .func = &tasks_info,
-    };
-    ESP_ERROR_CHECK(esp_console_cmd_register(&cmd));
-}
-
-#endif // WITH_TASKS_INFO
-
 void register_system()
 {
     register_free();
     register_heap();
     register_version();
     register_restart();
-#if WITH_TASKS_INFO
-    register_tasks();
-#endif
     register_log_level();
 }
\ No newline at end of file
@@ -11,7 +11,7 @@ ESP_EVENT_DECLARE_BASE(APP_EVENTS);
 
 typedef enum AppEventID
 {
-    APP_EVENT_DEV_NAME_CHANGED,
+    APP_EVENT_CONF_CHANGED, // 事件数据为变更的 conf_key_t
     APP_EVENT_POWER_DOWN,
     APP_EVENT_POWER_ON,
     APP_EVENT_POWER_LOW,
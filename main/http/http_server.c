@@ -0,0 +1,487 @@
+#include "http_server.h"
+#include "adc/adc.h"
+#include "boot/boot_prof.h"
+#include "capture/capture.h"
+#include "config/config.h"
+#include "esp_app_desc.h"
+#include "esp_heap_caps.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "log/log_ring.h"
+#include "sdkconfig.h"
+#include "stats/stats.h"
+#include "telnet/telnet_server.h"
+#include "usr_uart/usr_uart.h"
+#include "wifi_manager/wifi_manager.h"
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/unistd.h>
+
+#define HTTP_WS_STACK_BUF 128
+/* 帧长度由客户端指定，超过时以 1009 (Message Too Big) 关闭，不为其分配内存 */
+#define HTTP_WS_FRAME_MAX 1024
+#define HTTP_WS_CLOSE_TOO_BIG 1009
+#define HTTP_METRICS_BUF 512
+#define HTTP_PCAP_LINKTYPE_USER0 147
+
+/* pcap 文件头与每个数据包的头，每条记录导出为一个数据包 */
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t network;
+} pcap_file_header_t;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} pcap_packet_header_t;
+
+/* /metrics 的输出缓冲，攒满后作为一个 chunk 发送 */
+typedef struct
+{
+    httpd_req_t *req;
+    esp_err_t err;
+    size_t len;
+    char buf[HTTP_METRICS_BUF];
+} http_metrics_t;
+
+static const char *TAG = "http";
+
+static httpd_handle_t server;
+
+/* WebSocket 会话的上下文只作标记，指向该变量 */
+static int ws_session_tag;
+
+static void ws_session_free(void *ctx)
+{
+}
+
+/**
+ * @brief 读取客户端发来的一帧，数据写入串口，控制帧转交 telnet_srv 回复
+ *
+ * 发往客户端的数据帧全部由 telnet_srv 任务发送，本任务不在该连接上写入任何数据
+ */
+static esp_err_t ws_handler(httpd_req_t *req)
+{
+    int fd = httpd_req_to_sockfd(req);
+    if (req->method == HTTP_GET)
+    {
+        /* 握手应答已由 http 服务器发出，可以用 /ws?scrollback=字节数 指定回放长度 */
+        char query[32];
+        char value[12];
+        int scrollback = -1;
+        if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+            httpd_query_key_value(query, "scrollback", value, sizeof(value)) == ESP_OK)
+            scrollback = atoi(value);
+        /* 标记会话，关闭时只有这些套接字交给 telnet_srv 释放 */
+        req->sess_ctx = &ws_session_tag;
+        req->free_ctx = ws_session_free;
+        telnet_ws_attach(fd, scrollback);
+        return ESP_OK;
+    }
+
+    uint8_t buf[HTTP_WS_STACK_BUF];
+    httpd_ws_frame_t frame = {};
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%d recv frame length failed %s", fd, esp_err_to_name(err));
+        return err;
+    }
+
+    if (frame.len > HTTP_WS_FRAME_MAX)
+    {
+        /* 负载留在套接字中无法跳过，返回错误由 http 服务器关闭会话，关闭帧先于此交给 telnet_srv 发送 */
+        ESP_LOGW(TAG, "%d frame too big %u", fd, (unsigned)frame.len);
+        const uint8_t code[2] = {HTTP_WS_CLOSE_TOO_BIG >> 8, HTTP_WS_CLOSE_TOO_BIG & 0xff};
+        telnet_ws_control(fd, HTTPD_WS_TYPE_CLOSE, code, sizeof(code));
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    frame.payload = frame.len > sizeof(buf) ? malloc(frame.len) : buf;
+    if (frame.payload == NULL)
+        return ESP_ERR_NO_MEM;
+    if (frame.len)
+        err = httpd_ws_recv_frame(req, &frame, frame.len);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%d recv frame failed %s", fd, esp_err_to_name(err));
+        goto exit;
+    }
+
+    switch (frame.type)
+    {
+    case HTTPD_WS_TYPE_BINARY:
+    case HTTPD_WS_TYPE_TEXT:
+    case HTTPD_WS_TYPE_CONTINUE:
+        if (frame.len)
+            usr_uart_write(frame.payload, frame.len);
+        break;
+    case HTTPD_WS_TYPE_PING:
+    case HTTPD_WS_TYPE_CLOSE:
+        telnet_ws_control(fd, frame.type, frame.payload, frame.len);
+        break;
+    default:
+        break;
+    }
+
+exit:
+    if (frame.payload != buf)
+        free(frame.payload);
+    return err;
+}
+
+static int64_t http_query_time(const char *query, const char *key)
+{
+    char value[24];
+    if (httpd_query_key_value(query, key, value, sizeof(value)) != ESP_OK)
+        return 0;
+    return strtoll(value, NULL, 10) * 1000000;
+}
+
+/**
+ * @brief 导出 capture 分区中的记录，参数 from/to 为 Unix 秒，format=raw 时只输出串口数据
+ *
+ * 未校时的记录无法按时间筛选，位于范围内已校时记录之间的会一并导出，
+ * pcap 中这些记录的时间为自启动以来的时间
+ */
+static esp_err_t capture_handler(httpd_req_t *req)
+{
+    char query[96] = "";
+    httpd_req_get_url_query_str(req, query, sizeof(query));
+    int64_t from = http_query_time(query, "from");
+    int64_t to = http_query_time(query, "to");
+    char format[8] = "";
+    httpd_query_key_value(query, "format", format, sizeof(format));
+    bool raw_format = strcmp(format, "raw") == 0;
+
+    capture_iter_t *it = malloc(sizeof(capture_iter_t));
+    uint8_t *raw = malloc(CAPTURE_REC_RAW_MAX);
+    esp_err_t err = ESP_OK;
+    if (it == NULL || raw == NULL)
+    {
+        err = httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no memory");
+        goto exit;
+    }
+    if (capture_iter_init(it, from) != ESP_OK)
+    {
+        err = httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "no capture data");
+        goto exit;
+    }
+
+    httpd_resp_set_type(req, raw_format ? "application/octet-stream" : "application/vnd.tcpdump.pcap");
+    httpd_resp_set_hdr(req, "Content-Disposition",
+                       raw_format ? "attachment; filename=capture.bin" : "attachment; filename=capture.pcap");
+    if (!raw_format)
+    {
+        const pcap_file_header_t hdr = {
+            .magic = 0xa1b2c3d4,
+            .version_major = 2,
+            .version_minor = 4,
+            .snaplen = CAPTURE_REC_RAW_MAX,
+            .network = HTTP_PCAP_LINKTYPE_USER0,
+        };
+        err = httpd_resp_send_chunk(req, (const char *)&hdr, sizeof(hdr));
+    }
+
+    capture_record_t rec;
+    int n;
+    while (err == ESP_OK && (n = capture_iter_next(it, &rec, raw)) > 0)
+    {
+        if (rec.unix_us && rec.unix_us < from)
+            continue;
+        if (to && rec.unix_us > to)
+            break;
+        if (!raw_format)
+        {
+            int64_t ts = rec.unix_us ? rec.unix_us : rec.time_us;
+            const pcap_packet_header_t ph = {
+                .ts_sec = ts / 1000000,
+                .ts_usec = ts % 1000000,
+                .incl_len = n,
+                .orig_len = n,
+            };
+            err = httpd_resp_send_chunk(req, (const char *)&ph, sizeof(ph));
+        }
+        if (err == ESP_OK)
+            err = httpd_resp_send_chunk(req, (const char *)raw, n);
+    }
+    if (err == ESP_OK)
+        err = httpd_resp_send_chunk(req, NULL, 0);
+
+exit:
+    free(it);
+    free(raw);
+    return err;
+}
+
+/**
+ * @brief 导出日志环形缓冲区中保留的记录，用 tools/log_decode.py 与固件 ELF 解码
+ */
+static esp_err_t log_handler(httpd_req_t *req)
+{
+    log_ring_stats_t stats;
+    log_ring_get_stats(&stats);
+    if (stats.capacity == 0)
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "log ring disabled");
+
+    uint8_t *buf = malloc(sizeof(log_ring_export_t) + stats.capacity);
+    if (buf == NULL)
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no memory");
+    log_ring_export_t *hdr = (log_ring_export_t *)buf;
+    hdr->magic = LOG_RING_EXPORT_MAGIC;
+    hdr->version = LOG_RING_EXPORT_VERSION;
+    hdr->hdr_len = sizeof(log_ring_export_t);
+    memcpy(hdr->elf_sha256, esp_app_get_description()->app_elf_sha256, sizeof(hdr->elf_sha256));
+    size_t len = log_ring_export(buf + sizeof(log_ring_export_t), stats.capacity);
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=log.bin");
+    esp_err_t err = httpd_resp_send(req, (const char *)buf, sizeof(log_ring_export_t) + len);
+    free(buf);
+    return err;
+}
+
+static void metrics_printf(http_metrics_t *m, const char *fmt, ...)
+{
+    for (int i = 0; i < 2 && m->err == ESP_OK; i++)
+    {
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(m->buf + m->len, sizeof(m->buf) - m->len, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+            return;
+        if ((size_t)n < sizeof(m->buf) - m->len)
+        {
+            m->len += n;
+            return;
+        }
+        /* 放不下时先发送已有内容再重新格式化，单行不会超过缓冲区 */
+        m->err = httpd_resp_send_chunk(m->req, m->buf, m->len);
+        m->len = 0;
+    }
+}
+
+static void metrics_family(http_metrics_t *m, const char *name, const char *type, const char *help)
+{
+    metrics_printf(m, "# HELP bridge_%s %s\n# TYPE bridge_%s %s\n", name, help, name, type);
+}
+
+static void metrics_u32(http_metrics_t *m, const char *name, const char *type, const char *help, uint32_t value)
+{
+    metrics_family(m, name, type, help);
+    metrics_printf(m, "bridge_%s %" PRIu32 "\n", name, value);
+}
+
+/* 标签值中的 \ " 与换行需要转义 */
+static void metrics_escape(char *dst, size_t size, const char *src)
+{
+    size_t n = 0;
+    for (; *src && n + 2 < size; src++)
+    {
+        if (*src == '\\' || *src == '"' || *src == '\n')
+        {
+            dst[n++] = '\\';
+            dst[n++] = *src == '\n' ? 'n' : *src;
+        }
+        else
+        {
+            dst[n++] = *src;
+        }
+    }
+    dst[n] = '\0';
+}
+
+/**
+ * @brief 以 Prometheus 文本格式导出计数
+ *
+ * 各模块的计数由各自的任务独占累加或为原子计数，转发路径上不加锁，
+ * 这里在抓取时一次性读取；客户端计数由 telnet_srv 任务汇总已断开与当前的连接。
+ * 计数为 32 位，回绕由 Prometheus 按计数器重置处理。
+ */
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    http_metrics_t *m = malloc(sizeof(http_metrics_t));
+    if (m == NULL)
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "no memory");
+    m->req = req;
+    m->err = ESP_OK;
+    m->len = 0;
+    httpd_resp_set_type(req, "text/plain; version=0.0.4; charset=utf-8");
+
+    char name[64] = "";
+    char label[2][80];
+    conf_get_dev_name(name, sizeof(name));
+    metrics_escape(label[0], sizeof(label[0]), name);
+    metrics_escape(label[1], sizeof(label[1]), esp_app_get_description()->version);
+    metrics_family(m, "info", "gauge", "Device name and firmware version");
+    metrics_printf(m, "bridge_info{name=\"%s\",version=\"%s\"} 1\n", label[0], label[1]);
+    metrics_u32(m, "uptime_seconds", "gauge", "Time since boot", esp_timer_get_time() / 1000000);
+    metrics_family(m, "boot_milestone_seconds", "gauge",
+                   "Time from startup to the first UART byte, IP address, client and bridged byte");
+    for (int i = 0; i < BOOT_MILESTONE_MAX; i++)
+    {
+        int64_t t = boot_prof_milestone_time(i);
+        if (t)
+            metrics_printf(m, "bridge_boot_milestone_seconds{milestone=\"%s\"} %" PRId32 ".%03" PRId32 "\n",
+                           boot_prof_milestone_name(i), (int32_t)(t / 1000000), (int32_t)(t / 1000 % 1000));
+    }
+
+    telnet_core_stats_t core = {};
+    telnet_get_client_stats(NULL, 0, &core);
+    usr_uart_stats_t uart;
+    usr_uart_get_stats(&uart);
+    metrics_u32(m, "uart_rx_bytes_total", "counter", "Bytes read from the UART", core.uart_rx_bytes);
+    metrics_u32(m, "uart_tx_bytes_total", "counter", "Bytes written to the UART", uart.tx_bytes);
+    metrics_u32(m, "uart_tx_dropped_bytes_total", "counter", "Bytes that could not be written to the UART",
+                uart.tx_dropped);
+    metrics_family(m, "uart_events_total", "counter", "UART driver events by type");
+    for (int i = 0; i < UART_EVENT_MAX; i++)
+    {
+        if (stats_uart_event_name(i))
+            metrics_printf(m, "bridge_uart_events_total{type=\"%s\"} %" PRIu32 "\n", stats_uart_event_name(i),
+                           core.uart_events[i]);
+    }
+    metrics_u32(m, "uart_rx_pauses_total", "counter", "Times UART reads paused for lagging clients", core.rx_pauses);
+
+    metrics_u32(m, "clients", "gauge", "Connected bridge clients", core.clients);
+    metrics_u32(m, "client_connects_total", "counter", "Accepted bridge client connections", core.client_connects);
+    metrics_u32(m, "client_rx_bytes_total", "counter", "Bytes received from bridge clients", core.client_rx_bytes);
+    metrics_u32(m, "client_tx_bytes_total", "counter", "Bytes sent to bridge clients", core.client_tx_bytes);
+    metrics_u32(m, "client_overruns_total", "counter", "Times a lagging client lost data", core.client_overruns);
+    metrics_u32(m, "client_dropped_bytes_total", "counter", "Bytes lost by lagging clients", core.client_dropped);
+    metrics_u32(m, "udp_tx_bytes_total", "counter", "Bytes sent in UDP datagrams", core.udp.bytes);
+    metrics_u32(m, "udp_dropped_bytes_total", "counter", "Bytes overwritten in the ring before UDP could send them",
+                core.udp.dropped);
+    metrics_u32(m, "udp_send_errors_total", "counter", "UDP datagrams lost because sending failed", core.udp.errors);
+
+    log_ring_stats_t lr;
+    log_ring_get_stats(&lr);
+    metrics_u32(m, "log_lost_total", "counter", "Log records dropped because the log ring was full", lr.lost);
+
+    conf_stats_t cs;
+    conf_get_stats(&cs);
+    metrics_u32(m, "config_commits_total", "counter", "NVS transactions writing changed settings", cs.commits);
+    metrics_u32(m, "config_keys_written_total", "counter", "Settings written to NVS", cs.keys_written);
+    metrics_u32(m, "config_unchanged_total", "counter", "Setting writes skipped because the value was unchanged",
+                cs.unchanged);
+    metrics_u32(m, "config_commit_errors_total", "counter", "Failed NVS transactions", cs.errors);
+
+    wifi_stats_t wifi;
+    wifi_get_stats(&wifi);
+    metrics_u32(m, "wifi_connects_total", "counter", "WiFi associations", wifi.connects);
+    metrics_u32(m, "wifi_disconnects_total", "counter", "WiFi disconnections and failed attempts", wifi.disconnects);
+    metrics_u32(m, "wifi_reconnects_total", "counter", "Automatic WiFi reconnection attempts", wifi.reconnects);
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK)
+    {
+        metrics_family(m, "wifi_rssi_dbm", "gauge", "Signal strength of the associated AP");
+        metrics_printf(m, "bridge_wifi_rssi_dbm %d\n", ap.rssi);
+    }
+
+    int mv = adc_read_bat_voltage_mv();
+    if (mv >= 0)
+    {
+        metrics_family(m, "battery_voltage_volts", "gauge", "Battery voltage");
+        metrics_printf(m, "bridge_battery_voltage_volts %d.%03d\n", mv / 1000, mv % 1000);
+    }
+    metrics_u32(m, "battery_charging", "gauge", "1 while the battery is charging", adc_bat_is_charging());
+
+    metrics_u32(m, "heap_size_bytes", "gauge", "Heap size", heap_caps_get_total_size(MALLOC_CAP_DEFAULT));
+    metrics_u32(m, "heap_free_bytes", "gauge", "Free heap", heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+    metrics_u32(m, "heap_min_free_bytes", "gauge", "Lowest free heap since boot",
+                heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT));
+    metrics_u32(m, "heap_largest_free_block_bytes", "gauge", "Largest free heap block",
+                heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+    metrics_family(m, "heap_used_bytes", "gauge", "Heap used by subsystem, the rest is WiFi, BT, lwip and stacks");
+    for (int i = 0; i < STATS_MEM_MAX; i++)
+        metrics_printf(m, "bridge_heap_used_bytes{subsystem=\"%s\"} %u\n", stats_mem_name(i),
+                       (unsigned)stats_mem_get(i));
+
+    if (m->err == ESP_OK && m->len)
+        m->err = httpd_resp_send_chunk(req, m->buf, m->len);
+    esp_err_t err = m->err == ESP_OK ? httpd_resp_send_chunk(req, NULL, 0) : m->err;
+    free(m);
+    return err;
+}
+
+static void http_close_fn(httpd_handle_t hd, int sockfd)
+{
+    /* 会话上下文在调用本函数之后才释放 */
+    if (httpd_sess_get_ctx(hd, sockfd) == &ws_session_tag)
+        telnet_ws_detach(sockfd);
+    else
+        close(sockfd);
+}
+
+esp_err_t http_server_init()
+{
+#if CONFIG_BRIDGE_HTTP_PORT
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = CONFIG_BRIDGE_HTTP_PORT;
+    config.max_open_sockets = 4;
+    config.lru_purge_enable = true;
+    config.close_fn = http_close_fn;
+
+    esp_err_t err = httpd_start(&server, &config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "httpd_start failed %s", esp_err_to_name(err));
+        return err;
+    }
+
+    const httpd_uri_t ws_uri = {
+        .uri = "/ws",
+        .method = HTTP_GET,
+        .handler = ws_handler,
+        .is_websocket = true,
+        .handle_ws_control_frames = true,
+    };
+    httpd_register_uri_handler(server, &ws_uri);
+
+    const httpd_uri_t capture_uri = {
+        .uri = "/capture",
+        .method = HTTP_GET,
+        .handler = capture_handler,
+    };
+    httpd_register_uri_handler(server, &capture_uri);
+
+    const httpd_uri_t log_uri = {
+        .uri = "/log",
+        .method = HTTP_GET,
+        .handler = log_handler,
+    };
+    httpd_register_uri_handler(server, &log_uri);
+
+    const httpd_uri_t metrics_uri = {
+        .uri = "/metrics",
+        .method = HTTP_GET,
+        .handler = metrics_handler,
+    };
+    httpd_register_uri_handler(server, &metrics_uri);
+    ESP_LOGI(TAG, "listening on port %d", CONFIG_BRIDGE_HTTP_PORT);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void http_server_close_session(int fd)
+{
+    if (server)
+        httpd_sess_trigger_close(server, fd);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief 启动 http 服务器，/ws 为 WebSocket 终端，以二进制帧收发串口数据
+ */
+esp_err_t http_server_init();
+
+/**
+ * @brief 请求关闭一个会话，不阻塞，可在任意任务中调用
+ */
+void http_server_close_session(int fd);
+
+#ifdef __cplusplus
+}
+#endif
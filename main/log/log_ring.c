@@ -0,0 +1,503 @@
+#include "log_ring.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_memory_utils.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "stats/stats.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_RING_SIZE CONFIG_BRIDGE_LOG_RING_SIZE
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+#define LOG_RING_REC_MAX 160 // 单条记录的最大长度，参数超出时改为直接输出
+#define LOG_RING_STR_MAX 64  // 单个字符串参数保留的最大长度
+#define LOG_RING_SPEC_MAX 16 // 单个转换说明的最大长度
+#define LOG_RING_LINE_MAX 256
+#define LOG_RING_IDLE_MS 100 // 中断中记录的日志不唤醒输出任务，最迟在此间隔后输出
+#define LOG_RING_WRITE_RETRY 10
+
+typedef enum
+{
+    LOG_ARG_NONE, // %%
+    LOG_ARG_INT,
+    LOG_ARG_INT64,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_PTR,
+    LOG_ARG_STR,
+    LOG_ARG_BAD, // 无法编码，如 * 宽度、%n、long double
+} log_arg_t;
+
+typedef struct
+{
+    log_ring_rec_t hdr;
+    uint8_t args[LOG_RING_REC_MAX - sizeof(log_ring_rec_t)];
+} log_ring_entry_t;
+
+#if CONFIG_BRIDGE_LOG_RING_SIZE
+_Static_assert((LOG_RING_SIZE & LOG_RING_MASK) == 0, "BRIDGE_LOG_RING_SIZE must be a power of two");
+_Static_assert(LOG_RING_SIZE >= 4 * LOG_RING_REC_MAX, "BRIDGE_LOG_RING_SIZE too small");
+
+static const char *TAG = "log_ring";
+
+/*
+ * oldest <= tail <= head，均为按 32 位回绕的字节位置。
+ * [tail, head) 等待输出，[oldest, tail) 已输出但保留供导出，生产者需要空间时从 oldest 起覆盖。
+ * 互斥只用于修改位置与复制记录，格式化不在临界区内进行。
+ */
+static portMUX_TYPE log_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t *log_buf;
+static uint32_t log_head;
+static uint32_t log_tail;
+static uint32_t log_oldest;
+static uint32_t log_lost; // 下一条记录之前丢弃的条数
+static log_ring_stats_t log_stats;
+static TaskHandle_t log_task_handle;
+static int (*log_write)(const char *, uint32_t);
+
+/**
+ * @brief 解析从 % 开始的一个转换说明
+ *
+ * 整数的宽度按本机类型确定，与目标上 va_arg 取参数的宽度一致
+ *
+ * @return const char* 转换说明之后的位置
+ */
+static const char *log_ring_spec(const char *p, log_arg_t *type)
+{
+    p++;
+    while (*p && strchr("-+ #0", *p))
+        p++;
+    while ((*p >= '0' && *p <= '9') || *p == '.')
+        p++;
+
+    size_t size = sizeof(int);
+    *type = LOG_ARG_INT;
+    switch (*p)
+    {
+    case 'h':
+        p += p[1] == 'h' ? 2 : 1;
+        break;
+    case 'l':
+        if (p[1] == 'l')
+        {
+            size = sizeof(long long);
+            p += 2;
+        }
+        else
+        {
+            size = sizeof(long);
+            p++;
+        }
+        break;
+    case 'j':
+        size = sizeof(long long);
+        p++;
+        break;
+    case 'z':
+        size = sizeof(size_t);
+        p++;
+        break;
+    case 't':
+        size = sizeof(ptrdiff_t);
+        p++;
+        break;
+    }
+
+    switch (*p)
+    {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+    case 'c':
+        *type = size == 8 ? LOG_ARG_INT64 : LOG_ARG_INT;
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        *type = LOG_ARG_DOUBLE;
+        break;
+    case 'p':
+        *type = LOG_ARG_PTR;
+        break;
+    case 's':
+        *type = LOG_ARG_STR;
+        break;
+    case '%':
+        *type = LOG_ARG_NONE;
+        break;
+    default:
+        *type = LOG_ARG_BAD;
+        return *p ? p + 1 : p;
+    }
+    return p + 1;
+}
+
+static void log_ring_copy_in(uint32_t pos, const void *data, size_t len)
+{
+    size_t off = pos & LOG_RING_MASK;
+    size_t n = LOG_RING_SIZE - off < len ? LOG_RING_SIZE - off : len;
+    memcpy(log_buf + off, data, n);
+    memcpy(log_buf, (const uint8_t *)data + n, len - n);
+}
+
+static void log_ring_copy_out(uint32_t pos, void *data, size_t len)
+{
+    size_t off = pos & LOG_RING_MASK;
+    size_t n = LOG_RING_SIZE - off < len ? LOG_RING_SIZE - off : len;
+    memcpy(data, log_buf + off, n);
+    memcpy((uint8_t *)data + n, log_buf, len - n);
+}
+
+static uint16_t log_ring_rec_len(uint32_t pos)
+{
+    uint16_t len;
+    log_ring_copy_out(pos, &len, sizeof(len));
+    return len;
+}
+
+/**
+ * @brief 按格式串依次取出参数编码到 args
+ *
+ * @return int 编码后的长度，-1 表示无法编码
+ */
+static int log_ring_encode(const char *fmt, va_list ap, uint8_t *args, size_t size)
+{
+    size_t n = 0;
+    for (const char *p = fmt; (p = strchr(p, '%')) != NULL;)
+    {
+        log_arg_t type;
+        p = log_ring_spec(p, &type);
+        switch (type)
+        {
+        case LOG_ARG_NONE:
+            break;
+        case LOG_ARG_INT:
+        {
+            unsigned int v = va_arg(ap, unsigned int);
+            if (n + sizeof(v) > size)
+                return -1;
+            memcpy(args + n, &v, sizeof(v));
+            n += sizeof(v);
+            break;
+        }
+        case LOG_ARG_INT64:
+        {
+            unsigned long long v = va_arg(ap, unsigned long long);
+            if (n + sizeof(v) > size)
+                return -1;
+            memcpy(args + n, &v, sizeof(v));
+            n += sizeof(v);
+            break;
+        }
+        case LOG_ARG_DOUBLE:
+        {
+            double v = va_arg(ap, double);
+            if (n + sizeof(v) > size)
+                return -1;
+            memcpy(args + n, &v, sizeof(v));
+            n += sizeof(v);
+            break;
+        }
+        case LOG_ARG_PTR:
+        {
+            uintptr_t v = (uintptr_t)va_arg(ap, void *);
+            if (n + sizeof(v) > size)
+                return -1;
+            memcpy(args + n, &v, sizeof(v));
+            n += sizeof(v);
+            break;
+        }
+        case LOG_ARG_STR:
+        {
+            /* 字符串常在调用者的栈上，必须复制内容，放不下的部分截断 */
+            const char *s = va_arg(ap, const char *);
+            if (s == NULL)
+                s = "(null)";
+            if (n + 1 > size)
+                return -1;
+            size_t len = strnlen(s, LOG_RING_STR_MAX);
+            if (len > size - n - 1)
+                len = size - n - 1;
+            args[n++] = len;
+            memcpy(args + n, s, len);
+            n += len;
+            break;
+        }
+        default:
+            return -1;
+        }
+    }
+    return n;
+}
+
+static int log_ring_direct()
+{
+    portENTER_CRITICAL_SAFE(&log_lock);
+    log_stats.direct++;
+    portEXIT_CRITICAL_SAFE(&log_lock);
+    return -1;
+}
+
+int log_ring_vprintf(const char *fmt, va_list ap)
+{
+    if (log_buf == NULL || !esp_ptr_in_drom(fmt))
+        return log_ring_direct();
+
+    log_ring_entry_t rec;
+    va_list copy;
+    va_copy(copy, ap);
+    int n = log_ring_encode(fmt, copy, rec.args, sizeof(rec.args));
+    va_end(copy);
+    if (n < 0)
+        return log_ring_direct();
+    rec.hdr.len = sizeof(rec.hdr) + n;
+    rec.hdr.fmt = (uint32_t)(uintptr_t)fmt;
+    rec.hdr.time = esp_log_timestamp();
+
+    bool wake = false;
+    portENTER_CRITICAL_SAFE(&log_lock);
+    uint32_t head = log_head;
+    while (LOG_RING_SIZE - (head - log_oldest) < rec.hdr.len && log_oldest != log_tail)
+        log_oldest += log_ring_rec_len(log_oldest);
+    if (LOG_RING_SIZE - (head - log_oldest) < rec.hdr.len)
+    {
+        log_lost++;
+        log_stats.lost++;
+    }
+    else
+    {
+        rec.hdr.lost = log_lost > UINT16_MAX ? UINT16_MAX : log_lost;
+        log_lost = 0;
+        log_ring_copy_in(head, &rec, rec.hdr.len);
+        wake = head == log_tail;
+        log_head = head + rec.hdr.len;
+        log_stats.records++;
+    }
+    portEXIT_CRITICAL_SAFE(&log_lock);
+
+    if (wake && !xPortInIsrContext())
+        xTaskNotifyGive(log_task_handle);
+    return 0;
+}
+
+/**
+ * @brief 依次对每个转换说明单独调用 snprintf，还原记录对应的日志文本
+ */
+static size_t log_ring_format(const log_ring_entry_t *rec, char *out, size_t size)
+{
+    const char *p = (const char *)(uintptr_t)rec->hdr.fmt;
+    const uint8_t *args = rec->args;
+    const uint8_t *end = (const uint8_t *)rec + rec->hdr.len;
+    size_t n = 0;
+    while (*p && n < size - 1)
+    {
+        const char *q = strchr(p, '%');
+        size_t lit = q ? (size_t)(q - p) : strlen(p);
+        if (lit > size - 1 - n)
+            lit = size - 1 - n;
+        memcpy(out + n, p, lit);
+        n += lit;
+        if (q == NULL)
+            break;
+
+        log_arg_t type;
+        p = log_ring_spec(q, &type);
+        char spec[LOG_RING_SPEC_MAX];
+        if ((size_t)(p - q) >= sizeof(spec))
+            break;
+        memcpy(spec, q, p - q);
+        spec[p - q] = '\0';
+
+        int r = 0;
+        switch (type)
+        {
+        case LOG_ARG_NONE:
+            r = snprintf(out + n, size - n, "%%");
+            break;
+        case LOG_ARG_INT:
+        {
+            unsigned int v;
+            if (args + sizeof(v) > end)
+                goto exit;
+            memcpy(&v, args, sizeof(v));
+            args += sizeof(v);
+            r = snprintf(out + n, size - n, spec, v);
+            break;
+        }
+        case LOG_ARG_INT64:
+        {
+            unsigned long long v;
+            if (args + sizeof(v) > end)
+                goto exit;
+            memcpy(&v, args, sizeof(v));
+            args += sizeof(v);
+            r = snprintf(out + n, size - n, spec, v);
+            break;
+        }
+        case LOG_ARG_DOUBLE:
+        {
+            double v;
+            if (args + sizeof(v) > end)
+                goto exit;
+            memcpy(&v, args, sizeof(v));
+            args += sizeof(v);
+            r = snprintf(out + n, size - n, spec, v);
+            break;
+        }
+        case LOG_ARG_PTR:
+        {
+            uintptr_t v;
+            if (args + sizeof(v) > end)
+                goto exit;
+            memcpy(&v, args, sizeof(v));
+            args += sizeof(v);
+            r = snprintf(out + n, size - n, spec, (void *)v);
+            break;
+        }
+        case LOG_ARG_STR:
+        {
+            char s[LOG_RING_STR_MAX + 1];
+            if (args + 1 > end || args + 1 + args[0] > end)
+                goto exit;
+            memcpy(s, args + 1, args[0]);
+            s[args[0]] = '\0';
+            args += 1 + args[0];
+            r = snprintf(out + n, size - n, spec, s);
+            break;
+        }
+        default:
+            goto exit;
+        }
+        if (r > 0)
+            n += (size_t)r < size - 1 - n ? (size_t)r : size - 1 - n;
+    }
+exit:
+    out[n] = '\0';
+    return n;
+}
+
+static void log_ring_write(const char *buf, size_t len)
+{
+    /* 输出任务优先级最低，写不进去时等待而不是像直接输出那样丢弃 */
+    for (int retry = 0; len && retry < LOG_RING_WRITE_RETRY;)
+    {
+        int r = log_write(buf, len);
+        if (r > 0)
+        {
+            buf += r;
+            len -= r;
+            continue;
+        }
+        retry++;
+        vTaskDelay(1);
+    }
+}
+
+static void log_ring_task(void *arg)
+{
+    log_ring_entry_t rec;
+    char line[LOG_RING_LINE_MAX];
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(LOG_RING_IDLE_MS));
+        while (1)
+        {
+            portENTER_CRITICAL(&log_lock);
+            uint32_t tail = log_tail;
+            bool empty = tail == log_head;
+            portEXIT_CRITICAL(&log_lock);
+            if (empty)
+                break;
+
+            /* 生产者只覆盖 tail 之前的部分，读取待输出的记录不需要加锁 */
+            log_ring_copy_out(tail, &rec.hdr, sizeof(rec.hdr));
+            log_ring_copy_out(tail + sizeof(rec.hdr), rec.args, rec.hdr.len - sizeof(rec.hdr));
+            if (rec.hdr.lost)
+            {
+                int n = snprintf(line, sizeof(line), "(%u log messages lost)\n", rec.hdr.lost);
+                log_ring_write(line, n);
+            }
+            log_ring_write(line, log_ring_format(&rec, line, sizeof(line)));
+
+            portENTER_CRITICAL(&log_lock);
+            log_tail = tail + rec.hdr.len;
+            portEXIT_CRITICAL(&log_lock);
+        }
+    }
+}
+
+int log_ring_init(int (*write)(const char *, uint32_t))
+{
+    log_write = write;
+    uint8_t *buf = malloc(LOG_RING_SIZE);
+    if (buf == NULL)
+    {
+        ESP_LOGE(TAG, "no memory");
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(log_ring_task, "log_ring", 3072, NULL, 1, &log_task_handle) != pdPASS)
+    {
+        ESP_LOGE(TAG, "xTaskCreate log_ring failed");
+        free(buf);
+        return ESP_FAIL;
+    }
+    stats_mem_alloc(STATS_MEM_LOG, buf);
+    log_stats.capacity = LOG_RING_SIZE;
+    log_buf = buf;
+    return ESP_OK;
+}
+
+size_t log_ring_export(uint8_t *buf, size_t size)
+{
+    if (log_buf == NULL)
+        return 0;
+    /* 一次复制整个保留区，中断关闭的时间约为复制 BRIDGE_LOG_RING_SIZE 字节 */
+    portENTER_CRITICAL(&log_lock);
+    uint32_t from = log_oldest;
+    while (log_head - from > size)
+        from += log_ring_rec_len(from);
+    size_t len = log_head - from;
+    log_ring_copy_out(from, buf, len);
+    portEXIT_CRITICAL(&log_lock);
+    return len;
+}
+
+void log_ring_get_stats(log_ring_stats_t *stats)
+{
+    portENTER_CRITICAL(&log_lock);
+    *stats = log_stats;
+    stats->pending = log_head - log_tail;
+    portEXIT_CRITICAL(&log_lock);
+}
+#else
+int log_ring_init(int (*write)(const char *, uint32_t))
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+int log_ring_vprintf(const char *fmt, va_list ap)
+{
+    return -1;
+}
+
+size_t log_ring_export(uint8_t *buf, size_t size)
+{
+    return 0;
+}
+
+void log_ring_get_stats(log_ring_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+#endif
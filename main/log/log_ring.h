@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LOG_RING_EXPORT_MAGIC 0x31524C57 // "WLR1"
+#define LOG_RING_EXPORT_VERSION 1
+
+/**
+ * @brief 环形缓冲区中的一条日志，其后紧跟按格式串顺序编码的参数，均为小端
+ *
+ * 整数与指针按目标上的实际宽度存为 4 或 8 字节，浮点数存为 8 字节 double，
+ * 字符串存为 1 字节长度加内容（不含结尾的 0，超长截断）。格式串本身不复制，
+ * 只记录其在 flash 中的地址，主机端根据固件 ELF 还原。
+ */
+typedef struct __attribute__((packed))
+{
+    uint16_t len;  // 整条记录的长度，含本头部
+    uint16_t lost; // 本条之前因缓冲区满而丢弃的日志条数，最大 0xFFFF
+    uint32_t fmt;  // 格式串地址
+    uint32_t time; // esp_log_timestamp()，毫秒
+} log_ring_rec_t;
+
+/**
+ * @brief /log 导出文件头，其后依次为缓冲区中保留的记录，从最早的一条开始
+ */
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t hdr_len;       // 本头部长度，供以后扩展
+    uint8_t elf_sha256[32]; // 固件 ELF 文件的 SHA-256，主机端据此确认使用的 ELF 一致
+} log_ring_export_t;
+
+typedef struct
+{
+    uint32_t records;  // 进入缓冲区的日志条数
+    uint32_t lost;     // 缓冲区满而丢弃的条数
+    uint32_t direct;   // 无法延后格式化而直接输出的条数
+    uint32_t pending;  // 尚未输出的字节数
+    uint32_t capacity; // 缓冲区大小，0 表示未启用
+} log_ring_stats_t;
+
+/**
+ * @brief 分配缓冲区并启动输出任务
+ *
+ * @param write 格式化后的日志文本的输出函数，只在输出任务中调用
+ */
+int log_ring_init(int (*write)(const char *, uint32_t));
+
+/**
+ * @brief esp_log 的输出钩子，只记录格式串地址与参数，格式化与输出由低优先级任务完成
+ *
+ * 可被多个任务同时调用，互斥的范围只有预留空间与复制记录。格式串不在 flash 中、
+ * 含有 * 宽度等无法编码的转换，或尚未初始化时返回 -1，调用者应当直接输出该条日志，
+ * 此时它可能先于缓冲区中较早的日志出现。
+ *
+ * @return int 大于等于 0 表示已记录（或因缓冲区满而丢弃）
+ */
+int log_ring_vprintf(const char *fmt, va_list ap);
+
+/**
+ * @brief 复制缓冲区中保留的全部记录，包括已输出但尚未被覆盖的部分
+ *
+ * @param size buf 的大小，不小于 log_ring_stats_t.capacity 时可得到全部记录
+ * @return size_t 复制的字节数，总是以完整的记录结尾
+ */
+size_t log_ring_export(uint8_t *buf, size_t size);
+
+void log_ring_get_stats(log_ring_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,10 +1,14 @@
 #include "adc/adc.h"
+#include "boot/boot_prof.h"
+#include "capture/capture.h"
 #include "config/config.h"
 #include "console/console.h"
 #include "display/display.h"
+#include "http/http_server.h"
 #include "driver/uart.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "freertos/semphr.h"
 #include "hal/gpio_types.h"
 #include "key/key.h"
 #include "nvs_flash.h"
@@ -12,23 +16,118 @@
 #include "wifi_manager/blufi/blufi.h"
 #include "wifi_manager/wifi_manager.h"
 #include "telnet/telnet_server.h"
+#include "timesync/timesync.h"
 #include "usr_uart/usr_uart.h"
 
+#define BOOT_JOB_STACK 4096
+#define BOOT_JOB_WAIT_MS 10000
+
+static const char *TAG = "main";
+
+typedef struct
+{
+    const char *name;
+    void (*init)();
+} boot_job_t;
+
 static int nvs_init();
+static void boot_job_start(const boot_job_t *job);
+static void blufi_job_init();
+
+static const boot_job_t display_job = {"display", display_init};
+static const boot_job_t blufi_job = {"blufi", blufi_job_init};
+
+static SemaphoreHandle_t boot_jobs_done;
+static int boot_jobs;
+
+/*
+ * 串口驱动的接收缓冲区只有约 1 KB，目标与桥同时上电时它的启动输出很快就会溢出，
+ * 因此串口、抓取与转发任务最先启动，之后的数据都进入环形缓冲区，客户端连接时回放。
+ * 显示与蓝牙控制器的初始化较慢且与转发无关，放到各自的任务中与 WiFi 连接并行。
+ */
 void app_main(void)
 {
+    int stage = boot_prof_begin("power");
     key_init();
     adc_init();
     power_manager_init();
+    boot_prof_end(stage);
+
+    stage = boot_prof_begin("nvs");
     esp_event_loop_create_default();
     nvs_init();
+    conf_init();
+    boot_prof_end(stage);
 
+    stage = boot_prof_begin("uart");
     usr_uart_init();
+    boot_prof_end(stage);
+    stage = boot_prof_begin("capture");
+    capture_init();
+    boot_prof_end(stage);
+    stage = boot_prof_begin("bridge");
+    telnet_init();
+    boot_prof_end(stage);
+
+    boot_jobs_done = xSemaphoreCreateCounting(2, 0);
+    boot_job_start(&display_job);
+
+    stage = boot_prof_begin("console");
     console_repl_init();
-    display_init();
+    boot_prof_end(stage);
+    stage = boot_prof_begin("wifi");
     wifi_init();
+    boot_prof_end(stage);
+
+    /* BLUFI 的回调使用 WiFi 与控制台，须在二者之后 */
+    boot_job_start(&blufi_job);
+
+    stage = boot_prof_begin("services");
+    timesync_init();
+    http_server_init();
+    console_net_init();
+    boot_prof_end(stage);
+
+    for (int i = 0; i < boot_jobs; i++)
+    {
+        if (xSemaphoreTake(boot_jobs_done, pdMS_TO_TICKS(BOOT_JOB_WAIT_MS)) != pdTRUE)
+        {
+            ESP_LOGW(TAG, "deferred init still running");
+            break;
+        }
+    }
+    boot_prof_log();
+}
+
+static void boot_job_run(const boot_job_t *job)
+{
+    int stage = boot_prof_begin(job->name);
+    job->init();
+    boot_prof_end(stage);
+}
+
+static void boot_job_task(void *arg)
+{
+    boot_job_run(arg);
+    xSemaphoreGive(boot_jobs_done);
+    vTaskDelete(NULL);
+}
+
+static void boot_job_start(const boot_job_t *job)
+{
+    if (xTaskCreate(boot_job_task, job->name, BOOT_JOB_STACK, (void *)job, 1, NULL) == pdPASS)
+    {
+        boot_jobs++;
+        return;
+    }
+    /* 内存不足时在主任务中直接执行 */
+    ESP_LOGW(TAG, "xTaskCreate %s failed, run inline", job->name);
+    boot_job_run(job);
+}
+
+static void blufi_job_init()
+{
     blufi_init();
-    telnet_init();
 }
 
 static int nvs_init()
@@ -40,4 +139,4 @@ static int nvs_init()
         err = nvs_flash_init();
     }
     return err;
-}
\ No newline at end of file
+}
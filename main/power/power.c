@@ -1,5 +1,6 @@
 #include "power.h"
 #include "adc/adc.h"
+#include "config/config.h"
 #include "driver/gpio.h"
 #include "esp_bt.h"
 #include "esp_event.h"
@@ -86,6 +87,8 @@ void power_manager_init()
 
 void power_manager_shutdown(bool power_wakeup)
 {
+    /* 深度睡眠不经过 esp_restart 的关机回调，需要主动提交 */
+    conf_flush();
     esp_wifi_stop();
     esp_blufi_host_deinit();
     power_oled_power_ctl(false);
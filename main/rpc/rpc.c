@@ -0,0 +1,269 @@
+#include "rpc.h"
+#include "adc/adc.h"
+#include "config/config.h"
+#include "esp_app_desc.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_netif_types.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+#include "usr_uart/usr_uart.h"
+#include "wifi_manager/wifi_manager.h"
+#include <string.h>
+
+#define RPC_STR_MAX 64
+#define RPC_ERR_LEN 5
+
+static const char *TAG = "rpc";
+
+typedef struct
+{
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+} rpc_out_t;
+
+static bool rpc_put(rpc_out_t *out, uint8_t tag, const void *value, size_t len)
+{
+    if (out->len + 2 + len > out->size)
+        return false;
+    out->buf[out->len++] = tag;
+    out->buf[out->len++] = len;
+    memcpy(out->buf + out->len, value, len);
+    out->len += len;
+    return true;
+}
+
+static bool rpc_put_err(rpc_out_t *out, uint8_t tag, esp_err_t err)
+{
+    uint8_t value[RPC_ERR_LEN] = {tag};
+    memcpy(value + 1, &err, sizeof(err));
+    return rpc_put(out, RPC_TAG_ERROR, value, sizeof(value));
+}
+
+/* 设置请求中的整数按 1、2、4 字节小端读取，长度不符时视为无效 */
+static bool rpc_get_uint(const uint8_t *value, size_t len, uint32_t *v)
+{
+    if (len != 1 && len != 2 && len != 4)
+        return false;
+    *v = 0;
+    memcpy(v, value, len);
+    return true;
+}
+
+/**
+ * @brief 读取一个参数的当前值
+ *
+ * @return int 值的长度，负数为 esp_err_t 取反
+ */
+static int rpc_read(uint8_t tag, uint8_t *value)
+{
+    uart_config_t uart;
+    switch (tag)
+    {
+    case RPC_TAG_UART_BAUD:
+    case RPC_TAG_UART_DATA_BITS:
+    case RPC_TAG_UART_STOP_BITS:
+    case RPC_TAG_UART_PARITY:
+        usr_uart_get_param(&uart);
+        if (tag == RPC_TAG_UART_BAUD)
+        {
+            uint32_t baud = uart.baud_rate;
+            memcpy(value, &baud, sizeof(baud));
+            return sizeof(baud);
+        }
+        value[0] = tag == RPC_TAG_UART_DATA_BITS   ? uart.data_bits + 5
+                   : tag == RPC_TAG_UART_STOP_BITS ? uart.stop_bits
+                                                   : uart.parity;
+        return 1;
+    case RPC_TAG_UART_FLOW:
+        value[0] = usr_uart_get_flow();
+        return 1;
+    case RPC_TAG_DEV_NAME:
+    case RPC_TAG_WIFI_SSID: {
+        char str[RPC_STR_MAX] = "";
+        esp_err_t err = tag == RPC_TAG_DEV_NAME ? conf_get_dev_name(str, sizeof(str))
+                                                : conf_get_wifi_ssid(str, sizeof(str));
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+            return -err;
+        memcpy(value, str, strnlen(str, sizeof(str)));
+        return strnlen(str, sizeof(str));
+    }
+    case RPC_TAG_BAT_CAPACITY: {
+        uint16_t v = adc_read_bat_capacity() * 10;
+        memcpy(value, &v, sizeof(v));
+        return sizeof(v);
+    }
+    case RPC_TAG_BAT_VOLTAGE: {
+        uint16_t v = adc_read_bat_voltage_mv();
+        memcpy(value, &v, sizeof(v));
+        return sizeof(v);
+    }
+    case RPC_TAG_BAT_CHARGING:
+        value[0] = adc_bat_is_charging();
+        return 1;
+    case RPC_TAG_IP_INFO: {
+        esp_netif_ip_info_t ip_info = {};
+        wifi_get_ip_info(&ip_info);
+        memcpy(value, &ip_info.ip.addr, 4);
+        memcpy(value + 4, &ip_info.netmask.addr, 4);
+        memcpy(value + 8, &ip_info.gw.addr, 4);
+        return 12;
+    }
+    case RPC_TAG_FW_VERSION: {
+        const esp_app_desc_t *desc = esp_app_get_description();
+        size_t n = strnlen(desc->version, sizeof(desc->version));
+        memcpy(value, desc->version, n);
+        return n;
+    }
+    default:
+        return -ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+/**
+ * @brief 设置一个参数，串口参数只记录在 uart/mask 中，全部解析完后一并生效
+ */
+static esp_err_t rpc_write(uint8_t tag, const uint8_t *value, size_t len, uart_config_t *uart, uint32_t *mask)
+{
+    uint32_t v;
+    char str[RPC_STR_MAX + 1];
+    switch (tag)
+    {
+    case RPC_TAG_UART_BAUD:
+    case RPC_TAG_UART_DATA_BITS:
+    case RPC_TAG_UART_STOP_BITS:
+    case RPC_TAG_UART_PARITY:
+    case RPC_TAG_UART_FLOW:
+        if (!rpc_get_uint(value, len, &v))
+            return ESP_ERR_INVALID_SIZE;
+        if (tag == RPC_TAG_UART_BAUD)
+        {
+            uart->baud_rate = v;
+            *mask |= USR_UART_BAUD_RATE;
+        }
+        else if (tag == RPC_TAG_UART_DATA_BITS)
+        {
+            if (v < 5)
+                return ESP_ERR_INVALID_ARG;
+            uart->data_bits = v - 5;
+            *mask |= USR_UART_DATA_BITS;
+        }
+        else if (tag == RPC_TAG_UART_STOP_BITS)
+        {
+            uart->stop_bits = v;
+            *mask |= USR_UART_STOP_BITS;
+        }
+        else if (tag == RPC_TAG_UART_PARITY)
+        {
+            uart->parity = v;
+            *mask |= USR_UART_PARITY;
+        }
+        else
+        {
+            if (v > USR_UART_FLOW_SW)
+                return ESP_ERR_INVALID_ARG;
+            return usr_uart_set_flow(v);
+        }
+        return ESP_OK;
+    case RPC_TAG_DEV_NAME:
+        if (len > RPC_STR_MAX)
+            return ESP_ERR_INVALID_SIZE;
+        memcpy(str, value, len);
+        str[len] = '\0';
+        for (size_t i = 0; i < len; i++)
+        {
+            if (str[i] < 0x20 || str[i] > 0x7e)
+                return ESP_ERR_INVALID_ARG;
+        }
+        return conf_set_dev_name(str);
+    case RPC_TAG_WIFI_SSID:
+        if (len > sizeof(((wifi_sta_config_t *)0)->ssid) - 1)
+            return ESP_ERR_INVALID_SIZE;
+        return wifi_set_sta_ssid((uint8_t *)value, len);
+    case RPC_TAG_WIFI_PASSWD:
+        if (len > sizeof(((wifi_sta_config_t *)0)->password) - 1)
+            return ESP_ERR_INVALID_SIZE;
+        return wifi_set_sta_passwd((uint8_t *)value, len);
+    case RPC_TAG_WIFI_CONNECT:
+        /* 与 BLUFI 的连接请求相同，已连接时先断开才会按新配置重连 */
+        esp_wifi_disconnect();
+        wifi_connect();
+        return ESP_OK;
+    default:
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+}
+
+static bool rpc_is_uart(uint8_t tag)
+{
+    return tag >= RPC_TAG_UART_BAUD && tag <= RPC_TAG_UART_PARITY;
+}
+
+size_t rpc_handle(const uint8_t *req, size_t len, uint8_t *resp, size_t size)
+{
+    if (len < RPC_HDR_LEN || req[0] != RPC_MAGIC || req[1] != RPC_VERSION || size < RPC_HDR_LEN)
+        return 0;
+
+    /* 先检查 TLV 边界，格式错误的请求不执行任何设置 */
+    for (size_t pos = RPC_HDR_LEN; pos < len; pos += 2 + req[pos + 1])
+    {
+        if (pos + 2 > len || pos + 2 + req[pos + 1] > len)
+        {
+            ESP_LOGW(TAG, "malformed request");
+            return 0;
+        }
+    }
+
+    rpc_out_t out = {.buf = resp, .size = size, .len = RPC_HDR_LEN};
+    resp[0] = RPC_MAGIC;
+    resp[1] = RPC_VERSION;
+    resp[2] = req[2];
+    resp[3] = req[3];
+
+    /* 第一遍收集串口参数并一次生效，第二遍按请求顺序生成应答 */
+    uart_config_t uart = {};
+    uint32_t mask = 0;
+    esp_err_t uart_err = ESP_OK;
+    for (size_t pos = RPC_HDR_LEN; pos < len; pos += 2 + req[pos + 1])
+    {
+        uint8_t tag = req[pos] & ~RPC_SET;
+        if ((req[pos] & RPC_SET) && rpc_is_uart(tag))
+        {
+            esp_err_t err = rpc_write(tag, req + pos + 2, req[pos + 1], &uart, &mask);
+            if (err != ESP_OK && uart_err == ESP_OK)
+                uart_err = err;
+        }
+    }
+    if (mask && uart_err == ESP_OK)
+        uart_err = usr_uart_configure(&uart, mask);
+
+    for (size_t pos = RPC_HDR_LEN; pos < len; pos += 2 + req[pos + 1])
+    {
+        uint8_t tag = req[pos] & ~RPC_SET;
+        esp_err_t err = ESP_OK;
+        if (req[pos] & RPC_SET)
+        {
+            if (rpc_is_uart(tag))
+                err = uart_err;
+            else
+                err = rpc_write(tag, req + pos + 2, req[pos + 1], &uart, &mask);
+        }
+
+        uint8_t value[RPC_STR_MAX];
+        int n = 0;
+        if (err == ESP_OK)
+        {
+            /* 设置后读回当前值，无法读取的参数应答为空值 */
+            n = rpc_read(tag, value);
+            if (n < 0 && (req[pos] & RPC_SET))
+                n = 0;
+            else if (n < 0)
+                err = -n;
+        }
+        bool ok = err == ESP_OK ? rpc_put(&out, tag, value, n) : rpc_put_err(&out, tag, err);
+        if (!ok)
+            break;
+    }
+    return out.len;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * 二进制管理协议，一条请求可以读取或设置任意多个参数，一次往返完成配置。
+ *
+ * 消息：RPC_MAGIC、RPC_VERSION、2 字节请求编号（应答原样带回），其后为若干 TLV。
+ * TLV：1 字节 tag、1 字节长度、值。tag 置 RPC_SET 位表示设置该参数，否则为读取，读取时长度为 0。
+ * 多字节数值均为小端，字符串不含结尾的 0。
+ *
+ * 应答按请求中的顺序，对每个 TLV 给出不含 RPC_SET 位的同名 TLV，值为处理后的当前值；
+ * 处理失败时改为 RPC_TAG_ERROR，值为 1 字节原 tag 与 4 字节 esp_err_t。
+ * 请求中所有串口参数处理完后一并生效并保存。应答放不下时截断，之后的 TLV 没有应答，其中的设置可能已经执行。
+ *
+ * 网络控制台端口上行首为 RPC_MAGIC 时读取一条请求，前面加 RPC_MAGIC 与 2 字节小端长度，应答同样；
+ * BLUFI 自定义数据中首字节为 RPC_MAGIC 的包按消息处理，其余按文本命令处理。
+ */
+#define RPC_MAGIC 0xA5
+#define RPC_VERSION 1
+#define RPC_HDR_LEN 4
+#define RPC_SET 0x80
+#define RPC_MSG_MAX 512
+
+typedef enum
+{
+    RPC_TAG_ERROR = 0x00,
+    RPC_TAG_UART_BAUD = 0x01,      // u32，读取为实际波特率
+    RPC_TAG_UART_DATA_BITS = 0x02, // u8，5 到 8
+    RPC_TAG_UART_STOP_BITS = 0x03, // u8，uart_stop_bits_t：1 为 1 位，2 为 1.5 位，3 为 2 位
+    RPC_TAG_UART_PARITY = 0x04,    // u8，uart_parity_t：0 无校验，2 偶校验，3 奇校验
+    RPC_TAG_UART_FLOW = 0x05,      // u8，usr_uart_flow_t：0 无，1 RTS/CTS，2 XON/XOFF
+    RPC_TAG_DEV_NAME = 0x10,       // 字符串
+    RPC_TAG_WIFI_SSID = 0x11,      // 字符串，读取为最近一次连接成功的 SSID
+    RPC_TAG_WIFI_PASSWD = 0x12,    // 字符串，只能设置
+    RPC_TAG_WIFI_CONNECT = 0x13,   // 只能设置，无值，用已设置的 SSID 与密码重新连接
+    RPC_TAG_BAT_CAPACITY = 0x20,   // u16，0.1%
+    RPC_TAG_BAT_VOLTAGE = 0x21,    // u16，mV
+    RPC_TAG_BAT_CHARGING = 0x22,   // u8
+    RPC_TAG_IP_INFO = 0x30,        // 3 个 u32：地址、掩码、网关，网络字节序
+    RPC_TAG_FW_VERSION = 0x31,     // 字符串
+} rpc_tag_t;
+
+/**
+ * @brief 处理一条请求
+ *
+ * @param resp 应答缓冲区，通常为 RPC_MSG_MAX 字节
+ * @return size_t 应答长度，请求格式错误时为 0
+ */
+size_t rpc_handle(const uint8_t *req, size_t len, uint8_t *resp, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,79 @@
+#include "stats.h"
+#include "driver/uart.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+static const char *const stats_mem_names[STATS_MEM_MAX] = {
+    [STATS_MEM_CLIENTS] = "clients",
+    [STATS_MEM_TLS] = "tls",
+    [STATS_MEM_LOG] = "log",
+    [STATS_MEM_CAPTURE] = "capture",
+    [STATS_MEM_CONSOLE] = "console",
+};
+
+static const char *const stats_uart_event_names[UART_EVENT_MAX] = {
+    [UART_DATA] = "data",
+    [UART_BREAK] = "break",
+    [UART_BUFFER_FULL] = "buffer_full",
+    [UART_FIFO_OVF] = "fifo_ovf",
+    [UART_FRAME_ERR] = "frame_err",
+    [UART_PARITY_ERR] = "parity_err",
+    [UART_DATA_BREAK] = "data_break",
+    [UART_PATTERN_DET] = "pattern_det",
+};
+
+/* mbedtls 可能在任何任务中分配，ESP32-C3 没有原子指令，用临界区保护 */
+static portMUX_TYPE stats_mem_lock = portMUX_INITIALIZER_UNLOCKED;
+static size_t stats_mem[STATS_MEM_MAX];
+
+void stats_mem_alloc(stats_mem_t sub, void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    size_t size = heap_caps_get_allocated_size(ptr);
+    portENTER_CRITICAL(&stats_mem_lock);
+    stats_mem[sub] += size;
+    portEXIT_CRITICAL(&stats_mem_lock);
+}
+
+void stats_mem_free(stats_mem_t sub, void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    size_t size = heap_caps_get_allocated_size(ptr);
+    portENTER_CRITICAL(&stats_mem_lock);
+    stats_mem[sub] -= size;
+    portEXIT_CRITICAL(&stats_mem_lock);
+}
+
+size_t stats_mem_get(stats_mem_t sub)
+{
+    return stats_mem[sub];
+}
+
+const char *stats_mem_name(stats_mem_t sub)
+{
+    return stats_mem_names[sub];
+}
+
+const char *stats_uart_event_name(int type)
+{
+    return type >= 0 && type < UART_EVENT_MAX ? stats_uart_event_names[type] : NULL;
+}
+
+#if CONFIG_MBEDTLS_CUSTOM_MEM_ALLOC
+/* 与 CONFIG_MBEDTLS_INTERNAL_MEM_ALLOC 相同只使用内部 RAM，另外计入统计 */
+void *esp_mbedtls_mem_calloc(size_t n, size_t size)
+{
+    void *ptr = heap_caps_calloc(n, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    stats_mem_alloc(STATS_MEM_TLS, ptr);
+    return ptr;
+}
+
+void esp_mbedtls_mem_free(void *ptr)
+{
+    stats_mem_free(STATS_MEM_TLS, ptr);
+    heap_caps_free(ptr);
+}
+#endif
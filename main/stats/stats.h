@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 按子系统统计的堆内存，未列出的（WiFi、蓝牙、lwip、任务栈等）合计为剩余部分 */
+typedef enum
+{
+    STATS_MEM_CLIENTS, // 转发客户端的连接状态与 MCCP 压缩上下文
+    STATS_MEM_TLS,     // mbedtls 的全部分配，包括 TLS 会话与 BLUFI 协商
+    STATS_MEM_LOG,     // 延后格式化的日志缓冲区
+    STATS_MEM_CAPTURE, // 抓取记录的写入缓冲区
+    STATS_MEM_CONSOLE, // 控制台输出重定向的行缓冲
+    STATS_MEM_MAX,
+} stats_mem_t;
+
+/**
+ * @brief 记录一次分配，ptr 为 NULL 时忽略，按堆中实际占用的大小计入
+ */
+void stats_mem_alloc(stats_mem_t sub, void *ptr);
+
+/**
+ * @brief 记录一次释放，须在 free 之前调用
+ */
+void stats_mem_free(stats_mem_t sub, void *ptr);
+
+/**
+ * @brief 子系统当前占用的字节数
+ */
+size_t stats_mem_get(stats_mem_t sub);
+
+const char *stats_mem_name(stats_mem_t sub);
+
+/**
+ * @brief uart_event_type_t 的名称，控制台与 /metrics 共用，未知类型返回 NULL
+ */
+const char *stats_uart_event_name(int type);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,82 @@
+#include "telnet_codec.h"
+#include <string.h>
+
+#define ONES 0x01010101u
+#define HIGHS 0x80808080u
+
+/* 字中任意字节为 0 时返回非零值，最低的置位字节即第一个 0 字节（小端） */
+static inline uint32_t word_has_zero(uint32_t v)
+{
+    return (v - ONES) & ~v & HIGHS;
+}
+
+static inline uint32_t word_special(uint32_t v, bool with_cr)
+{
+    uint32_t mask = word_has_zero(~v);
+    if (with_cr)
+        mask |= word_has_zero(v ^ (0x0du * ONES));
+    return mask;
+}
+
+static inline bool byte_special(uint8_t c, bool with_cr)
+{
+    return c == 0xff || (with_cr && c == 0x0d);
+}
+
+size_t telnet_codec_scan(const uint8_t *data, size_t len, bool with_cr)
+{
+    size_t i = 0;
+
+    /* 对齐到 4 字节，C3 不支持高效的非对齐访问 */
+    while (i < len && ((uintptr_t)(data + i) & 3))
+    {
+        if (byte_special(data[i], with_cr))
+            return i;
+        i++;
+    }
+
+    for (; i + 4 <= len; i += 4)
+    {
+        uint32_t word;
+        memcpy(&word, data + i, sizeof(word));
+        uint32_t mask = word_special(word, with_cr);
+        if (mask)
+            return i + (__builtin_ctz(mask) >> 3);
+    }
+
+    for (; i < len; i++)
+    {
+        if (byte_special(data[i], with_cr))
+            return i;
+    }
+    return len;
+}
+
+size_t telnet_codec_escape(const uint8_t *src, size_t len, uint8_t *dst, size_t cap, size_t *consumed)
+{
+    size_t in = 0, out = 0;
+    while (in < len && out < cap)
+    {
+        size_t span = telnet_codec_scan(src + in, len - in, false);
+        if (span > cap - out)
+            span = cap - out;
+        memcpy(dst + out, src + in, span);
+        in += span;
+        out += span;
+
+        if (in == len || out == cap)
+            break;
+
+        /* src[in] 为 0xFF，空间不足以放下完整的转义对时留到下一次，连续的 0xFF 在此一并处理 */
+        if (cap - out < 2)
+            break;
+        do
+        {
+            dst[out++] = 0xff;
+            dst[out++] = 0xff;
+            in++;
+        } while (in < len && src[in] == 0xff && cap - out >= 2);
+    }
+    *consumed = in;
+    return out;
+}
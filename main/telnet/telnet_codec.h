@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief 按 32 位字扫描需要 telnet 特殊处理的字节
+ *
+ * @param with_cr 为 true 时 0x0D 也视为特殊字节（用于 CR NUL 处理）
+ * @return size_t 第一个 0xFF（或 0x0D）的偏移，不存在时返回 len
+ */
+size_t telnet_codec_scan(const uint8_t *data, size_t len, bool with_cr);
+
+/**
+ * @brief IAC 转义编码，将 0xFF 加倍，不会拆分转义对
+ *
+ * @param dst 输出缓冲区
+ * @param cap 输出缓冲区长度
+ * @param consumed 实际编码的输入字节数
+ * @return size_t 输出长度
+ */
+size_t telnet_codec_escape(const uint8_t *src, size_t len, uint8_t *dst, size_t cap, size_t *consumed);
+
+#ifdef __cplusplus
+}
+#endif
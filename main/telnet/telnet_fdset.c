@@ -0,0 +1,44 @@
+#include "telnet_fdset.h"
+
+/* 最大的描述符离开两个集合后向下收缩，只要仍在任一集合中就保留 */
+static void fdset_shrink(telnet_fdset_t *set)
+{
+    while (set->max_fd >= 0 && !FD_ISSET(set->max_fd, &set->rfds) && !FD_ISSET(set->max_fd, &set->wfds))
+        set->max_fd--;
+}
+
+void telnet_fdset_init(telnet_fdset_t *set)
+{
+    FD_ZERO(&set->rfds);
+    FD_ZERO(&set->wfds);
+    set->max_fd = -1;
+}
+
+void telnet_fdset_watch(telnet_fdset_t *set, int fd)
+{
+    FD_SET(fd, &set->rfds);
+    if (fd > set->max_fd)
+        set->max_fd = fd;
+}
+
+void telnet_fdset_unwatch(telnet_fdset_t *set, int fd)
+{
+    FD_CLR(fd, &set->rfds);
+    FD_CLR(fd, &set->wfds);
+    fdset_shrink(set);
+}
+
+void telnet_fdset_watch_write(telnet_fdset_t *set, int fd, bool enable)
+{
+    if (enable)
+    {
+        FD_SET(fd, &set->wfds);
+        if (fd > set->max_fd)
+            set->max_fd = fd;
+    }
+    else if (FD_ISSET(fd, &set->wfds))
+    {
+        FD_CLR(fd, &set->wfds);
+        fdset_shrink(set);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <sys/select.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief telnet_srv 持久的 select 集合，只在连接建立、关闭与发送阻塞状态变化时修改
+ *
+ * 读集合同时用作异常集合，可写集合只包含发送阻塞的连接；max_fd 为两个集合中最大的描述符。
+ */
+typedef struct
+{
+    fd_set rfds;
+    fd_set wfds;
+    int max_fd; // -1 表示两个集合都为空
+} telnet_fdset_t;
+
+void telnet_fdset_init(telnet_fdset_t *set);
+
+/**
+ * @brief 监听可读与异常
+ */
+void telnet_fdset_watch(telnet_fdset_t *set, int fd);
+
+/**
+ * @brief 从两个集合中移除，连接关闭时调用
+ */
+void telnet_fdset_unwatch(telnet_fdset_t *set, int fd);
+
+/**
+ * @brief 开始或停止等待可写，不影响读集合
+ */
+void telnet_fdset_watch_write(telnet_fdset_t *set, int fd, bool enable);
+
+#ifdef __cplusplus
+}
+#endif
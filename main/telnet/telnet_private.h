@@ -0,0 +1,176 @@
+#pragma once
+
+#include "bridge/bridge_deflate.h"
+#include "bridge/bridge_flush.h"
+#include "bridge/bridge_ring.h"
+#include "esp_err.h"
+#include "hal/uart_types.h"
+#include "sdkconfig.h"
+#include "telnet_server.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TELNET_TX_BUF 512
+#define TELNET_SB_BUF 48
+
+/* 一个 TLS 连接的 mbedTLS 上下文：收发记录缓冲区，另按 2 KB 估算会话与加密状态 */
+#if CONFIG_MBEDTLS_ASYMMETRIC_CONTENT_LEN
+#define TELNET_TLS_MEM (CONFIG_MBEDTLS_SSL_IN_CONTENT_LEN + CONFIG_MBEDTLS_SSL_OUT_CONTENT_LEN + 2048)
+#else
+#define TELNET_TLS_MEM (2 * CONFIG_MBEDTLS_SSL_MAX_CONTENT_LEN + 2048)
+#endif
+
+#define TELNET_IAC 255           /* FF interpret as command: */
+#define TELNET_DONT 254          /* FE you are not to use option */
+#define TELNET_DO 253            /* FD please, you use option */
+#define TELNET_WONT 252          /* FC I won't use option */
+#define TELNET_WILL 251          /* FB I TELNET_WILL use option */
+#define TELNET_SB 250            /* FA interpret as subnegotiation */
+#define TELNET_SE 240            /* F0 end sub negotiation */
+#define TELNET_NOP 241           /* F1 No Operation */
+#define TELNET_EOF 236
+
+#define TELOPT_BINARY 0     /* 00 8-bit data path (RFC 856) */
+#define TELOPT_ECHO 1       /* 01 echo */
+#define TELOPT_SGA 3        /* 03 suppress go ahead */
+#define TELOPT_TTYPE 24     /* 18 terminal type */
+#define TELOPT_NAWS 31      /* 1F window size */
+#define TELOPT_NEW_ENVIRON 39 /* 27 环境变量 (RFC 1572) */
+#define TELOPT_COM_PORT 44  /* 2C com port control (RFC 2217) */
+#define TELOPT_COMPRESS2 86 /* 56 MCCP2 zlib 压缩输出 */
+#define TELOPT_BREAK 0xf3   /* F3 Break */
+
+/* NEW-ENVIRON 子协商 */
+#define ENV_IS 0
+#define ENV_SEND 1
+#define ENV_INFO 2
+#define ENV_VAR 0
+#define ENV_VALUE 1
+#define ENV_ESC 2
+#define ENV_USERVAR 3
+
+/* 会话握手应答状态 */
+#define TELNET_SESSION_RESUMED 0 // 从请求的位置继续，没有遗漏
+#define TELNET_SESSION_NEW 1     // 令牌无效或未提供，分配了新会话
+#define TELNET_SESSION_GAP 2     // 请求的位置已被覆盖，从最早的数据继续
+
+typedef enum
+{
+    FSM_IDLE,
+    FSM_OPT,
+    FSM_CMD,
+    FSM_SUB_CMD,
+    FSM_SUB_CMD_OPT,
+    FSM_SKIP_NULL,
+} TELNET_IAC_FSM;
+
+typedef enum
+{
+    TELNET_MODE_TELNET,  // 完整的 telnet 协议处理
+    TELNET_MODE_RAW,     // 原始端口，数据原样透传
+    TELNET_MODE_WS,      // WebSocket 二进制帧，由 http 服务器接收，本模块只负责发送
+    TELNET_MODE_SESSION, // 握手后与原始端口相同，断线后可凭令牌与位置续传
+} TelnetMode;
+
+typedef struct telnet_tls telnet_tls_t;
+
+typedef struct TelnetConnect
+{
+    struct TelnetConnect *next;
+    int fd;
+    char ip_str[32];
+    TelnetMode mode;
+    TELNET_IAC_FSM fsm;
+    int opt;
+    bool binary_rx; // 客户端以二进制模式发送，不再处理 CR NUL
+    bool binary_tx;
+    bool com_port;  // 已启用 RFC 2217
+    bool new_environ; // 客户端同意发送环境变量 (NEW-ENVIRON)
+    bool timestamps; // 客户端通过环境变量 TIMESTAMP 要求在每行开头加上接收时间
+    bool ts_bol;     // 下一个发出的字节位于行首
+    bool suspended; // 客户端请求暂停发送 (FLOWCONTROL-SUSPEND)
+    bool flow_exempt; // 长时间无进展，不再参与串口流控
+    int64_t replay_deadline; // 非 0 时等待客户端通过 NEW-ENVIRON 选择回放长度，期间不发送串口数据
+    uint32_t scrollback;     // 开始转发前回放的历史数据长度
+    bool session_hello;      // 会话连接尚未收到握手，期间不发送串口数据
+    uint32_t session;        // 会话号，0 表示不是会话连接
+    telnet_tls_t *tls;       // 非空时收发都经过 TLS
+    int64_t last_progress;
+    uint8_t sb_len;
+    uint8_t sb_buf[TELNET_SB_BUF];
+    uint32_t uart_pending_mask;  // 本批数据中请求修改的串口参数，USR_UART_*
+    uart_config_t uart_pending;
+    uint32_t uart_reply_mask;    // 参数生效后需要回复实际值的命令
+    bridge_ring_cursor_t cursor;
+    bridge_flush_t flush;
+    bool tx_blocked; // 发送缓冲区已满，等待可写
+    bool ws_closing;       // 已回复 CLOSE 帧，发完后关闭连接
+    uint16_t ws_remaining; // 当前 WebSocket 帧尚未发送的负载长度
+    bridge_deflate_t *mccp; // 非空时发往客户端的全部数据都进入压缩流
+    uint64_t mccp_cycles;   // 压缩消耗的 CPU 周期
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint16_t tx_len; // 暂存区中已转义待发送的数据
+    uint16_t tx_off;
+    uint8_t tx_buf[TELNET_TX_BUF];
+} TelnetConnect_t;
+
+/**
+ * @brief 将协议数据追加到暂存区，保证其与已转义数据的先后顺序
+ */
+void telnet_client_queue(TelnetConnect_t *client, const void *data, size_t len);
+
+/**
+ * @brief 接收会话握手，完整后定位游标并回复令牌与起始位置
+ *
+ * @return int 消耗的字节数，握手无效返回 -1
+ */
+int telnet_session_proc_hello(TelnetConnect_t *client, const uint8_t *data, size_t len);
+
+/**
+ * @brief 创建 tls 任务，证书在该任务中加载或生成，不阻塞调用者
+ */
+esp_err_t telnet_tls_start();
+
+/**
+ * @brief 将已接受的连接交给 tls 任务握手，队列满时返回 false
+ *
+ * 握手结束后 tls 任务调用 telnet_tls_done，失败时 tls 为 NULL，套接字始终由转发任务关闭
+ */
+bool telnet_tls_handshake_start(int fd);
+void telnet_tls_done(int fd, telnet_tls_t *tls);
+void telnet_tls_free(telnet_tls_t *tls);
+
+/**
+ * @brief 与 lwip_send/lwip_recv 语义相同，需要等待时返回 -1 并置 errno 为 EWOULDBLOCK
+ *
+ * 因发送缓冲区满而返回的记录在重试时只接受同一段数据，长度会被截断为上次的长度
+ */
+int telnet_tls_send(telnet_tls_t *tls, const void *data, size_t len);
+int telnet_tls_recv(telnet_tls_t *tls, void *buf, size_t len);
+
+/**
+ * @brief 已解密未读取的字节数，这部分数据不会再触发 select
+ */
+size_t telnet_tls_pending(const telnet_tls_t *tls);
+
+void telnet_tls_get_stats(telnet_tls_stats_t *stats);
+
+/**
+ * @brief 处理一条完整的 COM-PORT-OPTION 子协商，sb_buf[0] 为选项号
+ */
+void telnet_rfc2217_proc_sb(TelnetConnect_t *client);
+
+/**
+ * @brief 一次性应用本批数据中累积的串口参数修改并回复实际值
+ */
+void telnet_rfc2217_apply(TelnetConnect_t *client);
+
+#ifdef __cplusplus
+}
+#endif
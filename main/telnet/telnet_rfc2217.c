@@ -0,0 +1,256 @@
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "telnet_private.h"
+#include "usr_uart/usr_uart.h"
+#include <string.h>
+
+/* RFC 2217 客户端命令，服务器回复为命令号 + 100 */
+#define CPC_SIGNATURE 0
+#define CPC_SET_BAUDRATE 1
+#define CPC_SET_DATASIZE 2
+#define CPC_SET_PARITY 3
+#define CPC_SET_STOPSIZE 4
+#define CPC_SET_CONTROL 5
+#define CPC_FLOWCONTROL_SUSPEND 8
+#define CPC_FLOWCONTROL_RESUME 9
+#define CPC_SET_LINESTATE_MASK 10
+#define CPC_SET_MODEMSTATE_MASK 11
+#define CPC_PURGE_DATA 12
+#define CPC_SERVER_OFFSET 100
+
+#define CPC_SIGNATURE_TEXT "wifi_uart"
+
+static const char *TAG = "rfc2217";
+
+static void rfc2217_reply(TelnetConnect_t *client, uint8_t cmd, const uint8_t *value, size_t len)
+{
+    uint8_t buf[TELNET_SB_BUF * 2 + 6];
+    size_t n = 0;
+    buf[n++] = TELNET_IAC;
+    buf[n++] = TELNET_SB;
+    buf[n++] = TELOPT_COM_PORT;
+    buf[n++] = cmd + CPC_SERVER_OFFSET;
+    for (size_t i = 0; i < len && n < sizeof(buf) - 3; i++)
+    {
+        buf[n++] = value[i];
+        if (value[i] == TELNET_IAC)
+            buf[n++] = TELNET_IAC;
+    }
+    buf[n++] = TELNET_IAC;
+    buf[n++] = TELNET_SE;
+    telnet_client_queue(client, buf, n);
+}
+
+static void rfc2217_reply_u8(TelnetConnect_t *client, uint8_t cmd, uint8_t value)
+{
+    rfc2217_reply(client, cmd, &value, 1);
+}
+
+static uint8_t rfc2217_parity_value(uart_parity_t parity)
+{
+    switch (parity)
+    {
+    case UART_PARITY_ODD:
+        return 2;
+    case UART_PARITY_EVEN:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+static uint8_t rfc2217_stopsize_value(uart_stop_bits_t stop_bits)
+{
+    switch (stop_bits)
+    {
+    case UART_STOP_BITS_2:
+        return 2;
+    case UART_STOP_BITS_1_5:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+/* 收发共用一种流控方式，出向用 1 到 3 表示，入向用 14 到 16 */
+static uint8_t rfc2217_flow_value()
+{
+    usr_uart_flow_t flow = usr_uart_get_flow();
+    return flow == USR_UART_FLOW_HW ? 3 : flow == USR_UART_FLOW_SW ? 2 : 1;
+}
+
+static void rfc2217_set_flow(TelnetConnect_t *client, uint8_t value)
+{
+    usr_uart_flow_t flow = value == 3 ? USR_UART_FLOW_HW : value == 2 ? USR_UART_FLOW_SW : USR_UART_FLOW_NONE;
+    if (usr_uart_set_flow(flow) != ESP_OK)
+        ESP_LOGW(TAG, "%d:%s set flow control %d failed", client->fd, client->ip_str, value);
+}
+
+/**
+ * @brief 设置或查询流控与线路控制信号，回复总是设置后的实际状态
+ */
+static void rfc2217_set_control(TelnetConnect_t *client, uint8_t value)
+{
+    switch (value)
+    {
+    case 0: // 查询流控
+    case 1: // 无流控
+    case 2: // XON/XOFF
+    case 3: // 硬件流控
+        if (value)
+            rfc2217_set_flow(client, value);
+        value = rfc2217_flow_value();
+        break;
+    case 4: // 查询 BREAK
+    case 5: // BREAK ON
+    case 6: // BREAK OFF
+        if (value != 4 && usr_uart_set_break(value == 5) != ESP_OK)
+            ESP_LOGW(TAG, "%d:%s set BREAK failed", client->fd, client->ip_str);
+        value = usr_uart_get_break() ? 5 : 6;
+        break;
+    case 7: // 查询 DTR
+    case 8: // DTR ON
+    case 9: // DTR OFF
+        if (value != 7 && usr_uart_set_dtr(value == 8) != ESP_OK)
+            ESP_LOGW(TAG, "%d:%s DTR not available", client->fd, client->ip_str);
+        value = usr_uart_get_dtr() ? 8 : 9;
+        break;
+    case 10: // 查询 RTS
+    case 11: // RTS ON
+    case 12: // RTS OFF
+        if (value != 10 && usr_uart_set_rts(value == 11) != ESP_OK)
+            ESP_LOGW(TAG, "%d:%s RTS not available", client->fd, client->ip_str);
+        value = usr_uart_get_rts() ? 11 : 12;
+        break;
+    case 13: // 查询入向流控
+    case 14: // 无流控
+    case 15: // XON/XOFF
+    case 16: // 硬件流控
+        if (value != 13)
+            rfc2217_set_flow(client, value - 13);
+        value = rfc2217_flow_value() + 13;
+        break;
+    case 17: // DCD 流控
+    case 18: // DTR 流控
+    case 19: // DSR 流控
+        /* 不受硬件支持，回复当前的入向流控 */
+        value = rfc2217_flow_value() + 13;
+        break;
+    default:
+        break;
+    }
+    rfc2217_reply_u8(client, CPC_SET_CONTROL, value);
+}
+
+void telnet_rfc2217_proc_sb(TelnetConnect_t *client)
+{
+    if (client->sb_len < 2 || client->sb_buf[0] != TELOPT_COM_PORT || !client->com_port)
+        return;
+
+    uint8_t cmd = client->sb_buf[1];
+    const uint8_t *value = client->sb_buf + 2;
+    size_t len = client->sb_len - 2;
+    uart_config_t *pending = &client->uart_pending;
+
+    switch (cmd)
+    {
+    case CPC_SIGNATURE:
+        rfc2217_reply(client, cmd, (const uint8_t *)CPC_SIGNATURE_TEXT, strlen(CPC_SIGNATURE_TEXT));
+        break;
+    case CPC_SET_BAUDRATE:
+        if (len < 4)
+            break;
+        pending->baud_rate = (uint32_t)value[0] << 24 | value[1] << 16 | value[2] << 8 | value[3];
+        if (pending->baud_rate)
+            client->uart_pending_mask |= USR_UART_BAUD_RATE;
+        client->uart_reply_mask |= USR_UART_BAUD_RATE;
+        break;
+    case CPC_SET_DATASIZE:
+        if (len < 1)
+            break;
+        if (value[0] >= 5 && value[0] <= 8)
+        {
+            pending->data_bits = value[0] - 5;
+            client->uart_pending_mask |= USR_UART_DATA_BITS;
+        }
+        client->uart_reply_mask |= USR_UART_DATA_BITS;
+        break;
+    case CPC_SET_PARITY:
+        if (len < 1)
+            break;
+        /* MARK/SPACE 不受硬件支持，回复当前值 */
+        if (value[0] >= 1 && value[0] <= 3)
+        {
+            pending->parity = value[0] == 2 ? UART_PARITY_ODD : value[0] == 3 ? UART_PARITY_EVEN : UART_PARITY_DISABLE;
+            client->uart_pending_mask |= USR_UART_PARITY;
+        }
+        client->uart_reply_mask |= USR_UART_PARITY;
+        break;
+    case CPC_SET_STOPSIZE:
+        if (len < 1)
+            break;
+        if (value[0] >= 1 && value[0] <= 3)
+        {
+            pending->stop_bits = value[0] == 2   ? UART_STOP_BITS_2
+                                 : value[0] == 3 ? UART_STOP_BITS_1_5
+                                                 : UART_STOP_BITS_1;
+            client->uart_pending_mask |= USR_UART_STOP_BITS;
+        }
+        client->uart_reply_mask |= USR_UART_STOP_BITS;
+        break;
+    case CPC_SET_CONTROL:
+        if (len < 1)
+            break;
+        rfc2217_set_control(client, value[0]);
+        break;
+    case CPC_FLOWCONTROL_SUSPEND:
+    case CPC_FLOWCONTROL_RESUME:
+        client->suspended = cmd == CPC_FLOWCONTROL_SUSPEND;
+        break;
+    case CPC_SET_LINESTATE_MASK:
+    case CPC_SET_MODEMSTATE_MASK:
+        /* 不主动上报线路与 modem 状态，仅确认 */
+        if (len < 1)
+            break;
+        rfc2217_reply_u8(client, cmd, value[0]);
+        break;
+    case CPC_PURGE_DATA:
+        if (len < 1)
+            break;
+        /* 1: 丢弃尚未发给该客户端的串口数据；2: 串口发送缓冲区无法丢弃，仅确认 */
+        if (value[0] == 1 || value[0] == 3)
+            bridge_ring_cursor_init(&client->cursor, 0);
+        rfc2217_reply_u8(client, cmd, value[0]);
+        break;
+    default:
+        ESP_LOGI(TAG, "%d:%s unsupported command %d", client->fd, client->ip_str, cmd);
+        break;
+    }
+}
+
+void telnet_rfc2217_apply(TelnetConnect_t *client)
+{
+    if (client->uart_pending_mask)
+    {
+        usr_uart_set_param(&client->uart_pending, client->uart_pending_mask);
+        client->uart_pending_mask = 0;
+    }
+
+    if (client->uart_reply_mask == 0)
+        return;
+
+    uart_config_t config;
+    usr_uart_get_param(&config);
+    if (client->uart_reply_mask & USR_UART_BAUD_RATE)
+    {
+        uint8_t baud[4] = {config.baud_rate >> 24, config.baud_rate >> 16, config.baud_rate >> 8, config.baud_rate};
+        rfc2217_reply(client, CPC_SET_BAUDRATE, baud, sizeof(baud));
+    }
+    if (client->uart_reply_mask & USR_UART_DATA_BITS)
+        rfc2217_reply_u8(client, CPC_SET_DATASIZE, config.data_bits + 5);
+    if (client->uart_reply_mask & USR_UART_PARITY)
+        rfc2217_reply_u8(client, CPC_SET_PARITY, rfc2217_parity_value(config.parity));
+    if (client->uart_reply_mask & USR_UART_STOP_BITS)
+        rfc2217_reply_u8(client, CPC_SET_STOPSIZE, rfc2217_stopsize_value(config.stop_bits));
+    client->uart_reply_mask = 0;
+}
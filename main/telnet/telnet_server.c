@@ -1,137 +1,282 @@
 
 
+#include "telnet_server.h"
+#include "telnet_codec.h"
+#include "telnet_fdset.h"
+#include "telnet_private.h"
+#include "boot/boot_prof.h"
+#include "bridge/bridge_flush.h"
+#include "bridge/bridge_ring.h"
+#include "bridge/bridge_udp.h"
+#include "capture/capture.h"
 #include "cc.h"
 #include "driver/uart.h"
+#include "esp_cpu.h"
 #include "esp_err.h"
 #include "esp_event.h"
+#include "esp_http_server.h"
 #include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_vfs_eventfd.h"
+#include "esp_wifi.h"
 #include "events/events.h"
+#include "http/http_server.h"
 #include "freertos/portmacro.h"
 #include "freertos/projdefs.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "lwip/inet.h"
 #include "lwip/ip_addr.h"
 #include "lwip/sockets.h"
+#include "stats/stats.h"
+#include "timesync/timesync.h"
 #include "usr_uart/usr_uart.h"
 #include "wifi_manager/wifi_manager.h"
 #include <assert.h>
 #include <errno.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <inttypes.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/_default_fcntl.h>
 #include <sys/errno.h>
 #include <sys/select.h>
 #include <sys/unistd.h>
-
-#define CLIENT_MAX 8
+#include <time.h>
 
 #define TELNET_PORT 23
-#define TELNET_TX_BUF 1024
-
-#define TELNET_IAC 255           /* FF interpret as command: */
-#define TELNET_DONT 254          /* FE you are not to use option */
-#define TELNET_DO 253            /* FD please, you use option */
-#define TELNET_WONT 252          /* FC I won't use option */
-#define TELNET_WILL 251          /* FB I TELNET_WILL use option */
-#define TELNET_SB 250            /* FA interpret as subnegotiation */
-#define TELNET_SE 240            /* F0 end sub negotiation */
-#define TELNET_NOP 241           /* F1 No Operation */
-#define TELNET_EOF 236
-
-#define TELOPT_ECHO 1     /* 01 echo */
-#define TELOPT_SGA 3      /* 03 suppress go ahead */
-#define TELOPT_TTYPE 24   /* 18 terminal type */
-#define TELOPT_NAWS 31    /* 1F window size */
-#define TELOPT_BREAK 0xf3 /* F3 Break */
-
-static const char *TAG = "telnet";
+#define TELNET_LISTEN_BACKLOG 4
+#define TELNET_MSG_QUEUE_LEN 8
+#define TELNET_TX_POLL_US 10000
+#define TELNET_FLOW_POLL_US 100000
+/* 无需转义的连续数据达到该长度时直接从环形缓冲区发送，否则经暂存区转义后发送 */
+#define TELNET_DIRECT_SEND_MIN 64
+/* 每批压缩的转义后数据上限，压缩结果放入暂存区后仍为协议应答与压缩流结尾留出空间 */
+#define TELNET_MCCP_CHUNK 384
+/* 行首时间戳的最大长度，含结尾的 NUL */
+#define TELNET_TS_PREFIX_MAX 24
+/* 等待 telnet 客户端回复 NEW-ENVIRON 的最长时间，超时按默认长度回放 */
+#define TELNET_REPLAY_WAIT_US 500000
+/* 握手在 tls 任务中进行，本任务只做 TLS 记录的加解密 */
+#define TELNET_TASK_STACK (CONFIG_BRIDGE_TLS_PORT ? 6144 : 4096)
+_Static_assert(BRIDGE_DEFLATE_BOUND(TELNET_MCCP_CHUNK) + 32 <= TELNET_TX_BUF, "mccp chunk too large");
+_Static_assert(CONFIG_BRIDGE_MCCP_WINDOW == 0 || (CONFIG_BRIDGE_MCCP_WINDOW >= 256 && CONFIG_BRIDGE_MCCP_WINDOW <= 32768 &&
+                                                   (CONFIG_BRIDGE_MCCP_WINDOW & (CONFIG_BRIDGE_MCCP_WINDOW - 1)) == 0),
+               "BRIDGE_MCCP_WINDOW must be 0 or a power of two between 256 and 32768");
 
 typedef enum
 {
-    FSM_IDLE,
-    FSM_OPT,
-    FSM_CMD,
-    FSM_SUB_CMD,
-    FSM_SUB_CMD_OPT,
-    FSM_SKIP_NULL,
-} TELNET_IAC_FSM;
+    TELNET_MSG_NOTICE, // 向所有 telnet 客户端发送提示信息
+    TELNET_MSG_STATS,  // 查询客户端统计，完成后释放 done
+    TELNET_MSG_NETIF,  // 网络连接状态变化，开关监听端口
+    TELNET_MSG_WS_ATTACH,  // http 服务器完成 WebSocket 握手，移交发送方向
+    TELNET_MSG_WS_CONTROL, // 客户端发来的控制帧，由本任务回复
+    TELNET_MSG_TLS_DONE,   // tls 任务完成握手，移交连接
+} TelnetMsgType;
 
 typedef struct
 {
-    int fd;
-    char ip_str[32];
-    TELNET_IAC_FSM fsm;
-    int opt;
-} TelnetConnect_t;
+    TelnetMsgType type;
+    union
+    {
+        const char *notice;
+        bool online;
+        struct
+        {
+            int fd;
+            int scrollback; // 小于 0 时使用默认回放长度
+            uint8_t opcode;
+            uint8_t len;
+            uint8_t *data; // 由接收方释放
+        } ws;
+        struct
+        {
+            int fd;
+            telnet_tls_t *tls; // 握手失败时为 NULL
+        } tls;
+        struct
+        {
+            telnet_client_stats_t *buf;
+            int max;
+            int *count;
+            telnet_core_stats_t *core;
+            SemaphoreHandle_t done;
+        } stats;
+    };
+} TelnetMsg_t;
+
+static const char *TAG = "telnet";
+
+/*
+ * 客户端表与 UART 接收都由 telnet_srv 任务处理，其他任务通过 core_queue 投递消息并经 wake_fd 唤醒 select。
+ */
+static TelnetConnect_t *client_list;
+static size_t client_mem;
+static TelnetConnect_t *fd_clients[FD_SETSIZE];
+/* 持久的监听集合，仅在连接建立、关闭和发送阻塞状态变化时更新 */
+static telnet_fdset_t core_fds;
+static uint8_t read_buf[256];
+static uint8_t mccp_buf[TELNET_MCCP_CHUNK];
+static int listen_fd = -1;
+static int raw_listen_fd = -1;
+static int session_listen_fd = -1;
+static int tls_listen_fd = -1;
+/* 已交给 tls 任务或已建立的 TLS 连接，每个都在 client_mem 中预留了 TELNET_TLS_MEM */
+static int tls_conns;
+static int uart_fd = -1;
+
+static QueueHandle_t core_queue;
+/* UART 任务写入新数据或合并发送超时后通过该 eventfd 唤醒 select */
+static int wake_fd = -1;
+static esp_timer_handle_t flush_timer;
+/* http 服务器已释放、等待本任务关闭的 WebSocket 套接字，不经过 core_queue，不会因队列满而等待 */
+static atomic_bool ws_detached[FD_SETSIZE];
+static atomic_int ws_detach_pending;
 
-static TelnetConnect_t client_fds[CLIENT_MAX];
-static char uart_rdbuf[1024];
+/* UART 数据写入环形缓冲区后首次未发送的时间，发送时取出计算读取到发送的延迟 */
+static _Atomic int64_t wake_stamp;
+static uint64_t latency_total_us;
+static telnet_core_stats_t core_stats;
+
+/* 客户端积压超过高水位时停止读取串口，由驱动的 RTS/XOFF 使对端暂停发送 */
+static bool uart_rx_paused;
+static bool uart_tx_paused;
+static uint32_t flow_high_water;
+static uint32_t flow_low_water;
 
 static TaskHandle_t telnet_server_task_handle;
 static void telnet_server_task(void *arg);
 
-static TaskHandle_t uart_event_task_handle;
-static void telnet_uart_event_task(void *arg);
-
 static int16_t telnet_proc_TELNET_IAC(TelnetConnect_t *connect, uint8_t data);
-static void telnet_send_to_all(const void *data, size_t len);
+static size_t telnet_decode(TelnetConnect_t *connect, uint8_t *buf, size_t len);
+static void telnet_proc_msgs();
+static void telnet_uart_read();
+static void telnet_uart_events();
+static void telnet_flow_update(int64_t now);
+static void telnet_ws_attach_proc(int fd, int scrollback);
+static void telnet_ws_control_proc(int fd, uint8_t opcode, const uint8_t *data, size_t len);
+static void telnet_ws_detach_proc();
+static void telnet_tls_done_proc(int fd, telnet_tls_t *tls);
+static void telnet_client_flush(TelnetConnect_t *client, int64_t now);
+static void telnet_flush_pending();
+static void telnet_wakeup();
+static void telnet_flush_timer_cb(void *arg);
 static void telnet_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+static void telnet_netif_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
 
 static const uint8_t telnet_ctrl[] = {
+    TELNET_IAC, TELNET_DO,   TELOPT_BINARY, //
+    TELNET_IAC, TELNET_WILL, TELOPT_BINARY, //
     TELNET_IAC, TELNET_DO,   TELOPT_ECHO, //
     TELNET_IAC, TELNET_DO,   TELOPT_NAWS, //
+    TELNET_IAC, TELNET_DO,   TELOPT_NEW_ENVIRON, //
     TELNET_IAC, TELNET_WILL, TELOPT_ECHO, //
     TELNET_IAC, TELNET_WILL, TELOPT_SGA,  //
+#if CONFIG_BRIDGE_MCCP_WINDOW
+    TELNET_IAC, TELNET_WILL, TELOPT_COMPRESS2, //
+#endif
 };
 
 esp_err_t telnet_init()
 {
-    for (int i = 0; i < CLIENT_MAX; i++)
+    telnet_fdset_init(&core_fds);
+    core_queue = xQueueCreate(TELNET_MSG_QUEUE_LEN, sizeof(TelnetMsg_t));
+    if (core_queue == NULL)
     {
-        client_fds[i].fd = -1;
+        ESP_LOGE(TAG, "xQueueCreate failed");
+        return ESP_FAIL;
     }
-    vTaskSuspendAll();
 
-    BaseType_t err = xTaskCreate(telnet_server_task, "telnet_srv", 4096, NULL, 1, &telnet_server_task_handle);
-    if (err != pdPASS)
+    bridge_ring_init();
+    /* 单次读取串口最多写入驱动缓冲区大小的数据，高水位之上保留两个写入块的余量 */
+    flow_high_water = bridge_ring_capacity() * CONFIG_BRIDGE_FLOW_HIGH_WATER / 100;
+    if (flow_high_water > bridge_ring_capacity() - 2 * BRIDGE_RING_CHUNK)
+        flow_high_water = bridge_ring_capacity() - 2 * BRIDGE_RING_CHUNK;
+    flow_low_water = flow_high_water / 2;
+    esp_vfs_eventfd_config_t eventfd_config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    esp_vfs_eventfd_register(&eventfd_config);
+    wake_fd = eventfd(0, 0);
+    if (wake_fd < 0)
     {
-        ESP_LOGE(TAG, "xTaskCreate telnet_srv failed %d %s", errno, strerror(errno));
-        xTaskResumeAll();
+        ESP_LOGE(TAG, "eventfd create failed %d %s", errno, strerror(errno));
         return ESP_FAIL;
     }
 
-    err = xTaskCreate(telnet_uart_event_task, "uart_event_task", 2048, NULL, 1, &uart_event_task_handle);
+    const esp_timer_create_args_t timer_args = {
+        .callback = telnet_flush_timer_cb,
+        .name = "telnet_flush",
+    };
+    esp_timer_create(&timer_args, &flush_timer);
+
+    uart_fd = usr_uart_open_fd();
+    if (uart_fd < 0)
+        return ESP_FAIL;
+
+    BaseType_t err = xTaskCreate(telnet_server_task, "telnet_srv", TELNET_TASK_STACK, NULL, 1, &telnet_server_task_handle);
     if (err != pdPASS)
     {
-        vTaskDelete(telnet_server_task_handle);
-        xTaskResumeAll();
         ESP_LOGE(TAG, "xTaskCreate telnet_srv failed %d %s", errno, strerror(errno));
         return ESP_FAIL;
     }
 
-    xTaskResumeAll();
+#if CONFIG_BRIDGE_TLS_PORT
+    /* 转发任务已在读取串口，证书的加载与生成在 tls 任务中进行 */
+    if (telnet_tls_start() != ESP_OK)
+        ESP_LOGE(TAG, "tls start failed, tls connections are refused");
+#endif
 
     esp_event_handler_register(APP_EVENTS, -1, telnet_event_handler, NULL);
+    esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, telnet_netif_handler, NULL);
+    esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, telnet_netif_handler, NULL);
 
     return ESP_OK;
 }
 
+static bool telnet_post(const TelnetMsg_t *msg, TickType_t wait)
+{
+    if (xQueueSend(core_queue, msg, wait) != pdTRUE)
+        return false;
+    telnet_wakeup();
+    return true;
+}
+
 static void telnet_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
+    TelnetMsg_t msg = {.type = TELNET_MSG_NOTICE};
     switch (event_id)
     {
     case APP_EVENT_POWER_DOWN:
-        telnet_send_to_all(">>> Wireless serial: Power down <<<\r\n", 0);
+        msg.notice = ">>> Wireless serial: Power down <<<\r\n";
         break;
     case APP_EVENT_POWER_ON:
-        telnet_send_to_all(">>> Wireless serial: Power on <<<\r\n", 0);
+        msg.notice = ">>> Wireless serial: Power on <<<\r\n";
         break;
     case APP_EVENT_POWER_LOW:
-        telnet_send_to_all(">>> Wireless serial: Low power <<<\r\n", 0);
+        msg.notice = ">>> Wireless serial: Low power <<<\r\n";
         break;
+    default:
+        return;
     }
+    /* 运行在事件循环任务中，不能等待 */
+    if (!telnet_post(&msg, 0))
+        ESP_LOGW(TAG, "message queue full, drop notice");
+}
+
+static void telnet_netif_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    /* 状态随消息传递，不依赖 wifi_manager 与本处理函数的执行顺序 */
+    TelnetMsg_t msg = {
+        .type = TELNET_MSG_NETIF,
+        .online = event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP,
+    };
+    if (!telnet_post(&msg, pdMS_TO_TICKS(100)))
+        ESP_LOGE(TAG, "message queue full, drop netif %s", msg.online ? "up" : "down");
 }
 
 static int set_keep_alive(int fd)
@@ -165,12 +310,12 @@ static int set_keep_alive(int fd)
     return ESP_OK;
 }
 
-static int create_sockte()
+static int create_sockte(uint16_t port)
 {
     struct sockaddr_in servaddr = {
         .sin_addr.s_addr = htonl(INADDR_ANY),
         .sin_family = AF_INET,
-        .sin_port = htons(TELNET_PORT),
+        .sin_port = htons(port),
     };
 
     int sock_fd = lwip_socket(AF_INET, SOCK_STREAM, 0);
@@ -199,7 +344,7 @@ static int create_sockte()
         goto err;
     }
 
-    if (lwip_listen(sock_fd, CLIENT_MAX) == -1)
+    if (lwip_listen(sock_fd, TELNET_LISTEN_BACKLOG) == -1)
     {
         ESP_LOGE(TAG, "socket listen failed %d %s", errno, strerror(errno));
         goto err;
@@ -211,145 +356,412 @@ err:
     return -1;
 }
 
-static void telnet_worker()
+static void telnet_client_close(TelnetConnect_t *client)
 {
-    struct timeval tv = {.tv_sec = 300, .tv_usec = 0};
-    int sock_fd = create_sockte();
-    ESP_LOGI(TAG, "create socket %d", sock_fd);
+    TelnetConnect_t **pp = &client_list;
+    while (*pp != client)
+        pp = &(*pp)->next;
+    *pp = client->next;
 
-    fd_set rfds, efds;
+    telnet_fdset_unwatch(&core_fds, client->fd);
+    fd_clients[client->fd] = NULL;
+    /* 计数只在断开时并入总数，转发路径上不做额外的累加 */
+    core_stats.client_rx_bytes += client->rx_bytes;
+    core_stats.client_tx_bytes += client->tx_bytes;
+    core_stats.client_overruns += client->cursor.overruns;
+    core_stats.client_dropped += client->cursor.dropped;
+#if CONFIG_BRIDGE_TLS_PORT
+    if (client->tls)
+    {
+        telnet_tls_free(client->tls);
+        client_mem -= TELNET_TLS_MEM;
+        tls_conns--;
+    }
+#endif
+    /* WebSocket 套接字在 http 服务器释放后由 telnet_ws_detach_proc 关闭 */
+    if (client->mode != TELNET_MODE_WS)
+    {
+        lwip_shutdown(client->fd, SHUT_RD);
+        lwip_close(client->fd);
+    }
+    if (client->mccp)
+    {
+        stats_mem_free(STATS_MEM_CLIENTS, client->mccp);
+        bridge_deflate_free(client->mccp);
+        client_mem -= bridge_deflate_size(CONFIG_BRIDGE_MCCP_WINDOW);
+    }
+    client_mem -= sizeof(TelnetConnect_t);
+    stats_mem_free(STATS_MEM_CLIENTS, client);
+    free(client);
+}
 
-    while (true)
+/**
+ * @brief 连接尚未就绪，只发送暂存区中的协议数据，串口数据留在环形缓冲区中
+ */
+static bool telnet_client_holding(const TelnetConnect_t *client)
+{
+    return client->replay_deadline || client->session_hello;
+}
+
+/**
+ * @brief 将游标从连接时的位置向前移动 scrollback 字节，之后的发送先回放历史数据
+ */
+static void telnet_replay_start(TelnetConnect_t *client)
+{
+    /* 等待期间游标停在连接时的位置，回退量包括等待期间收到的数据 */
+    bridge_ring_cursor_init(&client->cursor, bridge_ring_lag(&client->cursor) + client->scrollback);
+    client->replay_deadline = 0;
+    if (client->scrollback)
+        ESP_LOGI(TAG, "%d:%s replay %" PRIu32 " bytes", client->fd, client->ip_str, bridge_ring_lag(&client->cursor));
+}
+
+static TelnetConnect_t *telnet_client_new(int fd, TelnetMode mode, const char *ip_str, int scrollback)
+{
+    TelnetConnect_t *client = NULL;
+    if (fd < FD_SETSIZE && client_mem + sizeof(TelnetConnect_t) <= CONFIG_BRIDGE_CLIENT_MEM_BUDGET)
+        client = malloc(sizeof(TelnetConnect_t));
+    if (client == NULL)
+    {
+        ESP_LOGE(TAG, "connection is full, close %d:%s", fd, ip_str);
+        return NULL;
+    }
+
+    /* 只初始化头部状态，暂存区内容由 tx_len 标记有效范围 */
+    memset(client, 0, offsetof(TelnetConnect_t, tx_buf));
+    client->fd = fd;
+    client->mode = mode;
+    client->fsm = FSM_IDLE;
+    client->ts_bol = true;
+    strlcpy(client->ip_str, ip_str, sizeof(client->ip_str));
+    bridge_ring_cursor_init(&client->cursor, 0);
+    bridge_flush_init(&client->flush);
+    client->last_progress = esp_timer_get_time();
+    client->scrollback = scrollback < 0 ? CONFIG_BRIDGE_SCROLLBACK : scrollback;
+    /* telnet 客户端可以在协商中指定回放长度，其他客户端立即开始回放 */
+    if (mode == TELNET_MODE_TELNET)
+        client->replay_deadline = client->last_progress + TELNET_REPLAY_WAIT_US;
+    else if (mode == TELNET_MODE_SESSION)
+        client->session_hello = true;
+    else
+        telnet_replay_start(client);
+
+    client->next = client_list;
+    client_list = client;
+    client_mem += sizeof(TelnetConnect_t);
+    stats_mem_alloc(STATS_MEM_CLIENTS, client);
+    core_stats.client_connects++;
+    boot_prof_milestone(BOOT_MILESTONE_CLIENT);
+    fd_clients[fd] = client;
+    return client;
+}
+
+static void telnet_set_sockopt(int fd)
+{
+    if (set_keep_alive(fd) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "fd %d set_keep_alive failed %d %s", fd, errno, strerror(errno));
+    }
+
+    /* 合并由 telnet_flush_pending 完成，关闭 Nagle 避免交互数据被二次延迟 */
+    int opval = 1;
+    if (lwip_setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opval, sizeof(int)) == -1)
+    {
+        ESP_LOGE(TAG, "fd %d setsockopt TCP_NODELAY failed %d %s", fd, errno, strerror(errno));
+    }
+}
+
+/**
+ * @brief 握手交给 tls 任务，mbedTLS 上下文此时就计入预算，握手期间不会被其他连接挤占
+ */
+static void telnet_tls_accept(int fd, const char *ip_str)
+{
+#if CONFIG_BRIDGE_TLS_PORT
+    if (fd < FD_SETSIZE && tls_conns < CONFIG_BRIDGE_TLS_MAX_CLIENTS &&
+        client_mem + TELNET_TLS_MEM + sizeof(TelnetConnect_t) <= CONFIG_BRIDGE_CLIENT_MEM_BUDGET &&
+        telnet_tls_handshake_start(fd))
+    {
+        tls_conns++;
+        client_mem += TELNET_TLS_MEM;
+        ESP_LOGI(TAG, "%d:%s handshaking (tls)", fd, ip_str);
+        return;
+    }
+#endif
+    ESP_LOGE(TAG, "%d:%s tls connections are full", fd, ip_str);
+    lwip_shutdown(fd, SHUT_RD);
+    lwip_close(fd);
+}
+
+static void telnet_tls_done_proc(int fd, telnet_tls_t *tls)
+{
+#if CONFIG_BRIDGE_TLS_PORT
+    struct sockaddr_in inaddr;
+    socklen_t addrlen = sizeof(struct sockaddr_in);
+    char ip_str[32] = "?";
+    if (lwip_getpeername(fd, (struct sockaddr *)&inaddr, &addrlen) == 0)
+        inet_ntoa_r(inaddr.sin_addr, ip_str, sizeof(ip_str));
+
+    /* 握手期间网络断开时监听端口已关闭，其他连接也已断开 */
+    TelnetConnect_t *client = NULL;
+    if (tls != NULL && tls_listen_fd >= 0)
+        client = telnet_client_new(fd, TELNET_MODE_RAW, ip_str, -1);
+    if (client == NULL)
+    {
+        if (tls)
+            telnet_tls_free(tls);
+        client_mem -= TELNET_TLS_MEM;
+        tls_conns--;
+        lwip_shutdown(fd, SHUT_RD);
+        lwip_close(fd);
+        return;
+    }
+    client->tls = tls;
+    telnet_fdset_watch(&core_fds, fd);
+    ESP_LOGI(TAG, "%d:%s connected (tls)", fd, ip_str);
+#endif
+}
+
+void telnet_tls_done(int fd, telnet_tls_t *tls)
+{
+    /* 在 tls 任务中调用，可以等待；连接数受 BRIDGE_TLS_MAX_CLIENTS 限制，不会占满队列 */
+    TelnetMsg_t msg = {.type = TELNET_MSG_TLS_DONE, .tls = {.fd = fd, .tls = tls}};
+    telnet_post(&msg, portMAX_DELAY);
+}
+
+static void telnet_accept(int listen_fd, TelnetMode mode, bool tls)
+{
+    struct sockaddr_in inaddr;
+    socklen_t addrlen = sizeof(struct sockaddr_in);
+    int fd = lwip_accept(listen_fd, (struct sockaddr *)&inaddr, &addrlen);
+    if (fd == -1)
+    {
+        ESP_LOGE(TAG, "accept failed %d %s", errno, strerror(errno));
+        return;
+    }
+
+    char ip_str[32];
+    inet_ntoa_r(inaddr.sin_addr, ip_str, sizeof(ip_str));
+    if (tls)
     {
-        FD_ZERO(&rfds);
-        FD_ZERO(&efds);
-        FD_SET(sock_fd, &rfds);
-        FD_SET(sock_fd, &efds);
+        telnet_set_sockopt(fd);
+        telnet_tls_accept(fd, ip_str);
+        return;
+    }
+    TelnetConnect_t *client = telnet_client_new(fd, mode, ip_str, -1);
+    if (client == NULL)
+    {
+        lwip_shutdown(fd, SHUT_RD);
+        lwip_close(fd);
+        return;
+    }
+
+    telnet_set_sockopt(fd);
+    telnet_fdset_watch(&core_fds, fd);
 
-        int max_fd = sock_fd;
-        for (int i = 0; i < CLIENT_MAX; i++)
+    if (mode == TELNET_MODE_TELNET)
+        telnet_client_queue(client, telnet_ctrl, sizeof(telnet_ctrl));
+    ESP_LOGI(TAG, "%d:%s connected%s", fd, client->ip_str,
+             mode == TELNET_MODE_RAW       ? " (raw)"
+             : mode == TELNET_MODE_SESSION ? " (session)"
+                                           : "");
+}
+
+/**
+ * @brief 关闭同一会话的旧连接，断线后服务器往往还没有发现旧连接已失效
+ */
+static void telnet_session_takeover(TelnetConnect_t *client)
+{
+    TelnetConnect_t *old = client_list;
+    while (old != NULL)
+    {
+        TelnetConnect_t *next = old->next;
+        if (old != client && old->session == client->session)
         {
-            if (client_fds[i].fd > max_fd)
-                max_fd = client_fds[i].fd;
-            if (client_fds[i].fd != -1)
-            {
-                FD_SET(client_fds[i].fd, &rfds);
-                FD_SET(client_fds[i].fd, &efds);
-            }
+            ESP_LOGI(TAG, "%d:%s replaced by %d", old->fd, old->ip_str, client->fd);
+            telnet_client_close(old);
         }
+        old = next;
+    }
+}
 
-        int retval = lwip_select(max_fd + 1, &rfds, NULL, &efds, &tv);
-        if (retval == -1)
+static void telnet_client_read(TelnetConnect_t *client)
+{
+    /* 串口发送缓冲区放不下时暂不读取，下一轮 select 会暂停所有客户端的读取 */
+    if (usr_uart_tx_free() < sizeof(read_buf))
+        return;
+
+    int rd_len = client->tls ? telnet_tls_recv(client->tls, read_buf, sizeof(read_buf))
+                             : lwip_recv(client->fd, read_buf, sizeof(read_buf), MSG_DONTWAIT);
+    if (rd_len <= 0)
+    {
+        if (errno == EWOULDBLOCK)
+            return;
+        ESP_LOGI(TAG, "%d:%s disconnected %s", client->fd, client->ip_str, strerror(errno));
+        telnet_client_close(client);
+        return;
+    }
+    client->rx_bytes += rd_len;
+
+    uint8_t *data = read_buf;
+    if (client->session_hello)
+    {
+        int n = telnet_session_proc_hello(client, read_buf, rd_len);
+        if (n < 0)
         {
-            ESP_LOGE(TAG, "select failed %d %s", errno, strerror(errno));
+            telnet_client_close(client);
+            return;
         }
-        else if (retval)
-        {
-            if (FD_ISSET(sock_fd, &rfds))
-            {
-                struct sockaddr_in inaddr;
-                socklen_t addrlen = sizeof(struct sockaddr_in);
-                int fd = lwip_accept(sock_fd, (struct sockaddr *)&inaddr, &addrlen);
-                if (fd != -1)
-                {
-                    if (set_keep_alive(fd) != ESP_OK)
-                    {
-                        ESP_LOGE(TAG, "fd %d set_keep_alive failed %d %s", fd, errno, strerror(errno));
-                    }
-
-                    for (int i = 0; i < CLIENT_MAX; i++)
-                    {
-                        if (client_fds[i].fd == -1)
-                        {
-                            client_fds[i].fd = fd;
-                            inet_ntoa_r(inaddr.sin_addr, client_fds[i].ip_str, sizeof(client_fds[i].ip_str));
-                            lwip_send(fd, telnet_ctrl, sizeof(telnet_ctrl), MSG_DONTWAIT);
-                            fd = 0;
-                            break;
-                        }
-                    }
-
-                    if (fd)
-                    {
-                        char buf[32];
-                        ESP_LOGE(TAG, "connection is full, close %d:%s", fd,
-                                 inet_ntoa_r(inaddr.sin_addr, buf, sizeof(buf)));
-                        lwip_shutdown(fd, SHUT_RD);
-                        lwip_close(fd);
-                    }
-                }
-                else
-                {
-                    ESP_LOGE(TAG, "accept failed %d %s", errno, strerror(errno));
-                }
-            }
+        if (!client->session_hello)
+            telnet_session_takeover(client);
+        data += n;
+        rd_len -= n;
+    }
 
-            if (FD_ISSET(sock_fd, &efds))
-            {
-                ESP_LOGE(TAG, "sock_fd got error, shutdown");
-                break;
-            }
+    /* 原始端口与会话端口不做任何 telnet 处理 */
+    size_t send_len = client->mode == TELNET_MODE_TELNET ? telnet_decode(client, data, rd_len) : rd_len;
+    if (send_len)
+        usr_uart_write(data, send_len);
 
-            for (int i = 0; i < CLIENT_MAX; i++)
-            {
-                uint8_t read_buf[256] = {};
-                TelnetConnect_t *client = &client_fds[i];
-                if (FD_ISSET(client->fd, &rfds))
-                {
-                    int rd_len = lwip_recv(client->fd, read_buf, sizeof(read_buf), MSG_DONTWAIT);
-                    if (rd_len <= 0)
-                    {
-                        if (errno == EWOULDBLOCK)
-                        {
-                            continue;
-                        }
-                        ESP_LOGI(TAG, "%d:%s disconnected %s", client->fd, client->ip_str, strerror(errno));
-                        lwip_shutdown(client->fd, SHUT_RD);
-                        lwip_close(client->fd);
-                        client->fd = -1;
-                    }
-                    else
-                    {
-                        uint8_t *wp = read_buf;
-                        int send_len = 0;
-                        for (int j = 0; j < rd_len; j++)
-                        {
-                            int16_t tmp = telnet_proc_TELNET_IAC(client, read_buf[j]);
-                            if (tmp >= 0)
-                            {
-                                *wp++ = tmp;
-                                send_len++;
-                            }
-                        }
-
-                        if (send_len)
-                            uart_write_bytes(UART_NUM_1, read_buf, send_len);
-                    }
-                }
+    /* 同一批收到的多条 RFC 2217 参数设置合并后一次生效 */
+    if (client->mode == TELNET_MODE_TELNET)
+        telnet_rfc2217_apply(client);
+}
 
-                if (FD_ISSET(client->fd, &efds))
-                {
-                    ESP_LOGE(TAG, "%d:%s error, close", client->fd, client->ip_str);
-                    lwip_shutdown(client->fd, SHUT_RD);
-                    lwip_close(client->fd);
-                    client->fd = -1;
-                }
-            }
-        }
+static void telnet_listen_open()
+{
+    bridge_udp_open();
+    if (listen_fd < 0)
+    {
+        listen_fd = create_sockte(TELNET_PORT);
+        ESP_LOGI(TAG, "create socket %d", listen_fd);
+        if (listen_fd >= 0)
+            telnet_fdset_watch(&core_fds, listen_fd);
+    }
+#if CONFIG_BRIDGE_RAW_PORT
+    if (raw_listen_fd < 0)
+    {
+        raw_listen_fd = create_sockte(CONFIG_BRIDGE_RAW_PORT);
+        ESP_LOGI(TAG, "create raw socket %d", raw_listen_fd);
+        if (raw_listen_fd >= 0)
+            telnet_fdset_watch(&core_fds, raw_listen_fd);
+    }
+#endif
+#if CONFIG_BRIDGE_SESSION_PORT
+    if (session_listen_fd < 0)
+    {
+        session_listen_fd = create_sockte(CONFIG_BRIDGE_SESSION_PORT);
+        ESP_LOGI(TAG, "create session socket %d", session_listen_fd);
+        if (session_listen_fd >= 0)
+            telnet_fdset_watch(&core_fds, session_listen_fd);
+    }
+#endif
+#if CONFIG_BRIDGE_TLS_PORT
+    if (tls_listen_fd < 0)
+    {
+        tls_listen_fd = create_sockte(CONFIG_BRIDGE_TLS_PORT);
+        ESP_LOGI(TAG, "create tls socket %d", tls_listen_fd);
+        if (tls_listen_fd >= 0)
+            telnet_fdset_watch(&core_fds, tls_listen_fd);
     }
+#endif
+}
 
-    for (int i = 0; i < CLIENT_MAX; i++)
+/**
+ * @brief 断网或监听出错时关闭监听端口与所有连接，UART 数据继续写入环形缓冲区
+ */
+static void telnet_listen_close()
+{
+    bridge_udp_close();
+    /* WebSocket 连接由 http 服务器在断开时通知 */
+    TelnetConnect_t *client = client_list;
+    while (client != NULL)
+    {
+        TelnetConnect_t *next = client->next;
+        if (client->mode != TELNET_MODE_WS)
+            telnet_client_close(client);
+        client = next;
+    }
+    if (listen_fd >= 0)
+    {
+        telnet_fdset_unwatch(&core_fds, listen_fd);
+        lwip_close(listen_fd);
+        listen_fd = -1;
+    }
+    if (raw_listen_fd >= 0)
     {
-        if (client_fds[i].fd > -1)
+        telnet_fdset_unwatch(&core_fds, raw_listen_fd);
+        lwip_close(raw_listen_fd);
+        raw_listen_fd = -1;
+    }
+    if (session_listen_fd >= 0)
+    {
+        telnet_fdset_unwatch(&core_fds, session_listen_fd);
+        lwip_close(session_listen_fd);
+        session_listen_fd = -1;
+    }
+    if (tls_listen_fd >= 0)
+    {
+        telnet_fdset_unwatch(&core_fds, tls_listen_fd);
+        lwip_close(tls_listen_fd);
+        tls_listen_fd = -1;
+    }
+}
+
+/**
+ * @brief 处理 select 返回的一个就绪描述符
+ */
+static void telnet_dispatch(int fd, bool readable, bool writable, bool error)
+{
+    if (fd == uart_fd)
+    {
+        telnet_uart_read();
+        return;
+    }
+
+    if (fd == wake_fd)
+    {
+        uint64_t count;
+        read(wake_fd, &count, sizeof(count));
+        telnet_proc_msgs();
+        /* 在消息之后处理，同一连接先前投递的 ATTACH 与控制帧已处理完 */
+        if (atomic_load(&ws_detach_pending))
+            telnet_ws_detach_proc();
+        return;
+    }
+
+    if (fd == listen_fd || fd == raw_listen_fd || fd == session_listen_fd || fd == tls_listen_fd)
+    {
+        if (error)
         {
-            lwip_shutdown(client_fds[i].fd, SHUT_RD);
-            lwip_close(client_fds[i].fd);
+            /* 下次获取到 IP 时重新创建 */
+            ESP_LOGE(TAG, "listen socket %d got error, shutdown", fd);
+            telnet_listen_close();
+            return;
         }
-        client_fds[i].fsm = FSM_IDLE;
-        client_fds[i].opt = 0;
-        client_fds[i].fd = -1;
+        /* TLS 端口与原始端口一样透传数据 */
+        telnet_accept(fd,
+                      fd == listen_fd             ? TELNET_MODE_TELNET
+                      : fd == session_listen_fd ? TELNET_MODE_SESSION
+                                                  : TELNET_MODE_RAW,
+                      fd == tls_listen_fd);
+        return;
+    }
+
+    /* 读取时可能关闭连接，每一步之前重新查表 */
+    if (readable && fd_clients[fd] != NULL)
+        telnet_client_read(fd_clients[fd]);
+    /* 一个 TLS 记录中已解密未读完的数据不会再触发 select */
+    while (readable && fd_clients[fd] != NULL && fd_clients[fd]->tls != NULL &&
+           telnet_tls_pending(fd_clients[fd]->tls) && usr_uart_tx_free() >= sizeof(read_buf))
+        telnet_client_read(fd_clients[fd]);
+
+    if (writable && fd_clients[fd] != NULL)
+        telnet_client_flush(fd_clients[fd], esp_timer_get_time());
+
+    if (error && fd_clients[fd] != NULL)
+    {
+        ESP_LOGE(TAG, "%d:%s error, close", fd, fd_clients[fd]->ip_str);
+        telnet_client_close(fd_clients[fd]);
     }
-    lwip_close(sock_fd);
 }
 
 static int telnet_uart_send_break()
@@ -358,6 +770,132 @@ static int telnet_uart_send_break()
     return uart_write_bytes_with_break(UART_NUM_1, data, sizeof(data), 128);
 }
 
+/**
+ * @brief 更新选项状态，仅在状态改变时应答，避免协商循环
+ *
+ * @param accept 对方主动请求启用时的应答，0 表示该选项由我方在连接时发起，无需再次确认
+ * @param refuse 禁用时按 RFC 854 确认的应答
+ */
+static void telnet_negotiate(TelnetConnect_t *connect, bool *state, bool enable, uint8_t option, uint8_t accept,
+                             uint8_t refuse)
+{
+    if (*state == enable)
+        return;
+    *state = enable;
+    uint8_t reply[] = {TELNET_IAC, enable ? accept : refuse, option};
+    if (reply[1])
+        telnet_client_queue(connect, reply, sizeof(reply));
+}
+
+/**
+ * @brief 开始或结束 MCCP2 压缩
+ *
+ * 客户端以 DO 同意后发送 IAC SB COMPRESS2 IAC SE，其后发往该客户端的全部数据都进入压缩流；
+ * 客户端以 DONT 拒绝时不做应答，继续以明文发送。压缩器按连接分配，计入客户端内存预算。
+ */
+static void telnet_mccp_set(TelnetConnect_t *client, bool enable)
+{
+    if (enable == (client->mccp != NULL))
+        return;
+
+    if (enable)
+    {
+        size_t size = bridge_deflate_size(CONFIG_BRIDGE_MCCP_WINDOW);
+        bridge_deflate_t *z = NULL;
+        if (client_mem + size <= CONFIG_BRIDGE_CLIENT_MEM_BUDGET)
+            z = bridge_deflate_new(CONFIG_BRIDGE_MCCP_WINDOW);
+        if (z == NULL)
+        {
+            ESP_LOGW(TAG, "%d:%s no memory for compression", client->fd, client->ip_str);
+            uint8_t reply[] = {TELNET_IAC, TELNET_WONT, TELOPT_COMPRESS2};
+            telnet_client_queue(client, reply, sizeof(reply));
+            return;
+        }
+        static const uint8_t start[] = {TELNET_IAC, TELNET_SB, TELOPT_COMPRESS2, TELNET_IAC, TELNET_SE};
+        telnet_client_queue(client, start, sizeof(start));
+        client->mccp = z;
+        client_mem += size;
+        stats_mem_alloc(STATS_MEM_CLIENTS, z);
+        ESP_LOGI(TAG, "%d:%s compression on", client->fd, client->ip_str);
+        return;
+    }
+
+    uint8_t tail[16];
+    size_t len = bridge_deflate_finish(client->mccp, tail);
+    bridge_deflate_t *z = client->mccp;
+    client->mccp = NULL;
+    telnet_client_queue(client, tail, len);
+    uint8_t reply[] = {TELNET_IAC, TELNET_WONT, TELOPT_COMPRESS2};
+    telnet_client_queue(client, reply, sizeof(reply));
+    stats_mem_free(STATS_MEM_CLIENTS, z);
+    bridge_deflate_free(z);
+    client_mem -= bridge_deflate_size(CONFIG_BRIDGE_MCCP_WINDOW);
+    ESP_LOGI(TAG, "%d:%s compression off", client->fd, client->ip_str);
+}
+
+/**
+ * @brief 取出 NEW-ENVIRON 中的一个名称或值，到下一个 VAR/VALUE/USERVAR 为止，超长部分截断
+ *
+ * @return size_t 结束位置
+ */
+static size_t telnet_environ_field(const TelnetConnect_t *client, size_t i, char *buf, size_t size)
+{
+    size_t n = 0;
+    while (i < client->sb_len)
+    {
+        uint8_t c = client->sb_buf[i];
+        if (c == ENV_VAR || c == ENV_VALUE || c == ENV_USERVAR)
+            break;
+        if (c == ENV_ESC && i + 1 < client->sb_len)
+            c = client->sb_buf[++i];
+        if (n + 1 < size)
+            buf[n++] = c;
+        i++;
+    }
+    buf[n] = '\0';
+    return i;
+}
+
+/**
+ * @brief 处理 NEW-ENVIRON IS/INFO，客户端通过用户变量 TIMESTAMP 开关行首时间戳，通过 SCROLLBACK 指定回放的字节数
+ *
+ * 例如 Linux telnet 中执行 environ define TIMESTAMP 1 与 environ export TIMESTAMP 后连接，未定义或值为 0 时关闭。
+ * SCROLLBACK 只在连接时的第一次应答中生效，未定义时使用默认长度，超出环形缓冲区的部分无法回放。
+ */
+static void telnet_environ_proc_sb(TelnetConnect_t *client)
+{
+    if (client->sb_len < 2 || !client->new_environ ||
+        (client->sb_buf[1] != ENV_IS && client->sb_buf[1] != ENV_INFO))
+        return;
+
+    size_t i = 2;
+    while (i < client->sb_len)
+    {
+        uint8_t type = client->sb_buf[i++];
+        if (type != ENV_VAR && type != ENV_USERVAR)
+            continue;
+        char name[16];
+        char value[8] = "";
+        i = telnet_environ_field(client, i, name, sizeof(name));
+        if (i < client->sb_len && client->sb_buf[i] == ENV_VALUE)
+            i = telnet_environ_field(client, i + 1, value, sizeof(value));
+        if (strcmp(name, "SCROLLBACK") == 0 && value[0] != '\0' && client->replay_deadline)
+        {
+            client->scrollback = strtoul(value, NULL, 10);
+            continue;
+        }
+        if (strcmp(name, "TIMESTAMP") != 0)
+            continue;
+
+        bool enable = value[0] != '\0' && strcmp(value, "0") != 0;
+        if (enable != client->timestamps)
+            ESP_LOGI(TAG, "%d:%s timestamps %s", client->fd, client->ip_str, enable ? "on" : "off");
+        client->timestamps = enable;
+    }
+    if (client->replay_deadline)
+        telnet_replay_start(client);
+}
+
 static void telnet_proc_cmd(TelnetConnect_t *connect, uint8_t op, uint8_t cmd)
 {
     ESP_LOGI(TAG, "%d:%s Reveice TELNET_IAC %02X %02X", connect->fd, connect->ip_str, op, cmd);
@@ -366,6 +904,59 @@ static void telnet_proc_cmd(TelnetConnect_t *connect, uint8_t op, uint8_t cmd)
         ESP_LOGW(TAG, "%d:%s, send break signal", connect->fd, connect->ip_str);
         telnet_uart_send_break();
     }
+    else if (cmd == TELOPT_BINARY)
+    {
+        switch (op)
+        {
+        case TELNET_WILL:
+        case TELNET_WONT:
+            telnet_negotiate(connect, &connect->binary_rx, op == TELNET_WILL, cmd, 0, TELNET_DONT);
+            break;
+        case TELNET_DO:
+        case TELNET_DONT:
+            telnet_negotiate(connect, &connect->binary_tx, op == TELNET_DO, cmd, 0, TELNET_WONT);
+            break;
+        }
+    }
+    else if (cmd == TELOPT_COM_PORT && (op == TELNET_WILL || op == TELNET_WONT))
+    {
+        telnet_negotiate(connect, &connect->com_port, op == TELNET_WILL, cmd, TELNET_DO, TELNET_DONT);
+    }
+    else if (cmd == TELOPT_NEW_ENVIRON && (op == TELNET_WILL || op == TELNET_WONT))
+    {
+        bool was_enabled = connect->new_environ;
+        telnet_negotiate(connect, &connect->new_environ, op == TELNET_WILL, cmd, 0, TELNET_DONT);
+        if (connect->new_environ && !was_enabled)
+        {
+            /* 只请求用到的变量，应答足够短，能放进 sb_buf */
+            static const uint8_t send[] = {
+                TELNET_IAC,  TELNET_SB, TELOPT_NEW_ENVIRON, ENV_SEND,
+                ENV_USERVAR, 'T',       'I',                'M',      'E', 'S', 'T', 'A', 'M', 'P',
+                ENV_USERVAR, 'S',       'C',                'R',      'O', 'L', 'L', 'B', 'A', 'C', 'K',
+                TELNET_IAC,  TELNET_SE,
+            };
+            telnet_client_queue(connect, send, sizeof(send));
+        }
+        else if (!connect->new_environ && connect->replay_deadline)
+        {
+            telnet_replay_start(connect);
+        }
+    }
+    else if (cmd == TELOPT_COMPRESS2 && CONFIG_BRIDGE_MCCP_WINDOW && (op == TELNET_DO || op == TELNET_DONT))
+    {
+        telnet_mccp_set(connect, op == TELNET_DO);
+    }
+    else if (op == TELNET_WILL && cmd != TELOPT_ECHO && cmd != TELOPT_NAWS && cmd != TELOPT_TTYPE)
+    {
+        /* 拒绝不支持的选项，避免客户端一直等待协商结果 */
+        uint8_t reply[] = {TELNET_IAC, TELNET_DONT, cmd};
+        telnet_client_queue(connect, reply, sizeof(reply));
+    }
+    else if (op == TELNET_DO && cmd != TELOPT_ECHO && cmd != TELOPT_SGA)
+    {
+        uint8_t reply[] = {TELNET_IAC, TELNET_WONT, cmd};
+        telnet_client_queue(connect, reply, sizeof(reply));
+    }
 }
 
 static int16_t telnet_proc_TELNET_IAC(TelnetConnect_t *connect, uint8_t data)
@@ -378,7 +969,7 @@ static int16_t telnet_proc_TELNET_IAC(TelnetConnect_t *connect, uint8_t data)
             connect->fsm = FSM_OPT;
             return -1;
         }
-        connect->fsm = (data == 0x0d) ? FSM_SKIP_NULL : FSM_IDLE;
+        connect->fsm = (data == 0x0d && !connect->binary_rx) ? FSM_SKIP_NULL : FSM_IDLE;
         return data;
     case FSM_OPT:
         switch (data)
@@ -392,6 +983,7 @@ static int16_t telnet_proc_TELNET_IAC(TelnetConnect_t *connect, uint8_t data)
             return -1;
         case TELNET_SB:
             connect->fsm = FSM_SUB_CMD;
+            connect->sb_len = 0;
             return -1;
         case TELOPT_BREAK:
             telnet_proc_cmd(connect, TELOPT_BREAK, 0);
@@ -409,9 +1001,25 @@ static int16_t telnet_proc_TELNET_IAC(TelnetConnect_t *connect, uint8_t data)
         {
             connect->fsm = FSM_SUB_CMD_OPT;
         }
+        else if (connect->sb_len < sizeof(connect->sb_buf))
+        {
+            connect->sb_buf[connect->sb_len++] = data;
+        }
         return -1;
     case FSM_SUB_CMD_OPT:
+        if (data == TELNET_IAC)
+        {
+            /* 子协商参数中的 0xFF 被转义为 IAC IAC */
+            if (connect->sb_len < sizeof(connect->sb_buf))
+                connect->sb_buf[connect->sb_len++] = data;
+            connect->fsm = FSM_SUB_CMD;
+            return -1;
+        }
         connect->fsm = FSM_IDLE;
+        if (data == TELNET_SE && connect->sb_len && connect->sb_buf[0] == TELOPT_NEW_ENVIRON)
+            telnet_environ_proc_sb(connect);
+        else if (data == TELNET_SE)
+            telnet_rfc2217_proc_sb(connect);
         return -1;
     case FSM_CMD:
         connect->fsm = FSM_IDLE;
@@ -426,57 +1034,709 @@ static int16_t telnet_proc_TELNET_IAC(TelnetConnect_t *connect, uint8_t data)
     return -1;
 }
 
+/**
+ * @brief 批量解析客户端数据，普通数据段整体拷贝，仅在特殊字节附近逐字节运行状态机
+ *
+ * @return size_t 原地解码后需要写入串口的长度
+ */
+static size_t telnet_decode(TelnetConnect_t *connect, uint8_t *buf, size_t len)
+{
+    uint8_t *wp = buf;
+    size_t i = 0;
+    while (i < len)
+    {
+        if (connect->fsm == FSM_IDLE)
+        {
+            size_t span = telnet_codec_scan(buf + i, len - i, !connect->binary_rx);
+            if (wp != buf + i)
+                memmove(wp, buf + i, span);
+            wp += span;
+            i += span;
+            if (i == len)
+                break;
+        }
+
+        int16_t tmp = telnet_proc_TELNET_IAC(connect, buf[i++]);
+        if (tmp >= 0)
+            *wp++ = tmp;
+    }
+    return wp - buf;
+}
+
+/**
+ * @brief UART 接收与网络收发在同一个 select 循环中处理，转发路径上没有任务切换
+ */
 static void telnet_server_task(void *arg)
 {
+    telnet_fdset_watch(&core_fds, uart_fd);
+    telnet_fdset_watch(&core_fds, wake_fd);
+    if (wifi_is_goted_ip())
+        telnet_listen_open();
+
     while (true)
     {
-        wifi_wait_got_ip(portMAX_DELAY);
-        telnet_worker();
+        /* 定时合并由 flush_timer 经 wake_fd 唤醒，select 无需超时 */
+        fd_set rfds = core_fds.rfds, wfds = core_fds.wfds, efds = core_fds.rfds;
+        int max_fd = core_fds.max_fd;
+        struct timeval tv = {.tv_sec = 0, .tv_usec = 0};
+        struct timeval *tvp = NULL;
+
+        /* 串口发送缓冲区满时停止接收网络数据，让 TCP 窗口向发送方施加背压；缓冲区腾空没有事件通知，需要轮询 */
+        bool tx_full = usr_uart_tx_free() < sizeof(read_buf);
+        if (tx_full && !uart_tx_paused)
+            core_stats.tx_pauses++;
+        uart_tx_paused = tx_full;
+        if (tx_full)
+        {
+            for (TelnetConnect_t *client = client_list; client != NULL; client = client->next)
+                FD_CLR(client->fd, &rfds);
+            tv.tv_usec = TELNET_TX_POLL_US;
+            tvp = &tv;
+        }
+        /* 暂停读取串口期间需要定期检查停滞的客户端 */
+        else if (uart_rx_paused)
+        {
+            tv.tv_usec = TELNET_FLOW_POLL_US;
+            tvp = &tv;
+        }
+
+        int retval = select(max_fd + 1, &rfds, &wfds, &efds, tvp);
+        if (retval == -1)
+        {
+            ESP_LOGE(TAG, "select failed %d %s", errno, strerror(errno));
+        }
+
+        /* 按返回的就绪数量提前结束，不再逐个检查所有连接 */
+        for (int fd = 0; fd <= max_fd && retval > 0; fd++)
+        {
+            bool readable = FD_ISSET(fd, &rfds);
+            bool writable = FD_ISSET(fd, &wfds);
+            bool error = FD_ISSET(fd, &efds);
+            if (!readable && !writable && !error)
+                continue;
+            retval -= readable + writable + error;
+            telnet_dispatch(fd, readable, writable, error);
+        }
+
+        telnet_uart_events();
+        telnet_flush_pending();
+        telnet_flow_update(esp_timer_get_time());
     }
 }
 
-static void telnet_send_to_all(const void *data, size_t len)
+static void telnet_wakeup()
 {
-    if (len == 0)
-        len = strlen(data);
-    for (int i = 0; i < CLIENT_MAX; i++)
+    uint64_t count = 1;
+    write(wake_fd, &count, sizeof(count));
+}
+
+static void telnet_flush_timer_cb(void *arg)
+{
+    telnet_wakeup();
+}
+
+/**
+ * @brief 将协议数据追加到暂存区，保证其与已转义数据的先后顺序，启用压缩时压缩后追加
+ */
+void telnet_client_queue(TelnetConnect_t *client, const void *data, size_t len)
+{
+    size_t need = client->mccp ? BRIDGE_DEFLATE_BOUND(len) : len;
+    if (client->tx_off == client->tx_len)
     {
-        if (client_fds[i].fd != -1)
-            lwip_send(client_fds[i].fd, data, len, MSG_DONTWAIT);
+        client->tx_off = 0;
+        client->tx_len = 0;
     }
+    else if (client->tx_off && client->tx_len + need > sizeof(client->tx_buf))
+    {
+        memmove(client->tx_buf, client->tx_buf + client->tx_off, client->tx_len - client->tx_off);
+        client->tx_len -= client->tx_off;
+        client->tx_off = 0;
+    }
+    if (client->tx_len + need > sizeof(client->tx_buf))
+    {
+        ESP_LOGW(TAG, "%d:%s tx stage full, drop %d bytes", client->fd, client->ip_str, (int)len);
+        return;
+    }
+    if (client->mccp)
+    {
+        uint32_t start = esp_cpu_get_cycle_count();
+        client->tx_len += bridge_deflate_write(client->mccp, data, len, client->tx_buf + client->tx_len, true);
+        client->mccp_cycles += esp_cpu_get_cycle_count() - start;
+        return;
+    }
+    memcpy(client->tx_buf + client->tx_len, data, len);
+    client->tx_len += len;
 }
 
-static void telnet_uart_event_task(void *arg)
+/**
+ * @brief 非阻塞发送，发送缓冲区满时标记 tx_blocked
+ *
+ * @return int 已发送的字节数，出错返回 -1
+ */
+static int telnet_client_send(TelnetConnect_t *client, const void *data, size_t len)
 {
-    QueueHandle_t uart_queue = uart_get_event_queue();
-    uart_event_t event;
-    for (;;)
+    int ret = client->tls ? telnet_tls_send(client->tls, data, len) : lwip_send(client->fd, data, len, MSG_DONTWAIT);
+    if (ret <= 0)
+    {
+        client->tx_blocked = (errno == EWOULDBLOCK || errno == EAGAIN);
+        return -1;
+    }
+    client->tx_bytes += ret;
+    /* TLS 每次最多写入一个记录，写入不完整不代表发送缓冲区已满 */
+    if ((size_t)ret < len && client->tls == NULL)
+        client->tx_blocked = true;
+    return ret;
+}
+
+static size_t telnet_ts_format(int64_t boot_us, char *buf)
+{
+    int64_t unix_us;
+    if (timesync_to_unix(boot_us, &unix_us))
     {
-        // Waiting for UART event.
-        if (xQueueReceive(uart_queue, &event, portMAX_DELAY))
+        time_t sec = unix_us / 1000000;
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        return snprintf(buf, TELNET_TS_PREFIX_MAX, "[%02d:%02d:%02d.%06d] ", tm.tm_hour, tm.tm_min, tm.tm_sec,
+                        (int)(unix_us % 1000000));
+    }
+    /* 未校时的时候与内核日志一样显示启动以来的秒数 */
+    return snprintf(buf, TELNET_TS_PREFIX_MAX, "[%5ld.%06d] ", (long)(boot_us / 1000000), (int)(boot_us % 1000000));
+}
+
+/**
+ * @brief 转义并在每行开头插入该行首字节的接收时间
+ */
+static size_t telnet_ts_escape(TelnetConnect_t *client, const uint8_t *src, size_t len, uint8_t *dst, size_t cap,
+                               size_t *consumed)
+{
+    size_t in = 0, out = 0;
+    while (in < len)
+    {
+        if (client->ts_bol)
         {
-            switch (event.type)
-            {
-            case UART_PATTERN_DET:
-                uart_pattern_pop_pos(UART_NUM_1);
-            case UART_DATA:
-                uart_read_bytes(UART_NUM_1, uart_rdbuf, event.size, portMAX_DELAY);
-                telnet_send_to_all(uart_rdbuf, event.size);
+            if (cap - out < TELNET_TS_PREFIX_MAX)
                 break;
-            case UART_BREAK:
-                ESP_LOGI(TAG, "uart rx break");
-                break;
-            case UART_PARITY_ERR:
-                ESP_LOGI(TAG, "uart parity error");
+            out += telnet_ts_format(bridge_ring_time(client->cursor.pos + in), (char *)dst + out);
+            client->ts_bol = false;
+        }
+
+        const uint8_t *nl = memchr(src + in, '\n', len - in);
+        size_t span = nl ? (size_t)(nl - (src + in)) + 1 : len - in;
+        size_t used;
+        out += telnet_codec_escape(src + in, span, dst + out, cap - out, &used);
+        in += used;
+        if (used < span)
+            break;
+        client->ts_bol = nl != NULL;
+    }
+    *consumed = in;
+    return out;
+}
+
+static void telnet_client_flush(TelnetConnect_t *client, int64_t now)
+{
+    const uint8_t *data;
+    size_t len;
+    client->tx_blocked = false;
+    while (!client->tx_blocked)
+    {
+        /* 先发完暂存区中已转义的数据，保证 IAC 转义对不被其他数据打断 */
+        if (client->tx_off < client->tx_len)
+        {
+            int ret = telnet_client_send(client, client->tx_buf + client->tx_off, client->tx_len - client->tx_off);
+            if (ret < 0)
                 break;
-            case UART_FRAME_ERR:
-                ESP_LOGI(TAG, "uart frame error");
+            client->tx_off += ret;
+            continue;
+        }
+
+        if (telnet_client_holding(client))
+            break;
+        len = bridge_ring_peek(&client->cursor, &data);
+        if (len == 0)
+            break;
+
+        if (client->mode == TELNET_MODE_WS)
+        {
+            /* 帧头进入暂存区，负载直接从环形缓冲区发送，ws_remaining 记录当前帧未发完的负载 */
+            if (client->ws_remaining == 0)
+            {
+                if (len > UINT16_MAX)
+                    len = UINT16_MAX;
+                uint8_t header[4] = {0x82}; // FIN | binary
+                size_t header_len = 2;
+                if (len < 126)
+                {
+                    header[1] = len;
+                }
+                else
+                {
+                    header[1] = 126;
+                    header[2] = len >> 8;
+                    header[3] = len;
+                    header_len = 4;
+                }
+                telnet_client_queue(client, header, header_len);
+                client->ws_remaining = len;
+                continue;
+            }
+            if (len > client->ws_remaining)
+                len = client->ws_remaining;
+            int ret = telnet_client_send(client, data, len);
+            if (ret < 0)
                 break;
-            default:
-                ESP_LOGI(TAG, "uart event type: %d", event.type);
+            client->ws_remaining -= ret;
+            if (!bridge_ring_consume(&client->cursor, ret))
+                ESP_LOGW(TAG, "%d:%s overrun while sending", client->fd, client->ip_str);
+            client->last_progress = now;
+            continue;
+        }
+
+        if (client->mccp || client->timestamps)
+        {
+            /* 需要插入时间戳或压缩时，先转义到暂存区（压缩时为 mccp_buf）再处理 */
+            size_t consumed;
+            uint8_t *out = client->mccp ? mccp_buf : client->tx_buf;
+            size_t cap = client->mccp ? sizeof(mccp_buf) : sizeof(client->tx_buf);
+            uint32_t start = esp_cpu_get_cycle_count();
+            size_t out_len = client->timestamps ? telnet_ts_escape(client, data, len, out, cap, &consumed)
+                                                : telnet_codec_escape(data, len, out, cap, &consumed);
+            client->tx_len = out_len;
+            if (client->mccp)
+            {
+                /* 环形缓冲区中已无后续数据时同步刷新，使客户端能立即解出 */
+                bool last = consumed == bridge_ring_lag(&client->cursor);
+                client->tx_len = bridge_deflate_write(client->mccp, mccp_buf, out_len, client->tx_buf, last);
+                client->mccp_cycles += esp_cpu_get_cycle_count() - start;
+            }
+            client->tx_off = 0;
+            if (!bridge_ring_consume(&client->cursor, consumed))
+                ESP_LOGW(TAG, "%d:%s overrun while sending", client->fd, client->ip_str);
+            client->last_progress = now;
+            continue;
+        }
+
+        /* 发送缓冲区已满时保留游标，等 select 报告可写后从环形缓冲区继续发送 */
+        size_t clean = client->mode == TELNET_MODE_TELNET ? telnet_codec_scan(data, len, false) : len;
+        if (clean == len || clean >= TELNET_DIRECT_SEND_MIN)
+        {
+            int ret = telnet_client_send(client, data, clean);
+            if (ret < 0)
                 break;
+            if (!bridge_ring_consume(&client->cursor, ret))
+                ESP_LOGW(TAG, "%d:%s overrun while sending", client->fd, client->ip_str);
+            client->last_progress = now;
+        }
+        else
+        {
+            size_t consumed;
+            client->tx_len = telnet_codec_escape(data, len, client->tx_buf, sizeof(client->tx_buf), &consumed);
+            client->tx_off = 0;
+            if (!bridge_ring_consume(&client->cursor, consumed))
+                ESP_LOGW(TAG, "%d:%s overrun while sending", client->fd, client->ip_str);
+            client->last_progress = now;
+        }
+    }
+    /* 发送阻塞时等待可写，WebSocket 连接的读取由 http 服务器负责，只在可写集合中出现 */
+    telnet_fdset_watch_write(&core_fds, client->fd, client->tx_blocked);
+    if (client->ws_closing && client->tx_off == client->tx_len)
+    {
+        /* 关闭帧已发出，由 http 服务器关闭会话后通过 telnet_ws_detach 释放 */
+        client->ws_closing = false;
+        http_server_close_session(client->fd);
+    }
+    bridge_flush_done(&client->flush, bridge_ring_lag(&client->cursor) + client->tx_len - client->tx_off, now);
+}
+
+static void telnet_latency_record(int64_t now)
+{
+    int64_t stamp = atomic_exchange(&wake_stamp, 0);
+    if (stamp == 0)
+        return;
+    uint32_t us = now - stamp;
+    if (core_stats.latency_count == 0 || us < core_stats.latency_min_us)
+        core_stats.latency_min_us = us;
+    if (us > core_stats.latency_max_us)
+        core_stats.latency_max_us = us;
+    latency_total_us += us;
+    core_stats.latency_count++;
+}
+
+/**
+ * @brief 按合并策略发送各客户端的积压数据，并在最近的截止时间唤醒
+ */
+static void telnet_flush_pending()
+{
+    int64_t now = esp_timer_get_time();
+    int64_t next_wait = -1;
+    bool sent = false;
+    if (client_list == NULL)
+        atomic_store(&wake_stamp, 0);
+    for (TelnetConnect_t *client = client_list; client != NULL; client = client->next)
+    {
+        if (client->tx_blocked || client->suspended)
+            continue;
+
+        if (client->replay_deadline && now >= client->replay_deadline)
+            telnet_replay_start(client);
+        /* 等待选择回放长度期间只发送协商应答 */
+        uint32_t pending = client->tx_len - client->tx_off;
+        if (!telnet_client_holding(client))
+            pending += bridge_ring_lag(&client->cursor);
+        int64_t wait = bridge_flush_check(&client->flush, pending, now);
+        if (client->replay_deadline && (wait < 0 || client->replay_deadline - now < wait))
+            wait = client->replay_deadline - now;
+        if (wait == 0)
+        {
+            uint32_t pos = client->cursor.pos;
+            telnet_client_flush(client, now);
+            sent = true;
+            if (client->cursor.pos != pos)
+                boot_prof_milestone(BOOT_MILESTONE_BRIDGED);
+        }
+        else if (wait > 0 && (next_wait < 0 || wait < next_wait))
+        {
+            next_wait = wait;
+        }
+    }
+
+    if (sent)
+        telnet_latency_record(esp_timer_get_time());
+
+    int64_t udp_wait = bridge_udp_poll(now);
+    if (udp_wait > 0 && (next_wait < 0 || udp_wait < next_wait))
+        next_wait = udp_wait;
+    int64_t capture_wait = capture_poll(now);
+    if (capture_wait > 0 && (next_wait < 0 || capture_wait < next_wait))
+        next_wait = capture_wait;
+
+    esp_timer_stop(flush_timer);
+    if (next_wait > 0)
+        esp_timer_start_once(flush_timer, next_wait);
+}
+
+static int telnet_fill_stats(telnet_client_stats_t *stats, int max, telnet_core_stats_t *core)
+{
+    int n = 0;
+    for (TelnetConnect_t *client = client_list; client != NULL && n < max; client = client->next)
+    {
+        stats[n].fd = client->fd;
+        strlcpy(stats[n].ip_str, client->ip_str, sizeof(stats[n].ip_str));
+        stats[n].lag = bridge_ring_lag(&client->cursor);
+        stats[n].overruns = client->cursor.overruns;
+        stats[n].dropped = client->cursor.dropped;
+        stats[n].rx_bytes = client->rx_bytes;
+        stats[n].tx_bytes = client->tx_bytes;
+        stats[n].timestamps = client->timestamps;
+        stats[n].mccp_in = 0;
+        stats[n].mccp_out = 0;
+        stats[n].mccp_cycles_per_kb = 0;
+        if (client->mccp)
+        {
+            bridge_deflate_get_stats(client->mccp, &stats[n].mccp_in, &stats[n].mccp_out);
+            if (stats[n].mccp_in)
+                stats[n].mccp_cycles_per_kb = client->mccp_cycles * 1024 / stats[n].mccp_in;
+        }
+        n++;
+    }
+
+    if (core)
+    {
+        *core = core_stats;
+        for (TelnetConnect_t *client = client_list; client != NULL; client = client->next)
+        {
+            core->clients++;
+            core->client_rx_bytes += client->rx_bytes;
+            core->client_tx_bytes += client->tx_bytes;
+            core->client_overruns += client->cursor.overruns;
+            core->client_dropped += client->cursor.dropped;
+        }
+        bridge_udp_get_stats(&core->udp);
+        telnet_tls_get_stats(&core->tls);
+        core->tls.clients = tls_conns;
+        core->latency_avg_us = core_stats.latency_count ? latency_total_us / core_stats.latency_count : 0;
+    }
+    return n;
+}
+
+static void telnet_ws_attach_proc(int fd, int scrollback)
+{
+    struct sockaddr_in inaddr;
+    socklen_t addrlen = sizeof(struct sockaddr_in);
+    char ip_str[32] = "?";
+    if (lwip_getpeername(fd, (struct sockaddr *)&inaddr, &addrlen) == 0)
+        inet_ntoa_r(inaddr.sin_addr, ip_str, sizeof(ip_str));
+
+    if (fd < FD_SETSIZE && fd_clients[fd] != NULL)
+    {
+        ESP_LOGW(TAG, "%d:%s already attached", fd, ip_str);
+        return;
+    }
+    if (telnet_client_new(fd, TELNET_MODE_WS, ip_str, scrollback) == NULL)
+    {
+        http_server_close_session(fd);
+        return;
+    }
+    ESP_LOGI(TAG, "%d:%s connected (ws)", fd, ip_str);
+}
+
+/**
+ * @brief 回复 PING 与 CLOSE，与数据帧一样经暂存区发送，保证不会插入到数据帧中间
+ */
+static void telnet_ws_control_proc(int fd, uint8_t opcode, const uint8_t *data, size_t len)
+{
+    TelnetConnect_t *client = fd < FD_SETSIZE ? fd_clients[fd] : NULL;
+    if (client == NULL || client->mode != TELNET_MODE_WS || client->ws_closing)
+        return;
+
+    /* 当前帧的负载发完之前暂存区中的数据不会被发送，先把剩余负载发完 */
+    telnet_client_flush(client, esp_timer_get_time());
+    if (client->ws_remaining)
+    {
+        if (opcode == HTTPD_WS_TYPE_CLOSE)
+            http_server_close_session(fd);
+        return;
+    }
+
+    uint8_t header[2] = {0x80 | (opcode == HTTPD_WS_TYPE_PING ? HTTPD_WS_TYPE_PONG : opcode), len};
+    telnet_client_queue(client, header, sizeof(header));
+    telnet_client_queue(client, data, len);
+    if (opcode == HTTPD_WS_TYPE_CLOSE)
+        client->ws_closing = true;
+    telnet_client_flush(client, esp_timer_get_time());
+}
+
+/**
+ * @brief 移除 http 服务器已释放的 WebSocket 连接并关闭套接字
+ *
+ * 描述符在本任务不再使用后才关闭，不会被新连接复用后收到旧连接的数据
+ */
+static void telnet_ws_detach_proc()
+{
+    for (int fd = 0; fd < FD_SETSIZE && atomic_load(&ws_detach_pending); fd++)
+    {
+        if (!atomic_exchange(&ws_detached[fd], false))
+            continue;
+        atomic_fetch_sub(&ws_detach_pending, 1);
+        if (fd_clients[fd] != NULL && fd_clients[fd]->mode == TELNET_MODE_WS)
+        {
+            ESP_LOGI(TAG, "%d:%s disconnected (ws)", fd, fd_clients[fd]->ip_str);
+            telnet_client_close(fd_clients[fd]);
+        }
+        lwip_close(fd);
+    }
+}
+
+static void telnet_proc_msgs()
+{
+    TelnetMsg_t msg;
+    while (xQueueReceive(core_queue, &msg, 0) == pdTRUE)
+    {
+        switch (msg.type)
+        {
+        case TELNET_MSG_NOTICE:
+            /* 原始端口的数据流不插入提示信息 */
+            for (TelnetConnect_t *client = client_list; client != NULL; client = client->next)
+            {
+                if (client->mode == TELNET_MODE_TELNET)
+                    telnet_client_queue(client, msg.notice, strlen(msg.notice));
             }
+            break;
+        case TELNET_MSG_NETIF:
+            if (msg.online)
+                telnet_listen_open();
+            else
+                telnet_listen_close();
+            break;
+        case TELNET_MSG_WS_ATTACH:
+            telnet_ws_attach_proc(msg.ws.fd, msg.ws.scrollback);
+            break;
+        case TELNET_MSG_WS_CONTROL:
+            telnet_ws_control_proc(msg.ws.fd, msg.ws.opcode, msg.ws.data, msg.ws.len);
+            free(msg.ws.data);
+            break;
+        case TELNET_MSG_TLS_DONE:
+            telnet_tls_done_proc(msg.tls.fd, msg.tls.tls);
+            break;
+        case TELNET_MSG_STATS:
+            *msg.stats.count = telnet_fill_stats(msg.stats.buf, msg.stats.max, msg.stats.core);
+            xSemaphoreGive(msg.stats.done);
+            break;
         }
     }
-    vTaskDelete(NULL);
+}
+
+int telnet_get_client_stats(telnet_client_stats_t *stats, int max, telnet_core_stats_t *core)
+{
+    StaticSemaphore_t done_buf;
+    int count = 0;
+    TelnetMsg_t msg = {
+        .type = TELNET_MSG_STATS,
+        .stats =
+            {
+                .buf = stats,
+                .max = max,
+                .count = &count,
+                .core = core,
+                .done = xSemaphoreCreateBinaryStatic(&done_buf),
+            },
+    };
+    if (!telnet_post(&msg, pdMS_TO_TICKS(100)))
+        return 0;
+    /* 请求已入队，必须等待处理完成，否则 telnet_srv 会写入已释放的栈空间 */
+    xSemaphoreTake(msg.stats.done, portMAX_DELAY);
+    vSemaphoreDelete(msg.stats.done);
+    return count;
+}
+
+static void telnet_uart_read()
+{
+    int64_t now = esp_timer_get_time();
+    size_t buffered = 0;
+    uart_get_buffered_data_len(UART_NUM_1, &buffered);
+    uint32_t char_ns = usr_uart_char_time_ns();
+    size_t total = 0;
+    while (true)
+    {
+        uint8_t *buf;
+        size_t len = bridge_ring_write_begin(&buf);
+        int rd_len = uart_read_bytes(UART_NUM_1, buf, len, 0);
+        if (rd_len <= 0)
+            break;
+        /* 驱动缓冲区中的数据至少需要按线路速率传输这么久，据此倒推本段首字节最晚的到达时间 */
+        size_t behind = buffered > total ? buffered - total - 1 : 0;
+        bridge_ring_write_commit(rd_len, now - (int64_t)behind * char_ns / 1000);
+        total += rd_len;
+        if ((size_t)rd_len < len)
+            break;
+    }
+
+    core_stats.uart_rx_bytes += total;
+    if (total)
+    {
+        boot_prof_milestone(BOOT_MILESTONE_UART_RX);
+        int64_t expected = 0;
+        atomic_compare_exchange_strong(&wake_stamp, &expected, now);
+    }
+}
+
+/**
+ * @brief 取出驱动事件队列中积累的事件，数据已由 select 处理，这里只记录错误
+ */
+static void telnet_uart_events()
+{
+    QueueHandle_t uart_queue = uart_get_event_queue();
+    uart_event_t event;
+    while (xQueueReceive(uart_queue, &event, 0))
+    {
+        if (event.type < UART_EVENT_MAX)
+            core_stats.uart_events[event.type]++;
+        switch (event.type)
+        {
+        case UART_DATA:
+            break;
+        case UART_FIFO_OVF:
+            /* 驱动已自行复位 FIFO */
+            ESP_LOGW(TAG, "uart fifo overflow");
+            break;
+        case UART_BUFFER_FULL:
+            /* 流控暂停读取时属于正常现象，驱动在读取后恢复接收 */
+            break;
+        case UART_BREAK:
+            ESP_LOGI(TAG, "uart rx break");
+            break;
+        case UART_PARITY_ERR:
+            ESP_LOGI(TAG, "uart parity error");
+            break;
+        case UART_FRAME_ERR:
+            ESP_LOGI(TAG, "uart frame error");
+            break;
+        default:
+            ESP_LOGI(TAG, "uart event type: %d", event.type);
+            break;
+        }
+    }
+}
+
+/**
+ * @brief 根据最慢客户端的积压暂停或恢复读取串口
+ *
+ * 长时间没有进展的客户端不再参与计算，避免一个失效的连接拖住串口；
+ * 通过 RFC 2217 主动暂停的客户端除外。
+ */
+static void telnet_flow_update(int64_t now)
+{
+    uint32_t max_lag = 0;
+    for (TelnetConnect_t *client = client_list; client != NULL; client = client->next)
+    {
+        uint32_t lag = bridge_ring_lag(&client->cursor);
+        if (client->flow_exempt)
+        {
+            if (lag >= flow_low_water)
+                continue;
+            client->flow_exempt = false;
+        }
+        if (lag >= flow_high_water && !client->suspended &&
+            now - client->last_progress > CONFIG_BRIDGE_FLOW_STALL_MS * 1000LL)
+        {
+            ESP_LOGW(TAG, "%d:%s stalled, exempt from flow control", client->fd, client->ip_str);
+            client->flow_exempt = true;
+            continue;
+        }
+        if (lag > max_lag)
+            max_lag = lag;
+    }
+
+    bool pause = usr_uart_get_flow() != USR_UART_FLOW_NONE &&
+                 (max_lag >= flow_high_water || (uart_rx_paused && max_lag >= flow_low_water));
+    if (pause == uart_rx_paused)
+        return;
+
+    uart_rx_paused = pause;
+    if (pause)
+    {
+        telnet_fdset_unwatch(&core_fds, uart_fd);
+        core_stats.rx_pauses++;
+    }
+    else
+    {
+        telnet_fdset_watch(&core_fds, uart_fd);
+    }
+}
+
+void telnet_ws_attach(int fd, int scrollback)
+{
+    TelnetMsg_t msg = {.type = TELNET_MSG_WS_ATTACH, .ws = {.fd = fd, .scrollback = scrollback}};
+    if (!telnet_post(&msg, pdMS_TO_TICKS(100)))
+        ESP_LOGE(TAG, "message queue full, drop ws %d", fd);
+}
+
+void telnet_ws_detach(int fd)
+{
+    /* 超出范围的描述符不会被加入转发，直接关闭 */
+    if (fd < 0 || fd >= FD_SETSIZE)
+    {
+        lwip_close(fd);
+        return;
+    }
+    if (!atomic_exchange(&ws_detached[fd], true))
+        atomic_fetch_add(&ws_detach_pending, 1);
+    telnet_wakeup();
+}
+
+void telnet_ws_control(int fd, uint8_t opcode, const uint8_t *data, size_t len)
+{
+    /* 控制帧负载最长 125 字节 */
+    if (len > 125)
+        return;
+    TelnetMsg_t msg = {.type = TELNET_MSG_WS_CONTROL, .ws = {.fd = fd, .opcode = opcode, .len = len}};
+    if (len)
+    {
+        msg.ws.data = malloc(len);
+        if (msg.ws.data == NULL)
+            return;
+        memcpy(msg.ws.data, data, len);
+    }
+    if (!telnet_post(&msg, pdMS_TO_TICKS(100)))
+        free(msg.ws.data);
 }
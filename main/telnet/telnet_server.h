@@ -1,12 +1,95 @@
 #pragma once
 
+#include "bridge/bridge_udp.h"
+#include "driver/uart.h"
 #include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef struct
+{
+    int fd;
+    char ip_str[32];
+    uint32_t lag;      // 尚未发送给该客户端的字节数
+    uint32_t overruns; // 积压超过环形缓冲区导致丢数据的次数
+    uint32_t dropped;  // 丢失的字节数
+    uint32_t rx_bytes; // 从客户端收到的字节数，含 telnet 协议数据
+    uint32_t tx_bytes; // 发送给客户端的字节数，压缩后、加密前
+    uint32_t mccp_in;  // MCCP2 压缩前后的字节数，未启用压缩时为 0
+    uint32_t mccp_out;
+    uint32_t mccp_cycles_per_kb; // 每 KB 输入消耗的 CPU 周期
+    bool timestamps;             // 启用了行首时间戳
+} telnet_client_stats_t;
+
+typedef struct
+{
+    uint32_t clients;          // 当前 TLS 连接数，包括正在握手的连接
+    uint32_t handshakes;       // 完整握手次数
+    uint32_t resumed;          // 凭会话票据完成的简化握手次数
+    uint32_t failed;           // 握手失败次数
+    uint32_t handshake_avg_ms; // tls 任务开始握手到完成的平均耗时
+    uint32_t resumed_avg_ms;
+    uint32_t tx_bytes;         // 加密发送的应用数据
+    uint8_t fingerprint[32];   // 服务器证书的 SHA-256 指纹
+} telnet_tls_stats_t;
+
+typedef struct
+{
+    uint32_t latency_count;  // 统计的发送次数
+    uint32_t latency_min_us; // UART 数据读取到首次发送的延迟，包含合并发送的等待时间
+    uint32_t latency_avg_us;
+    uint32_t latency_max_us;
+    uint32_t uart_rx_bytes; // 从串口读取的字节数
+    /* 按 uart_event_type_t 统计的驱动事件次数，UART_FIFO_OVF 时数据已丢失，
+       UART_BUFFER_FULL 在流控暂停读取时属于正常现象 */
+    uint32_t uart_events[UART_EVENT_MAX];
+    uint32_t clients;         // 当前连接数
+    uint32_t client_connects; // 累计建立的连接数
+    /* 所有客户端的累计值，包括已断开的连接 */
+    uint32_t client_rx_bytes;
+    uint32_t client_tx_bytes;
+    uint32_t client_overruns;
+    uint32_t client_dropped;
+    uint32_t rx_pauses; // 因客户端积压暂停读取串口的次数
+    uint32_t tx_pauses; // 因串口发送缓冲区满暂停读取网络数据的次数
+    bridge_udp_stats_t udp;
+    telnet_tls_stats_t tls;
+} telnet_core_stats_t;
+
 esp_err_t telnet_init();
 
+/**
+ * @brief 获取当前所有客户端的积压与丢失统计
+ *
+ * @param stats 输出数组
+ * @param max 数组长度
+ * @param core 转发延迟与串口流控统计，不需要时传 NULL
+ * @return int 实际填充的客户端数量
+ */
+int telnet_get_client_stats(telnet_client_stats_t *stats, int max, telnet_core_stats_t *core);
+
+/**
+ * @brief 将完成握手的 WebSocket 连接加入转发，之后由 telnet_srv 任务发送串口数据
+ *
+ * @param scrollback 开始转发前回放的历史字节数，小于 0 时使用默认值
+ */
+void telnet_ws_attach(int fd, int scrollback);
+
+/**
+ * @brief 代替 close 释放经 telnet_ws_attach 移交的套接字，不阻塞
+ *
+ * telnet_srv 移除连接后再关闭描述符，避免描述符被新连接复用后收到旧连接的数据
+ */
+void telnet_ws_detach(int fd);
+
+/**
+ * @brief 转交客户端发来的 PING/CLOSE 控制帧，由 telnet_srv 任务回复以免打断正在发送的数据帧
+ */
+void telnet_ws_control(int fd, uint8_t opcode, const uint8_t *data, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
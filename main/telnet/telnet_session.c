@@ -0,0 +1,87 @@
+#include "esp_log.h"
+#include "esp_random.h"
+#include "lwip/inet.h"
+#include "sdkconfig.h"
+#include "telnet_private.h"
+#include <inttypes.h>
+#include <string.h>
+
+#define SESSION_MAGIC "WUS1"
+
+/* 会话端口上客户端首先发送的握手，多字节字段均为网络字节序 */
+typedef struct __attribute__((packed))
+{
+    char magic[4];
+    uint32_t boot;   // 令牌高 32 位，新会话填 0
+    uint32_t id;     // 令牌低 32 位
+    uint32_t offset; // 希望收到的下一个字节在串口数据流中的位置
+} session_hello_t;
+
+typedef struct __attribute__((packed))
+{
+    char magic[4];
+    uint8_t status; // TELNET_SESSION_*
+    uint8_t reserved[3];
+    uint32_t boot;
+    uint32_t id;
+    uint32_t offset; // 随后发送的第一个字节的位置
+} session_reply_t;
+
+_Static_assert(sizeof(session_hello_t) <= TELNET_SB_BUF, "session hello does not fit sb_buf");
+
+static const char *TAG = "session";
+
+/* 每次启动随机生成，环形缓冲区的位置在重启后不再有效，旧令牌随之失效 */
+static uint32_t session_boot;
+static uint32_t session_last_id;
+
+int telnet_session_proc_hello(TelnetConnect_t *client, const uint8_t *data, size_t len)
+{
+    /* 会话连接不做 telnet 处理，握手暂存在 sb_buf 中 */
+    size_t n = sizeof(session_hello_t) - client->sb_len;
+    if (n > len)
+        n = len;
+    memcpy(client->sb_buf + client->sb_len, data, n);
+    client->sb_len += n;
+    if (client->sb_len < sizeof(session_hello_t))
+        return n;
+
+    session_hello_t hello;
+    memcpy(&hello, client->sb_buf, sizeof(hello));
+    client->sb_len = 0;
+    if (memcmp(hello.magic, SESSION_MAGIC, sizeof(hello.magic)) != 0)
+    {
+        ESP_LOGW(TAG, "%d:%s bad hello", client->fd, client->ip_str);
+        return -1;
+    }
+    if (session_boot == 0)
+        session_boot = esp_random() | 1;
+
+    session_reply_t reply = {};
+    memcpy(reply.magic, SESSION_MAGIC, sizeof(reply.magic));
+    uint32_t id = ntohl(hello.id);
+    uint32_t offset = ntohl(hello.offset);
+    if (ntohl(hello.boot) == session_boot && id != 0 && id <= session_last_id)
+    {
+        /* 请求位置仍在环形缓冲区中时从该位置继续，否则从最早的数据开始并告知缺口 */
+        bridge_ring_cursor_init(&client->cursor, bridge_ring_head() - offset);
+        reply.status = client->cursor.pos == offset ? TELNET_SESSION_RESUMED : TELNET_SESSION_GAP;
+        ESP_LOGI(TAG, "%d:%s resume session %" PRIu32 " at %" PRIu32 "%s", client->fd, client->ip_str, id, offset,
+                 reply.status == TELNET_SESSION_GAP ? " with gap" : "");
+    }
+    else
+    {
+        id = ++session_last_id;
+        bridge_ring_cursor_init(&client->cursor, client->scrollback);
+        reply.status = TELNET_SESSION_NEW;
+        ESP_LOGI(TAG, "%d:%s new session %" PRIu32, client->fd, client->ip_str, id);
+    }
+
+    client->session = id;
+    client->session_hello = false;
+    reply.boot = htonl(session_boot);
+    reply.id = htonl(id);
+    reply.offset = htonl(client->cursor.pos);
+    telnet_client_queue(client, &reply, sizeof(reply));
+    return n;
+}
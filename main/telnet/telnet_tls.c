@@ -0,0 +1,543 @@
+#include "boot/boot_prof.h"
+#include "config/config.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_vfs_eventfd.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "mbedtls/ecp.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_ticket.h"
+#include "mbedtls/version.h"
+#include "mbedtls/x509_crt.h"
+#include "sdkconfig.h"
+#include "stats/stats.h"
+#include "telnet_private.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+#if CONFIG_BRIDGE_TLS_PORT
+
+#define TLS_KEY_MAX 256
+#define TLS_CERT_MAX 1024
+#define TLS_CERT_SUBJECT "CN=wifi_uart"
+/* ECDHE 与签名运算需要较大的栈 */
+#define TLS_TASK_STACK 8192
+/* 握手超过该时间未完成时关闭连接，防止半开的连接一直占用预算 */
+#define TLS_HANDSHAKE_TIMEOUT_MS 10000
+
+struct telnet_tls
+{
+    mbedtls_ssl_context ssl;
+    int fd;
+    int64_t start;  // 开始握手的时间，用于统计握手耗时
+    size_t pending; // 上次因发送缓冲区满未写完的记录长度，重试时必须传入相同的数据
+    int64_t deadline; // 握手截止时间
+    int want;         // 握手上次返回的 MBEDTLS_ERR_SSL_WANT_READ 或 WANT_WRITE
+    bool resumed;     // 客户端出示的会话票据有效，只进行简化握手
+    bool ready;
+};
+
+static const char *TAG = "tls";
+
+static mbedtls_ssl_config tls_conf;
+static mbedtls_ssl_ticket_context tls_ticket;
+static mbedtls_x509_crt tls_cert;
+static mbedtls_pk_context tls_key;
+/*
+ * 证书加载与握手都在 tls 任务中进行，一次握手的椭圆曲线运算需要几百毫秒，
+ * 转发任务同时负责读取串口，不能等待。握手完成后连接交给转发任务，之后只做记录的加解密。
+ * 转发任务经 tls_queue 交来新连接并通过 tls_wake_fd 唤醒 tls 任务的 select。
+ */
+static QueueHandle_t tls_queue;
+static int tls_wake_fd = -1;
+/* 所有正在握手的连接在同一个 select 中等待，哪个连接的数据到达就推进哪个，只由 tls 任务访问 */
+static telnet_tls_t *tls_pending[CONFIG_BRIDGE_TLS_MAX_CLIENTS];
+static int tls_pending_count;
+/* 正在调用 mbedtls_ssl_handshake 的连接，供票据回调记录简化握手 */
+static telnet_tls_t *tls_current;
+/* 握手统计由 tls 任务写入，转发任务读取 */
+static portMUX_TYPE tls_lock = portMUX_INITIALIZER_UNLOCKED;
+static telnet_tls_stats_t tls_stats;
+static uint64_t tls_full_total_ms;
+static uint64_t tls_resumed_total_ms;
+/* 只由转发任务更新 */
+static uint32_t tls_tx_bytes;
+
+/* 只使用一种密码套件，AES-GCM 与 SHA-256 都由硬件加速 */
+static const int tls_ciphersuites[] = {MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256, 0};
+
+static int tls_rng(void *ctx, unsigned char *buf, size_t len)
+{
+    esp_fill_random(buf, len);
+    return 0;
+}
+
+static int tls_bio_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    int ret = lwip_send(*(int *)ctx, buf, len, MSG_DONTWAIT);
+    if (ret < 0)
+        return (errno == EWOULDBLOCK || errno == EAGAIN) ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_SEND_FAILED;
+    return ret;
+}
+
+static int tls_bio_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    int ret = lwip_recv(*(int *)ctx, buf, len, MSG_DONTWAIT);
+    if (ret < 0)
+        return (errno == EWOULDBLOCK || errno == EAGAIN) ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_RECV_FAILED;
+    return ret;
+}
+
+static int tls_ticket_parse(void *p_ticket, mbedtls_ssl_session *session, unsigned char *buf, size_t len)
+{
+    int ret = mbedtls_ssl_ticket_parse(p_ticket, session, buf, len);
+    if (ret == 0 && tls_current)
+        tls_current->resumed = true;
+    return ret;
+}
+
+/**
+ * @brief 首次启动时生成 P-256 密钥与自签名证书并保存，客户端通过证书指纹确认设备
+ */
+static int tls_generate_cred(uint8_t *key_buf, size_t *key_len, uint8_t *cert_buf, size_t *cert_len)
+{
+    ESP_LOGI(TAG, "generating server key");
+    mbedtls_pk_context key;
+    mbedtls_x509write_cert crt;
+    mbedtls_pk_init(&key);
+    mbedtls_x509write_crt_init(&crt);
+
+    int ret = mbedtls_pk_setup(&key, mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY));
+    if (ret == 0)
+        ret = mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(key), tls_rng, NULL);
+    if (ret != 0)
+        goto exit;
+
+    uint8_t serial[8];
+    esp_fill_random(serial, sizeof(serial));
+    serial[0] &= 0x7f;
+    mbedtls_x509write_crt_set_version(&crt, MBEDTLS_X509_CRT_VERSION_3);
+    mbedtls_x509write_crt_set_md_alg(&crt, MBEDTLS_MD_SHA256);
+    mbedtls_x509write_crt_set_subject_key(&crt, &key);
+    mbedtls_x509write_crt_set_issuer_key(&crt, &key);
+    ret = mbedtls_x509write_crt_set_subject_name(&crt, TLS_CERT_SUBJECT);
+    if (ret == 0)
+        ret = mbedtls_x509write_crt_set_issuer_name(&crt, TLS_CERT_SUBJECT);
+#if MBEDTLS_VERSION_NUMBER >= 0x03040000
+    if (ret == 0)
+        ret = mbedtls_x509write_crt_set_serial_raw(&crt, serial, sizeof(serial));
+#else
+    mbedtls_mpi serial_mpi;
+    mbedtls_mpi_init(&serial_mpi);
+    if (ret == 0)
+        ret = mbedtls_mpi_read_binary(&serial_mpi, serial, sizeof(serial));
+    if (ret == 0)
+        ret = mbedtls_x509write_crt_set_serial(&crt, &serial_mpi);
+    mbedtls_mpi_free(&serial_mpi);
+#endif
+    if (ret == 0)
+        ret = mbedtls_x509write_crt_set_validity(&crt, "20240101000000", "20991231235959");
+    if (ret != 0)
+        goto exit;
+
+    /* DER 数据写在缓冲区末尾，移到开头 */
+    ret = mbedtls_pk_write_key_der(&key, key_buf, *key_len);
+    if (ret <= 0)
+        goto exit;
+    memmove(key_buf, key_buf + *key_len - ret, ret);
+    *key_len = ret;
+    ret = mbedtls_x509write_crt_der(&crt, cert_buf, *cert_len, tls_rng, NULL);
+    if (ret <= 0)
+        goto exit;
+    memmove(cert_buf, cert_buf + *cert_len - ret, ret);
+    *cert_len = ret;
+    ret = 0;
+
+    if (conf_set_tls_cred(key_buf, *key_len, cert_buf, *cert_len) != ESP_OK)
+        ESP_LOGW(TAG, "save credentials failed, a new key is generated on next boot");
+
+exit:
+    if (ret != 0)
+        ESP_LOGE(TAG, "generate credentials failed -0x%04x", -ret);
+    mbedtls_x509write_crt_free(&crt);
+    mbedtls_pk_free(&key);
+    return ret;
+}
+
+/**
+ * @brief 加载或生成服务器证书，配置 TLS 与会话票据
+ */
+static esp_err_t tls_init()
+{
+    uint8_t *key_buf = malloc(TLS_KEY_MAX);
+    uint8_t *cert_buf = malloc(TLS_CERT_MAX);
+    if (key_buf == NULL || cert_buf == NULL)
+    {
+        free(key_buf);
+        free(cert_buf);
+        return ESP_ERR_NO_MEM;
+    }
+
+    size_t key_len = TLS_KEY_MAX, cert_len = TLS_CERT_MAX;
+    int ret = 0;
+    if (conf_get_tls_cred(key_buf, &key_len, cert_buf, &cert_len) != ESP_OK)
+    {
+        key_len = TLS_KEY_MAX;
+        cert_len = TLS_CERT_MAX;
+        ret = tls_generate_cred(key_buf, &key_len, cert_buf, &cert_len);
+    }
+
+    mbedtls_x509_crt_init(&tls_cert);
+    mbedtls_pk_init(&tls_key);
+    mbedtls_ssl_config_init(&tls_conf);
+    mbedtls_ssl_ticket_init(&tls_ticket);
+    if (ret == 0)
+        ret = mbedtls_x509_crt_parse_der(&tls_cert, cert_buf, cert_len);
+    if (ret == 0)
+        ret = mbedtls_pk_parse_key(&tls_key, key_buf, key_len, NULL, 0, tls_rng, NULL);
+    if (ret == 0)
+    {
+        uint8_t fingerprint[sizeof(tls_stats.fingerprint)];
+        mbedtls_sha256(cert_buf, cert_len, fingerprint, 0);
+        taskENTER_CRITICAL(&tls_lock);
+        memcpy(tls_stats.fingerprint, fingerprint, sizeof(fingerprint));
+        taskEXIT_CRITICAL(&tls_lock);
+    }
+    free(key_buf);
+    free(cert_buf);
+
+    if (ret == 0)
+        ret = mbedtls_ssl_config_defaults(&tls_conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                          MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret == 0)
+    {
+        mbedtls_ssl_conf_rng(&tls_conf, tls_rng, NULL);
+        mbedtls_ssl_conf_ciphersuites(&tls_conf, tls_ciphersuites);
+        ret = mbedtls_ssl_conf_own_cert(&tls_conf, &tls_cert, &tls_key);
+    }
+    /* 票据密钥每次启动随机生成，客户端断线重连时只需一次往返的简化握手 */
+    if (ret == 0)
+        ret = mbedtls_ssl_ticket_setup(&tls_ticket, tls_rng, NULL, MBEDTLS_CIPHER_AES_128_GCM,
+                                       CONFIG_BRIDGE_TLS_TICKET_LIFETIME);
+    if (ret != 0)
+    {
+        ESP_LOGE(TAG, "init failed -0x%04x", -ret);
+        return ESP_FAIL;
+    }
+    mbedtls_ssl_conf_session_tickets_cb(&tls_conf, mbedtls_ssl_ticket_write, tls_ticket_parse, &tls_ticket);
+    return ESP_OK;
+}
+
+static telnet_tls_t *tls_new(int fd)
+{
+    telnet_tls_t *tls = calloc(1, sizeof(telnet_tls_t));
+    if (tls == NULL)
+        return NULL;
+
+    mbedtls_ssl_init(&tls->ssl);
+    if (mbedtls_ssl_setup(&tls->ssl, &tls_conf) != 0)
+    {
+        mbedtls_ssl_free(&tls->ssl);
+        free(tls);
+        return NULL;
+    }
+    stats_mem_alloc(STATS_MEM_TLS, tls);
+    tls->fd = fd;
+    tls->start = esp_timer_get_time();
+    mbedtls_ssl_set_bio(&tls->ssl, &tls->fd, tls_bio_send, tls_bio_recv, NULL);
+    return tls;
+}
+
+void telnet_tls_free(telnet_tls_t *tls)
+{
+    if (tls->ready)
+        mbedtls_ssl_close_notify(&tls->ssl);
+    mbedtls_ssl_free(&tls->ssl);
+    stats_mem_free(STATS_MEM_TLS, tls);
+    free(tls);
+}
+
+/**
+ * @brief 推进一次握手，数据不足时立即返回，不等待
+ *
+ * @return int 0 完成，MBEDTLS_ERR_SSL_WANT_READ/WANT_WRITE 需要等待，其他值为失败
+ */
+static int tls_handshake_step(telnet_tls_t *tls)
+{
+    tls_current = tls;
+    int ret = mbedtls_ssl_handshake(&tls->ssl);
+    tls_current = NULL;
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+        tls->want = ret;
+        if (esp_timer_get_time() >= tls->deadline)
+            ret = MBEDTLS_ERR_SSL_TIMEOUT;
+    }
+    return ret;
+}
+
+/**
+ * @brief 结束握手并把连接交还转发任务，失败时释放上下文，套接字始终由转发任务关闭
+ */
+static void tls_handshake_end(telnet_tls_t *tls, int ret)
+{
+    int fd = tls->fd;
+    if (ret != 0)
+    {
+        ESP_LOGW(TAG, "%d handshake failed -0x%04x", fd, -ret);
+        taskENTER_CRITICAL(&tls_lock);
+        tls_stats.failed++;
+        taskEXIT_CRITICAL(&tls_lock);
+        telnet_tls_free(tls);
+        telnet_tls_done(fd, NULL);
+        return;
+    }
+
+    tls->ready = true;
+    uint32_t ms = (esp_timer_get_time() - tls->start) / 1000;
+    taskENTER_CRITICAL(&tls_lock);
+    if (tls->resumed)
+    {
+        tls_stats.resumed++;
+        tls_resumed_total_ms += ms;
+    }
+    else
+    {
+        tls_stats.handshakes++;
+        tls_full_total_ms += ms;
+    }
+    taskEXIT_CRITICAL(&tls_lock);
+    ESP_LOGI(TAG, "%d %s handshake %" PRIu32 "ms", fd, tls->resumed ? "resumed" : "full", ms);
+    telnet_tls_done(fd, tls);
+}
+
+/**
+ * @brief 接收转发任务交来的连接，加入等待握手的集合
+ */
+static void tls_accept_queued(bool inited)
+{
+    int fd;
+    while (xQueueReceive(tls_queue, &fd, 0) == pdTRUE)
+    {
+        telnet_tls_t *tls = inited && tls_pending_count < CONFIG_BRIDGE_TLS_MAX_CLIENTS ? tls_new(fd) : NULL;
+        if (tls == NULL)
+        {
+            if (inited)
+                ESP_LOGE(TAG, "%d no memory for tls", fd);
+            telnet_tls_done(fd, NULL);
+            continue;
+        }
+        tls->deadline = tls->start + TLS_HANDSHAKE_TIMEOUT_MS * 1000LL;
+        tls->want = MBEDTLS_ERR_SSL_WANT_READ; // 等待 ClientHello
+        tls_pending[tls_pending_count++] = tls;
+    }
+}
+
+static void tls_task(void *arg)
+{
+    /* 首次启动时生成密钥需要几百毫秒，放在本任务中，不推迟串口接收与转发任务的启动 */
+    int stage = boot_prof_begin("tls");
+    bool inited = tls_init() == ESP_OK;
+    boot_prof_end(stage);
+    if (!inited)
+        ESP_LOGE(TAG, "tls connections are refused");
+
+    while (true)
+    {
+        tls_accept_queued(inited);
+
+        /* 按各连接等待的方向监听，超时取最早的截止时间，不活动的客户端不会拖延其他连接的握手 */
+        fd_set rfds, wfds;
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        FD_SET(tls_wake_fd, &rfds);
+        int max_fd = tls_wake_fd;
+        int64_t deadline = INT64_MAX;
+        for (int i = 0; i < tls_pending_count; i++)
+        {
+            telnet_tls_t *tls = tls_pending[i];
+            FD_SET(tls->fd, tls->want == MBEDTLS_ERR_SSL_WANT_WRITE ? &wfds : &rfds);
+            if (tls->fd > max_fd)
+                max_fd = tls->fd;
+            if (tls->deadline < deadline)
+                deadline = tls->deadline;
+        }
+        struct timeval tv, *tvp = NULL;
+        if (tls_pending_count)
+        {
+            int64_t remain = deadline - esp_timer_get_time();
+            if (remain < 0)
+                remain = 0;
+            tv = (struct timeval){.tv_sec = remain / 1000000, .tv_usec = remain % 1000000};
+            tvp = &tv;
+        }
+        if (select(max_fd + 1, &rfds, &wfds, NULL, tvp) < 0)
+        {
+            ESP_LOGE(TAG, "select failed %d %s", errno, strerror(errno));
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        if (FD_ISSET(tls_wake_fd, &rfds))
+        {
+            uint64_t count;
+            read(tls_wake_fd, &count, sizeof(count));
+        }
+
+        int64_t now = esp_timer_get_time();
+        for (int i = 0; i < tls_pending_count;)
+        {
+            telnet_tls_t *tls = tls_pending[i];
+            int ret = MBEDTLS_ERR_SSL_TIMEOUT;
+            if (FD_ISSET(tls->fd, &rfds) || FD_ISSET(tls->fd, &wfds))
+                ret = tls_handshake_step(tls);
+            else if (now < tls->deadline)
+                ret = tls->want;
+            if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+            {
+                i++;
+                continue;
+            }
+            tls_pending[i] = tls_pending[--tls_pending_count];
+            tls_handshake_end(tls, ret);
+        }
+    }
+}
+
+esp_err_t telnet_tls_start()
+{
+    /* 转发任务限制了同时交来的连接数，队列不会满；eventfd 的 VFS 已由 telnet_init 注册 */
+    tls_queue = xQueueCreate(CONFIG_BRIDGE_TLS_MAX_CLIENTS, sizeof(int));
+    if (tls_queue == NULL)
+        return ESP_ERR_NO_MEM;
+    tls_wake_fd = eventfd(0, 0);
+    if (tls_wake_fd < 0)
+    {
+        ESP_LOGE(TAG, "eventfd create failed %d %s", errno, strerror(errno));
+        goto err;
+    }
+    /* 优先级低于转发任务，握手运算只使用空闲时间 */
+    if (xTaskCreate(tls_task, "tls", TLS_TASK_STACK, NULL, tskIDLE_PRIORITY, NULL) != pdPASS)
+    {
+        ESP_LOGE(TAG, "xTaskCreate tls failed");
+        goto err;
+    }
+    return ESP_OK;
+err:
+    if (tls_wake_fd >= 0)
+        close(tls_wake_fd);
+    tls_wake_fd = -1;
+    vQueueDelete(tls_queue);
+    tls_queue = NULL;
+    return ESP_FAIL;
+}
+
+bool telnet_tls_handshake_start(int fd)
+{
+    if (tls_queue == NULL || xQueueSend(tls_queue, &fd, 0) != pdTRUE)
+        return false;
+    uint64_t count = 1;
+    write(tls_wake_fd, &count, sizeof(count));
+    return true;
+}
+
+int telnet_tls_send(telnet_tls_t *tls, const void *data, size_t len)
+{
+    if (tls->pending && len > tls->pending)
+        len = tls->pending;
+    int ret = mbedtls_ssl_write(&tls->ssl, data, len);
+    if (ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ)
+    {
+        tls->pending = len;
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+    tls->pending = 0;
+    if (ret < 0)
+    {
+        errno = EIO;
+        return -1;
+    }
+    tls_tx_bytes += ret;
+    return ret;
+}
+
+int telnet_tls_recv(telnet_tls_t *tls, void *buf, size_t len)
+{
+    int ret = mbedtls_ssl_read(&tls->ssl, buf, len);
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE)
+    {
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+    if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY)
+        return 0;
+    if (ret < 0)
+    {
+        errno = EIO;
+        return -1;
+    }
+    return ret;
+}
+
+size_t telnet_tls_pending(const telnet_tls_t *tls)
+{
+    return mbedtls_ssl_get_bytes_avail(&tls->ssl);
+}
+
+void telnet_tls_get_stats(telnet_tls_stats_t *stats)
+{
+    taskENTER_CRITICAL(&tls_lock);
+    *stats = tls_stats;
+    stats->handshake_avg_ms = tls_stats.handshakes ? tls_full_total_ms / tls_stats.handshakes : 0;
+    stats->resumed_avg_ms = tls_stats.resumed ? tls_resumed_total_ms / tls_stats.resumed : 0;
+    taskEXIT_CRITICAL(&tls_lock);
+    stats->tx_bytes = tls_tx_bytes;
+}
+
+#else
+
+esp_err_t telnet_tls_start()
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+bool telnet_tls_handshake_start(int fd)
+{
+    return false;
+}
+
+void telnet_tls_free(telnet_tls_t *tls)
+{
+}
+
+int telnet_tls_send(telnet_tls_t *tls, const void *data, size_t len)
+{
+    return -1;
+}
+
+int telnet_tls_recv(telnet_tls_t *tls, void *buf, size_t len)
+{
+    return -1;
+}
+
+size_t telnet_tls_pending(const telnet_tls_t *tls)
+{
+    return 0;
+}
+
+void telnet_tls_get_stats(telnet_tls_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+#endif
@@ -0,0 +1,62 @@
+#include "timesync.h"
+#include "esp_idf_version.h"
+#include "esp_log.h"
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* 5.1 之前没有 esp_ 前缀的接口 */
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 1, 0)
+#define esp_sntp_setoperatingmode sntp_setoperatingmode
+#define esp_sntp_setservername sntp_setservername
+#define esp_sntp_init sntp_init
+#define ESP_SNTP_OPMODE_POLL SNTP_OPMODE_POLL
+#endif
+
+static const char *TAG = "timesync";
+
+/* Unix 时间与 esp_timer 启动时间之差，0 表示尚未同步；在 lwip 任务中写入，各任务读取 */
+static _Atomic int64_t unix_offset_us;
+
+static void timesync_notify_cb(struct timeval *tv)
+{
+    /* 回调时系统时间刚被设置，两次读取之间的间隔可以忽略 */
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    int64_t offset = (int64_t)now.tv_sec * 1000000 + now.tv_usec - esp_timer_get_time();
+    int64_t old = atomic_exchange(&unix_offset_us, offset);
+    if (old)
+        ESP_LOGI(TAG, "time synced, adjusted %lldus", (long long)(offset - old));
+    else
+        ESP_LOGI(TAG, "time synced");
+}
+
+esp_err_t timesync_init()
+{
+    if (strlen(CONFIG_BRIDGE_SNTP_SERVER) == 0)
+        return ESP_ERR_NOT_SUPPORTED;
+
+    esp_sntp_setoperatingmode(ESP_SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, CONFIG_BRIDGE_SNTP_SERVER);
+    sntp_set_time_sync_notification_cb(timesync_notify_cb);
+    esp_sntp_init();
+    ESP_LOGI(TAG, "sntp server %s", CONFIG_BRIDGE_SNTP_SERVER);
+    return ESP_OK;
+}
+
+bool timesync_synced()
+{
+    return atomic_load(&unix_offset_us) != 0;
+}
+
+bool timesync_to_unix(int64_t boot_us, int64_t *unix_us)
+{
+    int64_t offset = atomic_load(&unix_offset_us);
+    if (offset == 0)
+        return false;
+    *unix_us = boot_us + offset;
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief 按 CONFIG_BRIDGE_SNTP_SERVER 启动 SNTP 校时，需要在 esp_netif_init 之后调用
+ *
+ * @return esp_err_t 未配置服务器时返回 ESP_ERR_NOT_SUPPORTED
+ */
+esp_err_t timesync_init();
+
+/**
+ * @brief 是否已与服务器同步
+ */
+bool timesync_synced();
+
+/**
+ * @brief 将 esp_timer_get_time() 得到的启动时间换算为 Unix 时间
+ *
+ * @param boot_us 自启动以来的微秒数
+ * @param unix_us 输出自 1970 年以来的微秒数
+ * @return true 已同步，换算有效
+ */
+bool timesync_to_unix(int64_t boot_us, int64_t *unix_us);
+
+#ifdef __cplusplus
+}
+#endif
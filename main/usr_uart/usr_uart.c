@@ -1,27 +1,315 @@
-
+#include "usr_uart.h"
 #include "config/config.h"
+#include "driver/gpio.h"
 #include "driver/uart.h"
 #include "driver/uart_select.h"
 #include "esp_err.h"
+#include "esp_idf_version.h"
 #include "esp_log.h"
+#include "freertos/semphr.h"
 #include "hal/gpio_types.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/errno.h>
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+#include "driver/uart_vfs.h"
+#define usr_uart_vfs_use_driver() uart_vfs_dev_use_driver(UART_NUM_1)
+#else
+#include "esp_vfs_dev.h"
+#define usr_uart_vfs_use_driver() esp_vfs_dev_uart_use_driver(UART_NUM_1)
+#endif
+
+#define USR_UART_RTS_GPIO (CONFIG_BRIDGE_UART_RTS_GPIO < 0 ? UART_PIN_NO_CHANGE : CONFIG_BRIDGE_UART_RTS_GPIO)
+#define USR_UART_CTS_GPIO (CONFIG_BRIDGE_UART_CTS_GPIO < 0 ? UART_PIN_NO_CHANGE : CONFIG_BRIDGE_UART_CTS_GPIO)
+#define USR_UART_RX_BUF 1024
+#define USR_UART_TX_BUF 1024
+/* 软件流控按 RX FIFO（128 字节）中的数据量发送 XOFF/XON */
+#define USR_UART_XOFF_THRESH 96
+#define USR_UART_XON_THRESH 32
+
+static const char *TAG = "usr_uart";
 
 static QueueHandle_t uart_queue;
+static SemaphoreHandle_t uart_param_mutex;
+/* 硬件不提供读取流控等配置的接口，在此记录当前生效的参数 */
+static uart_config_t uart_current;
+static bool uart_sw_flow;
+/* 线路控制信号的当前状态，只在设置成功后更新，供 RFC 2217 查询 */
+static bool uart_break;
+static bool uart_dtr;
+static bool uart_rts;
+static uint32_t uart_char_ns;
+/* telnet_srv 与 http 服务器任务都会写入串口 */
+static atomic_uint uart_tx_bytes;
+static atomic_uint uart_tx_dropped;
+
+static void usr_uart_update_char_time()
+{
+    /* 起始位 + 数据位 + 校验位 + 停止位，以半位计数以表示 1.5 个停止位 */
+    uint32_t half_bits = 2 * (1 + 5 + uart_current.data_bits) + (uart_current.parity != UART_PARITY_DISABLE ? 2 : 0) +
+                         (uart_current.stop_bits + 1);
+    if (uart_current.baud_rate)
+        uart_char_ns = half_bits * 500000000ULL / uart_current.baud_rate;
+}
 
 esp_err_t usr_uart_init()
 {
     uart_config_t uart_config = {};
     conf_get_uart_param(&uart_config);
-    uart_driver_install(UART_NUM_1, 1024, 1024, 20, &uart_queue, 0);
+    uart_param_mutex = xSemaphoreCreateMutex();
+    uart_current = uart_config;
+    usr_uart_update_char_time();
+    uart_driver_install(UART_NUM_1, USR_UART_RX_BUF, USR_UART_TX_BUF, 20, &uart_queue, 0);
     uart_param_config(UART_NUM_1, &uart_config);
-    uart_set_pin(UART_NUM_1, GPIO_NUM_5, GPIO_NUM_4, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    uart_set_pin(UART_NUM_1, GPIO_NUM_5, GPIO_NUM_4, USR_UART_RTS_GPIO, USR_UART_CTS_GPIO);
+
+#if CONFIG_BRIDGE_FLOW_CTRL_HW
+    usr_uart_set_flow(USR_UART_FLOW_HW);
+#elif CONFIG_BRIDGE_FLOW_CTRL_SW
+    usr_uart_set_flow(USR_UART_FLOW_SW);
+#endif
 
-    uart_enable_pattern_det_baud_intr(UART_NUM_1, '\n', 1, 64, 0, 0);
-    uart_pattern_queue_reset(UART_NUM_1, 20);
+#if CONFIG_BRIDGE_UART_DTR_GPIO >= 0
+    gpio_config_t gpio_conf = {};
+    gpio_conf.pin_bit_mask = 1ULL << CONFIG_BRIDGE_UART_DTR_GPIO;
+    gpio_conf.mode = GPIO_MODE_OUTPUT;
+    gpio_config(&gpio_conf);
+    usr_uart_set_dtr(true);
+#endif
     return ESP_OK;
 }
 
 QueueHandle_t uart_get_event_queue()
 {
     return uart_queue;
-}
\ No newline at end of file
+}
+
+int usr_uart_open_fd()
+{
+    /* 经由驱动访问 VFS 设备后 select 可以等待驱动接收缓冲区中的数据 */
+    usr_uart_vfs_use_driver();
+    int fd = open("/dev/uart/1", O_RDWR | O_NONBLOCK);
+    if (fd < 0)
+        ESP_LOGE(TAG, "open /dev/uart/1 failed %d %s", errno, strerror(errno));
+    return fd;
+}
+
+esp_err_t usr_uart_set_param(const uart_config_t *config, uint32_t mask)
+{
+    esp_err_t err = ESP_OK;
+    /* 逐项设置而不使用 uart_param_config，后者会复位收发 FIFO */
+    xSemaphoreTake(uart_param_mutex, portMAX_DELAY);
+    if ((mask & USR_UART_BAUD_RATE) && err == ESP_OK)
+    {
+        err = uart_set_baudrate(UART_NUM_1, config->baud_rate);
+        if (err == ESP_OK)
+            uart_current.baud_rate = config->baud_rate;
+    }
+    if ((mask & USR_UART_DATA_BITS) && err == ESP_OK)
+    {
+        err = uart_set_word_length(UART_NUM_1, config->data_bits);
+        if (err == ESP_OK)
+            uart_current.data_bits = config->data_bits;
+    }
+    if ((mask & USR_UART_PARITY) && err == ESP_OK)
+    {
+        err = uart_set_parity(UART_NUM_1, config->parity);
+        if (err == ESP_OK)
+            uart_current.parity = config->parity;
+    }
+    if ((mask & USR_UART_STOP_BITS) && err == ESP_OK)
+    {
+        err = uart_set_stop_bits(UART_NUM_1, config->stop_bits);
+        if (err == ESP_OK)
+            uart_current.stop_bits = config->stop_bits;
+    }
+    if ((mask & USR_UART_FLOW_CTRL) && err == ESP_OK)
+    {
+        /* 硬件流控与软件流控互斥 */
+        if (config->flow_ctrl != UART_HW_FLOWCTRL_DISABLE && uart_sw_flow)
+        {
+            err = uart_set_sw_flow_ctrl(UART_NUM_1, false, 0, 0);
+            uart_sw_flow = err != ESP_OK;
+        }
+        if (err == ESP_OK)
+            err = uart_set_hw_flow_ctrl(UART_NUM_1, config->flow_ctrl, config->rx_flow_ctrl_thresh);
+        if (err == ESP_OK)
+        {
+            uart_current.flow_ctrl = config->flow_ctrl;
+            uart_current.rx_flow_ctrl_thresh = config->rx_flow_ctrl_thresh;
+        }
+    }
+    usr_uart_update_char_time();
+    xSemaphoreGive(uart_param_mutex);
+
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "set uart param failed %s", esp_err_to_name(err));
+    return err;
+}
+
+esp_err_t usr_uart_configure(uart_config_t *config, uint32_t mask)
+{
+    mask &= USR_UART_BAUD_RATE | USR_UART_DATA_BITS | USR_UART_PARITY | USR_UART_STOP_BITS;
+    if (((mask & USR_UART_BAUD_RATE) && config->baud_rate <= 0) ||
+        ((mask & USR_UART_DATA_BITS) && (config->data_bits < UART_DATA_5_BITS || config->data_bits > UART_DATA_8_BITS)) ||
+        ((mask & USR_UART_STOP_BITS) && (config->stop_bits < UART_STOP_BITS_1 || config->stop_bits > UART_STOP_BITS_2)) ||
+        ((mask & USR_UART_PARITY) && config->parity != UART_PARITY_DISABLE && config->parity != UART_PARITY_EVEN &&
+         config->parity != UART_PARITY_ODD))
+        return ESP_ERR_INVALID_ARG;
+
+    uart_config_t old;
+    usr_uart_get_param(&old);
+    esp_err_t err = usr_uart_set_param(config, mask);
+    if (err != ESP_OK)
+        return err;
+
+    uart_config_t cur;
+    usr_uart_get_param(&cur);
+    if (mask & USR_UART_BAUD_RATE)
+    {
+        /* 分频系数有限，偏差超过 0.05% 时视为不支持该波特率，恢复原值 */
+        int requested = config->baud_rate;
+        config->baud_rate = cur.baud_rate;
+        if (abs(cur.baud_rate - requested) >= requested * 0.0005)
+        {
+            usr_uart_set_param(&old, USR_UART_BAUD_RATE);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+    }
+
+    /* 保存实际生效的参数 */
+    uart_config_t saved = {};
+    conf_get_uart_param(&saved);
+    if (mask & USR_UART_BAUD_RATE)
+        saved.baud_rate = cur.baud_rate;
+    if (mask & USR_UART_DATA_BITS)
+        saved.data_bits = cur.data_bits;
+    if (mask & USR_UART_PARITY)
+        saved.parity = cur.parity;
+    if (mask & USR_UART_STOP_BITS)
+        saved.stop_bits = cur.stop_bits;
+    return conf_set_uart_param(&saved);
+}
+
+void usr_uart_get_param(uart_config_t *config)
+{
+    xSemaphoreTake(uart_param_mutex, portMAX_DELAY);
+    *config = uart_current;
+    uint32_t baud = 0;
+    if (uart_get_baudrate(UART_NUM_1, &baud) == ESP_OK)
+        config->baud_rate = baud;
+    xSemaphoreGive(uart_param_mutex);
+}
+
+esp_err_t usr_uart_set_break(bool on)
+{
+    /* 反相 TXD 使线路保持低电平即为 break */
+    esp_err_t err = uart_set_line_inverse(UART_NUM_1, on ? UART_SIGNAL_TXD_INV : UART_SIGNAL_INV_DISABLE);
+    if (err == ESP_OK)
+        uart_break = on;
+    return err;
+}
+
+esp_err_t usr_uart_set_dtr(bool on)
+{
+#if CONFIG_BRIDGE_UART_DTR_GPIO >= 0
+    /* DTR 低电平有效 */
+    esp_err_t err = gpio_set_level(CONFIG_BRIDGE_UART_DTR_GPIO, on ? 0 : 1);
+    if (err == ESP_OK)
+        uart_dtr = on;
+    return err;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t usr_uart_set_rts(bool on)
+{
+#if CONFIG_BRIDGE_UART_RTS_GPIO >= 0
+    /* 硬件流控开启时 RTS 由硬件控制，uart_set_rts 会返回错误 */
+    esp_err_t err = uart_set_rts(UART_NUM_1, on ? 1 : 0);
+    if (err == ESP_OK)
+        uart_rts = on;
+    return err;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+bool usr_uart_get_break()
+{
+    return uart_break;
+}
+
+bool usr_uart_get_dtr()
+{
+    return uart_dtr;
+}
+
+bool usr_uart_get_rts()
+{
+    return uart_rts;
+}
+
+esp_err_t usr_uart_set_flow(usr_uart_flow_t flow)
+{
+    uart_config_t config = {
+        .flow_ctrl = flow == USR_UART_FLOW_HW ? UART_HW_FLOWCTRL_CTS_RTS : UART_HW_FLOWCTRL_DISABLE,
+        .rx_flow_ctrl_thresh = 122,
+    };
+    esp_err_t err = usr_uart_set_param(&config, USR_UART_FLOW_CTRL);
+    if (err != ESP_OK || (flow == USR_UART_FLOW_SW) == uart_sw_flow)
+        return err;
+
+    xSemaphoreTake(uart_param_mutex, portMAX_DELAY);
+    err = uart_set_sw_flow_ctrl(UART_NUM_1, flow == USR_UART_FLOW_SW, USR_UART_XON_THRESH, USR_UART_XOFF_THRESH);
+    if (err == ESP_OK)
+        uart_sw_flow = flow == USR_UART_FLOW_SW;
+    xSemaphoreGive(uart_param_mutex);
+
+    if (err != ESP_OK)
+        ESP_LOGE(TAG, "set uart sw flow control failed %s", esp_err_to_name(err));
+    return err;
+}
+
+usr_uart_flow_t usr_uart_get_flow()
+{
+    if (uart_sw_flow)
+        return USR_UART_FLOW_SW;
+    return uart_current.flow_ctrl == UART_HW_FLOWCTRL_DISABLE ? USR_UART_FLOW_NONE : USR_UART_FLOW_HW;
+}
+
+size_t usr_uart_tx_free()
+{
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    size_t size = 0;
+    if (uart_get_tx_buffer_free_size(UART_NUM_1, &size) == ESP_OK)
+        return size;
+#endif
+    /* 无法查询时按空闲处理，由 uart_write_bytes 阻塞等待 */
+    return USR_UART_TX_BUF;
+}
+
+int usr_uart_write(const void *data, size_t len)
+{
+    int ret = uart_write_bytes(UART_NUM_1, data, len);
+    if (ret > 0)
+        atomic_fetch_add(&uart_tx_bytes, ret);
+    if (ret < (int)len)
+        atomic_fetch_add(&uart_tx_dropped, len - (ret > 0 ? ret : 0));
+    return ret;
+}
+
+void usr_uart_get_stats(usr_uart_stats_t *stats)
+{
+    stats->tx_bytes = atomic_load(&uart_tx_bytes);
+    stats->tx_dropped = atomic_load(&uart_tx_dropped);
+}
+
+uint32_t usr_uart_char_time_ns()
+{
+    return uart_char_ns;
+}
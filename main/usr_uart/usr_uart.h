@@ -1,16 +1,106 @@
 #pragma once
 
+#include "esp_bit_defs.h"
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "hal/uart_types.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* usr_uart_set_param 的参数掩码 */
+#define USR_UART_BAUD_RATE BIT0
+#define USR_UART_DATA_BITS BIT1
+#define USR_UART_PARITY BIT2
+#define USR_UART_STOP_BITS BIT3
+#define USR_UART_FLOW_CTRL BIT4
+
+typedef enum
+{
+    USR_UART_FLOW_NONE,
+    USR_UART_FLOW_HW, // RTS/CTS
+    USR_UART_FLOW_SW, // XON/XOFF
+} usr_uart_flow_t;
+
+typedef struct
+{
+    uint32_t tx_bytes;   // 从网络写入串口的字节数
+    uint32_t tx_dropped; // 写入失败而丢弃的字节数
+} usr_uart_stats_t;
+
 esp_err_t usr_uart_init();
 QueueHandle_t uart_get_event_queue();
 
+/**
+ * @brief 打开非阻塞的 UART VFS 描述符，仅用于 select 等待可读，数据仍通过 uart_read_bytes 读取
+ *
+ * @return int 描述符，失败返回 -1
+ */
+int usr_uart_open_fd();
+
+/**
+ * @brief 一次性修改多个串口参数，不复位 FIFO，已缓冲的数据不会丢失
+ *
+ * @param config 新参数，仅 mask 指定的字段有效
+ * @param mask USR_UART_* 的组合
+ * @return esp_err_t 任一参数设置失败时返回错误，已设置的参数不回滚
+ */
+esp_err_t usr_uart_set_param(const uart_config_t *config, uint32_t mask);
+
+/**
+ * @brief 校验并设置波特率、字长、校验与停止位，并保存到 NVS，控制台命令与 RPC 共用
+ *
+ * @param config 新参数，仅 mask 指定的字段有效；返回时 baud_rate 为实际生效的波特率
+ * @return esp_err_t 参数超出范围时返回 ESP_ERR_INVALID_ARG，不做任何修改；
+ *                   实际波特率偏差超过 0.05% 时恢复原波特率并返回 ESP_ERR_NOT_SUPPORTED
+ */
+esp_err_t usr_uart_configure(uart_config_t *config, uint32_t mask);
+
+/**
+ * @brief 读取当前生效的串口参数，波特率为硬件实际值
+ */
+void usr_uart_get_param(uart_config_t *config);
+
+/**
+ * @brief 切换流控方式，硬件流控需要配置 RTS/CTS 引脚
+ */
+esp_err_t usr_uart_set_flow(usr_uart_flow_t flow);
+usr_uart_flow_t usr_uart_get_flow();
+
+/**
+ * @brief 串口发送缓冲区剩余空间，写入不超过该长度时 uart_write_bytes 不会阻塞
+ */
+size_t usr_uart_tx_free();
+
+/**
+ * @brief 写入从网络收到的数据并计入统计，发送缓冲区满时阻塞等待
+ *
+ * @return int 写入的字节数，失败返回 -1
+ */
+int usr_uart_write(const void *data, size_t len);
+void usr_uart_get_stats(usr_uart_stats_t *stats);
+
+/**
+ * @brief 按当前波特率与帧格式传输一个字符所需的时间（纳秒）
+ */
+uint32_t usr_uart_char_time_ns();
+
+esp_err_t usr_uart_set_break(bool on);
+esp_err_t usr_uart_set_dtr(bool on);
+esp_err_t usr_uart_set_rts(bool on);
+
+/**
+ * @brief 最近一次设置成功的线路控制状态，未配置引脚或从未设置成功时为 false
+ */
+bool usr_uart_get_break();
+bool usr_uart_get_dtr();
+bool usr_uart_get_rts();
+
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
@@ -1,6 +1,5 @@
 #include "blufi_private.h"
 #include "config/config.h"
-#include "console/console.h"
 #include "esp_blufi.h"
 #include "esp_blufi_api.h"
 #include "esp_bt.h"
@@ -18,8 +17,6 @@
 static void example_event_callback(esp_blufi_cb_event_t event, esp_blufi_cb_param_t *param);
 
 /* store the station info for send back to phone */
-static QueueHandle_t blufi_event_queue;
-static TaskHandle_t blufi_task_handle;
 static bool ble_is_connected;
 static wifi_sta_list_t gl_sta_list;
 static esp_blufi_extra_info_t gl_sta_conn_info;
@@ -66,18 +63,6 @@ static int softap_get_current_connection_number(void)
     return 0;
 }
 
-static void blufi_cmd_task(void *unused)
-{
-    char *cmd;
-    while (true)
-    {
-        if (xQueueReceive(blufi_event_queue, &cmd, portMAX_DELAY) != pdPASS)
-            continue;
-        console_run_command(cmd);
-        free(cmd);
-    }
-}
-
 static void blufi_adv_start()
 {
     char name[32] = {};
@@ -87,6 +72,13 @@ static void blufi_adv_start()
     esp_ble_gap_config_adv_data(&blufi_adv_data);
 }
 
+/* 设备名从内存中的配置读取，修改后在未连接时立即以新名称广播 */
+static void blufi_app_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    if (*(conf_key_t *)event_data == CONF_KEY_DEV_NAME && !ble_is_connected)
+        blufi_adv_start();
+}
+
 static void example_event_callback(esp_blufi_cb_event_t event, esp_blufi_cb_param_t *param)
 {
     switch (event)
@@ -206,13 +198,9 @@ static void example_event_callback(esp_blufi_cb_event_t event, esp_blufi_cb_para
         }
         break;
     }
-    case ESP_BLUFI_EVENT_RECV_CUSTOM_DATA: {
-        char *cmd = malloc(param->custom_data.data_len + 1);
-        memcpy(cmd, param->custom_data.data, param->custom_data.data_len);
-        cmd[param->custom_data.data_len] = 0;
-        xQueueSend(blufi_event_queue, &cmd, 5);
+    case ESP_BLUFI_EVENT_RECV_CUSTOM_DATA:
+        blufi_console_recv(param->custom_data.data, param->custom_data.data_len);
         break;
-    }
     case ESP_BLUFI_EVENT_RECV_USERNAME:
         /* Not handle currently */
         break;
@@ -281,11 +269,10 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
 
 int blufi_init()
 {
-    blufi_event_queue = xQueueCreate(1, sizeof(char *));
-    xTaskCreate(blufi_cmd_task, "blufi_cmd", 2048, NULL, 2, &blufi_task_handle);
-    console_register_redirection(blufi_task_handle, (int (*)(const char *, uint32_t))esp_blufi_send_custom_data);
+    blufi_console_init();
 
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, WIFI_EVENT_SCAN_DONE, &wifi_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(APP_EVENTS, APP_EVENT_CONF_CHANGED, &blufi_app_event_handler, NULL));
 
     ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT));
 
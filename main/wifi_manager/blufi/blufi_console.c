@@ -0,0 +1,168 @@
+#include "blufi_private.h"
+#include "console/console.h"
+#include "esp_blufi_api.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "rpc/rpc.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define BLUFI_CONSOLE_CMDS 4      // 可同时排队的命令数，手机端可连续发送而不必等待应答
+#define BLUFI_CONSOLE_CMD_MAX 256 // RPC 请求的最大长度，文本命令另受 esp_console_init 的 max_cmdline_length 限制
+/*
+ * 输出在此合并后一次交给 BLUFI，由协议栈按协商的 MTU 切分为连续的通知，
+ * 每个自定义数据包都有独立的序号、校验与加密开销，合并后一条命令的输出通常只需一个包
+ */
+#define BLUFI_CONSOLE_TX_BUF 512
+#define BLUFI_CONSOLE_SEND_RETRY 20
+
+/* 流控信号，与串口软件流控相同：命令槽用完时发送 XOFF，再次空出时发送 XON */
+#define BLUFI_CONSOLE_XON 0x11
+#define BLUFI_CONSOLE_XOFF 0x13
+
+typedef struct
+{
+    uint16_t len;
+    char line[BLUFI_CONSOLE_CMD_MAX];
+} blufi_console_cmd_t;
+
+static blufi_console_cmd_t blufi_cmd_pool[BLUFI_CONSOLE_CMDS];
+static QueueHandle_t blufi_cmd_free;    // 空闲的命令槽
+static QueueHandle_t blufi_cmd_pending; // 等待执行的命令
+static TaskHandle_t blufi_cmd_task_handle;
+static volatile bool blufi_xoff; // 已通知手机暂停发送
+static uint32_t blufi_cmd_dropped;
+
+/* 以下只在命令任务中使用 */
+static char blufi_tx_buf[BLUFI_CONSOLE_TX_BUF];
+static size_t blufi_tx_len;
+static uint8_t blufi_rpc_resp[RPC_MSG_MAX];
+
+static void blufi_console_send(const void *data, size_t len)
+{
+    /* BTC 队列满时发送失败，稍后重试，断开连接后放弃 */
+    for (int retry = 0; retry < BLUFI_CONSOLE_SEND_RETRY; retry++)
+    {
+        if (esp_blufi_send_custom_data((uint8_t *)data, len) == ESP_OK)
+            return;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+static void blufi_console_tx_flush()
+{
+    if (blufi_tx_len)
+    {
+        blufi_console_send(blufi_tx_buf, blufi_tx_len);
+        blufi_tx_len = 0;
+    }
+}
+
+static int blufi_console_write(const char *buf, uint32_t len)
+{
+    uint32_t left = len;
+    while (left)
+    {
+        size_t n = sizeof(blufi_tx_buf) - blufi_tx_len;
+        if (n > left)
+            n = left;
+        memcpy(blufi_tx_buf + blufi_tx_len, buf, n);
+        blufi_tx_len += n;
+        buf += n;
+        left -= n;
+        if (blufi_tx_len == sizeof(blufi_tx_buf))
+            blufi_console_tx_flush();
+    }
+    return len;
+}
+
+static void blufi_console_task(void *unused)
+{
+    blufi_console_cmd_t *cmd;
+    while (true)
+    {
+        if (xQueueReceive(blufi_cmd_pending, &cmd, portMAX_DELAY) != pdPASS)
+            continue;
+        if ((uint8_t)cmd->line[0] == RPC_MAGIC)
+        {
+            /* 应答作为单独的自定义数据包发送，不与文本输出合并 */
+            size_t n = rpc_handle((const uint8_t *)cmd->line, cmd->len, blufi_rpc_resp, sizeof(blufi_rpc_resp));
+            blufi_console_tx_flush();
+            if (n)
+                blufi_console_send(blufi_rpc_resp, n);
+        }
+        else
+        {
+            console_run_command(cmd->line);
+        }
+        xQueueSend(blufi_cmd_free, &cmd, 0);
+        /* 还有排队的命令时继续合并，全部执行完再发出 */
+        if (uxQueueMessagesWaiting(blufi_cmd_pending) == 0)
+            blufi_console_tx_flush();
+        if (blufi_xoff)
+        {
+            blufi_xoff = false;
+            const uint8_t xon = BLUFI_CONSOLE_XON;
+            blufi_console_send(&xon, 1);
+        }
+    }
+}
+
+int blufi_console_init()
+{
+    blufi_cmd_free = xQueueCreate(BLUFI_CONSOLE_CMDS, sizeof(blufi_console_cmd_t *));
+    blufi_cmd_pending = xQueueCreate(BLUFI_CONSOLE_CMDS, sizeof(blufi_console_cmd_t *));
+    if (blufi_cmd_free == NULL || blufi_cmd_pending == NULL)
+        return ESP_ERR_NO_MEM;
+    for (int i = 0; i < BLUFI_CONSOLE_CMDS; i++)
+    {
+        blufi_console_cmd_t *cmd = &blufi_cmd_pool[i];
+        xQueueSend(blufi_cmd_free, &cmd, 0);
+    }
+    if (xTaskCreate(blufi_console_task, "blufi_cmd", 3072, NULL, 2, &blufi_cmd_task_handle) != pdPASS)
+        return ESP_FAIL;
+    return console_register_redirection(blufi_cmd_task_handle, blufi_console_write);
+}
+
+void blufi_console_recv(const uint8_t *data, size_t len)
+{
+    /* 在 BTC 任务中调用，不能阻塞 */
+    if (len == 0)
+        return;
+    bool rpc = data[0] == RPC_MAGIC;
+    if (rpc && len > BLUFI_CONSOLE_CMD_MAX)
+    {
+        BLUFI_ERROR("rpc request too long %u", (unsigned)len);
+        return;
+    }
+
+    blufi_console_cmd_t *cmd;
+    if (xQueueReceive(blufi_cmd_free, &cmd, 0) != pdPASS)
+    {
+        blufi_cmd_dropped++;
+        BLUFI_ERROR("console busy, %u commands dropped", (unsigned)blufi_cmd_dropped);
+        const uint8_t xoff = BLUFI_CONSOLE_XOFF;
+        esp_blufi_send_custom_data((uint8_t *)&xoff, 1);
+        blufi_xoff = true;
+        return;
+    }
+
+    if (!rpc)
+    {
+        while (len && (data[len - 1] == '\n' || data[len - 1] == '\r'))
+            len--;
+        if (len > sizeof(cmd->line) - 1)
+            len = sizeof(cmd->line) - 1;
+        cmd->line[len] = '\0';
+    }
+    memcpy(cmd->line, data, len);
+    cmd->len = len;
+    if (uxQueueMessagesWaiting(blufi_cmd_free) == 0)
+    {
+        const uint8_t xoff = BLUFI_CONSOLE_XOFF;
+        esp_blufi_send_custom_data((uint8_t *)&xoff, 1);
+        blufi_xoff = true;
+    }
+    xQueueSend(blufi_cmd_pending, &cmd, 0);
+}
@@ -14,6 +14,7 @@
 #include "esp_bt.h"
 #include "esp_bt_device.h"
 #include "esp_bt_main.h"
+#include "esp_gatt_common_api.h"
 #endif
 
 #ifdef CONFIG_BT_NIMBLE_ENABLED
@@ -45,6 +46,13 @@ esp_err_t esp_blufi_host_init(void)
     }
     BLUFI_INFO("BD ADDR: " ESP_BD_ADDR_STR "\n", ESP_BD_ADDR_HEX(esp_bt_dev_get_address()));
 
+    /* BLUFI 按协商的 MTU 切分发送的数据，允许手机协商更大的 MTU 以减少分片 */
+    ret = esp_ble_gatt_set_local_mtu(ESP_GATT_MAX_MTU_SIZE);
+    if (ret)
+    {
+        BLUFI_ERROR("%s set local mtu failed: %s\n", __func__, esp_err_to_name(ret));
+    }
+
     return ESP_OK;
 }
 
@@ -30,6 +30,10 @@ esp_err_t esp_blufi_host_init(void);
 esp_err_t esp_blufi_host_and_cb_init(esp_blufi_callbacks_t *callbacks);
 esp_err_t esp_blufi_host_deinit(void);
 
+/* 通过 BLUFI 自定义数据执行控制台命令，见 blufi_console.c */
+int blufi_console_init(void);
+void blufi_console_recv(const uint8_t *data, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
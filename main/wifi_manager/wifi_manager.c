@@ -1,4 +1,5 @@
 #include "wifi_manager/wifi_manager.h"
+#include "boot/boot_prof.h"
 #include "config/config.h"
 #include "esp_blufi_api.h"
 #include "esp_err.h"
@@ -35,6 +36,7 @@ static uint8_t gl_sta_bssid[6];
 static uint8_t gl_sta_ssid[32];
 static int gl_sta_ssid_len;
 static esp_netif_ip_info_t ip_info;
+static wifi_stats_t wifi_stats;
 
 static void ip_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
 {
@@ -49,6 +51,7 @@ static void ip_event_handler(void *arg, esp_event_base_t event_base, int32_t eve
         ip_info = event->ip_info;
         ESP_LOGI(TAG, "got ip:%s gw:%s mask:%s", ip, gw, mask);
         xEventGroupSetBits(s_wifi_event_group, CONNECTED_BIT | GOT_IP_BIT);
+        boot_prof_milestone(BOOT_MILESTONE_GOT_IP);
         break;
     }
     case IP_EVENT_GOT_IP6: {
@@ -85,6 +88,8 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
         memcpy(gl_sta_bssid, event->bssid, 6);
         memcpy(gl_sta_ssid, event->ssid, event->ssid_len);
         gl_sta_ssid_len = event->ssid_len;
+        wifi_stats.connects++;
+        /* 与缓存相同时不写 flash，频繁重连不会磨损 NVS */
         conf_set_wifi_ssid((char *)sta_config.sta.ssid);
         conf_set_wifi_passwd((char *)sta_config.sta.password);
         xEventGroupSetBits(s_wifi_event_group, CONNECTED_BIT);
@@ -95,6 +100,7 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
         /* Only handle reconnection during connecting */
         wifi_event_sta_disconnected_t *disconnected_event = (wifi_event_sta_disconnected_t *)event_data;
         ESP_LOGE(TAG, "wifi disconnected reason=%d", disconnected_event->reason);
+        wifi_stats.disconnects++;
         if (!wifi_wait_connect(0) && wifi_reconnect() == false)
         {
             record_wifi_conn_info(disconnected_event->rssi, disconnected_event->reason);
@@ -117,6 +123,9 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
 
 bool wifi_wait_event(uint32_t event, TickType_t xTicksToWait)
 {
+    /* 转发任务先于 wifi_init 启动 */
+    if (s_wifi_event_group == NULL)
+        return false;
     return (event & xEventGroupWaitBits(s_wifi_event_group, event, false, false, xTicksToWait)) == event;
 }
 
@@ -151,6 +160,7 @@ bool wifi_reconnect(void)
     if (wifi_is_connecting() && wifi_retry_count++ < WIFI_CONNECTION_MAXIMUM_RETRY)
     {
         ESP_LOGI(TAG, "WiFi starts reconnection\n");
+        wifi_stats.reconnects++;
         if (esp_wifi_connect() == ESP_OK)
             xEventGroupSetBits(s_wifi_event_group, CONNECTING_BIT);
         record_wifi_conn_info(INVALID_RSSI, INVALID_REASON);
@@ -250,6 +260,11 @@ void wifi_get_ip_info(esp_netif_ip_info_t *ip)
     *ip = ip_info;
 }
 
+void wifi_get_stats(wifi_stats_t *stats)
+{
+    *stats = wifi_stats;
+}
+
 int wifi_init()
 {
     s_wifi_event_group = xEventGroupCreate();
@@ -14,6 +14,13 @@ extern "C" {
 #define GOT_IP_BIT BIT3
 #define PASSWORD_ERROR BIT4
 
+typedef struct
+{
+    uint32_t connects;    // 与 AP 建立连接的次数
+    uint32_t disconnects; // 连接断开或连接失败的次数
+    uint32_t reconnects;  // 连接失败后自动重试的次数
+} wifi_stats_t;
+
 int wifi_init();
 
 bool wifi_wait_event(uint32_t event, TickType_t xTicksToWait);
@@ -42,6 +49,11 @@ esp_err_t wifi_set_ap_channel(uint8_t channel);
 void wifi_get_ssid_bssid(uint8_t bssid[6], uint8_t *ssid, int *len);
 void wifi_get_ip_info(esp_netif_ip_info_t *ip);
 
+/**
+ * @brief 读取连接统计，计数只在事件任务中累加，可在任意任务中读取
+ */
+void wifi_get_stats(wifi_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
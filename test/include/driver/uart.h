@@ -0,0 +1,3 @@
+#pragma once
+
+#include "hal/uart_types.h"
@@ -0,0 +1,7 @@
+#pragma once
+
+#define BIT(nr) (1UL << (nr))
+#define BIT0 BIT(0)
+#define BIT1 BIT(1)
+#define BIT2 BIT(2)
+#define BIT3 BIT(3)
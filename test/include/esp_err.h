@@ -0,0 +1,17 @@
+#pragma once
+
+/* 主机测试用的替身，只提供被测模块用到的部分 */
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_SUPPORTED 0x106
+
+static inline const char *esp_err_to_name(esp_err_t code)
+{
+    return "ERROR";
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdbool.h>
+
+/* 主机上没有 flash 映射，视所有地址为只读数据 */
+static inline bool esp_ptr_in_drom(const void *p)
+{
+    return true;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_wifi_types.h"
+
+esp_err_t esp_wifi_disconnect(void);
@@ -0,0 +1,9 @@
+#pragma once
+
+/* 主机测试使用的配置，与 main/Kconfig.projbuild 的默认值一致 */
+#define CONFIG_BRIDGE_RING_SIZE 16384
+#define CONFIG_BRIDGE_SCROLLBACK 8192
+#define CONFIG_BRIDGE_FLUSH_THRESHOLD 1024
+#define CONFIG_BRIDGE_FLUSH_DEADLINE_US 5000
+#define CONFIG_BRIDGE_LOG_RING_SIZE 8192
+#define CONFIG_BRIDGE_CONF_COMMIT_DELAY_MS 1000
@@ -0,0 +1,284 @@
+/*
+ * 压缩器的主机测试：各窗口大小的输出分别用 bridge_deflate_decode 与 zlib 解压，
+ * 同步刷新后 zlib 能立即解出已写入的全部数据；并在日志语料上给出压缩率与耗时，与 zlib 对比。
+ *
+ * 用法：test_bridge_deflate [语料文件...]，未指定时使用生成的 ESP-IDF 风格日志。
+ */
+#include "bridge/bridge_deflate.h"
+#include "test.h"
+#include <string.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define CORPUS_MAX (4u << 20)
+#define SYNTH_LEN (1u << 20)
+#define CHUNK_FLUSH 512  // 921600 baud 下 5 ms 的数据量，客户端追上时每次发送都同步刷新
+#define CHUNK_STREAM 1024 // 客户端落后时每次从环形缓冲区取出的数据量，不刷新
+#define BENCH_ROUNDS 3
+
+static const char *const log_tags[] = {"wifi", "esp_netif_handler", "app_main", "sensor", "mqtt_client", "pm"};
+
+/* 生成与目标设备调试输出相似的日志：带颜色的级别前缀、递增的时间戳、少量变化的数值与十六进制转储 */
+static size_t synth_corpus(uint8_t *buf, size_t cap)
+{
+    uint32_t seed = 4;
+    uint32_t ms = 1234;
+    size_t len = 0;
+    while (len + 256 < cap)
+    {
+        uint32_t r = test_rand(&seed);
+        const char *tag = log_tags[r % 6];
+        ms += r >> 28;
+        int n;
+        switch ((r >> 8) % 8)
+        {
+        case 0:
+            n = sprintf((char *)buf + len, "\033[0;32mI (%u) %s: rssi=%d, channel=%u, heap=%u\033[0m\r\n", ms, tag,
+                        -40 - (int)(r >> 20) % 40, 1 + (r >> 12) % 13, 180000 + (r >> 16) % 4096);
+            break;
+        case 1:
+            n = sprintf((char *)buf + len, "\033[0;33mW (%u) %s: retry %u, last error 0x%x\033[0m\r\n", ms, tag,
+                        (r >> 12) % 5, 0x3000 + (r >> 20) % 32);
+            break;
+        case 2:
+            n = sprintf((char *)buf + len, "D (%u) %s: temperature %u.%u C, humidity %u.%u %%\r\n", ms, tag,
+                        20 + (r >> 12) % 10, (r >> 16) % 10, 40 + (r >> 20) % 30, (r >> 24) % 10);
+            break;
+        case 3:
+        {
+            n = sprintf((char *)buf + len, "D (%u) %s: 0x3fc9%04x  ", ms, tag, (r >> 12) & 0xfff0);
+            for (int i = 0; i < 16; i++)
+                n += sprintf((char *)buf + len + n, "%02x ", test_rand(&seed) & 0xff);
+            n += sprintf((char *)buf + len + n, "\r\n");
+            break;
+        }
+        case 4:
+            n = sprintf((char *)buf + len, "\033[0;32mI (%u) %s: publish topic=/dev/%08x/state, msg_id=%u\033[0m\r\n",
+                        ms, tag, 0xa1b2c3d4, (r >> 12) % 65536);
+            break;
+        default:
+            n = sprintf((char *)buf + len, "V (%u) %s: tick %u, queue %u/%u\r\n", ms, tag, ms / 10, (r >> 12) % 16,
+                        16);
+            break;
+        }
+        len += n;
+    }
+    return len;
+}
+
+static size_t load_file(const char *path, uint8_t *buf, size_t cap)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        perror(path);
+        exit(1);
+    }
+    size_t len = fread(buf, 1, cap, f);
+    fclose(f);
+    return len;
+}
+
+/**
+ * @brief 分块压缩，flush 时每块同步刷新，返回输出长度
+ */
+static size_t deflate_chunks(bridge_deflate_t *z, const uint8_t *src, size_t len, uint8_t *dst, size_t chunk, bool flush)
+{
+    size_t out = 0;
+    for (size_t i = 0; i < len; i += chunk)
+    {
+        size_t n = len - i < chunk ? len - i : chunk;
+        out += bridge_deflate_write(z, src + i, n, dst + out, flush);
+    }
+    return out + bridge_deflate_finish(z, dst + out);
+}
+
+static void test_invalid_window()
+{
+    static const size_t bad[] = {0, 1, 128, 255, 257, 384, 1000, 65536};
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+        CHECK(bridge_deflate_new(bad[i]) == NULL);
+}
+
+/**
+ * @brief 随机大小的分块与随机的刷新，两种解压器都须还原原文
+ */
+static void test_round_trip(const uint8_t *src, size_t len, size_t window, uint8_t *packed, uint8_t *plain)
+{
+    bridge_deflate_t *z = bridge_deflate_new(window);
+    CHECK(z != NULL);
+    uint32_t seed = window;
+
+#ifdef HAVE_ZLIB
+    z_stream zs = {};
+    CHECK(inflateInit(&zs) == Z_OK);
+    zs.next_out = plain;
+    zs.avail_out = len;
+#endif
+
+    size_t out = 0;
+    for (size_t i = 0; i < len;)
+    {
+        size_t n = 1 + test_rand(&seed) % 2048;
+        if (n > len - i)
+            n = len - i;
+        bool flush = test_rand(&seed) & 1;
+        size_t w = bridge_deflate_write(z, src + i, n, packed + out, flush);
+        CHECK(w <= BRIDGE_DEFLATE_BOUND(n) + 2);
+        i += n;
+#ifdef HAVE_ZLIB
+        /* 同步刷新后，已写入的全部数据都能立即解出 */
+        zs.next_in = packed + out;
+        zs.avail_in = w;
+        int ret = inflate(&zs, Z_SYNC_FLUSH);
+        CHECK(ret == Z_OK || (ret == Z_BUF_ERROR && w == 0));
+        CHECK(zs.avail_in == 0);
+        if (flush)
+            CHECK(zs.total_out == i && memcmp(plain, src, i) == 0);
+#endif
+        out += w;
+    }
+    size_t tail = bridge_deflate_finish(z, packed + out);
+    CHECK(tail <= 16 + 2);
+#ifdef HAVE_ZLIB
+    zs.next_in = packed + out;
+    zs.avail_in = tail;
+    CHECK(inflate(&zs, Z_FINISH) == Z_STREAM_END); // 同时校验 Adler-32
+    CHECK(zs.total_out == len && memcmp(plain, src, len) == 0);
+    inflateEnd(&zs);
+#endif
+    out += tail;
+
+    uint32_t in_total, out_total;
+    bridge_deflate_get_stats(z, &in_total, &out_total);
+    CHECK(in_total == len && out_total == out);
+
+    memset(plain, 0, len);
+    CHECK(bridge_deflate_decode(packed, out, plain, len) == (int)len);
+    CHECK(memcmp(plain, src, len) == 0);
+    CHECK(bridge_deflate_decode(packed, out, plain, len - 1) == -1);
+
+    /* reset 后开始一个独立的新流 */
+    bridge_deflate_reset(z);
+    size_t part = len < 5000 ? len : 5000;
+    out = deflate_chunks(z, src + len - part, part, packed, 700, false);
+    CHECK(bridge_deflate_decode(packed, out, plain, part) == (int)part);
+    CHECK(memcmp(plain, src + len - part, part) == 0);
+#ifdef HAVE_ZLIB
+    uLongf plain_len = part;
+    CHECK(uncompress(plain, &plain_len, packed, out) == Z_OK && plain_len == part);
+#endif
+    bridge_deflate_free(z);
+}
+
+typedef struct
+{
+    const char *name;
+    size_t out;
+    int64_t ns;
+} bench_result_t;
+
+static void print_result(const bench_result_t *r, size_t len, size_t mem)
+{
+    printf("  %-16s %6.3f %8.0f", r->name, (double)r->out / len, r->ns / (len / 1024.0));
+    if (mem)
+        printf(" %8zu", mem);
+    printf("\n");
+}
+
+static void bench(const char *name, const uint8_t *src, size_t len, uint8_t *packed)
+{
+    printf("%s, %zu bytes, %d-byte chunks with sync flush / %d-byte chunks without:\n", name, len, CHUNK_FLUSH,
+           CHUNK_STREAM);
+    printf("  %-16s %6s %8s %8s\n", "", "ratio", "ns/KB", "mem");
+    for (size_t window = 256; window <= 32768; window *= 2)
+    {
+        for (int flush = 1; flush >= 0; flush--)
+        {
+            char label[32];
+            snprintf(label, sizeof(label), "window %5zu %s", window, flush ? "sf" : "  ");
+            bench_result_t r = {label, 0, INT64_MAX};
+            for (int round = 0; round < BENCH_ROUNDS; round++)
+            {
+                bridge_deflate_t *z = bridge_deflate_new(window);
+                int64_t start = test_now_ns();
+                r.out = deflate_chunks(z, src, len, packed, flush ? CHUNK_FLUSH : CHUNK_STREAM, flush);
+                int64_t ns = test_now_ns() - start;
+                if (ns < r.ns)
+                    r.ns = ns;
+                bridge_deflate_free(z);
+            }
+            print_result(&r, len, flush ? bridge_deflate_size(window) : 0);
+        }
+    }
+
+#ifdef HAVE_ZLIB
+    static const int levels[] = {1, 6};
+    for (int l = 0; l < 2; l++)
+    {
+        for (int flush = 1; flush >= 0; flush--)
+        {
+            char label[32];
+            snprintf(label, sizeof(label), "zlib -%d 32K %s", levels[l], flush ? "sf" : "  ");
+            bench_result_t r = {label, 0, INT64_MAX};
+            size_t chunk = flush ? CHUNK_FLUSH : CHUNK_STREAM;
+            for (int round = 0; round < BENCH_ROUNDS; round++)
+            {
+                z_stream zs = {};
+                CHECK(deflateInit(&zs, levels[l]) == Z_OK);
+                zs.next_out = packed;
+                zs.avail_out = deflateBound(&zs, len) + len / 8;
+                int64_t start = test_now_ns();
+                for (size_t i = 0; i < len; i += chunk)
+                {
+                    zs.next_in = (uint8_t *)src + i;
+                    zs.avail_in = len - i < chunk ? len - i : chunk;
+                    CHECK(deflate(&zs, flush ? Z_SYNC_FLUSH : Z_NO_FLUSH) == Z_OK);
+                }
+                CHECK(deflate(&zs, Z_FINISH) == Z_STREAM_END);
+                int64_t ns = test_now_ns() - start;
+                if (ns < r.ns)
+                    r.ns = ns;
+                r.out = zs.total_out;
+                deflateEnd(&zs);
+            }
+            print_result(&r, len, 0);
+        }
+    }
+#endif
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t src[CORPUS_MAX], packed[BRIDGE_DEFLATE_BOUND(CORPUS_MAX) * 2], plain[CORPUS_MAX];
+    test_invalid_window();
+
+    size_t len = synth_corpus(src, SYNTH_LEN);
+    for (size_t window = 256; window <= 32768; window *= 2)
+        test_round_trip(src, len, window, packed, plain);
+
+    /* 不可压缩的数据与长串重复，覆盖字面量最长编码与最长匹配 */
+    uint32_t seed = 5;
+    static uint8_t noise[200000];
+    for (size_t i = 0; i < sizeof(noise); i++)
+        noise[i] = i < 100000 ? test_rand(&seed) : 0xff;
+    for (size_t window = 256; window <= 32768; window *= 4)
+        test_round_trip(noise, sizeof(noise), window, packed, plain);
+
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            len = load_file(argv[i], src, sizeof(src));
+            test_round_trip(src, len, 1024, packed, plain);
+            bench(argv[i], src, len, packed);
+        }
+    }
+    else
+    {
+        bench("synthetic ESP-IDF log", src, len, packed);
+    }
+    puts("ok");
+    return 0;
+}
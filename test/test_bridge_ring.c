@@ -0,0 +1,267 @@
+/*
+ * 环形缓冲区的主机测试：8 个模拟客户端以不同速度读取 2 Mbaud 的串口数据，
+ * 以及生产者与读者在不同线程中并发时的覆盖检测。
+ */
+#include "bridge/bridge_ring.h"
+#include "test.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#define SIM_CLIENTS 8
+#define SIM_BAUD 2000000
+#define SIM_BYTES_PER_S (SIM_BAUD / 10) // 8N1
+#define SIM_STEP_US 5000                // 驱动每 5 ms 交来一批数据
+#define SIM_SECONDS 10
+
+typedef enum
+{
+    CLIENT_FAST,   // 每批都读完
+    CLIENT_HICCUP, // 每 500 ms 停顿 50 ms，之后以两倍速率追赶，模拟 WiFi 重传
+    CLIENT_SLOW,   // 只有输入速率的一半
+} client_kind_t;
+
+typedef struct
+{
+    client_kind_t kind;
+    bridge_ring_cursor_t cursor;
+    uint64_t received;
+    uint32_t max_lag;
+} sim_client_t;
+
+static uint32_t produced;
+
+static void produce(size_t len)
+{
+    while (len)
+    {
+        uint8_t *ptr;
+        size_t n = bridge_ring_write_begin(&ptr);
+        if (n > len)
+            n = len;
+        for (size_t i = 0; i < n; i++)
+            ptr[i] = test_stream_byte(produced + i);
+        bridge_ring_write_commit(n, 0);
+        produced += n;
+        len -= n;
+    }
+}
+
+/**
+ * @brief 读取至多 budget 字节，逐字节校验内容与其在数据流中的位置
+ */
+static void drain(sim_client_t *c, size_t budget)
+{
+    while (budget)
+    {
+        const uint8_t *ptr;
+        size_t n = bridge_ring_peek(&c->cursor, &ptr);
+        if (n == 0)
+            break;
+        if (n > budget)
+            n = budget;
+        uint32_t pos = c->cursor.pos;
+        for (size_t i = 0; i < n; i++)
+            CHECK(ptr[i] == test_stream_byte(pos + i));
+        CHECK(bridge_ring_consume(&c->cursor, n));
+        c->received += n;
+        budget -= n;
+    }
+}
+
+static void test_fanout()
+{
+    bridge_ring_init();
+    produced = 0;
+    sim_client_t clients[SIM_CLIENTS] = {};
+    for (int i = 0; i < SIM_CLIENTS; i++)
+    {
+        clients[i].kind = i < 6 ? CLIENT_FAST : i == 6 ? CLIENT_HICCUP : CLIENT_SLOW;
+        bridge_ring_cursor_init(&clients[i].cursor, 0);
+    }
+
+    const size_t step_bytes = (size_t)SIM_BYTES_PER_S * SIM_STEP_US / 1000000;
+    const int steps = SIM_SECONDS * 1000000 / SIM_STEP_US;
+    for (int step = 0; step < steps; step++)
+    {
+        produce(step_bytes);
+        int ms = step * SIM_STEP_US / 1000;
+        for (int i = 0; i < SIM_CLIENTS; i++)
+        {
+            sim_client_t *c = &clients[i];
+            uint32_t lag = bridge_ring_lag(&c->cursor);
+            if (lag > c->max_lag)
+                c->max_lag = lag;
+            switch (c->kind)
+            {
+            case CLIENT_FAST:
+                drain(c, SIZE_MAX);
+                break;
+            case CLIENT_HICCUP:
+                if (ms % 500 >= 50)
+                    drain(c, 2 * step_bytes);
+                break;
+            case CLIENT_SLOW:
+                drain(c, step_bytes / 2);
+                break;
+            }
+        }
+    }
+
+    printf("fan-out: %d clients, %d baud (%d B/s), %d s, %" PRIu32 " bytes, ring %zu bytes\n", SIM_CLIENTS, SIM_BAUD,
+           SIM_BYTES_PER_S, SIM_SECONDS, produced, bridge_ring_capacity());
+    for (int i = 0; i < SIM_CLIENTS; i++)
+    {
+        sim_client_t *c = &clients[i];
+        uint64_t lost = c->cursor.dropped;
+        uint64_t backlog = bridge_ring_lag(&c->cursor);
+        printf("  client %d %-6s received %8" PRIu64 " dropped %8" PRIu64 " overruns %4" PRIu32 " max lag %5" PRIu32
+               "\n",
+               i, c->kind == CLIENT_FAST ? "fast" : c->kind == CLIENT_HICCUP ? "hiccup" : "slow", c->received, lost,
+               c->cursor.overruns, c->max_lag);
+        /* 每个字节要么收到、要么计入 dropped、要么仍在积压中，没有遗漏或重复 */
+        CHECK(c->received + lost + backlog == produced);
+        if (c->kind != CLIENT_SLOW)
+        {
+            /* 快的客户端不受慢客户端影响，短暂停顿的客户端从缓冲区追上，都不丢数据 */
+            CHECK(c->cursor.overruns == 0 && lost == 0);
+            CHECK(c->max_lag <= bridge_ring_capacity());
+        }
+        else
+        {
+            CHECK(c->cursor.overruns > 0 && lost > 0);
+        }
+    }
+}
+
+/**
+ * @brief 不限速的 1 写 8 读吞吐，读者把数据复制到发送缓冲区，相当于 lwip_send 的拷贝
+ */
+static void bench_fanout()
+{
+    bridge_ring_init();
+    produced = 0;
+    bridge_ring_cursor_t cursors[SIM_CLIENTS];
+    for (int i = 0; i < SIM_CLIENTS; i++)
+        bridge_ring_cursor_init(&cursors[i], 0);
+    static uint8_t sink[BRIDGE_RING_CHUNK];
+    const uint32_t total = 256u << 20;
+
+    int64_t start = test_now_ns();
+    while (produced < total)
+    {
+        uint8_t *ptr;
+        size_t n = bridge_ring_write_begin(&ptr);
+        memset(ptr, (uint8_t)produced, n);
+        bridge_ring_write_commit(n, 0);
+        produced += n;
+        for (int i = 0; i < SIM_CLIENTS; i++)
+        {
+            const uint8_t *data;
+            size_t len;
+            while ((len = bridge_ring_peek(&cursors[i], &data)) != 0)
+            {
+                memcpy(sink, data, len);
+                bridge_ring_consume(&cursors[i], len);
+            }
+        }
+    }
+    double s = (test_now_ns() - start) / 1e9;
+    for (int i = 0; i < SIM_CLIENTS; i++)
+        CHECK(cursors[i].overruns == 0);
+    printf("fan-out throughput (host): %.0f MB/s in, %.0f MB/s out to %d clients\n", total / s / 1e6,
+           total / s / 1e6 * SIM_CLIENTS, SIM_CLIENTS);
+}
+
+#define STRESS_READERS 4
+#define STRESS_MS 500
+
+static atomic_bool stress_stop;
+
+static void *stress_producer(void *arg)
+{
+    uint32_t pos = 0;
+    uint32_t seed = 1;
+    while (!atomic_load(&stress_stop))
+    {
+        uint8_t *ptr;
+        size_t n = bridge_ring_write_begin(&ptr);
+        n = 1 + test_rand(&seed) % n;
+        for (size_t i = 0; i < n; i++)
+            ptr[i] = test_stream_byte(pos + i);
+        bridge_ring_write_commit(n, 0);
+        pos += n;
+    }
+    return NULL;
+}
+
+typedef struct
+{
+    uint64_t verified;
+    uint64_t detected; // consume 报告数据在复制期间被覆盖
+    bridge_ring_cursor_t cursor;
+} stress_reader_t;
+
+static void *stress_reader(void *arg)
+{
+    stress_reader_t *r = arg;
+    static _Thread_local uint8_t copy[16384];
+    bridge_ring_cursor_init(&r->cursor, 0);
+    while (!atomic_load(&stress_stop))
+    {
+        const uint8_t *ptr;
+        size_t n = bridge_ring_peek(&r->cursor, &ptr);
+        if (n == 0)
+            continue;
+        uint32_t pos = r->cursor.pos;
+        memcpy(copy, ptr, n);
+        if (!bridge_ring_consume(&r->cursor, n))
+        {
+            r->detected++;
+            continue;
+        }
+        /* consume 确认未被覆盖的数据必须完整无误 */
+        for (size_t i = 0; i < n; i++)
+            CHECK(copy[i] == test_stream_byte(pos + i));
+        r->verified += n;
+    }
+    return NULL;
+}
+
+static void test_concurrent()
+{
+    bridge_ring_init();
+    pthread_t producer, readers[STRESS_READERS];
+    stress_reader_t state[STRESS_READERS] = {};
+    atomic_store(&stress_stop, false);
+    pthread_create(&producer, NULL, stress_producer, NULL);
+    for (int i = 0; i < STRESS_READERS; i++)
+        pthread_create(&readers[i], NULL, stress_reader, &state[i]);
+    struct timespec ts = {.tv_nsec = STRESS_MS * 1000000L};
+    nanosleep(&ts, NULL);
+    atomic_store(&stress_stop, true);
+    pthread_join(producer, NULL);
+    uint64_t verified = 0, detected = 0, overruns = 0;
+    for (int i = 0; i < STRESS_READERS; i++)
+    {
+        pthread_join(readers[i], NULL);
+        verified += state[i].verified;
+        detected += state[i].detected;
+        overruns += state[i].cursor.overruns;
+    }
+    printf("concurrent: %d readers verified %" PRIu64 " bytes, %" PRIu64 " overwritten reads detected, %" PRIu64
+           " overruns\n",
+           STRESS_READERS, verified, detected, overruns);
+    CHECK(verified > 0);
+}
+
+int main()
+{
+    test_fanout();
+    bench_fanout();
+    test_concurrent();
+    puts("ok");
+    return 0;
+}
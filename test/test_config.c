@@ -0,0 +1,304 @@
+/*
+ * 配置缓存的主机测试：取值未变的设置不写 NVS，串口参数的比较不受结构体填充影响，
+ * 提交失败的配置项保留到下次提交，旧版本的 4 字节 uart_conf 不被当作有效配置。
+ * NVS 由内存中的替身实现，提交任务不运行，由测试直接调用 conf_flush。
+ */
+#include "config/config.h"
+#include "esp_system.h"
+#include "events/events.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "test.h"
+#include <string.h>
+
+#define NVS_KEYS 8
+#define NVS_VALUE_MAX 128
+
+typedef struct
+{
+    char key[16];
+    uint8_t value[NVS_VALUE_MAX];
+    size_t len; // 字符串含结尾的 0
+} nvs_entry_t;
+
+static nvs_entry_t nvs_store[NVS_KEYS];
+static int nvs_keys;
+static int nvs_opens;
+static int nvs_sets;
+static int nvs_commit_failures; // 之后这么多次 nvs_commit 返回错误
+static int notifies;
+static int events;
+static shutdown_handler_t shutdown_handler;
+
+static nvs_entry_t *nvs_find(const char *key)
+{
+    for (int i = 0; i < nvs_keys; i++)
+    {
+        if (strcmp(nvs_store[i].key, key) == 0)
+            return &nvs_store[i];
+    }
+    return NULL;
+}
+
+static esp_err_t nvs_put(const char *key, const void *value, size_t len)
+{
+    CHECK(len <= NVS_VALUE_MAX);
+    nvs_entry_t *e = nvs_find(key);
+    if (e == NULL)
+    {
+        CHECK(nvs_keys < NVS_KEYS && strlen(key) < sizeof(e->key));
+        e = &nvs_store[nvs_keys++];
+        strcpy(e->key, key);
+    }
+    memcpy(e->value, value, len);
+    e->len = len;
+    nvs_sets++;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    nvs_opens++;
+    /* 与 NVS 一样，只读打开尚未创建的命名空间时返回 NOT_FOUND */
+    if (open_mode == NVS_READONLY && nvs_keys == 0)
+        return ESP_ERR_NVS_NOT_FOUND;
+    *out_handle = 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+static esp_err_t nvs_get(const char *key, void *out_value, size_t *length)
+{
+    nvs_entry_t *e = nvs_find(key);
+    if (e == NULL)
+        return ESP_ERR_NVS_NOT_FOUND;
+    if (e->len > *length)
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    memcpy(out_value, e->value, e->len);
+    *length = e->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length)
+{
+    return nvs_get(key, out_value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    return nvs_get(key, out_value, length);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return nvs_put(key, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return nvs_put(key, value, length);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    if (nvs_commit_failures)
+    {
+        nvs_commit_failures--;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *arg, UBaseType_t priority,
+                       TaskHandle_t *handle)
+{
+    *handle = (TaskHandle_t)task;
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    notifies++;
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    return 0;
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handle)
+{
+    shutdown_handler = handle;
+    return ESP_OK;
+}
+
+int app_event_post(AppEventID event, void *event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    CHECK(event == APP_EVENT_CONF_CHANGED && event_data_size == sizeof(conf_key_t));
+    events++;
+    return ESP_OK;
+}
+
+static conf_stats_t stats()
+{
+    conf_stats_t s;
+    conf_get_stats(&s);
+    return s;
+}
+
+static void expect_str(int (*get)(char *, size_t), const char *value)
+{
+    char buf[80];
+    CHECK(get(buf, sizeof(buf)) == ESP_OK && strcmp(buf, value) == 0);
+}
+
+/* 首次启动命名空间不存在，全部使用默认值 */
+static void test_first_boot()
+{
+    char buf[80];
+    CHECK(conf_init() == ESP_OK);
+    expect_str(conf_get_dev_name, "DEVICE");
+    CHECK(conf_get_wifi_ssid(buf, sizeof(buf)) == ESP_ERR_NVS_NOT_FOUND);
+    uart_config_t uart;
+    CHECK(conf_get_uart_param(&uart) == ESP_OK && uart.baud_rate == 115200 && uart.data_bits == UART_DATA_8_BITS);
+    CHECK(conf_flush() == ESP_OK && nvs_sets == 0);
+}
+
+/* 旧版本以 4 字节保存波特率，长度不符时使用默认值，之后的设置必须写入完整的结构体 */
+static void test_legacy_uart_blob()
+{
+    uint32_t legacy_baud = 9600;
+    nvs_put("uart_conf", &legacy_baud, sizeof(legacy_baud));
+    nvs_put("dev_name", "lab", 4);
+    nvs_sets = 0;
+    CHECK(conf_init() == ESP_OK);
+    expect_str(conf_get_dev_name, "lab");
+    uart_config_t uart;
+    conf_get_uart_param(&uart);
+    CHECK(uart.baud_rate == 115200);
+
+    /* 与默认值相同也要写入，否则 NVS 中一直是旧格式 */
+    conf_stats_t before = stats();
+    CHECK(conf_set_uart_param(&uart) == ESP_OK);
+    CHECK(stats().unchanged == before.unchanged && notifies == 1 && events == 1);
+    CHECK(conf_flush() == ESP_OK);
+    CHECK(nvs_sets == 1 && nvs_find("uart_conf")->len == sizeof(uart_config_t));
+    CHECK(stats().commits == before.commits + 1 && stats().keys_written == before.keys_written + 1);
+}
+
+/* 调用者的结构体填充中是随机内容，取值相同时不应视为变更 */
+static void test_uart_padding()
+{
+    uart_config_t clean;
+    conf_get_uart_param(&clean);
+    uart_config_t dirty;
+    memset(&dirty, 0xa5, sizeof(dirty));
+    dirty.baud_rate = clean.baud_rate;
+    dirty.data_bits = clean.data_bits;
+    dirty.parity = clean.parity;
+    dirty.stop_bits = clean.stop_bits;
+    dirty.flow_ctrl = clean.flow_ctrl;
+    dirty.rx_flow_ctrl_thresh = clean.rx_flow_ctrl_thresh;
+    dirty.source_clk = clean.source_clk;
+    dirty.flags.backup_before_sleep = clean.flags.backup_before_sleep;
+    CHECK(memcmp(&dirty, &clean, sizeof(dirty)) != 0); // 结构体确有填充
+
+    conf_stats_t before = stats();
+    int sets = nvs_sets;
+    CHECK(conf_set_uart_param(&dirty) == ESP_OK);
+    CHECK(stats().unchanged == before.unchanged + 1 && notifies == 1 && events == 1);
+
+    dirty.baud_rate = 921600;
+    CHECK(conf_set_uart_param(&dirty) == ESP_OK);
+    CHECK(stats().unchanged == before.unchanged + 1 && notifies == 2 && events == 2);
+    CHECK(conf_flush() == ESP_OK && nvs_sets == sets + 1);
+    uart_config_t stored;
+    memcpy(&stored, nvs_find("uart_conf")->value, sizeof(stored));
+    CHECK(stored.baud_rate == 921600 && stored.rx_flow_ctrl_thresh == clean.rx_flow_ctrl_thresh);
+}
+
+/* 重复设置相同的值只计数，不标记为脏，也不唤醒提交任务 */
+static void test_unchanged()
+{
+    conf_stats_t before = stats();
+    int sets = nvs_sets, opens = nvs_opens;
+    for (int i = 0; i < 10; i++)
+    {
+        CHECK(conf_set_wifi_ssid("home") == ESP_OK);
+        CHECK(conf_set_wifi_passwd("secret") == ESP_OK);
+    }
+    CHECK(stats().unchanged == before.unchanged + 18 && notifies == 4 && events == 4 && nvs_sets == sets);
+    CHECK(conf_flush() == ESP_OK && nvs_sets == sets + 2);
+    CHECK(stats().commits == before.commits + 1 && stats().keys_written == before.keys_written + 2);
+
+    for (int i = 0; i < 10; i++)
+    {
+        CHECK(conf_set_wifi_ssid("home") == ESP_OK);
+        CHECK(conf_set_dev_name("lab") == ESP_OK);
+    }
+    CHECK(stats().unchanged == before.unchanged + 38 && notifies == 4);
+    /* 没有脏配置时不打开 NVS */
+    opens = nvs_opens;
+    CHECK(conf_flush() == ESP_OK && nvs_opens == opens && stats().commits == before.commits + 1);
+
+    char buf[80];
+    CHECK(conf_set_dev_name("012345678901234567890") == ESP_ERR_INVALID_SIZE);
+    CHECK(conf_get_wifi_ssid(buf, 4) == ESP_ERR_NVS_INVALID_LENGTH);
+    expect_str(conf_get_wifi_ssid, "home");
+}
+
+/* 提交失败后配置项重新标记为脏，与之后的变更一起再次提交 */
+static void test_failed_commit()
+{
+    conf_stats_t before = stats();
+    CHECK(conf_set_dev_name("bench") == ESP_OK);
+    nvs_commit_failures = 1;
+    CHECK(conf_flush() == ESP_FAIL);
+    CHECK(stats().errors == before.errors + 1 && stats().commits == before.commits);
+
+    CHECK(conf_set_wifi_passwd("changed") == ESP_OK);
+    int sets = nvs_sets;
+    CHECK(conf_flush() == ESP_OK && nvs_sets == sets + 2);
+    CHECK(stats().commits == before.commits + 1 && stats().errors == before.errors + 1);
+
+    /* 关机前的提交同样重试 */
+    CHECK(conf_set_dev_name("bench2") == ESP_OK);
+    nvs_commit_failures = 1;
+    CHECK(conf_flush() == ESP_FAIL);
+    sets = nvs_sets;
+    shutdown_handler();
+    CHECK(nvs_sets == sets + 1 && strcmp((char *)nvs_find("dev_name")->value, "bench2") == 0);
+}
+
+/* 重启后从 NVS 读回，之后的读取不再访问 NVS */
+static void test_reload()
+{
+    int opens = nvs_opens;
+    CHECK(conf_init() == ESP_OK && nvs_opens == opens + 1);
+    expect_str(conf_get_dev_name, "bench2");
+    expect_str(conf_get_wifi_ssid, "home");
+    expect_str(conf_get_wifi_passwd, "changed");
+    uart_config_t uart;
+    conf_get_uart_param(&uart);
+    CHECK(uart.baud_rate == 921600);
+    for (int i = 0; i < 100; i++)
+        expect_str(conf_get_dev_name, "bench2");
+    CHECK(nvs_opens == opens + 1);
+}
+
+int main()
+{
+    test_first_boot();
+    test_legacy_uart_blob();
+    test_uart_padding();
+    test_unchanged();
+    test_failed_commit();
+    test_reload();
+    conf_stats_t s = stats();
+    printf("commits %u keys %u unchanged %u errors %u\n", s.commits, s.keys_written, s.unchanged, s.errors);
+    return 0;
+}
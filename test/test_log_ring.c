@@ -0,0 +1,278 @@
+/*
+ * 延后格式化日志的主机测试：记录编码后再还原的文本与 vsnprintf 直接格式化的结果一致，
+ * 输出缓冲区不足时得到其前缀，并比较日志调用方在两种方式下的开销。
+ * 被测函数均为 static，直接包含源文件。
+ */
+#include "log/log_ring.c"
+#include "test.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#define BENCH_CALLS 200000
+#define BENCH_BATCH 32 // 每记录这么多条后模拟输出任务取走
+
+/* 与 esp_log_write 的调用方式相同的一行 ESP_LOGI */
+#define BENCH_FMT "\033[0;32mI (%lu) %s: %d:%s client connected, mode %s, %u bytes\033[0m\n"
+
+void stats_mem_alloc(stats_mem_t sub, void *ptr)
+{
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *arg, UBaseType_t priority,
+                       TaskHandle_t *handle)
+{
+    /* 不运行输出任务，由测试直接取出记录 */
+    *handle = (TaskHandle_t)task;
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    return 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+}
+
+static int null_write(const char *buf, uint32_t len)
+{
+    return len;
+}
+
+/* 格式串只以 32 位地址记录，与目标一致，主机上要求程序不以 PIE 方式加载 */
+static void set_fmt(log_ring_entry_t *rec, const char *fmt)
+{
+    CHECK((uintptr_t)fmt <= UINT32_MAX);
+    rec->hdr.fmt = (uint32_t)(uintptr_t)fmt;
+}
+
+static void encode(log_ring_entry_t *rec, size_t args_size, const char *fmt, va_list ap)
+{
+    int n = log_ring_encode(fmt, ap, rec->args, args_size);
+    CHECK(n >= 0);
+    rec->hdr.len = sizeof(rec->hdr) + n;
+    set_fmt(rec, fmt);
+}
+
+/**
+ * @brief 编码后还原，与 vsnprintf 的结果比较，并对每个更小的输出缓冲区检查得到的是其前缀
+ */
+__attribute__((format(printf, 1, 2))) static void check_format(const char *fmt, ...)
+{
+    char expect[4 * LOG_RING_LINE_MAX], out[LOG_RING_LINE_MAX];
+    log_ring_entry_t rec;
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(expect, sizeof(expect), fmt, ap);
+    va_end(ap);
+    CHECK(len >= 0 && len < (int)sizeof(expect));
+    va_start(ap, fmt);
+    encode(&rec, sizeof(rec.args), fmt, ap);
+    va_end(ap);
+
+    for (size_t size = sizeof(out); size > 0; size = size > (size_t)len + 1 ? (size_t)len + 1 : size - 1)
+    {
+        size_t want = (size_t)len < size - 1 ? (size_t)len : size - 1;
+        memset(out, 0x55, sizeof(out));
+        size_t n = log_ring_format(&rec, out, size);
+        if (n != want || memcmp(out, expect, want) != 0 || out[n] != '\0')
+        {
+            fprintf(stderr, "format \"%s\" size %zu: got \"%s\", expected \"%.*s\"\n", fmt, size, out, (int)want,
+                    expect);
+            exit(1);
+        }
+    }
+}
+
+static void test_corpus()
+{
+    char ip[] = "192.168.1.23"; // 调用者栈上的字符串，记录中须保存内容
+    check_format("plain text, no conversions\n");
+    check_format("%s", "");
+    check_format("[%s] [%10s] [%-10s] [%.3s]", ip, "ab", "ab", "abcdef");
+    check_format("%d %i %u %x %X %o %c", -1, 42, 4000000000u, 0xbeef, 0xbeef, 0755, 'z');
+    check_format("%hd %hhu %hx", (short)-5, (unsigned char)200, (unsigned short)0xffff);
+    check_format("%ld %lu %lx", -123456789L, 123456789UL, 0xdeadbeefUL);
+    check_format("%lld %llu %llx %+lld", -9000000000LL, 18000000000ULL, 0x123456789abcULL, 42LL);
+    check_format("%jd %zu %td", (intmax_t)-7, (size_t)7, (ptrdiff_t)-7);
+    check_format("%p %p", (void *)0x1234, NULL);
+    check_format("100%% %%d %%%s%%", "x");
+    check_format("%f|%-8.3f|%8.3f|%e|%g|%.0f|%a", 3.14159, 2.5, -2.5, 1e-9, 1234567.0, 0.5, 1.0);
+    check_format("%05d %-5d| %+d % d %#x %#o", 42, 42, 42, 42, 42, 8);
+    check_format(BENCH_FMT, 1234UL, "telnet", 54, ip, "raw", 4096u);
+    check_format("%s:%d %lld %s %f %p %c %%", "a", 1, 2LL, "b", 3.0, (void *)4, '5');
+
+    /* 还原的一行超过输出缓冲区 */
+    char wide[LOG_RING_STR_MAX + 1];
+    memset(wide, 'w', LOG_RING_STR_MAX);
+    wide[LOG_RING_STR_MAX] = '\0';
+    check_format("%-150s|%150s|%d", wide, wide, 3);
+    check_format("%200d|%d", 1, 2);
+}
+
+static void format_args(char *out, size_t size, size_t args_size, const char *fmt, ...)
+{
+    log_ring_entry_t rec;
+    va_list ap;
+    va_start(ap, fmt);
+    encode(&rec, args_size, fmt, ap);
+    va_end(ap);
+    log_ring_format(&rec, out, size);
+}
+
+static void test_truncated_strings()
+{
+    char out[LOG_RING_LINE_MAX], expect[LOG_RING_LINE_MAX];
+    char a[100], b[100], c[100];
+    memset(a, 'a', sizeof(a) - 1);
+    memset(b, 'b', sizeof(b) - 1);
+    memset(c, 'c', sizeof(c) - 1);
+    a[99] = b[99] = c[99] = '\0';
+
+    /* 单个字符串最多保留 LOG_RING_STR_MAX 字节 */
+    format_args(out, sizeof(out), sizeof(((log_ring_entry_t *)0)->args), "[%s]", a);
+    snprintf(expect, sizeof(expect), "[%.*s]", LOG_RING_STR_MAX, a);
+    CHECK(strcmp(out, expect) == 0);
+
+    /* 记录放不下时截断最后一个字符串，其余参数不受影响 */
+    size_t args_size = sizeof(((log_ring_entry_t *)0)->args);
+    size_t last = args_size - 2 * (1 + LOG_RING_STR_MAX) - 1;
+    format_args(out, sizeof(out), args_size, "[%s][%s][%s]", a, b, c);
+    snprintf(expect, sizeof(expect), "[%.*s][%.*s][%.*s]", LOG_RING_STR_MAX, a, LOG_RING_STR_MAX, b, (int)last, c);
+    CHECK(strcmp(out, expect) == 0);
+
+    format_args(out, sizeof(out), args_size, "%s", (const char *)NULL);
+    CHECK(strcmp(out, "(null)") == 0);
+}
+
+static int encode_only(uint8_t *args, size_t size, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = log_ring_encode(fmt, ap, args, size);
+    va_end(ap);
+    return n;
+}
+
+static void test_unencodable()
+{
+    log_ring_entry_t rec;
+    CHECK(encode_only(rec.args, sizeof(rec.args), "%*d", 5, 1) < 0);
+    CHECK(encode_only(rec.args, sizeof(rec.args), "%.*s", 2, "abc") < 0);
+    CHECK(encode_only(rec.args, sizeof(rec.args), "%Lf", 1.0L) < 0);
+    CHECK(encode_only(rec.args, sizeof(rec.args), "%d %s %d", 1, "ab", 2) == 4 + 3 + 4);
+    /* 字符串之后的定长参数放不下时放弃整条，改为直接输出 */
+    CHECK(encode_only(rec.args, 4 + 3 + 3, "%d %s %d", 1, "ab", 2) < 0);
+
+    /* 记录长度不足时还原到缺少参数的转换为止，不越过记录读取 */
+    char out[LOG_RING_LINE_MAX];
+    CHECK(encode_only(rec.args, sizeof(rec.args), "x=%d y=%s", 1, "ab") == 4 + 3);
+    set_fmt(&rec, "x=%d y=%s");
+    rec.hdr.len = sizeof(rec.hdr) + 4 + 2;
+    log_ring_format(&rec, out, sizeof(out));
+    CHECK(strcmp(out, "x=1 y=") == 0);
+    rec.hdr.len = sizeof(rec.hdr) + 3;
+    log_ring_format(&rec, out, sizeof(out));
+    CHECK(strcmp(out, "x=") == 0);
+}
+
+/* 修改前的输出钩子：在调用者上格式化后写出 */
+__attribute__((noinline)) static int direct_vprintf(const char *fmt, va_list ap)
+{
+    char buf[128];
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    return null_write(buf, n);
+}
+
+typedef int (*vprintf_t)(const char *, va_list);
+
+__attribute__((format(printf, 2, 3))) static void log_call(vprintf_t hook, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    CHECK(hook(fmt, ap) >= 0);
+    va_end(ap);
+}
+
+/* 输出任务的工作：取出 tail 处的记录并还原为文本 */
+static void drain()
+{
+    log_ring_entry_t rec;
+    char line[LOG_RING_LINE_MAX];
+    while (log_tail != log_head)
+    {
+        log_ring_copy_out(log_tail, &rec.hdr, sizeof(rec.hdr));
+        log_ring_copy_out(log_tail + sizeof(rec.hdr), rec.args, rec.hdr.len - sizeof(rec.hdr));
+        null_write(line, log_ring_format(&rec, line, sizeof(line)));
+        log_tail += rec.hdr.len;
+    }
+}
+
+static uint64_t cycles()
+{
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void bench()
+{
+    char ip[] = "192.168.1.23";
+    printf("%-18s %10s %10s\n", "per log call", "ns", "cycles");
+    for (int round = 0; round < 3; round++)
+    {
+        int64_t t0 = test_now_ns();
+        uint64_t c0 = cycles();
+        for (int i = 0; i < BENCH_CALLS; i++)
+            log_call(direct_vprintf, BENCH_FMT, (unsigned long)i, "telnet", 54, ip, "raw", 4096u);
+        int64_t direct_ns = test_now_ns() - t0;
+        uint64_t direct_cycles = cycles() - c0;
+
+        /* 调用者只承担记录的开销，取出与还原在计时之外，即由低优先级任务完成 */
+        int64_t ring_ns = 0;
+        uint64_t ring_cycles = 0;
+        int64_t drain_ns = 0;
+        for (int i = 0; i < BENCH_CALLS; i += BENCH_BATCH)
+        {
+            t0 = test_now_ns();
+            c0 = cycles();
+            for (int j = 0; j < BENCH_BATCH; j++)
+                log_call(log_ring_vprintf, BENCH_FMT, (unsigned long)(i + j), "telnet", 54, ip, "raw", 4096u);
+            ring_cycles += cycles() - c0;
+            int64_t t1 = test_now_ns();
+            ring_ns += t1 - t0;
+            drain();
+            drain_ns += test_now_ns() - t1;
+        }
+        printf("%-18s %10.1f %10.0f\n", "direct vsnprintf", (double)direct_ns / BENCH_CALLS,
+               (double)direct_cycles / BENCH_CALLS);
+        printf("%-18s %10.1f %10.0f\n", "ring producer", (double)ring_ns / BENCH_CALLS,
+               (double)ring_cycles / BENCH_CALLS);
+        printf("%-18s %10.1f %10s\n", "ring drain", (double)drain_ns / BENCH_CALLS, "-");
+    }
+
+    log_ring_stats_t stats;
+    log_ring_get_stats(&stats);
+    CHECK(stats.records == 3u * BENCH_CALLS && stats.lost == 0 && stats.direct == 0 && stats.pending == 0);
+}
+
+int main()
+{
+    CHECK(log_ring_init(null_write) == ESP_OK);
+    test_corpus();
+    test_truncated_strings();
+    test_unencodable();
+    printf("encode/format round trip ok\n");
+    bench();
+    return 0;
+}
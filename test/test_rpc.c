@@ -0,0 +1,479 @@
+/*
+ * 二进制管理协议的主机测试：格式错误的请求不执行任何设置，串口参数先全部校验再一次生效，
+ * 应答放不下时在 TLV 边界截断。被调用的模块由内存中的替身代替并记录调用。
+ */
+#include "rpc/rpc.h"
+#include "adc/adc.h"
+#include "config/config.h"
+#include "esp_app_desc.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+#include "test.h"
+#include "usr_uart/usr_uart.h"
+#include "wifi_manager/wifi_manager.h"
+#include <string.h>
+
+#define RPC_STR_MAX 64  // rpc.c 中字符串参数的上限
+#define DEV_NAME_MAX 20 // config.c 中 CONF_DEV_NAME_MAX
+
+static uart_config_t uart_param = {.baud_rate = 115200, .data_bits = 3, .parity = 0, .stop_bits = 1};
+static usr_uart_flow_t uart_flow;
+static int uart_configure_calls;
+static uint32_t uart_configure_mask;
+static char dev_name[DEV_NAME_MAX + 1] = "bridge";
+static int dev_name_sets;
+static int wifi_ssid_sets;
+static int wifi_connects;
+
+/* 与 usr_uart_configure 一样先校验全部参数，失败时不做任何修改 */
+esp_err_t usr_uart_configure(uart_config_t *config, uint32_t mask)
+{
+    uart_configure_calls++;
+    uart_configure_mask = mask;
+    if (((mask & USR_UART_BAUD_RATE) && (config->baud_rate < 1200 || config->baud_rate > 5000000)) ||
+        ((mask & USR_UART_DATA_BITS) && config->data_bits > 3) ||
+        ((mask & USR_UART_STOP_BITS) && (config->stop_bits < 1 || config->stop_bits > 3)) ||
+        ((mask & USR_UART_PARITY) && (config->parity == 1 || config->parity > 3)))
+        return ESP_ERR_INVALID_ARG;
+    if (mask & USR_UART_BAUD_RATE)
+        uart_param.baud_rate = config->baud_rate;
+    if (mask & USR_UART_DATA_BITS)
+        uart_param.data_bits = config->data_bits;
+    if (mask & USR_UART_STOP_BITS)
+        uart_param.stop_bits = config->stop_bits;
+    if (mask & USR_UART_PARITY)
+        uart_param.parity = config->parity;
+    return ESP_OK;
+}
+
+void usr_uart_get_param(uart_config_t *config)
+{
+    *config = uart_param;
+}
+
+esp_err_t usr_uart_set_flow(usr_uart_flow_t flow)
+{
+    uart_flow = flow;
+    return ESP_OK;
+}
+
+usr_uart_flow_t usr_uart_get_flow()
+{
+    return uart_flow;
+}
+
+int conf_get_dev_name(char *name, size_t len)
+{
+    if (strlen(dev_name) + 1 > len)
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    strcpy(name, dev_name);
+    return ESP_OK;
+}
+
+int conf_set_dev_name(const char *name)
+{
+    dev_name_sets++;
+    if (strlen(name) > DEV_NAME_MAX)
+        return ESP_ERR_INVALID_SIZE;
+    strcpy(dev_name, name);
+    return ESP_OK;
+}
+
+int conf_get_wifi_ssid(char *ssid, size_t len)
+{
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+int adc_read_bat_voltage_mv()
+{
+    return 3900;
+}
+
+float adc_read_bat_capacity()
+{
+    return 87.5f;
+}
+
+bool adc_bat_is_charging()
+{
+    return true;
+}
+
+void wifi_get_ip_info(esp_netif_ip_info_t *ip)
+{
+    ip->ip.addr = 0x0101a8c0;
+    ip->netmask.addr = 0x00ffffff;
+    ip->gw.addr = 0x0101a8c0;
+}
+
+esp_err_t wifi_set_sta_ssid(uint8_t *ssid, int ssid_len)
+{
+    wifi_ssid_sets++;
+    return ESP_OK;
+}
+
+esp_err_t wifi_set_sta_passwd(uint8_t *passwd, int len)
+{
+    return ESP_OK;
+}
+
+void wifi_connect(void)
+{
+    wifi_connects++;
+}
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    return ESP_OK;
+}
+
+const esp_app_desc_t *esp_app_get_description(void)
+{
+    static const esp_app_desc_t desc = {.version = "v1.2.3"};
+    return &desc;
+}
+
+typedef struct
+{
+    uint8_t buf[RPC_MSG_MAX];
+    size_t len;
+} msg_t;
+
+static void msg_init(msg_t *m, uint16_t id)
+{
+    m->buf[0] = RPC_MAGIC;
+    m->buf[1] = RPC_VERSION;
+    memcpy(m->buf + 2, &id, sizeof(id));
+    m->len = RPC_HDR_LEN;
+}
+
+static void msg_add(msg_t *m, uint8_t tag, const void *value, size_t len)
+{
+    CHECK(m->len + 2 + len <= sizeof(m->buf));
+    m->buf[m->len++] = tag;
+    m->buf[m->len++] = len;
+    if (len)
+        memcpy(m->buf + m->len, value, len);
+    m->len += len;
+}
+
+static void msg_add_u32(msg_t *m, uint8_t tag, uint32_t v)
+{
+    msg_add(m, tag, &v, sizeof(v));
+}
+
+static void msg_add_u8(msg_t *m, uint8_t tag, uint8_t v)
+{
+    msg_add(m, tag, &v, sizeof(v));
+}
+
+/**
+ * @brief 取应答中的第 index 个 TLV，同时检查应答由完整的 TLV 组成
+ */
+static const uint8_t *resp_tlv(const msg_t *resp, int index, uint8_t *tag, uint8_t *len)
+{
+    size_t pos = RPC_HDR_LEN;
+    for (int i = 0; pos < resp->len; i++)
+    {
+        CHECK(pos + 2 <= resp->len && pos + 2 + resp->buf[pos + 1] <= resp->len);
+        if (i == index)
+        {
+            *tag = resp->buf[pos];
+            *len = resp->buf[pos + 1];
+            return resp->buf + pos + 2;
+        }
+        pos += 2 + resp->buf[pos + 1];
+    }
+    return NULL;
+}
+
+static int resp_count(const msg_t *resp)
+{
+    uint8_t tag, len;
+    int n = 0;
+    while (resp_tlv(resp, n, &tag, &len))
+        n++;
+    return n;
+}
+
+static void expect_value(const msg_t *resp, int index, uint8_t tag, const void *value, size_t len)
+{
+    uint8_t t, l;
+    const uint8_t *v = resp_tlv(resp, index, &t, &l);
+    CHECK(v != NULL && t == tag && l == len && memcmp(v, value, len) == 0);
+}
+
+static void expect_u32(const msg_t *resp, int index, uint8_t tag, uint32_t value)
+{
+    expect_value(resp, index, tag, &value, sizeof(value));
+}
+
+static void expect_u8(const msg_t *resp, int index, uint8_t tag, uint8_t value)
+{
+    expect_value(resp, index, tag, &value, sizeof(value));
+}
+
+static void expect_err(const msg_t *resp, int index, uint8_t tag, esp_err_t err)
+{
+    uint8_t value[5] = {tag};
+    memcpy(value + 1, &err, sizeof(err));
+    expect_value(resp, index, RPC_TAG_ERROR, value, sizeof(value));
+}
+
+static void handle(const msg_t *req, msg_t *resp, size_t size)
+{
+    CHECK(size <= sizeof(resp->buf));
+    memset(resp->buf, 0xee, sizeof(resp->buf));
+    resp->len = rpc_handle(req->buf, req->len, resp->buf, size);
+    CHECK(resp->len <= size);
+}
+
+static void test_header()
+{
+    msg_t req, resp;
+    msg_init(&req, 0x1234);
+    msg_add(&req, RPC_TAG_UART_BAUD, NULL, 0);
+    handle(&req, &resp, sizeof(resp.buf));
+    CHECK(resp.len == RPC_HDR_LEN + 6 && memcmp(resp.buf, req.buf, RPC_HDR_LEN) == 0);
+    expect_u32(&resp, 0, RPC_TAG_UART_BAUD, 115200);
+
+    msg_init(&req, 1);
+    handle(&req, &resp, sizeof(resp.buf));
+    CHECK(resp.len == RPC_HDR_LEN);
+
+    for (size_t len = 0; len < RPC_HDR_LEN; len++)
+    {
+        req.len = len;
+        handle(&req, &resp, sizeof(resp.buf));
+        CHECK(resp.len == 0);
+    }
+    msg_init(&req, 1);
+    req.buf[0] = RPC_MAGIC ^ 1;
+    handle(&req, &resp, sizeof(resp.buf));
+    CHECK(resp.len == 0);
+    msg_init(&req, 1);
+    req.buf[1] = RPC_VERSION + 1;
+    handle(&req, &resp, sizeof(resp.buf));
+    CHECK(resp.len == 0);
+    msg_init(&req, 1);
+    handle(&req, &resp, RPC_HDR_LEN - 1);
+    CHECK(resp.len == 0);
+}
+
+/* 截断在 TLV 中间的请求整条拒绝，其中在截断点之前的设置也不执行 */
+static void test_malformed()
+{
+    msg_t req, bad, resp;
+    msg_init(&req, 7);
+    msg_add(&req, RPC_SET | RPC_TAG_DEV_NAME, "first", 5);
+    msg_add_u32(&req, RPC_SET | RPC_TAG_UART_BAUD, 9600);
+    msg_add_u8(&req, RPC_SET | RPC_TAG_UART_FLOW, USR_UART_FLOW_HW);
+    msg_add(&req, RPC_SET | RPC_TAG_WIFI_CONNECT, NULL, 0);
+    size_t full = req.len;
+
+    /* 只有落在 TLV 边界上的长度是合法请求 */
+    for (size_t len = RPC_HDR_LEN + 1, next = RPC_HDR_LEN + 2 + req.buf[RPC_HDR_LEN + 1]; len < full; len++)
+    {
+        if (len == next)
+        {
+            next += 2 + req.buf[next + 1];
+            continue;
+        }
+        req.len = len;
+        handle(&req, &resp, sizeof(resp.buf));
+        CHECK(resp.len == 0);
+    }
+    CHECK(dev_name_sets == 0 && uart_configure_calls == 0 && uart_flow == USR_UART_FLOW_NONE && wifi_connects == 0);
+
+    /* 长度字节越过请求末尾 */
+    msg_init(&bad, 7);
+    msg_add(&bad, RPC_SET | RPC_TAG_DEV_NAME, "x", 1);
+    bad.buf[bad.len - 2] = 0xff;
+    handle(&bad, &resp, sizeof(resp.buf));
+    CHECK(resp.len == 0 && dev_name_sets == 0);
+
+    req.len = full;
+    handle(&req, &resp, sizeof(resp.buf));
+    CHECK(resp_count(&resp) == 4 && strcmp(dev_name, "first") == 0 && uart_param.baud_rate == 9600 &&
+          uart_flow == USR_UART_FLOW_HW && wifi_connects == 1);
+    expect_value(&resp, 3, RPC_TAG_WIFI_CONNECT, NULL, 0);
+}
+
+static void test_zero_length()
+{
+    msg_t req, resp;
+    int sets = dev_name_sets;
+    msg_init(&req, 1);
+    msg_add(&req, RPC_SET | RPC_TAG_UART_BAUD, NULL, 0);
+    msg_add(&req, RPC_SET | RPC_TAG_UART_FLOW, NULL, 0);
+    msg_add(&req, RPC_SET | RPC_TAG_DEV_NAME, NULL, 0);
+    msg_add(&req, RPC_TAG_WIFI_SSID, NULL, 0);
+    msg_add(&req, RPC_SET | RPC_TAG_WIFI_SSID, NULL, 0);
+    int calls = uart_configure_calls;
+    handle(&req, &resp, sizeof(resp.buf));
+    CHECK(resp_count(&resp) == 5 && uart_configure_calls == calls);
+    expect_err(&resp, 0, RPC_TAG_UART_BAUD, ESP_ERR_INVALID_SIZE);
+    expect_err(&resp, 1, RPC_TAG_UART_FLOW, ESP_ERR_INVALID_SIZE);
+    expect_value(&resp, 2, RPC_TAG_DEV_NAME, NULL, 0);
+    expect_value(&resp, 3, RPC_TAG_WIFI_SSID, NULL, 0);
+    CHECK(dev_name_sets == sets + 1 && dev_name[0] == '\0');
+
+    /* 1、2、4 字节的整数均可，其他长度无效 */
+    uint8_t v[3] = {0x80, 0x25, 0x00};
+    msg_init(&req, 1);
+    msg_add(&req, RPC_SET | RPC_TAG_UART_BAUD, v, 2);
+    handle(&req, &resp, sizeof(resp.buf));
+    expect_u32(&resp, 0, RPC_TAG_UART_BAUD, 9600);
+    msg_init(&req, 1);
+    msg_add(&req, RPC_SET | RPC_TAG_UART_BAUD, v, 3);
+    handle(&req, &resp, sizeof(resp.buf));
+    expect_err(&resp, 0, RPC_TAG_UART_BAUD, ESP_ERR_INVALID_SIZE);
+}
+
+static void test_dev_name()
+{
+    msg_t req, resp;
+    char name[RPC_STR_MAX + 1];
+    memset(name, 'n', sizeof(name));
+    strcpy(dev_name, "bridge");
+    int sets = dev_name_sets;
+
+    /* 超过 rpc 的字符串上限，不调用 conf_set_dev_name */
+    msg_init(&req, 1);
+    msg_add(&req, RPC_SET | RPC_TAG_DEV_NAME, name, RPC_STR_MAX + 1);
+    handle(&req, &resp, sizeof(resp.buf));
+    expect_err(&resp, 0, RPC_TAG_DEV_NAME, ESP_ERR_INVALID_SIZE);
+    CHECK(dev_name_sets == sets);
+
+    msg_init(&req, 1);
+    msg_add(&req, RPC_SET | RPC_TAG_DEV_NAME, "bad\nname", 8);
+    handle(&req, &resp, sizeof(resp.buf));
+    expect_err(&resp, 0, RPC_TAG_DEV_NAME, ESP_ERR_INVALID_ARG);
+    CHECK(dev_name_sets == sets);
+
+    /* 在 rpc 的上限内而超过配置的上限，由 conf_set_dev_name 拒绝 */
+    msg_init(&req, 1);
+    msg_add(&req, RPC_SET | RPC_TAG_DEV_NAME, name, RPC_STR_MAX);
+    msg_add(&req, RPC_SET | RPC_TAG_DEV_NAME, name, DEV_NAME_MAX + 1);
+    msg_add(&req, RPC_TAG_DEV_NAME, NULL, 0);
+    handle(&req, &resp, sizeof(resp.buf));
+    expect_err(&resp, 0, RPC_TAG_DEV_NAME, ESP_ERR_INVALID_SIZE);
+    expect_err(&resp, 1, RPC_TAG_DEV_NAME, ESP_ERR_INVALID_SIZE);
+    expect_value(&resp, 2, RPC_TAG_DEV_NAME, "bridge", 6);
+    CHECK(dev_name_sets == sets + 2);
+
+    msg_init(&req, 1);
+    msg_add(&req, RPC_SET | RPC_TAG_DEV_NAME, name, DEV_NAME_MAX);
+    handle(&req, &resp, sizeof(resp.buf));
+    expect_value(&resp, 0, RPC_TAG_DEV_NAME, name, DEV_NAME_MAX);
+
+    /* SSID 的上限来自 wifi_sta_config_t */
+    msg_init(&req, 1);
+    msg_add(&req, RPC_SET | RPC_TAG_WIFI_SSID, name, 32);
+    int ssid_sets = wifi_ssid_sets;
+    handle(&req, &resp, sizeof(resp.buf));
+    expect_err(&resp, 0, RPC_TAG_WIFI_SSID, ESP_ERR_INVALID_SIZE);
+    CHECK(wifi_ssid_sets == ssid_sets);
+}
+
+/* 串口参数在生成应答之前一次生效，请求中排在设置之前的读取也得到新值 */
+static void test_mixed()
+{
+    msg_t req, resp;
+    uart_param = (uart_config_t){.baud_rate = 115200, .data_bits = 3, .parity = 0, .stop_bits = 1};
+    msg_init(&req, 0xbeef);
+    msg_add(&req, RPC_TAG_UART_BAUD, NULL, 0);
+    msg_add_u32(&req, RPC_SET | RPC_TAG_UART_BAUD, 57600);
+    msg_add_u8(&req, RPC_SET | RPC_TAG_UART_DATA_BITS, 7);
+    msg_add(&req, RPC_TAG_BAT_CAPACITY, NULL, 0);
+    msg_add_u8(&req, RPC_SET | RPC_TAG_UART_PARITY, 2);
+    msg_add(&req, RPC_SET | RPC_TAG_DEV_NAME, "lab-3", 5);
+    msg_add(&req, RPC_TAG_UART_DATA_BITS, NULL, 0);
+    msg_add(&req, RPC_TAG_FW_VERSION, NULL, 0);
+    msg_add(&req, 0x7f, NULL, 0);
+    msg_add(&req, RPC_SET | 0x7f, "x", 1);
+    int calls = uart_configure_calls;
+    handle(&req, &resp, sizeof(resp.buf));
+
+    CHECK(uart_configure_calls == calls + 1);
+    CHECK(uart_configure_mask == (USR_UART_BAUD_RATE | USR_UART_DATA_BITS | USR_UART_PARITY));
+    CHECK(resp_count(&resp) == 10 && resp.buf[2] == 0xef && resp.buf[3] == 0xbe);
+    expect_u32(&resp, 0, RPC_TAG_UART_BAUD, 57600);
+    expect_u32(&resp, 1, RPC_TAG_UART_BAUD, 57600);
+    expect_u8(&resp, 2, RPC_TAG_UART_DATA_BITS, 7);
+    uint16_t capacity = 875;
+    expect_value(&resp, 3, RPC_TAG_BAT_CAPACITY, &capacity, sizeof(capacity));
+    expect_u8(&resp, 4, RPC_TAG_UART_PARITY, 2);
+    expect_value(&resp, 5, RPC_TAG_DEV_NAME, "lab-3", 5);
+    expect_u8(&resp, 6, RPC_TAG_UART_DATA_BITS, 7);
+    expect_value(&resp, 7, RPC_TAG_FW_VERSION, "v1.2.3", 6);
+    expect_err(&resp, 8, 0x7f, ESP_ERR_NOT_SUPPORTED);
+    expect_err(&resp, 9, 0x7f, ESP_ERR_NOT_SUPPORTED);
+}
+
+/* 任一串口参数无效时都不生效，全部串口设置应答同一个错误，其他设置照常执行 */
+static void test_uart_all_or_nothing()
+{
+    msg_t req, resp;
+    uart_param = (uart_config_t){.baud_rate = 115200, .data_bits = 3, .parity = 0, .stop_bits = 1};
+
+    msg_init(&req, 1);
+    msg_add_u32(&req, RPC_SET | RPC_TAG_UART_BAUD, 9600);
+    msg_add_u8(&req, RPC_SET | RPC_TAG_UART_DATA_BITS, 4);
+    msg_add_u8(&req, RPC_SET | RPC_TAG_UART_STOP_BITS, 3);
+    msg_add(&req, RPC_SET | RPC_TAG_DEV_NAME, "kept", 4);
+    int calls = uart_configure_calls;
+    handle(&req, &resp, sizeof(resp.buf));
+    CHECK(uart_configure_calls == calls && uart_param.baud_rate == 115200 && uart_param.stop_bits == 1);
+    expect_err(&resp, 0, RPC_TAG_UART_BAUD, ESP_ERR_INVALID_ARG);
+    expect_err(&resp, 1, RPC_TAG_UART_DATA_BITS, ESP_ERR_INVALID_ARG);
+    expect_err(&resp, 2, RPC_TAG_UART_STOP_BITS, ESP_ERR_INVALID_ARG);
+    expect_value(&resp, 3, RPC_TAG_DEV_NAME, "kept", 4);
+
+    /* 解析通过而 usr_uart_configure 拒绝 */
+    msg_init(&req, 1);
+    msg_add_u32(&req, RPC_SET | RPC_TAG_UART_BAUD, 9600);
+    msg_add_u8(&req, RPC_SET | RPC_TAG_UART_PARITY, 1);
+    handle(&req, &resp, sizeof(resp.buf));
+    CHECK(uart_configure_calls == calls + 1 && uart_param.baud_rate == 115200 && uart_param.parity == 0);
+    expect_err(&resp, 0, RPC_TAG_UART_BAUD, ESP_ERR_INVALID_ARG);
+    expect_err(&resp, 1, RPC_TAG_UART_PARITY, ESP_ERR_INVALID_ARG);
+}
+
+/* 应答缓冲区不足时在 TLV 边界截断，得到的是完整应答的前缀 */
+static void test_small_response()
+{
+    msg_t req, full, resp;
+    msg_init(&req, 9);
+    msg_add(&req, RPC_TAG_UART_BAUD, NULL, 0);
+    msg_add(&req, RPC_TAG_DEV_NAME, NULL, 0);
+    msg_add(&req, RPC_TAG_IP_INFO, NULL, 0);
+    msg_add(&req, RPC_TAG_WIFI_PASSWD, NULL, 0);
+    msg_add(&req, RPC_TAG_BAT_CHARGING, NULL, 0);
+    handle(&req, &full, sizeof(full.buf));
+    int count = resp_count(&full);
+    CHECK(count == 5);
+    expect_err(&full, 3, RPC_TAG_WIFI_PASSWD, ESP_ERR_NOT_SUPPORTED);
+
+    for (size_t size = RPC_HDR_LEN; size <= full.len; size++)
+    {
+        handle(&req, &resp, size);
+        int n = resp_count(&resp);
+        CHECK(resp.len <= size && memcmp(resp.buf, full.buf, resp.len) == 0);
+        CHECK(n == count || resp.len + 2 + full.buf[resp.len + 1] > size);
+        CHECK(resp.buf[resp.len] == 0xee);
+    }
+}
+
+int main()
+{
+    test_header();
+    test_malformed();
+    test_zero_length();
+    test_dev_name();
+    test_mixed();
+    test_uart_all_or_nothing();
+    test_small_response();
+    printf("rpc ok\n");
+    return 0;
+}
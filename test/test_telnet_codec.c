@@ -0,0 +1,211 @@
+/*
+ * telnet 编解码的主机测试：按字扫描与逐字节参考实现的结果一致，转义不拆分 IAC 对，
+ * 并给出两种实现在不同数据上的吞吐。
+ */
+#include "telnet/telnet_codec.h"
+#include "test.h"
+#include <string.h>
+
+#define BENCH_LEN (64 * 1024)
+#define BENCH_BYTES (64u << 20)
+
+/* 逐字节参考实现，即改为按字扫描之前的写法 */
+__attribute__((noinline)) static size_t ref_scan(const uint8_t *data, size_t len, bool with_cr)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        if (data[i] == 0xff || (with_cr && data[i] == 0x0d))
+            return i;
+    }
+    return len;
+}
+
+__attribute__((noinline)) static size_t ref_escape(const uint8_t *src, size_t len, uint8_t *dst, size_t cap,
+                                                   size_t *consumed)
+{
+    size_t in = 0, out = 0;
+    for (; in < len; in++)
+    {
+        if (src[in] == 0xff)
+        {
+            if (cap - out < 2)
+                break;
+            dst[out++] = 0xff;
+        }
+        else if (out == cap)
+        {
+            break;
+        }
+        dst[out++] = src[in];
+    }
+    *consumed = in;
+    return out;
+}
+
+static void test_scan()
+{
+    static uint8_t buf[256 + 8];
+    uint32_t seed = 1;
+    for (int round = 0; round < 20000; round++)
+    {
+        /* 不同对齐、长度与特殊字节位置，覆盖首尾的逐字节部分与中间的按字部分 */
+        size_t off = round & 7;
+        size_t len = test_rand(&seed) % 256;
+        uint8_t *data = buf + off;
+        for (size_t i = 0; i < len; i++)
+        {
+            uint8_t c = test_rand(&seed);
+            data[i] = c == 0xff || c == 0x0d ? c - 1 : c;
+        }
+        int specials = test_rand(&seed) % 3;
+        for (int k = 0; k < specials && len; k++)
+            data[test_rand(&seed) % len] = test_rand(&seed) & 1 ? 0xff : 0x0d;
+        /* 0xFE 与 0x0C 之类相邻值不能误判 */
+        if (len && round % 5 == 0)
+            data[test_rand(&seed) % len] = 0x80;
+
+        CHECK(telnet_codec_scan(data, len, false) == ref_scan(data, len, false));
+        CHECK(telnet_codec_scan(data, len, true) == ref_scan(data, len, true));
+    }
+
+    /* 每个位置单独放一个特殊字节 */
+    for (size_t off = 0; off < 4; off++)
+    {
+        for (size_t pos = 0; pos < 64; pos++)
+        {
+            uint8_t *data = buf + off;
+            memset(data, 0xfe, 64);
+            data[pos] = 0xff;
+            CHECK(telnet_codec_scan(data, 64, false) == pos);
+            data[pos] = 0x0d;
+            CHECK(telnet_codec_scan(data, 64, false) == 64);
+            CHECK(telnet_codec_scan(data, 64, true) == pos);
+        }
+    }
+}
+
+static void test_escape()
+{
+    static uint8_t src[512], dst[1024], expect[1024];
+    uint32_t seed = 2;
+    for (int round = 0; round < 20000; round++)
+    {
+        size_t len = test_rand(&seed) % sizeof(src);
+        uint32_t density = test_rand(&seed) % 4; // 0 表示没有 0xFF，3 表示几乎全是
+        for (size_t i = 0; i < len; i++)
+        {
+            uint32_t r = test_rand(&seed);
+            src[i] = (r & 3) < density ? 0xff : (uint8_t)(r >> 8) % 0xff;
+        }
+        size_t cap = round & 1 ? test_rand(&seed) % (2 * len + 2) : 2 * len;
+
+        size_t consumed, ref_consumed;
+        size_t out = telnet_codec_escape(src, len, dst, cap, &consumed);
+        size_t ref_out = ref_escape(src, len, expect, cap, &ref_consumed);
+        CHECK(out == ref_out && consumed == ref_consumed);
+        CHECK(memcmp(dst, expect, out) == 0);
+        CHECK(out <= cap && consumed <= len);
+        /* 空间足够时全部编码，不够时只剩单个 0xFF 放不下 */
+        if (cap >= 2 * len)
+            CHECK(consumed == len);
+        else if (consumed < len)
+            CHECK(out == cap || (src[consumed] == 0xff && cap - out == 1));
+
+        /* 输出中 0xFF 总是成对出现 */
+        for (size_t i = 0; i < out; i++)
+        {
+            if (dst[i] == 0xff)
+            {
+                CHECK(i + 1 < out && dst[i + 1] == 0xff);
+                i++;
+            }
+        }
+    }
+}
+
+typedef enum
+{
+    DATA_BINARY, // 均匀随机，约每 256 字节一个 0xFF
+    DATA_TEXT,   // 日志文本，只有 CRLF
+    DATA_IAC,    // 全部为 0xFF，最坏情况
+} data_kind_t;
+
+static const char *const data_names[] = {"binary", "text", "all-0xff"};
+
+static void fill(uint8_t *buf, size_t len, data_kind_t kind)
+{
+    uint32_t seed = 3;
+    static const char line[] = "I (123456) wifi:state: run -> auth (b0)\r\n";
+    for (size_t i = 0; i < len; i++)
+    {
+        switch (kind)
+        {
+        case DATA_BINARY:
+            buf[i] = test_rand(&seed);
+            break;
+        case DATA_TEXT:
+            buf[i] = line[i % (sizeof(line) - 1)];
+            break;
+        case DATA_IAC:
+            buf[i] = 0xff;
+            break;
+        }
+    }
+}
+
+static double mbps(int64_t ns)
+{
+    return BENCH_BYTES / (ns / 1e9) / 1e6;
+}
+
+/* 按转发路径的用法扫描整块数据：每遇到一个特殊字节就从其后继续 */
+static int64_t bench_scan(const uint8_t *data, size_t (*scan)(const uint8_t *, size_t, bool), bool with_cr)
+{
+    volatile size_t sink = 0;
+    int64_t start = test_now_ns();
+    for (uint32_t done = 0; done < BENCH_BYTES; done += BENCH_LEN)
+    {
+        for (size_t i = 0; i < BENCH_LEN;)
+        {
+            i += scan(data + i, BENCH_LEN - i, with_cr) + 1;
+            sink += i;
+        }
+    }
+    return test_now_ns() - start;
+}
+
+static int64_t bench_escape(const uint8_t *data, uint8_t *dst,
+                            size_t (*escape)(const uint8_t *, size_t, uint8_t *, size_t, size_t *))
+{
+    int64_t start = test_now_ns();
+    for (uint32_t done = 0; done < BENCH_BYTES; done += BENCH_LEN)
+    {
+        size_t consumed;
+        escape(data, BENCH_LEN, dst, 2 * BENCH_LEN, &consumed);
+        CHECK(consumed == BENCH_LEN);
+    }
+    return test_now_ns() - start;
+}
+
+static void bench()
+{
+    static uint8_t data[BENCH_LEN], dst[2 * BENCH_LEN];
+    printf("%-9s %12s %12s %12s %12s %12s %12s\n", "MB/s", "scan", "ref", "scan+cr", "ref+cr", "escape", "ref");
+    for (data_kind_t kind = DATA_BINARY; kind <= DATA_IAC; kind++)
+    {
+        fill(data, sizeof(data), kind);
+        printf("%-9s %12.0f %12.0f %12.0f %12.0f %12.0f %12.0f\n", data_names[kind],
+               mbps(bench_scan(data, telnet_codec_scan, false)), mbps(bench_scan(data, ref_scan, false)),
+               mbps(bench_scan(data, telnet_codec_scan, true)), mbps(bench_scan(data, ref_scan, true)),
+               mbps(bench_escape(data, dst, telnet_codec_escape)), mbps(bench_escape(data, dst, ref_escape)));
+    }
+}
+
+int main()
+{
+    test_scan();
+    test_escape();
+    bench();
+    puts("ok");
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * telnet_srv 的 select 集合：发送阻塞解除后连接仍须可读，最大描述符只在离开两个集合后收缩。
+ * 以 socketpair 实际调用 select 验证客户端的输入与断开仍能被发现。
+ */
+#include "telnet/telnet_fdset.h"
+#include "test.h"
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* 与 telnet_srv 相同的调用方式：读集合同时作为异常集合，不等待 */
+static bool poll_readable(const telnet_fdset_t *set, int fd)
+{
+    fd_set rfds = set->rfds, wfds = set->wfds, efds = set->rfds;
+    struct timeval tv = {};
+    CHECK(select(set->max_fd + 1, &rfds, &wfds, &efds, &tv) >= 0);
+    return FD_ISSET(fd, &rfds);
+}
+
+static void test_block_unblock()
+{
+    int listener[2], client[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, listener) == 0);
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, client) == 0);
+
+    telnet_fdset_t set;
+    telnet_fdset_init(&set);
+    CHECK(set.max_fd == -1);
+    telnet_fdset_watch(&set, listener[0]);
+    telnet_fdset_watch(&set, client[0]); // 最新的连接通常是最大的描述符
+    CHECK(set.max_fd == client[0]);
+
+    /* 发送阻塞又解除，连接仍在读集合中且仍是最大描述符 */
+    for (int round = 0; round < 3; round++)
+    {
+        telnet_fdset_watch_write(&set, client[0], true);
+        CHECK(FD_ISSET(client[0], &set.wfds) && set.max_fd == client[0]);
+        telnet_fdset_watch_write(&set, client[0], false);
+        CHECK(!FD_ISSET(client[0], &set.wfds));
+        CHECK(FD_ISSET(client[0], &set.rfds) && set.max_fd == client[0]);
+    }
+    /* 未在等待可写时清除没有影响 */
+    telnet_fdset_watch_write(&set, client[0], false);
+    CHECK(FD_ISSET(client[0], &set.rfds) && set.max_fd == client[0]);
+
+    /* 对端发来的数据与断开都能被 select 发现 */
+    CHECK(!poll_readable(&set, client[0]));
+    CHECK(write(client[1], "x", 1) == 1);
+    CHECK(poll_readable(&set, client[0]));
+    char c;
+    CHECK(read(client[0], &c, 1) == 1);
+    close(client[1]);
+    CHECK(poll_readable(&set, client[0]));
+    CHECK(read(client[0], &c, 1) == 0);
+
+    /* 关闭后收缩到仍被监听的最大描述符 */
+    telnet_fdset_unwatch(&set, client[0]);
+    CHECK(set.max_fd == listener[0]);
+    telnet_fdset_unwatch(&set, listener[0]);
+    CHECK(set.max_fd == -1);
+
+    close(client[0]);
+    close(listener[0]);
+    close(listener[1]);
+}
+
+static void test_write_only()
+{
+    /* WebSocket 连接只在可写集合中，解除阻塞后离开集合，max_fd 收缩到下一个仍被监听的描述符 */
+    telnet_fdset_t set;
+    telnet_fdset_init(&set);
+    telnet_fdset_watch(&set, 5);
+    telnet_fdset_watch(&set, 9);
+    telnet_fdset_watch_write(&set, 12, true);
+    CHECK(set.max_fd == 12);
+    telnet_fdset_watch_write(&set, 12, false);
+    CHECK(set.max_fd == 9 && FD_ISSET(9, &set.rfds));
+
+    /* 较小的描述符解除阻塞不影响 max_fd */
+    telnet_fdset_watch_write(&set, 5, true);
+    telnet_fdset_watch_write(&set, 5, false);
+    CHECK(set.max_fd == 9 && FD_ISSET(5, &set.rfds));
+
+    /* 最大描述符关闭时跳过中间的空位 */
+    telnet_fdset_unwatch(&set, 9);
+    CHECK(set.max_fd == 5);
+}
+
+int main()
+{
+    test_block_unblock();
+    test_write_only();
+    puts("ok");
+    return 0;
+}
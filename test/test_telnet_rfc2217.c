@@ -0,0 +1,160 @@
+/*
+ * RFC 2217 SET-CONTROL 的主机测试：查询回复当前状态，设置失败时回复实际状态而不是请求的值。
+ * 串口由替身代替，与 usr_uart.c 一样只在设置成功后更新状态。
+ */
+#include "telnet/telnet_private.h"
+#include "test.h"
+#include "usr_uart/usr_uart.h"
+#include <string.h>
+
+#define CPC_SET_CONTROL 5
+
+static uint8_t queued[256];
+static size_t queued_len;
+static usr_uart_flow_t uart_flow;
+static bool uart_break, uart_dtr, uart_rts;
+static bool dtr_available = true;
+static bool rts_available = true;
+
+void telnet_client_queue(TelnetConnect_t *client, const void *data, size_t len)
+{
+    CHECK(queued_len + len <= sizeof(queued));
+    memcpy(queued + queued_len, data, len);
+    queued_len += len;
+}
+
+esp_err_t usr_uart_set_param(const uart_config_t *config, uint32_t mask)
+{
+    return ESP_OK;
+}
+
+void usr_uart_get_param(uart_config_t *config)
+{
+    memset(config, 0, sizeof(*config));
+}
+
+esp_err_t usr_uart_set_flow(usr_uart_flow_t flow)
+{
+    uart_flow = flow;
+    return ESP_OK;
+}
+
+usr_uart_flow_t usr_uart_get_flow()
+{
+    return uart_flow;
+}
+
+esp_err_t usr_uart_set_break(bool on)
+{
+    uart_break = on;
+    return ESP_OK;
+}
+
+esp_err_t usr_uart_set_dtr(bool on)
+{
+    if (!dtr_available)
+        return ESP_ERR_NOT_SUPPORTED;
+    uart_dtr = on;
+    return ESP_OK;
+}
+
+esp_err_t usr_uart_set_rts(bool on)
+{
+    /* 硬件流控开启时 RTS 由硬件控制 */
+    if (!rts_available || uart_flow == USR_UART_FLOW_HW)
+        return ESP_ERR_NOT_SUPPORTED;
+    uart_rts = on;
+    return ESP_OK;
+}
+
+bool usr_uart_get_break()
+{
+    return uart_break;
+}
+
+bool usr_uart_get_dtr()
+{
+    return uart_dtr;
+}
+
+bool usr_uart_get_rts()
+{
+    return uart_rts;
+}
+
+/**
+ * @brief 发送一条 SET-CONTROL，返回回复中的值
+ */
+static uint8_t set_control(TelnetConnect_t *client, uint8_t value)
+{
+    client->sb_buf[0] = TELOPT_COM_PORT;
+    client->sb_buf[1] = CPC_SET_CONTROL;
+    client->sb_buf[2] = value;
+    client->sb_len = 3;
+    queued_len = 0;
+    telnet_rfc2217_proc_sb(client);
+
+    const uint8_t head[] = {TELNET_IAC, TELNET_SB, TELOPT_COM_PORT, 100 + CPC_SET_CONTROL};
+    CHECK(queued_len == sizeof(head) + 3 && memcmp(queued, head, sizeof(head)) == 0);
+    CHECK(queued[queued_len - 2] == TELNET_IAC && queued[queued_len - 1] == TELNET_SE);
+    return queued[sizeof(head)];
+}
+
+static void test_queries()
+{
+    TelnetConnect_t client = {.com_port = true, .ip_str = "test"};
+    CHECK(set_control(&client, 4) == 6);
+    CHECK(set_control(&client, 7) == 9);
+    CHECK(set_control(&client, 10) == 12);
+
+    CHECK(set_control(&client, 5) == 5 && uart_break);
+    CHECK(set_control(&client, 4) == 5);
+    CHECK(set_control(&client, 6) == 6 && !uart_break);
+    CHECK(set_control(&client, 8) == 8 && uart_dtr);
+    CHECK(set_control(&client, 7) == 8);
+    CHECK(set_control(&client, 11) == 11 && uart_rts);
+    CHECK(set_control(&client, 10) == 11);
+    CHECK(set_control(&client, 12) == 12);
+    CHECK(set_control(&client, 10) == 12);
+}
+
+/* 设置失败时回复的是未改变的实际状态 */
+static void test_failures()
+{
+    TelnetConnect_t client = {.com_port = true, .ip_str = "test"};
+    uart_dtr = true;
+    dtr_available = false;
+    CHECK(set_control(&client, 9) == 8 && uart_dtr);
+    CHECK(set_control(&client, 7) == 8);
+    dtr_available = true;
+
+    uart_rts = false;
+    CHECK(set_control(&client, 3) == 3 && uart_flow == USR_UART_FLOW_HW);
+    CHECK(set_control(&client, 11) == 12 && !uart_rts);
+    rts_available = false;
+    CHECK(set_control(&client, 1) == 1);
+    CHECK(set_control(&client, 11) == 12);
+    rts_available = true;
+}
+
+/* 收发共用一种流控，入向的查询与设置用 13 到 16 表示 */
+static void test_flow()
+{
+    TelnetConnect_t client = {.com_port = true, .ip_str = "test"};
+    CHECK(set_control(&client, 2) == 2 && uart_flow == USR_UART_FLOW_SW);
+    CHECK(set_control(&client, 0) == 2);
+    CHECK(set_control(&client, 13) == 15);
+    CHECK(set_control(&client, 16) == 16 && uart_flow == USR_UART_FLOW_HW);
+    CHECK(set_control(&client, 0) == 3);
+    CHECK(set_control(&client, 18) == 16 && uart_flow == USR_UART_FLOW_HW);
+    CHECK(set_control(&client, 14) == 14 && uart_flow == USR_UART_FLOW_NONE);
+}
+
+int main()
+{
+    test_queries();
+    test_failures();
+    test_flow();
+    printf("rfc2217 set-control ok\n");
+    return 0;
+}
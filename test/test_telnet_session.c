@@ -0,0 +1,244 @@
+/*
+ * 会话续传的主机测试：客户端在数据流中途反复断线，在途数据随连接一起丢失，
+ * 凭令牌与位置重连后收到的数据流须逐字节一致，没有重复与遗漏；积压超过环形缓冲区时应答 GAP。
+ */
+#include "telnet/telnet_private.h"
+#include "test.h"
+#include <arpa/inet.h>
+#include <inttypes.h>
+#include <string.h>
+
+#define KILLS 2000
+#define INFLIGHT_MAX 4096 // 断线时丢失的已发送数据，相当于发送缓冲区与路由器队列
+#define ONLINE_MAX 4096   // 每次连接期间的串口输出
+
+typedef struct __attribute__((packed))
+{
+    char magic[4];
+    uint32_t boot;
+    uint32_t id;
+    uint32_t offset;
+} hello_t;
+
+typedef struct __attribute__((packed))
+{
+    char magic[4];
+    uint8_t status;
+    uint8_t reserved[3];
+    uint32_t boot;
+    uint32_t id;
+    uint32_t offset;
+} reply_t;
+
+static uint8_t queued[TELNET_TX_BUF];
+static size_t queued_len;
+
+void telnet_client_queue(TelnetConnect_t *client, const void *data, size_t len)
+{
+    CHECK(queued_len + len <= sizeof(queued));
+    memcpy(queued + queued_len, data, len);
+    queued_len += len;
+}
+
+/* 模拟的 Linux 客户端，与 tools/session_client.py 保存的状态相同 */
+typedef struct
+{
+    uint32_t boot;
+    uint32_t id;
+    uint32_t next; // 下一个期望的字节位置
+    uint64_t received;
+    uint64_t gap;
+} sim_client_t;
+
+static uint32_t produced;
+static uint32_t seed = 6;
+
+static void produce(size_t len)
+{
+    while (len)
+    {
+        uint8_t *ptr;
+        size_t n = bridge_ring_write_begin(&ptr);
+        if (n > len)
+            n = len;
+        for (size_t i = 0; i < n; i++)
+            ptr[i] = test_stream_byte(produced + i);
+        bridge_ring_write_commit(n, 0);
+        produced += n;
+        len -= n;
+    }
+}
+
+/**
+ * @brief 建立连接并发送握手，握手分成随机的若干段到达
+ */
+static reply_t connect_client(TelnetConnect_t *conn, const sim_client_t *c)
+{
+    memset(conn, 0, sizeof(*conn));
+    conn->fd = 3;
+    strcpy(conn->ip_str, "192.168.4.2");
+    conn->mode = TELNET_MODE_SESSION;
+    conn->session_hello = true;
+    conn->scrollback = CONFIG_BRIDGE_SCROLLBACK;
+
+    hello_t hello = {.boot = htonl(c->boot), .id = htonl(c->id), .offset = htonl(c->next)};
+    memcpy(hello.magic, "WUS1", 4);
+    const uint8_t *p = (const uint8_t *)&hello;
+    size_t left = sizeof(hello);
+    queued_len = 0;
+    while (left)
+    {
+        CHECK(conn->session_hello);
+        size_t n = 1 + test_rand(&seed) % left;
+        CHECK(telnet_session_proc_hello(conn, p, n) == (int)n);
+        p += n;
+        left -= n;
+    }
+    CHECK(!conn->session_hello);
+    CHECK(queued_len == sizeof(reply_t));
+
+    reply_t reply;
+    memcpy(&reply, queued, sizeof(reply));
+    CHECK(memcmp(reply.magic, "WUS1", 4) == 0);
+    reply.boot = ntohl(reply.boot);
+    reply.id = ntohl(reply.id);
+    reply.offset = ntohl(reply.offset);
+    CHECK(reply.boot != 0 && reply.id == conn->session && reply.offset == conn->cursor.pos);
+    return reply;
+}
+
+static void accept_reply(sim_client_t *c, const reply_t *reply)
+{
+    if (reply->status == TELNET_SESSION_GAP)
+        c->gap += reply->offset - c->next;
+    c->boot = reply->boot;
+    c->id = reply->id;
+    c->next = reply->offset;
+}
+
+/**
+ * @brief 服务器转发至多 budget 字节，其中最后 lost 字节在途中随连接丢失
+ */
+static void forward(TelnetConnect_t *conn, sim_client_t *c, size_t budget, size_t lost)
+{
+    size_t sent = 0;
+    while (sent < budget)
+    {
+        const uint8_t *ptr;
+        size_t n = bridge_ring_peek(&conn->cursor, &ptr);
+        if (n == 0)
+            break;
+        if (n > budget - sent)
+            n = budget - sent;
+        size_t deliver = sent + n <= budget - lost ? n : sent < budget - lost ? budget - lost - sent : 0;
+        for (size_t i = 0; i < deliver; i++)
+        {
+            CHECK(conn->cursor.pos + i == c->next);
+            CHECK(ptr[i] == test_stream_byte(c->next));
+            c->next++;
+        }
+        c->received += deliver;
+        CHECK(bridge_ring_consume(&conn->cursor, n));
+        sent += n;
+    }
+}
+
+static void test_kill_and_resume()
+{
+    bridge_ring_init();
+    produced = 0;
+    produce(3000);
+
+    sim_client_t c = {};
+    TelnetConnect_t conn;
+    reply_t reply = connect_client(&conn, &c);
+    CHECK(reply.status == TELNET_SESSION_NEW && reply.id == 1);
+    CHECK(reply.offset == 0); // 已有数据少于回放长度，从头开始
+    accept_reply(&c, &reply);
+    uint32_t first_id = reply.id;
+
+    uint64_t lost_total = 0;
+    for (int kill = 0; kill < KILLS; kill++)
+    {
+        /* 转发一段，断线时最后一部分已发出的数据没有到达客户端 */
+        produce(test_rand(&seed) % ONLINE_MAX);
+        size_t budget = bridge_ring_lag(&conn.cursor);
+        size_t lost = test_rand(&seed) % (INFLIGHT_MAX + 1);
+        if (lost > budget)
+            lost = budget;
+        forward(&conn, &c, budget, lost);
+        lost_total += lost;
+
+        /* 断线期间串口继续输出，不超过环形缓冲区容量 */
+        produce(test_rand(&seed) % (bridge_ring_capacity() - INFLIGHT_MAX - ONLINE_MAX));
+        reply = connect_client(&conn, &c);
+        CHECK(reply.status == TELNET_SESSION_RESUMED);
+        CHECK(reply.id == first_id && reply.offset == c.next);
+        accept_reply(&c, &reply);
+    }
+    forward(&conn, &c, SIZE_MAX, 0);
+    CHECK(c.next == produced && c.gap == 0);
+    CHECK(c.received == produced); // 每个字节恰好收到一次
+    printf("kill and resume: %d kills, %" PRIu32 " bytes streamed, %" PRIu64 " in-flight bytes lost and resent, "
+           "0 duplicated, 0 missing\n",
+           KILLS, produced, lost_total);
+}
+
+static void test_gap()
+{
+    sim_client_t c = {};
+    TelnetConnect_t conn;
+    accept_reply(&c, &(reply_t){});
+    reply_t reply = connect_client(&conn, &c);
+    accept_reply(&c, &reply);
+    forward(&conn, &c, SIZE_MAX, 0);
+
+    /* 断线期间的输出超过环形缓冲区，从最早的数据继续并报告缺口 */
+    uint32_t missed = bridge_ring_capacity() + 1000;
+    produce(missed);
+    uint32_t requested = c.next;
+    reply = connect_client(&conn, &c);
+    CHECK(reply.status == TELNET_SESSION_GAP && reply.id == c.id);
+    CHECK(reply.offset == produced - bridge_ring_capacity());
+    accept_reply(&c, &reply);
+    forward(&conn, &c, SIZE_MAX, 0);
+    CHECK(c.next == produced && c.gap == reply.offset - requested);
+    printf("gap: %" PRIu32 " bytes missed offline, resumed at the oldest byte, gap %" PRIu64 " bytes reported\n",
+           missed, c.gap);
+}
+
+static void test_invalid_token()
+{
+    sim_client_t c = {};
+    TelnetConnect_t conn;
+    reply_t first = connect_client(&conn, &c);
+    CHECK(first.status == TELNET_SESSION_NEW);
+
+    /* 上次启动的令牌 */
+    c = (sim_client_t){.boot = first.boot ^ 2, .id = first.id, .next = produced};
+    reply_t reply = connect_client(&conn, &c);
+    CHECK(reply.status == TELNET_SESSION_NEW && reply.id == first.id + 1 && reply.boot == first.boot);
+
+    /* 尚未分配的会话号 */
+    c = (sim_client_t){.boot = first.boot, .id = reply.id + 10, .next = produced};
+    reply = connect_client(&conn, &c);
+    CHECK(reply.status == TELNET_SESSION_NEW);
+
+    /* 新会话从回放长度处开始 */
+    CHECK(reply.offset == produced - CONFIG_BRIDGE_SCROLLBACK);
+
+    /* 错误的握手 */
+    memset(&conn, 0, sizeof(conn));
+    conn.session_hello = true;
+    static const uint8_t bad[sizeof(hello_t)] = "HTTP/1.1 GET /";
+    CHECK(telnet_session_proc_hello(&conn, bad, sizeof(bad)) == -1);
+}
+
+int main()
+{
+    test_kill_and_resume();
+    test_gap();
+    test_invalid_token();
+    puts("ok");
+    return 0;
+}
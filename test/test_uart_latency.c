@@ -0,0 +1,271 @@
+/*
+ * 串口到网络的转发延迟对比，伪终端充当串口：
+ *   select: 一个循环同时等待串口与唤醒描述符，读到数据后直接发送，即现在的 telnet_srv
+ *   tasks:  读串口的线程把数据放入缓冲区并唤醒发送循环，即原来的 uart_event_task 加 telnet_srv
+ * 所有线程绑定在同一个 CPU 上，模拟单核的 C3。
+ */
+#define _GNU_SOURCE
+#include "test.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define SAMPLES 5000
+#define INTERVAL_US 200
+#define SKIP_RETURN_CODE 77
+
+typedef enum
+{
+    MODE_SELECT,
+    MODE_TASKS,
+} bridge_mode_t;
+
+static const char *const mode_names[] = {"select", "tasks"};
+
+typedef struct
+{
+    int uart;   // 伪终端从端，相当于 /dev/uart/1
+    int sock;   // socketpair 的一端，相当于客户端连接
+    int wake;   // eventfd，相当于 wake_fd
+    atomic_bool stop;
+
+    /* tasks 模式中读线程与发送循环之间的缓冲区，相当于驱动队列加静态缓冲区 */
+    pthread_mutex_t lock;
+    uint8_t buf[1024];
+    size_t buf_len;
+} bridge_t;
+
+static void pin_cpu()
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(0, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+static void send_all(int fd, const uint8_t *data, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = send(fd, data, len, 0);
+        CHECK(n > 0);
+        data += n;
+        len -= n;
+    }
+}
+
+static void *select_loop(void *arg)
+{
+    bridge_t *b = arg;
+    uint8_t buf[1024];
+    while (!atomic_load(&b->stop))
+    {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(b->uart, &rfds);
+        FD_SET(b->wake, &rfds);
+        int maxfd = b->uart > b->wake ? b->uart : b->wake;
+        if (select(maxfd + 1, &rfds, NULL, NULL, NULL) <= 0)
+            continue;
+        if (FD_ISSET(b->wake, &rfds))
+        {
+            uint64_t v;
+            CHECK(read(b->wake, &v, sizeof(v)) == sizeof(v));
+        }
+        if (FD_ISSET(b->uart, &rfds))
+        {
+            ssize_t n = read(b->uart, buf, sizeof(buf));
+            if (n > 0)
+                send_all(b->sock, buf, n);
+        }
+    }
+    return NULL;
+}
+
+static void *uart_task(void *arg)
+{
+    bridge_t *b = arg;
+    uint8_t buf[1024];
+    while (!atomic_load(&b->stop))
+    {
+        /* 阻塞读取，相当于等待驱动事件后 uart_read_bytes */
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(b->uart, &rfds);
+        struct timeval tv = {.tv_usec = 100000};
+        if (select(b->uart + 1, &rfds, NULL, NULL, &tv) <= 0)
+            continue;
+        ssize_t n = read(b->uart, buf, sizeof(buf));
+        if (n <= 0)
+            continue;
+        pthread_mutex_lock(&b->lock);
+        if (n > (ssize_t)(sizeof(b->buf) - b->buf_len))
+            n = sizeof(b->buf) - b->buf_len;
+        memcpy(b->buf + b->buf_len, buf, n);
+        b->buf_len += n;
+        pthread_mutex_unlock(&b->lock);
+        uint64_t one = 1;
+        CHECK(write(b->wake, &one, sizeof(one)) == sizeof(one));
+    }
+    return NULL;
+}
+
+static void *sender_loop(void *arg)
+{
+    bridge_t *b = arg;
+    uint8_t buf[1024];
+    while (!atomic_load(&b->stop))
+    {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(b->wake, &rfds);
+        if (select(b->wake + 1, &rfds, NULL, NULL, NULL) <= 0)
+            continue;
+        uint64_t v;
+        CHECK(read(b->wake, &v, sizeof(v)) == sizeof(v));
+        pthread_mutex_lock(&b->lock);
+        size_t n = b->buf_len;
+        memcpy(buf, b->buf, n);
+        b->buf_len = 0;
+        pthread_mutex_unlock(&b->lock);
+        if (n)
+            send_all(b->sock, buf, n);
+    }
+    return NULL;
+}
+
+typedef struct
+{
+    int fd;
+    int64_t lat[SAMPLES];
+    int count;
+} receiver_t;
+
+/* 每条记录是写入伪终端时的 8 字节时间戳，接收端据此计算延迟 */
+static void *receiver(void *arg)
+{
+    receiver_t *r = arg;
+    uint8_t rec[8];
+    size_t have = 0;
+    while (r->count < SAMPLES)
+    {
+        ssize_t n = recv(r->fd, rec + have, sizeof(rec) - have, 0);
+        CHECK(n > 0);
+        have += n;
+        if (have < sizeof(rec))
+            continue;
+        int64_t sent;
+        memcpy(&sent, rec, sizeof(sent));
+        r->lat[r->count++] = test_now_ns() - sent;
+        have = 0;
+    }
+    return NULL;
+}
+
+static int open_pty(int *slave)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) || unlockpt(master))
+        return -1;
+    *slave = open(ptsname(master), O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (*slave < 0)
+        return -1;
+    struct termios tio;
+    tcgetattr(*slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(*slave, TCSANOW, &tio);
+    tcgetattr(master, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(master, TCSANOW, &tio);
+    return master;
+}
+
+static bool run(bridge_mode_t mode)
+{
+    bridge_t b = {.lock = PTHREAD_MUTEX_INITIALIZER};
+    int master = open_pty(&b.uart);
+    if (master < 0)
+        return false;
+    int sv[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    b.sock = sv[0];
+    b.wake = eventfd(0, 0);
+    CHECK(b.wake >= 0);
+
+    static receiver_t r;
+    r = (receiver_t){.fd = sv[1]};
+    pthread_t threads[2], rx;
+    int nthreads = 0;
+    pthread_create(&rx, NULL, receiver, &r);
+    if (mode == MODE_SELECT)
+    {
+        pthread_create(&threads[nthreads++], NULL, select_loop, &b);
+    }
+    else
+    {
+        pthread_create(&threads[nthreads++], NULL, uart_task, &b);
+        pthread_create(&threads[nthreads++], NULL, sender_loop, &b);
+    }
+
+    /* 目标设备每 INTERVAL_US 输出一条记录 */
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (int i = 0; i < SAMPLES; i++)
+    {
+        next.tv_nsec += INTERVAL_US * 1000;
+        if (next.tv_nsec >= 1000000000)
+        {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        int64_t now = test_now_ns();
+        CHECK(write(master, &now, sizeof(now)) == sizeof(now));
+    }
+    pthread_join(rx, NULL);
+
+    atomic_store(&b.stop, true);
+    uint64_t one = 1;
+    CHECK(write(b.wake, &one, sizeof(one)) == sizeof(one));
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(threads[i], NULL);
+    close(master);
+    close(b.uart);
+    close(b.wake);
+    close(sv[0]);
+    close(sv[1]);
+
+    CHECK(r.count == SAMPLES);
+    qsort(r.lat, SAMPLES, sizeof(r.lat[0]), test_cmp_i64);
+    printf("%-7s %d threads  p50 %6.1f us  p99 %6.1f us  max %7.1f us\n", mode_names[mode], nthreads,
+           r.lat[SAMPLES / 2] / 1e3, r.lat[SAMPLES * 99 / 100] / 1e3, r.lat[SAMPLES - 1] / 1e3);
+    return true;
+}
+
+int main()
+{
+    pin_cpu();
+    printf("pty -> socketpair, %d records every %d us, pinned to one CPU\n", SAMPLES, INTERVAL_US);
+    for (int round = 0; round < 2; round++)
+    {
+        for (bridge_mode_t mode = MODE_SELECT; mode <= MODE_TASKS; mode++)
+        {
+            if (!run(mode))
+            {
+                puts("no pty available, skipped");
+                return SKIP_RETURN_CODE;
+            }
+        }
+    }
+    puts("ok");
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * 唤醒到发送的延迟对比：串口数据提交后经 eventfd 唤醒 telnet_srv，到第一次 send 返回的时间。
+ *   rebuild:    每轮按 8 个客户端槽位重建三个集合，select 超时 300 s，之后逐个槽位检查，即单一所有者之前的循环
+ *   persistent: telnet_fdset 持久集合，无超时，按 select 返回的就绪数量提前结束分发，即现在的循环
+ * 所有线程绑定在同一个 CPU 上，模拟单核的 C3。
+ */
+#define _GNU_SOURCE
+#include "telnet/telnet_fdset.h"
+#include "test.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define CLIENT_MAX 8
+#define SAMPLES 5000
+#define INTERVAL_US 200
+#define SEND_LEN 64
+
+typedef enum
+{
+    LOOP_REBUILD,
+    LOOP_PERSISTENT,
+} loop_mode_t;
+
+static const char *const mode_names[] = {"rebuild", "persistent"};
+
+typedef struct
+{
+    loop_mode_t mode;
+    int wake_fd;
+    int listen_fd; // 只用于占位，与设备上的监听套接字一样出现在集合中
+    int client_fd[CLIENT_MAX];
+    int peer_fd[CLIENT_MAX];
+    bool client_used[FD_SETSIZE];
+    atomic_llong committed; // 串口数据提交时间，0 表示已发送
+    atomic_bool stop;
+    int64_t lat[SAMPLES];
+    int count;
+} server_t;
+
+static void pin_cpu()
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(0, &set);
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+/* 相当于 telnet_flush_pending：把新数据发给每个客户端，记录第一次发送返回的时间 */
+static void flush_pending(server_t *s)
+{
+    int64_t committed = atomic_exchange(&s->committed, 0);
+    if (committed == 0)
+        return;
+    static const uint8_t data[SEND_LEN];
+    for (int i = 0; i < CLIENT_MAX; i++)
+    {
+        CHECK(send(s->client_fd[i], data, sizeof(data), MSG_DONTWAIT) == sizeof(data));
+        if (i == 0 && s->count < SAMPLES)
+            s->lat[s->count++] = test_now_ns() - committed;
+    }
+    /* 测量结束后读走对端的数据，不让发送缓冲区填满 */
+    uint8_t sink[SEND_LEN * 4];
+    for (int i = 0; i < CLIENT_MAX; i++)
+        while (recv(s->peer_fd[i], sink, sizeof(sink), MSG_DONTWAIT) > 0)
+            ;
+}
+
+static void drain_wake(server_t *s)
+{
+    uint64_t count;
+    CHECK(read(s->wake_fd, &count, sizeof(count)) == sizeof(count));
+}
+
+static void *rebuild_loop(void *arg)
+{
+    server_t *s = arg;
+    fd_set rfds, wfds, efds;
+    while (!atomic_load(&s->stop))
+    {
+        struct timeval tv = {.tv_sec = 300, .tv_usec = 0};
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        FD_ZERO(&efds);
+        FD_SET(s->listen_fd, &rfds);
+        FD_SET(s->listen_fd, &efds);
+        FD_SET(s->wake_fd, &rfds);
+        int max_fd = s->listen_fd > s->wake_fd ? s->listen_fd : s->wake_fd;
+        for (int i = 0; i < CLIENT_MAX; i++)
+        {
+            int fd = s->client_fd[i];
+            if (fd > max_fd)
+                max_fd = fd;
+            FD_SET(fd, &rfds);
+            FD_SET(fd, &efds);
+        }
+
+        int retval = select(max_fd + 1, &rfds, &wfds, &efds, &tv);
+        CHECK(retval >= 0);
+        if (retval)
+        {
+            if (FD_ISSET(s->wake_fd, &rfds))
+                drain_wake(s);
+            for (int i = 0; i < CLIENT_MAX; i++)
+            {
+                int fd = s->client_fd[i];
+                CHECK(!FD_ISSET(fd, &rfds) && !FD_ISSET(fd, &wfds) && !FD_ISSET(fd, &efds));
+            }
+        }
+        flush_pending(s);
+    }
+    return NULL;
+}
+
+static void *persistent_loop(void *arg)
+{
+    server_t *s = arg;
+    telnet_fdset_t set;
+    telnet_fdset_init(&set);
+    telnet_fdset_watch(&set, s->listen_fd);
+    telnet_fdset_watch(&set, s->wake_fd);
+    for (int i = 0; i < CLIENT_MAX; i++)
+        telnet_fdset_watch(&set, s->client_fd[i]);
+
+    while (!atomic_load(&s->stop))
+    {
+        fd_set rfds = set.rfds, wfds = set.wfds, efds = set.rfds;
+        int max_fd = set.max_fd;
+        int retval = select(max_fd + 1, &rfds, &wfds, &efds, NULL);
+        CHECK(retval >= 0);
+        for (int fd = 0; fd <= max_fd && retval > 0; fd++)
+        {
+            bool readable = FD_ISSET(fd, &rfds);
+            bool writable = FD_ISSET(fd, &wfds);
+            bool error = FD_ISSET(fd, &efds);
+            if (!readable && !writable && !error)
+                continue;
+            retval -= readable + writable + error;
+            if (fd == s->wake_fd)
+                drain_wake(s);
+            else
+                CHECK(!s->client_used[fd]);
+        }
+        flush_pending(s);
+    }
+    return NULL;
+}
+
+static void run(loop_mode_t mode)
+{
+    static server_t s;
+    memset(&s, 0, sizeof(s));
+    s.mode = mode;
+    s.wake_fd = eventfd(0, 0);
+    CHECK(s.wake_fd >= 0);
+    int listen_pair[2];
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, listen_pair) == 0);
+    s.listen_fd = listen_pair[0];
+    for (int i = 0; i < CLIENT_MAX; i++)
+    {
+        int sv[2];
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        s.client_fd[i] = sv[0];
+        s.peer_fd[i] = sv[1];
+        s.client_used[sv[0]] = true;
+    }
+
+    pthread_t server;
+    pthread_create(&server, NULL, mode == LOOP_REBUILD ? rebuild_loop : persistent_loop, &s);
+
+    /* 每 INTERVAL_US 提交一批串口数据并唤醒，与驱动回调写 wake_fd 相同 */
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    uint64_t one = 1;
+    for (int i = 0; i < SAMPLES; i++)
+    {
+        next.tv_nsec += INTERVAL_US * 1000;
+        if (next.tv_nsec >= 1000000000)
+        {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        atomic_store(&s.committed, test_now_ns());
+        CHECK(write(s.wake_fd, &one, sizeof(one)) == sizeof(one));
+    }
+    /* 等最后一次唤醒处理完再停止 */
+    while (atomic_load(&s.committed) != 0)
+        sched_yield();
+    atomic_store(&s.stop, true);
+    CHECK(write(s.wake_fd, &one, sizeof(one)) == sizeof(one));
+    pthread_join(server, NULL);
+
+    close(s.wake_fd);
+    close(listen_pair[0]);
+    close(listen_pair[1]);
+    for (int i = 0; i < CLIENT_MAX; i++)
+    {
+        close(s.client_fd[i]);
+        close(s.peer_fd[i]);
+    }
+
+    /* 同一时间片内的多次唤醒会合并为一次发送，样本数可能略少 */
+    CHECK(s.count > SAMPLES * 8 / 10);
+    qsort(s.lat, s.count, sizeof(s.lat[0]), test_cmp_i64);
+    printf("%-10s %d clients  n=%d  p50 %6.1f us  p99 %6.1f us  max %7.1f us\n", mode_names[mode], CLIENT_MAX,
+           s.count, s.lat[s.count / 2] / 1e3, s.lat[s.count * 99 / 100] / 1e3, s.lat[s.count - 1] / 1e3);
+}
+
+int main()
+{
+    pin_cpu();
+    printf("eventfd wake -> first send, %d commits every %d us, pinned to one CPU\n", SAMPLES, INTERVAL_US);
+    for (int round = 0; round < 2; round++)
+    {
+        run(LOOP_REBUILD);
+        run(LOOP_PERSISTENT);
+    }
+    puts("ok");
+    return 0;
+}
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""Smoke test for tools/tls_bench.py against a host TLS server set up like the device.
+
+The server uses the bridge's TLS parameters: TLS 1.2 only,
+ECDHE-ECDSA-AES128-GCM-SHA256, a self-signed P-256 certificate and RFC 5077
+session tickets. The test checks that the tool pins the fingerprint, resumes
+with the ticket, negotiates the expected suite and measures a stream. It does
+not run telnet_tls.c, so the timings it prints are not a benchmark of the
+bridge; device numbers come from running tls_bench.py against the bridge.
+
+Exits 77 (skipped) when the openssl command line tool is not available.
+"""
+
+import hashlib
+import os
+import shutil
+import socket
+import ssl
+import subprocess
+import sys
+import tempfile
+import threading
+
+TOOLS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tools")
+SKIP = 77
+CIPHER = "ECDHE-ECDSA-AES128-GCM-SHA256"
+CHUNK = bytes(range(256)) * 4
+
+
+def make_cert(tmp):
+    key = os.path.join(tmp, "key.pem")
+    cert = os.path.join(tmp, "cert.pem")
+    subprocess.run(
+        ["openssl", "ecparam", "-name", "prime256v1", "-genkey", "-noout", "-out", key],
+        check=True,
+        capture_output=True,
+    )
+    subprocess.run(
+        ["openssl", "req", "-new", "-x509", "-key", key, "-out", cert, "-days", "1", "-subj", "/CN=wifi-uart"],
+        check=True,
+        capture_output=True,
+    )
+    return cert, key
+
+
+def serve_client(ctx, conn):
+    try:
+        with ctx.wrap_socket(conn, server_side=True) as tls:
+            while True:
+                tls.sendall(CHUNK)
+    except (OSError, ssl.SSLError):
+        pass
+
+
+def serve(ctx, listener):
+    while True:
+        conn, _ = listener.accept()
+        threading.Thread(target=serve_client, args=(ctx, conn), daemon=True).start()
+
+
+def main():
+    if shutil.which("openssl") is None:
+        print("openssl not found, skipped")
+        return SKIP
+
+    with tempfile.TemporaryDirectory() as tmp:
+        cert, key = make_cert(tmp)
+        ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        ctx.minimum_version = ssl.TLSVersion.TLSv1_2
+        ctx.maximum_version = ssl.TLSVersion.TLSv1_2
+        ctx.set_ciphers(CIPHER)
+        ctx.load_cert_chain(cert, key)
+
+        listener = socket.create_server(("127.0.0.1", 0))
+        port = listener.getsockname()[1]
+        threading.Thread(target=serve, args=(ctx, listener), daemon=True).start()
+
+        with open(cert) as f:
+            der = ssl.PEM_cert_to_DER_cert(f.read())
+        fingerprint = hashlib.sha256(der).hexdigest()
+        result = subprocess.run(
+            [
+                sys.executable,
+                os.path.join(TOOLS, "tls_bench.py"),
+                "127.0.0.1",
+                "--port",
+                str(port),
+                "--fingerprint",
+                fingerprint,
+                "--handshakes",
+                "3",
+                "--duration",
+                "0.5",
+            ],
+            capture_output=True,
+            text=True,
+        )
+    sys.stdout.write(result.stdout)
+    sys.stderr.write(result.stderr)
+    if result.returncode != 0:
+        return 1
+    for expected in ("full handshake", "resumed handshake", "TLSv1.2 " + CIPHER, "throughput"):
+        if expected not in result.stdout:
+            print("missing %r in tls_bench output" % expected, file=sys.stderr)
+            return 1
+    if "not resumed" in result.stderr:
+        return 1
+    print("ok")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""Run console commands on one or more bridges over the network console port.
+
+Usage:
+    console_client.py HOST [HOST ...] -c COMMAND [-c COMMAND ...] [--port 8883] [--password PW]
+
+Commands are sent to every host in parallel, in the given order on each
+connection, and each host's output is printed prefixed with its name. The
+device sends the prompt "#" after each command, which marks the end of its
+output. Without -c, an interactive session is opened to the single HOST.
+"""
+
+import argparse
+import concurrent.futures
+import socket
+import sys
+import threading
+
+PROMPT = b"#"
+
+
+class Console:
+    def __init__(self, host, port, password=None, timeout=10):
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buf = b""
+        if password is not None:
+            self.read_until(b"password: ")
+            self.sock.sendall(password.encode() + b"\n")
+        self.read_prompt()
+
+    def read_until(self, marker):
+        while not self.buf.endswith(marker):
+            data = self.sock.recv(4096)
+            if not data:
+                raise ConnectionError(self.buf.decode(errors="replace").strip() or "connection closed")
+            self.buf += data
+        out, self.buf = self.buf[: -len(marker)], b""
+        return out
+
+    def read_prompt(self):
+        # the prompt follows a complete line of output, or stands alone
+        out = self.read_until(PROMPT)
+        while out and not out.endswith(b"\n"):
+            out += PROMPT + self.read_until(PROMPT)
+        return out
+
+    def run(self, command):
+        self.sock.sendall(command.encode() + b"\n")
+        return self.read_prompt().decode(errors="replace")
+
+    def close(self):
+        self.sock.close()
+
+
+def run_host(host, args, lock):
+    try:
+        console = Console(host, args.port, args.password)
+        for command in args.command:
+            out = console.run(command)
+            with lock:
+                for line in out.splitlines() or [""]:
+                    print("%s: %s" % (host, line))
+        console.close()
+        return True
+    except (OSError, ConnectionError) as e:
+        with lock:
+            print("%s: error: %s" % (host, e), file=sys.stderr)
+        return False
+
+
+def interactive(host, args):
+    console = Console(host, args.port, args.password, timeout=None)
+    try:
+        while True:
+            command = input("%s# " % host)
+            sys.stdout.write(console.run(command))
+    except (EOFError, KeyboardInterrupt):
+        print()
+    finally:
+        console.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("hosts", nargs="+")
+    parser.add_argument("-c", "--command", action="append", help="command to run, may be repeated")
+    parser.add_argument("--port", type=int, default=8883)
+    parser.add_argument("--password")
+    parser.add_argument("--jobs", type=int, default=64, help="hosts handled in parallel")
+    args = parser.parse_args()
+
+    if not args.command:
+        if len(args.hosts) != 1:
+            parser.error("interactive mode takes a single host")
+        interactive(args.hosts[0], args)
+        return
+
+    lock = threading.Lock()
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        results = list(pool.map(lambda h: run_host(h, args, lock), args.hosts))
+    failed = results.count(False)
+    if failed:
+        sys.exit("%d of %d hosts failed" % (failed, len(results)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""Decode the binary log ring exported at /log into text.
+
+Usage:
+    log_decode.py ELF SOURCE [--no-color]
+
+SOURCE is a file saved from http://DEVICE/log or the URL itself. The device
+stores only the address of each format string, so the firmware ELF that is
+running on the device is needed to look them up; a warning is printed when
+its SHA-256 does not match the one in the export.
+"""
+
+import argparse
+import hashlib
+import re
+import struct
+import sys
+import urllib.request
+
+MAGIC = 0x31524C57
+EXPORT = struct.Struct("<IHH32s")
+RECORD = struct.Struct("<HHII")
+SPEC = re.compile(rb"%([-+ #0]*[0-9.]*)(hh|h|ll|l|j|z|t)?([diuxXocfFeEgGaAps%])")
+COLOR = re.compile(rb"\x1b\[[0-9;]*m")
+
+
+class Elf:
+    """Allocated sections of a 32-bit little-endian ELF, enough to read strings."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        self.sha256 = hashlib.sha256(self.data).digest()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1:
+            sys.exit("%s is not a 32-bit ELF file" % path)
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+        self.sections = []
+        for i in range(shnum):
+            _, sh_type, flags, addr, offset, size = struct.unpack_from("<IIIIII", self.data, shoff + i * shentsize)
+            # SHT_NOBITS has no file contents, SHF_ALLOC sections are in the image
+            if sh_type != 8 and flags & 2 and size:
+                self.sections.append((addr, offset, size))
+
+    def string(self, addr):
+        for start, offset, size in self.sections:
+            if start <= addr < start + size:
+                pos = offset + addr - start
+                end = self.data.index(b"\0", pos)
+                return self.data[pos:end]
+        return None
+
+
+def fetch(source):
+    if source.startswith(("http://", "https://")):
+        with urllib.request.urlopen(source, timeout=10) as resp:
+            return resp.read()
+    with open(source, "rb") as f:
+        return f.read()
+
+
+def format_record(fmt, args):
+    """Format one record the way the device's drain task does."""
+    out = []
+    pos = 0
+    apos = 0
+    for m in SPEC.finditer(fmt):
+        out.append(fmt[pos : m.start()])
+        pos = m.end()
+        flags, length, conv = m.group(1).decode(), m.group(2), m.group(3)
+        if conv == b"%":
+            out.append(b"%")
+            continue
+        if conv == b"s":
+            n = args[apos]
+            value = args[apos + 1 : apos + 1 + n].decode("utf-8", "replace")
+            apos += 1 + n
+        elif conv in b"fFeEgGaA":
+            value, = struct.unpack_from("<d", args, apos)
+            apos += 8
+        else:
+            size = 8 if length in (b"ll", b"j") else 4
+            signed = conv in b"di"
+            value, = struct.unpack_from("<" + ("q" if size == 8 else "i" if signed else "I"), args, apos)
+            if size == 8 and not signed:
+                value &= (1 << 64) - 1
+            apos += size
+        if conv == b"p":
+            text = "0x%x" % value
+        elif conv in b"aA":
+            text = float.hex(value)
+        elif conv == b"c":
+            text = ("%" + flags + "c") % chr(value & 0xFF)
+        else:
+            text = ("%" + flags + conv.decode().replace("u", "d")) % value
+        out.append(text.encode("utf-8", "replace"))
+    out.append(fmt[pos:])
+    return b"".join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("elf", help="firmware ELF file, e.g. build/<project>.elf")
+    parser.add_argument("source", help="exported file or http://DEVICE/log")
+    parser.add_argument("--no-color", action="store_true", help="strip ANSI color codes")
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    data = fetch(args.source)
+    magic, version, hdr_len, sha256 = EXPORT.unpack_from(data)
+    if magic != MAGIC:
+        sys.exit("not a log ring export")
+    if version != 1:
+        print("warning: unknown export version %d" % version, file=sys.stderr)
+    if sha256 != elf.sha256:
+        print("warning: ELF SHA-256 differs from the running firmware", file=sys.stderr)
+
+    out = sys.stdout.buffer
+    pos = hdr_len
+    while pos + RECORD.size <= len(data):
+        length, lost, fmt_addr, time_ms = RECORD.unpack_from(data, pos)
+        if length < RECORD.size or pos + length > len(data):
+            print("warning: truncated record at offset %d" % pos, file=sys.stderr)
+            break
+        rec_args = data[pos + RECORD.size : pos + length]
+        pos += length
+        if lost:
+            out.write(b"(%d log messages lost)\n" % lost)
+        fmt = elf.string(fmt_addr)
+        if fmt is None:
+            line = b"(%d) <unknown format 0x%08x>\n" % (time_ms, fmt_addr)
+        else:
+            try:
+                line = format_record(fmt, rec_args)
+            except (struct.error, IndexError, TypeError, ValueError):
+                line = b"(%d) <bad arguments for %r>\n" % (time_ms, fmt)
+        if args.no_color:
+            line = COLOR.sub(b"", line)
+        out.write(line)
+
+
+if __name__ == "__main__":
+    main()
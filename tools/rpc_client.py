@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""Get and set device parameters with the binary RPC protocol in one round trip.
+
+Usage:
+    rpc_client.py HOST [--port 8883] [--password PW] [NAME | NAME=VALUE ...]
+
+Each NAME reads a parameter and each NAME=VALUE sets it; all of them go out in
+a single request and the reply lists the resulting values in the same order.
+Without arguments every readable parameter is shown. Example:
+
+    rpc_client.py 192.168.4.1 baud=921600 data_bits=8 parity=none stop_bits=1 name=line3 battery
+
+The request is sent on the network console port. Over BLE the same message is
+carried as BLUFI custom data without the 3-byte length prefix.
+"""
+
+import argparse
+import ipaddress
+import random
+import socket
+import struct
+import sys
+
+MAGIC = 0xA5
+VERSION = 1
+SET = 0x80
+TAG_ERROR = 0x00
+
+PARITY = {"none": 0, "even": 2, "odd": 3}
+STOP_BITS = {"1": 1, "1.5": 2, "2": 3}
+FLOW = {"none": 0, "rtscts": 1, "xonxoff": 2}
+
+
+def enum(table):
+    names = {v: k for k, v in table.items()}
+    return (lambda s: bytes([table[s.lower()]]), lambda b: names.get(b[0], b[0]))
+
+
+def uint(fmt):
+    return (lambda s: struct.pack(fmt, int(s, 0)), lambda b: struct.unpack(fmt, b)[0])
+
+
+def string():
+    return (lambda s: s.encode(), lambda b: b.decode(errors="replace"))
+
+
+def ip_info(b):
+    addrs = [str(ipaddress.IPv4Address(b[i : i + 4])) for i in range(0, 12, 4)]
+    return "inet %s netmask %s gw %s" % tuple(addrs)
+
+
+# name: (tag, encoder for set or None, decoder or None for set-only)
+PARAMS = {
+    "baud": (0x01,) + uint("<I"),
+    "data_bits": (0x02,) + uint("<B"),
+    "stop_bits": (0x03,) + enum(STOP_BITS),
+    "parity": (0x04,) + enum(PARITY),
+    "flow": (0x05,) + enum(FLOW),
+    "name": (0x10,) + string(),
+    "ssid": (0x11,) + string(),
+    "password": (0x12, string()[0], None),
+    "connect": (0x13, lambda s: b"", None),
+    "battery": (0x20, None, lambda b: "%.1f%%" % (struct.unpack("<H", b)[0] / 10)),
+    "voltage": (0x21, None, lambda b: "%dmV" % struct.unpack("<H", b)[0]),
+    "charging": (0x22, None, lambda b: bool(b[0])),
+    "ip": (0x30, None, ip_info),
+    "version": (0x31, None, lambda b: b.decode(errors="replace")),
+}
+NAMES = {p[0]: name for name, p in PARAMS.items()}
+
+
+def build_request(items, req_id):
+    body = bytearray([MAGIC, VERSION]) + struct.pack("<H", req_id)
+    for item in items:
+        name, sep, value = item.partition("=")
+        if name not in PARAMS:
+            sys.exit("unknown parameter %s, known: %s" % (name, " ".join(PARAMS)))
+        tag, encode, decode = PARAMS[name]
+        if sep or decode is None:
+            if encode is None:
+                sys.exit("%s is read-only" % name)
+            data = encode(value)
+            body += bytes([tag | SET, len(data)]) + data
+        else:
+            body += bytes([tag, 0])
+    return bytes(body)
+
+
+def parse_response(resp, req_id):
+    if len(resp) < 4 or resp[0] != MAGIC or resp[1] != VERSION:
+        raise ValueError("bad response header")
+    if struct.unpack_from("<H", resp, 2)[0] != req_id:
+        raise ValueError("response id mismatch")
+    pos = 4
+    while pos + 2 <= len(resp):
+        tag, length = resp[pos], resp[pos + 1]
+        value = resp[pos + 2 : pos + 2 + length]
+        pos += 2 + length
+        if tag == TAG_ERROR:
+            failed, err = struct.unpack("<Bi", value)
+            yield NAMES.get(failed, "0x%02x" % failed), "error 0x%x" % err
+            continue
+        name = NAMES.get(tag, "0x%02x" % tag)
+        decode = PARAMS[name][2] if name in PARAMS else None
+        if not value:
+            yield name, '""' if name in ("name", "ssid") else "ok"
+        else:
+            yield name, decode(value) if decode else value.hex()
+
+
+def recv_exact(sock, n):
+    data = b""
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError("connection closed")
+        data += chunk
+    return data
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("params", nargs="*", help="NAME to read, NAME=VALUE to set")
+    parser.add_argument("--port", type=int, default=8883)
+    parser.add_argument("--password")
+    args = parser.parse_args()
+
+    items = args.params or [n for n, p in PARAMS.items() if p[2] is not None]
+    req_id = random.randrange(0x10000)
+    request = build_request(items, req_id)
+
+    sock = socket.create_connection((args.host, args.port), timeout=10)
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    if args.password is not None:
+        sock.sendall(args.password.encode() + b"\n")
+    # the prompt that greets text sessions is skipped, the reply starts at the magic byte
+    sock.sendall(bytes([MAGIC]) + struct.pack("<H", len(request)) + request)
+    while recv_exact(sock, 1)[0] != MAGIC:
+        pass
+    length = struct.unpack("<H", recv_exact(sock, 2))[0]
+    resp = recv_exact(sock, length)
+    sock.close()
+    if not resp:
+        sys.exit("device rejected the request")
+
+    for name, value in parse_response(resp, req_id):
+        print("%-10s %s" % (name, value))
+
+
+if __name__ == "__main__":
+    main()
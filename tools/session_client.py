@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""Resumable session client: keep receiving UART output across dropped connections.
+
+Usage:
+    session_client.py HOST [--port 8881] [--output FILE] [--state FILE] [--kill-interval SECONDS]
+
+The client sends a hello with its session token and the stream offset of the
+next byte it wants. After a dropped connection it reconnects with the same
+token and offset, and the device retransmits exactly the missed bytes from its
+ring buffer. If they have already been overwritten the gap size is reported.
+With --state the token and offset are also kept across client restarts.
+
+Lines typed on stdin are sent to the UART. Input is not resumable: anything
+sent while the connection was dropping may be lost.
+
+--kill-interval aborts the connection with a RST at random intervals (mean of
+the given seconds) to exercise resuming. To check that the stream is byte-exact,
+run a second client without it and compare both output files, e.g.
+
+    session_client.py dev --output a.bin --kill-interval 2 &
+    session_client.py dev --output b.bin &
+    ... ; cmp a.bin b.bin
+"""
+
+import argparse
+import json
+import random
+import select
+import socket
+import struct
+import sys
+import time
+
+MAGIC = b"WUS1"
+HELLO = struct.Struct("!4sIII")
+REPLY = struct.Struct("!4sB3xIII")
+STATUS_RESUMED = 0
+STATUS_NEW = 1
+STATUS_GAP = 2
+
+
+def log(msg):
+    print(msg, file=sys.stderr, flush=True)
+
+
+def recv_exact(sock, n):
+    data = b""
+    while len(data) < n:
+        chunk = sock.recv(n - len(data))
+        if not chunk:
+            raise ConnectionError("connection closed during hello")
+        data += chunk
+    return data
+
+
+class Session:
+    def __init__(self, state_path=None):
+        self.state_path = state_path
+        self.boot = 0
+        self.id = 0
+        self.offset = 0
+        if state_path:
+            try:
+                with open(state_path) as f:
+                    state = json.load(f)
+                self.boot, self.id, self.offset = state["boot"], state["id"], state["offset"]
+            except (OSError, ValueError, KeyError):
+                pass
+
+    def save(self):
+        if self.state_path:
+            with open(self.state_path, "w") as f:
+                json.dump({"boot": self.boot, "id": self.id, "offset": self.offset}, f)
+
+    def connect(self, host, port):
+        sock = socket.create_connection((host, port), timeout=5)
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        sock.sendall(HELLO.pack(MAGIC, self.boot, self.id, self.offset))
+        magic, status, boot, sid, offset = REPLY.unpack(recv_exact(sock, REPLY.size))
+        if magic != MAGIC:
+            raise ConnectionError("not a session port")
+        sock.settimeout(None)
+
+        if status == STATUS_RESUMED:
+            log("resumed session %d at offset %d" % (sid, offset))
+        elif status == STATUS_GAP:
+            log("resumed session %d, %d bytes lost" % (sid, (offset - self.offset) & 0xFFFFFFFF))
+        elif self.id:
+            log("session %d expired (device restarted?), new session %d" % (self.id, sid))
+        else:
+            log("new session %d at offset %d" % (sid, offset))
+        self.boot, self.id, self.offset = boot, sid, offset
+        self.save()
+        return sock
+
+
+def abort(sock):
+    """Close with a RST, like a connection lost while roaming."""
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack("ii", 1, 0))
+    sock.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=8881)
+    parser.add_argument("--output", default="-", help="write received data to this file ('-' for stdout)")
+    parser.add_argument("--state", help="keep the session token and offset in this file")
+    parser.add_argument("--kill-interval", type=float, default=0, help="abort the connection at random intervals")
+    args = parser.parse_args()
+
+    session = Session(args.state)
+    out = sys.stdout.buffer if args.output == "-" else open(args.output, "ab" if args.state else "wb")
+    inputs = [] if args.kill_interval or not sys.stdin or sys.stdin.closed else [sys.stdin.buffer]
+    received = 0
+    kills = 0
+    backoff = 0.2
+    try:
+        while True:
+            try:
+                sock = session.connect(args.host, args.port)
+            except (OSError, ConnectionError) as e:
+                log("connect failed: %s, retry in %.1fs" % (e, backoff))
+                time.sleep(backoff)
+                backoff = min(backoff * 2, 5.0)
+                continue
+            backoff = 0.2
+            kill_at = time.monotonic() + random.expovariate(1 / args.kill_interval) if args.kill_interval else None
+
+            try:
+                while True:
+                    timeout = max(kill_at - time.monotonic(), 0) if kill_at else None
+                    readable, _, _ = select.select([sock] + inputs, [], [], timeout)
+                    if kill_at and time.monotonic() >= kill_at:
+                        kills += 1
+                        abort(sock)
+                        break
+                    if sys.stdin.buffer in readable:
+                        line = sys.stdin.buffer.readline()
+                        if not line:
+                            inputs = []
+                        else:
+                            sock.sendall(line)
+                    if sock in readable:
+                        data = sock.recv(65536)
+                        if not data:
+                            raise ConnectionError("closed by device")
+                        out.write(data)
+                        out.flush()
+                        received += len(data)
+                        session.offset = (session.offset + len(data)) & 0xFFFFFFFF
+            except (OSError, ConnectionError) as e:
+                log("connection lost: %s" % e)
+                sock.close()
+            session.save()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        session.save()
+        log("received %d bytes, %d forced disconnects" % (received, kills))
+        if out is not sys.stdout.buffer:
+            out.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+"""Minimal SNTP server answering from the host clock, for testing without internet.
+
+Usage:
+    sntp_server.py [--bind 0.0.0.0] [--port 123]
+
+Point CONFIG_BRIDGE_SNTP_SERVER at this host. The device always queries port
+123, so the server usually needs root or CAP_NET_BIND_SERVICE. It replies as a
+stratum 2 server; the host should itself be synced if absolute latency figures
+from udp_receiver.py are to be trusted.
+"""
+
+import argparse
+import socket
+import struct
+import time
+
+NTP_EPOCH_OFFSET = 2208988800  # seconds from 1900-01-01 to 1970-01-01
+PACKET = struct.Struct("!BBbbII4sQQQQ")
+
+
+def ntp_time(t):
+    sec = int(t)
+    frac = int((t - sec) * (1 << 32))
+    return ((sec + NTP_EPOCH_OFFSET) << 32) | frac
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=123)
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.bind, args.port))
+    print("sntp server on %s:%d" % (args.bind, args.port))
+    while True:
+        data, addr = sock.recvfrom(512)
+        receive = time.time()
+        if len(data) < PACKET.size:
+            continue
+        first, _, poll, _, _, _, _, _, _, _, transmit = PACKET.unpack_from(data)
+        version = (first >> 3) & 0x7
+        if first & 0x7 != 3:  # only answer client requests
+            continue
+        reply = PACKET.pack(
+            (version << 3) | 4,  # LI 0, same version, mode 4 (server)
+            2,  # stratum
+            poll,
+            -20,  # precision, about 1us
+            0,  # root delay
+            0,  # root dispersion
+            b"LOCL",
+            ntp_time(receive),  # reference timestamp
+            transmit,  # originate = client's transmit timestamp
+            ntp_time(receive),
+            ntp_time(time.time()),
+        )
+        sock.sendto(reply, addr)
+        print("%s: replied" % addr[0], flush=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""TLS bridge benchmark: full and resumed handshake time, sustained throughput.
+
+Usage:
+    tls_bench.py HOST [--port 8882] [--fingerprint HEX] [--handshakes 10] [--duration 10] [--output FILE]
+
+Handshake times are measured from TCP connect to the end of the TLS handshake,
+first without and then with the session ticket from the previous connection.
+Throughput is the rate of decrypted bridge data received over --duration
+seconds, so the UART needs a source faster than the link, e.g. a target
+printing continuously at a high baud rate.
+
+The device uses a self-signed certificate. Pass the SHA-256 fingerprint shown
+by the `clients` console command to --fingerprint to pin it; without it the
+fingerprint is only printed.
+"""
+
+import argparse
+import hashlib
+import socket
+import ssl
+import sys
+import time
+
+
+def make_context():
+    ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    ctx.check_hostname = False
+    ctx.verify_mode = ssl.CERT_NONE
+    # the device speaks TLS 1.2, where resumption uses RFC 5077 session tickets
+    ctx.maximum_version = ssl.TLSVersion.TLSv1_2
+    return ctx
+
+
+def connect(ctx, host, port, session=None):
+    start = time.perf_counter()
+    raw = socket.create_connection((host, port), timeout=10)
+    sock = ctx.wrap_socket(raw, session=session)
+    elapsed = time.perf_counter() - start
+    return sock, elapsed
+
+
+def check_fingerprint(sock, expected):
+    der = sock.getpeercert(binary_form=True)
+    fingerprint = hashlib.sha256(der).hexdigest().upper()
+    pretty = ":".join(fingerprint[i : i + 2] for i in range(0, len(fingerprint), 2))
+    if expected and expected.replace(":", "").upper() != fingerprint:
+        sys.exit("certificate fingerprint mismatch: %s" % pretty)
+    return pretty
+
+
+def summary(name, samples):
+    samples = sorted(samples)
+    print(
+        "%-18s n=%d min %.1fms avg %.1fms max %.1fms"
+        % (name, len(samples), samples[0] * 1000, sum(samples) / len(samples) * 1000, samples[-1] * 1000)
+    )
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=8882)
+    parser.add_argument("--fingerprint", help="expected certificate SHA-256 fingerprint")
+    parser.add_argument("--handshakes", type=int, default=10, help="handshakes of each kind to measure")
+    parser.add_argument("--duration", type=float, default=10.0, help="throughput measurement time in seconds")
+    parser.add_argument("--output", help="write received data to this file")
+    args = parser.parse_args()
+
+    ctx = make_context()
+    full = []
+    resumed = []
+    session = None
+    for _ in range(args.handshakes):
+        sock, elapsed = connect(ctx, args.host, args.port)
+        pretty = check_fingerprint(sock, args.fingerprint)
+        full.append(elapsed)
+        session = sock.session
+        sock.close()
+    print("certificate sha256 %s" % pretty)
+
+    for _ in range(args.handshakes):
+        sock, elapsed = connect(ctx, args.host, args.port, session)
+        if not sock.session_reused:
+            print("warning: session was not resumed", file=sys.stderr)
+        else:
+            resumed.append(elapsed)
+        session = sock.session
+        sock.close()
+
+    summary("full handshake", full)
+    if resumed:
+        summary("resumed handshake", resumed)
+
+    if args.duration <= 0:
+        return
+    sock, _ = connect(ctx, args.host, args.port, session)
+    print("cipher %s %s" % (sock.version(), sock.cipher()[0]))
+    out = open(args.output, "wb") if args.output else None
+    total = 0
+    start = time.perf_counter()
+    deadline = start + args.duration
+    sock.settimeout(0.5)
+    while time.perf_counter() < deadline:
+        try:
+            data = sock.recv(65536)
+        except socket.timeout:
+            continue
+        if not data:
+            print("connection closed by device", file=sys.stderr)
+            break
+        total += len(data)
+        if out:
+            out.write(data)
+    elapsed = time.perf_counter() - start
+    sock.close()
+    if out:
+        out.close()
+    print("throughput %.1f KB/s (%d bytes in %.1fs)" % (total / elapsed / 1024, total, elapsed))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""Receive the bridge UDP stream, detect gaps and report loss and latency.
+
+Usage:
+    udp_receiver.py [--group 239.255.43.21] [--port PORT] [--output FILE] [--interval 5]
+
+The datagram header is described in main/bridge/bridge_udp.h. The device
+timestamp is the UART receive time in microseconds. Before the device has
+synced over SNTP it counts from boot, so latency is reported relative to the
+fastest datagram seen (one-way delay jitter). Once the device sets the
+UNIX_TIME flag the absolute one-way latency is reported, which is only
+meaningful if this host is synced to the same time source.
+"""
+
+import argparse
+import ipaddress
+import socket
+import struct
+import sys
+import time
+
+HEADER = struct.Struct("!HBBIIII")
+MAGIC = 0x5755
+VERSION = 1
+FLAG_OVERRUN = 0x01
+FLAG_UNIX_TIME = 0x02
+
+
+class Stats:
+    def __init__(self):
+        self.datagrams = 0
+        self.bytes = 0
+        self.lost_datagrams = 0
+        self.lost_bytes = 0
+        self.reordered = 0
+        self.overruns = 0
+        self.delay_min = None
+        self.delays = []
+        self.unix_time = False
+
+    def report(self, out):
+        line = "datagrams %d bytes %d lost %d datagrams / %d bytes, reordered %d, device overruns %d" % (
+            self.datagrams,
+            self.bytes,
+            self.lost_datagrams,
+            self.lost_bytes,
+            self.reordered,
+            self.overruns,
+        )
+        if self.delays:
+            base = 0 if self.unix_time else self.delay_min
+            rel = sorted(d - base for d in self.delays)
+            line += ", %s: avg %.0fus p99 %.0fus max %.0fus" % (
+                "one-way latency" if self.unix_time else "latency over min",
+                sum(rel) / len(rel),
+                rel[int(len(rel) * 0.99)],
+                rel[-1],
+            )
+            self.delays.clear()
+        print(line, file=out, flush=True)
+
+
+def open_socket(group, port):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(("", port))
+    if group and ipaddress.ip_address(group).is_multicast:
+        mreq = struct.pack("4s4s", socket.inet_aton(group), socket.inet_aton("0.0.0.0"))
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_ADD_MEMBERSHIP, mreq)
+    return sock
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--group", default="239.255.43.21", help="multicast group to join, empty for unicast")
+    parser.add_argument("--port", type=int, required=True)
+    parser.add_argument("--output", help="write the received UART data to this file ('-' for stdout)")
+    parser.add_argument("--interval", type=float, default=5.0, help="report interval in seconds")
+    args = parser.parse_args()
+
+    sock = open_socket(args.group, args.port)
+    out = None
+    if args.output == "-":
+        out = sys.stdout.buffer
+    elif args.output:
+        out = open(args.output, "wb")
+
+    stats = Stats()
+    next_seq = None
+    next_offset = None
+    next_report = time.monotonic() + args.interval
+    sock.settimeout(args.interval)
+    try:
+        while True:
+            try:
+                data = sock.recv(2048)
+            except socket.timeout:
+                data = None
+
+            if data and len(data) >= HEADER.size:
+                magic, version, flags, seq, offset, ts_hi, ts_lo = HEADER.unpack_from(data)
+                unix_time = bool(flags & FLAG_UNIX_TIME)
+                now_us = (time.time_ns() if unix_time else time.monotonic_ns()) // 1000
+                payload = data[HEADER.size:]
+                if magic != MAGIC or version != VERSION:
+                    continue
+
+                if next_seq is not None:
+                    gap = (seq - next_seq) & 0xFFFFFFFF
+                    if gap & 0x80000000:
+                        stats.reordered += 1
+                        continue
+                    stats.lost_datagrams += gap
+                    stats.lost_bytes += (offset - next_offset) & 0xFFFFFFFF
+                if flags & FLAG_OVERRUN:
+                    stats.overruns += 1
+                next_seq = (seq + 1) & 0xFFFFFFFF
+                next_offset = (offset + len(payload)) & 0xFFFFFFFF
+
+                stats.datagrams += 1
+                stats.bytes += len(payload)
+                if unix_time != stats.unix_time:
+                    # the device clock base changed, earlier delays are not comparable
+                    stats.unix_time = unix_time
+                    stats.delay_min = None
+                    stats.delays.clear()
+                delay = now_us - ((ts_hi << 32) | ts_lo)
+                stats.delay_min = delay if stats.delay_min is None else min(stats.delay_min, delay)
+                stats.delays.append(delay)
+                if out:
+                    out.write(payload)
+
+            if time.monotonic() >= next_report:
+                stats.report(sys.stderr)
+                next_report = time.monotonic() + args.interval
+    except KeyboardInterrupt:
+        stats.report(sys.stderr)
+    finally:
+        if out and out is not sys.stdout.buffer:
+            out.close()
+
+
+if __name__ == "__main__":
+    main()
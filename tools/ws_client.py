@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""WebSocket terminal test client: measure frame rate and end-to-end latency.
+
+Usage:
+    ws_client.py HOST [--port 80] [--path /ws] [--interval 5] [--probe-rate 10]
+
+Without --probe-rate the client only listens and reports frames/s, bytes/s
+and the average frame size. With --probe-rate N it also sends N probes per
+second and measures the round trip, which needs the UART TX and RX pins
+connected to each other on the device.
+"""
+
+import argparse
+import base64
+import os
+import select
+import socket
+import struct
+import sys
+import time
+
+PROBE_MAGIC = b"\x02WSPROBE"
+PROBE = struct.Struct("!8sQ")
+
+
+def ws_connect(host, port, path):
+    sock = socket.create_connection((host, port))
+    key = base64.b64encode(os.urandom(16)).decode()
+    request = (
+        "GET %s HTTP/1.1\r\n"
+        "Host: %s:%d\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: %s\r\n"
+        "Sec-WebSocket-Version: 13\r\n\r\n" % (path, host, port, key)
+    )
+    sock.sendall(request.encode())
+    response = b""
+    while b"\r\n\r\n" not in response:
+        chunk = sock.recv(1024)
+        if not chunk:
+            raise ConnectionError("connection closed during handshake")
+        response += chunk
+    header, rest = response.split(b"\r\n\r\n", 1)
+    if b" 101 " not in header.split(b"\r\n", 1)[0]:
+        raise ConnectionError(header.decode(errors="replace"))
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    return sock, rest
+
+
+def ws_send(sock, opcode, payload):
+    """Client frames must be masked."""
+    mask = os.urandom(4)
+    length = len(payload)
+    if length < 126:
+        header = struct.pack("!BB", 0x80 | opcode, 0x80 | length)
+    else:
+        header = struct.pack("!BBH", 0x80 | opcode, 0x80 | 126, length)
+    masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+    sock.sendall(header + mask + masked)
+
+
+class FrameReader:
+    def __init__(self, initial=b""):
+        self.buf = bytearray(initial)
+
+    def feed(self, data):
+        self.buf += data
+
+    def frames(self):
+        while len(self.buf) >= 2:
+            opcode = self.buf[0] & 0x0F
+            length = self.buf[1] & 0x7F
+            pos = 2
+            if length == 126:
+                if len(self.buf) < 4:
+                    return
+                length = struct.unpack_from("!H", self.buf, 2)[0]
+                pos = 4
+            elif length == 127:
+                if len(self.buf) < 10:
+                    return
+                length = struct.unpack_from("!Q", self.buf, 2)[0]
+                pos = 10
+            if len(self.buf) < pos + length:
+                return
+            payload = bytes(self.buf[pos : pos + length])
+            del self.buf[: pos + length]
+            yield opcode, payload
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--path", default="/ws")
+    parser.add_argument("--interval", type=float, default=5.0, help="report interval in seconds")
+    parser.add_argument("--probe-rate", type=float, default=0, help="latency probes per second (needs UART loopback)")
+    parser.add_argument("--output", help="write received data to this file ('-' for stdout)")
+    args = parser.parse_args()
+
+    sock, rest = ws_connect(args.host, args.port, args.path)
+    reader = FrameReader(rest)
+    out = sys.stdout.buffer if args.output == "-" else open(args.output, "wb") if args.output else None
+
+    frames = 0
+    nbytes = 0
+    rtts = []
+    pending = bytearray()
+    start = time.monotonic()
+    next_report = start + args.interval
+    next_probe = start
+    try:
+        while True:
+            now = time.monotonic()
+            if args.probe_rate and now >= next_probe:
+                ws_send(sock, 0x2, PROBE.pack(PROBE_MAGIC, time.monotonic_ns()))
+                next_probe = now + 1.0 / args.probe_rate
+
+            timeout = min(next_report, next_probe if args.probe_rate else next_report) - now
+            readable, _, _ = select.select([sock], [], [], max(timeout, 0))
+            if readable:
+                data = sock.recv(65536)
+                if not data:
+                    print("connection closed", file=sys.stderr)
+                    break
+                reader.feed(data)
+                for opcode, payload in reader.frames():
+                    if opcode == 0x8:
+                        print("close frame received", file=sys.stderr)
+                        return
+                    if opcode == 0x9:
+                        ws_send(sock, 0xA, payload)
+                        continue
+                    frames += 1
+                    nbytes += len(payload)
+                    if out:
+                        out.write(payload)
+                    if args.probe_rate:
+                        # a probe may be split across frames, search the concatenated stream
+                        pending += payload
+                        while True:
+                            idx = pending.find(PROBE_MAGIC)
+                            if idx < 0 or len(pending) < idx + PROBE.size:
+                                del pending[: max(0, len(pending) - PROBE.size)]
+                                break
+                            _, sent = PROBE.unpack_from(pending, idx)
+                            rtts.append((time.monotonic_ns() - sent) / 1000)
+                            del pending[: idx + PROBE.size]
+
+            now = time.monotonic()
+            if now >= next_report:
+                elapsed = now - start
+                line = "frames %.1f/s bytes %.0f/s avg frame %.0f bytes" % (
+                    frames / elapsed,
+                    nbytes / elapsed,
+                    nbytes / frames if frames else 0,
+                )
+                if rtts:
+                    rtts.sort()
+                    line += ", rtt min %.0fus avg %.0fus p99 %.0fus max %.0fus" % (
+                        rtts[0],
+                        sum(rtts) / len(rtts),
+                        rtts[int(len(rtts) * 0.99)],
+                        rtts[-1],
+                    )
+                print(line, file=sys.stderr, flush=True)
+                frames = nbytes = 0
+                rtts = []
+                start = now
+                next_report = now + args.interval
+    except KeyboardInterrupt:
+        pass
+    finally:
+        try:
+            ws_send(sock, 0x8, struct.pack("!H", 1000))
+        except OSError:
+            pass
+        sock.close()
+        if out and out is not sys.stdout.buffer:
+            out.close()
+
+
+if __name__ == "__main__":
+    main()